@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+// Minimal canvas line chart for the dashboard, everything the page needs from a chart library:
+// one series over time, nice y ticks, local time on the x axis and a redraw at most once per animation frame.
+"use strict";
+
+class LineChart {
+    // options: title, unit, decimals of the current value, color, window [ms] of data that is kept and shown
+    constructor(canvas, options) {
+        this.canvas = canvas;
+        this.title = options.title;
+        this.unit = options.unit;
+        this.decimals = options.decimals || 0;
+        this.color = options.color || "#059e8a";
+        this.window = options.window || 10 * 60 * 1000;
+        this.points = []; // [time [ms], value], ascending time
+        this.pending = false;
+
+        // hidden tabs have no size, they are drawn once they are shown
+        new ResizeObserver(() => this.update()).observe(canvas);
+    }
+
+    // time [ms] as in Date.getTime(), points may come out of order (e.g. the history arrives after the first live values)
+    add(time, value) {
+        if (!Number.isFinite(value)) {
+            return;
+        }
+
+        let index = this.points.length;
+        while (index > 0 && this.points[index - 1][0] > time) {
+            index--;
+        }
+        this.points.splice(index, 0, [time, value]);
+
+        const newest = this.points[this.points.length - 1][0];
+        let first = 0;
+        while (this.points[first][0] < newest - this.window) {
+            first++;
+        }
+        if (first > 0) {
+            this.points.splice(0, first);
+        }
+        this.update();
+    }
+
+    // Any number of updates between two frames result in one draw
+    update() {
+        if (this.pending) {
+            return;
+        }
+        this.pending = true;
+        requestAnimationFrame(() => {
+            this.pending = false;
+            this.draw();
+        });
+    }
+
+    draw() {
+        const ratio = window.devicePixelRatio || 1;
+        const width = this.canvas.clientWidth;
+        const height = this.canvas.clientHeight;
+        if (width == 0 || height == 0) {
+            return;
+        }
+        this.canvas.width = Math.round(width * ratio);
+        this.canvas.height = Math.round(height * ratio);
+
+        const ctx = this.canvas.getContext("2d");
+        ctx.setTransform(ratio, 0, 0, ratio, 0, 0);
+        ctx.clearRect(0, 0, width, height);
+        ctx.font = "12px sans-serif";
+        ctx.textBaseline = "middle";
+
+        const last = this.points.length > 0 ? this.points[this.points.length - 1][1] : null;
+        ctx.fillStyle = "#333";
+        ctx.textAlign = "left";
+        ctx.fillText(this.title + " [" + this.unit + "]", 0, 10);
+        if (last !== null) {
+            ctx.textAlign = "right";
+            ctx.fillText(last.toFixed(this.decimals), width, 10);
+        }
+        if (this.points.length == 0) {
+            return;
+        }
+
+        // plot area
+        const left = 56, top = 24, right = width - 8, bottom = height - 20;
+
+        let min = Infinity, max = -Infinity;
+        for (const point of this.points) {
+            min = Math.min(min, point[1]);
+            max = Math.max(max, point[1]);
+        }
+        if (min == max) {
+            min -= 1;
+            max += 1;
+        }
+        const step = niceStep((max - min) / 4);
+        const decimals = Math.max(0, -Math.floor(Math.log10(step)));
+        min = Math.floor(min / step) * step;
+        max = Math.ceil(max / step) * step;
+
+        const tEnd = this.points[this.points.length - 1][0];
+        const tBegin = Math.min(this.points[0][0], tEnd - 1000);
+        const x = (t) => left + (t - tBegin) / (tEnd - tBegin) * (right - left);
+        const y = (v) => bottom - (v - min) / (max - min) * (bottom - top);
+
+        // grid and labels
+        ctx.strokeStyle = "#ddd";
+        ctx.lineWidth = 1;
+        ctx.fillStyle = "#666";
+        ctx.textAlign = "right";
+        ctx.beginPath();
+        for (let v = min; v <= max + step / 2; v += step) {
+            const yv = Math.round(y(v)) + 0.5;
+            ctx.moveTo(left, yv);
+            ctx.lineTo(right, yv);
+            ctx.fillText(v.toFixed(decimals), left - 6, yv);
+        }
+        ctx.stroke();
+
+        for (let i = 0; i <= 3; i++) {
+            const t = tBegin + (tEnd - tBegin) * i / 3;
+            ctx.textAlign = (i == 0) ? "left" : (i == 3) ? "right" : "center";
+            ctx.fillText(new Date(t).toLocaleTimeString(), x(t), height - 8);
+        }
+
+        // series
+        ctx.strokeStyle = this.color;
+        ctx.lineWidth = 2;
+        ctx.lineJoin = "round";
+        ctx.beginPath();
+        for (const [t, v] of this.points) {
+            ctx.lineTo(x(t), y(v));
+        }
+        ctx.stroke();
+    }
+}
+
+// 1, 2 or 5 times a power of ten, at least raw
+function niceStep(raw) {
+    const scale = Math.pow(10, Math.floor(Math.log10(raw)));
+    const fraction = raw / scale;
+    return ((fraction <= 1) ? 1 : (fraction <= 2) ? 2 : (fraction <= 5) ? 5 : 10) * scale;
+}
@@ -0,0 +1,358 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// No Arduino includes on purpose, this header is shared with the host tools (see tools/archive_export)
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/// On-flash format of the sensor archive
+///
+/// A segment file starts with a SegmentHeader and is then filled with records.
+/// Records never straddle a BLOCK_SIZE boundary, the remainder of a block is padded with 0x00.
+/// The first record of every block is absolute, so every block decodes on its own:
+///   - the first record per block is the sparse time index of a segment, a seek is a binary search over blocks
+///   - a torn write only loses the records behind it up to the next block boundary
+///
+/// Record: [u8 length][length bytes payload][u16 CRC-16/CCITT over length and payload]
+/// Payload: [u8 flags][timestamp][u8 valid][zigzag varint per valid channel]
+///   absolute: timestamp is u32 LE [unix seconds], values are absolute
+///   delta:    timestamp is a varint [s] since the previous record, values are deltas to the previous record
+namespace ArchiveFormat
+{
+constexpr std::array<char, 4> MAGIC{'h', 'S', 'A', 'R'};
+constexpr uint8_t             VERSION{1};
+constexpr size_t              BLOCK_SIZE{4096}; // flash sector size, LittleFS writes whole blocks anyway
+constexpr size_t              CHANNEL_COUNT{7};
+constexpr size_t              MAX_RECORD_SIZE{1 + 1 + 4 + 1 + CHANNEL_COUNT * 5 + 2};
+
+constexpr uint8_t FLAG_ABSOLUTE{0x01};
+constexpr uint8_t PADDING{0x00};
+constexpr uint8_t ERASED{0xFF};
+
+/// Channel order and scaling, matches SensorHistory::CHANNELS
+struct Channel
+{
+    const char* name;
+    uint8_t     decimals; // value = encoded / 10^decimals
+};
+constexpr std::array<Channel, CHANNEL_COUNT> CHANNELS{{
+    {"TVOC", 0},
+    {"eCO2", 0},
+    {"rawH2", 0},
+    {"rawEthanol", 0},
+    {"temperature", 2},
+    {"humidity", 2},
+    {"pressure", 1},
+}};
+
+struct SegmentHeader
+{
+    std::array<char, 4> magic{MAGIC};
+    uint8_t             version{VERSION};
+    uint8_t             channelCount{CHANNEL_COUNT};
+    uint16_t            blockSizeKiB{BLOCK_SIZE / 1024};
+    uint32_t            segmentId{};
+    uint32_t            created{}; // [unix seconds]
+
+    static constexpr size_t SIZE{16};
+
+    void toBytes(uint8_t* out) const
+    {
+        memcpy(out, magic.data(), 4);
+        out[4] = version;
+        out[5] = channelCount;
+        putU16(out + 6, blockSizeKiB);
+        putU32(out + 8, segmentId);
+        putU32(out + 12, created);
+    }
+
+    bool fromBytes(const uint8_t* in)
+    {
+        memcpy(magic.data(), in, 4);
+        version      = in[4];
+        channelCount = in[5];
+        blockSizeKiB = getU16(in + 6);
+        segmentId    = getU32(in + 8);
+        created      = getU32(in + 12);
+        return magic == MAGIC && version == VERSION && channelCount == CHANNEL_COUNT && blockSizeKiB == BLOCK_SIZE / 1024;
+    }
+
+    static void putU16(uint8_t* out, uint16_t val)
+    {
+        out[0] = static_cast<uint8_t>(val);
+        out[1] = static_cast<uint8_t>(val >> 8);
+    }
+
+    static void putU32(uint8_t* out, uint32_t val)
+    {
+        putU16(out, static_cast<uint16_t>(val));
+        putU16(out + 2, static_cast<uint16_t>(val >> 16));
+    }
+
+    static uint16_t getU16(const uint8_t* in)
+    {
+        return static_cast<uint16_t>(in[0] | (in[1] << 8));
+    }
+
+    static uint32_t getU32(const uint8_t* in)
+    {
+        return getU16(in) | (static_cast<uint32_t>(getU16(in + 2)) << 16);
+    }
+};
+
+struct Record
+{
+    uint32_t                           timestamp{}; // [unix seconds]
+    uint8_t                            valid{};     // bit per channel
+    std::array<int32_t, CHANNEL_COUNT> values{};
+};
+
+/// CRC-16/CCITT-FALSE, bitwise is plenty for a few records per minute
+inline uint16_t crc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        crc ^= static_cast<uint16_t>(data[i] << 8);
+        for (uint8_t bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+////////////////////////////////
+/// Encoding
+////////////////////////////////
+
+/// Stateful, keeps the previous record for the delta encoding
+class Encoder
+{
+public:
+    /// Next record will be absolute, call at every block boundary
+    void reset()
+    {
+        m_hasPrevious = false;
+    }
+
+    /// @return bytes written to out (at most MAX_RECORD_SIZE)
+    size_t encode(const Record& record, uint8_t* out)
+    {
+        const bool absolute{!m_hasPrevious || record.timestamp < m_previous.timestamp};
+        if (absolute)
+        {
+            m_previous = {}; // the decoder starts from zero as well
+        }
+
+        size_t pos{1}; // length comes last
+        out[pos++] = absolute ? FLAG_ABSOLUTE : 0;
+        if (absolute)
+        {
+            SegmentHeader::putU32(out + pos, record.timestamp);
+            pos += 4;
+        }
+        else
+        {
+            pos += putVarint(out + pos, record.timestamp - m_previous.timestamp);
+        }
+
+        out[pos++] = record.valid;
+        for (size_t channel = 0; channel < CHANNEL_COUNT; ++channel)
+        {
+            if (record.valid & (1U << channel))
+            {
+                // wrapping arithmetic, so any int32 round trips
+                const auto base{static_cast<uint32_t>(m_previous.values[channel])};
+                pos += putVarint(out + pos, zigzag(static_cast<int32_t>(static_cast<uint32_t>(record.values[channel]) - base)));
+                m_previous.values[channel] = record.values[channel];
+            }
+        }
+
+        out[0] = static_cast<uint8_t>(pos - 1);
+        SegmentHeader::putU16(out + pos, crc16(out, pos));
+        pos += 2;
+
+        m_previous.timestamp = record.timestamp;
+        m_hasPrevious        = true;
+        return pos;
+    }
+
+private:
+    Record m_previous{};
+    bool   m_hasPrevious{false};
+
+    static uint32_t zigzag(int32_t val)
+    {
+        return (static_cast<uint32_t>(val) << 1) ^ static_cast<uint32_t>(val >> 31);
+    }
+
+    static size_t putVarint(uint8_t* out, uint32_t val)
+    {
+        size_t n{};
+        while (val >= 0x80)
+        {
+            out[n++] = static_cast<uint8_t>(val | 0x80);
+            val >>= 7;
+        }
+        out[n++] = static_cast<uint8_t>(val);
+        return n;
+    }
+};
+
+////////////////////////////////
+/// Decoding
+////////////////////////////////
+
+/// Decodes the records of one block, stops at padding, erased flash or the first broken record
+class BlockDecoder
+{
+public:
+    BlockDecoder(const uint8_t* block, size_t length)
+        : m_block(block), m_length(length)
+    {
+    }
+
+    /// @return false at the end of the valid data of this block
+    bool next(Record& record)
+    {
+        if (m_pos >= m_length || m_block[m_pos] == PADDING || m_block[m_pos] == ERASED)
+        {
+            return false;
+        }
+
+        const size_t payloadLength{m_block[m_pos]};
+        const size_t frameLength{1 + payloadLength + 2};
+        if (m_pos + frameLength > m_length ||
+            crc16(m_block + m_pos, 1 + payloadLength) != SegmentHeader::getU16(m_block + m_pos + 1 + payloadLength))
+        {
+            m_corrupt = true;
+            return false;
+        }
+
+        const uint8_t* payload{m_block + m_pos + 1};
+        const uint8_t* end{payload + payloadLength};
+        if (!decode(payload, end))
+        {
+            m_corrupt = true;
+            return false;
+        }
+
+        m_pos += frameLength;
+        record = m_current;
+        return true;
+    }
+
+    /// true if decoding stopped at a broken record (as opposed to padding or the end)
+    bool isCorrupt() const
+    {
+        return m_corrupt;
+    }
+
+    /// Offset behind the last valid record
+    size_t position() const
+    {
+        return m_pos;
+    }
+
+private:
+    const uint8_t* m_block;
+    size_t         m_length;
+    size_t         m_pos{};
+    bool           m_corrupt{false};
+    bool           m_hasCurrent{false};
+    Record         m_current{};
+
+    bool decode(const uint8_t* in, const uint8_t* end)
+    {
+        if (end - in < 2)
+        {
+            return false;
+        }
+
+        const auto flags{*in++};
+        if (flags & FLAG_ABSOLUTE)
+        {
+            if (end - in < 4)
+            {
+                return false;
+            }
+            m_current           = {};
+            m_current.timestamp = SegmentHeader::getU32(in);
+            m_hasCurrent        = true;
+            in += 4;
+        }
+        else
+        {
+            uint32_t delta{};
+            if (!m_hasCurrent || !getVarint(in, end, delta))
+            {
+                return false;
+            }
+            m_current.timestamp += delta;
+        }
+
+        if (in == end)
+        {
+            return false;
+        }
+        m_current.valid = *in++;
+
+        for (size_t channel = 0; channel < CHANNEL_COUNT; ++channel)
+        {
+            if (m_current.valid & (1U << channel))
+            {
+                uint32_t encoded{};
+                if (!getVarint(in, end, encoded))
+                {
+                    return false;
+                }
+                const auto delta{(encoded >> 1) ^ (0U - (encoded & 1U))};
+                m_current.values[channel] = static_cast<int32_t>(static_cast<uint32_t>(m_current.values[channel]) + delta);
+            }
+        }
+        return in == end;
+    }
+
+    static bool getVarint(const uint8_t*& in, const uint8_t* end, uint32_t& val)
+    {
+        val = 0;
+        for (uint8_t shift = 0; shift < 35 && in != end; shift += 7)
+        {
+            const auto byte{*in++};
+            val |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+} // namespace ArchiveFormat
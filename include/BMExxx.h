@@ -0,0 +1,188 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// No Arduino includes on purpose, the driver and its compensation run on the host against a mocked I2CBus
+#include "I2CBus.h"
+#include <cstddef>
+#include <cstdint>
+
+/// Bosch BME280 / BME680 (temperature, humidity, pressure; the gas heater of the BME680 stays off)
+///
+/// Forced mode only: measure() triggers one conversion and returns Status::Pending, the caller comes back at
+/// readyAt() (see TaskItem::runExtraAt) and gets the compensated sample. Status and data registers are one burst read.
+/// The compensation is the integer one of the datasheets, no float on the way from the ADC to the sample.
+///
+/// https://www.bosch-sensortec.com/media/boschsensortec/downloads/datasheets/bst-bme280-ds002.pdf
+/// https://www.bosch-sensortec.com/media/boschsensortec/downloads/datasheets/bst-bme680-ds001.pdf
+class BMExxx
+{
+public:
+    static constexpr uint8_t ADDRESS_PRIMARY{0x76};   // SDO to GND
+    static constexpr uint8_t ADDRESS_SECONDARY{0x77}; // SDO to VDDIO
+
+    enum class Chip
+    {
+        None,
+        BME280,
+        BME680,
+    };
+
+    enum class Status
+    {
+        Pending, // triggered or still converting, call again at readyAt()
+        Done,    // the sample is there
+        Failed,  // no ACK or the conversion never finished
+    };
+
+    struct Settings
+    {
+        uint8_t temperatureOversampling{2}; // 1, 2, 4, 8 or 16
+        uint8_t pressureOversampling{4};    // 1, 2, 4, 8 or 16
+        uint8_t humidityOversampling{1};    // 1, 2, 4, 8 or 16
+        uint8_t filter{2};                  // IIR coefficient setting 0 (off) .. 4, BME280 => 2^n, BME680 => 2^n - 1
+    };
+
+    struct Sample
+    {
+        int32_t  temperature; // [0.01 °C]
+        uint32_t humidity;    // [0.001 %RH]
+        uint32_t pressure;    // [Pa]
+    };
+
+    /// Blocks, sleeps the given milliseconds (delay() on the target)
+    using Delay = void (*)(uint32_t);
+
+    explicit BMExxx(I2CBus& bus)
+        : m_bus(bus)
+    {
+    }
+
+    /// Blocking (~5 ms) for the setup: soft reset, finds the chip on either address, reads its calibration
+    bool begin(const Settings& settings, Delay delay);
+
+    Status measure(int32_t now, Sample& sample);
+
+    /// [ms] when the conversion in flight is done
+    int32_t readyAt() const
+    {
+        return m_readyAt;
+    }
+
+    Chip getChip() const
+    {
+        return m_chip;
+    }
+
+    const char* getChipName() const;
+
+    /// [us] max. duration of one forced conversion, datasheet BME280 9.1 / BME68x API
+    static uint32_t measurementTime(Chip chip, const Settings& settings);
+
+    /// 1, 2, 4, 8 or 16
+    static bool isValidOversampling(int32_t factor);
+
+    ////////////////////////////////
+    /// Compensation, public so it can be checked against the datasheet vectors without a sensor
+    ////////////////////////////////
+
+    struct Calibration280
+    {
+        uint16_t T1;
+        int16_t  T2;
+        int16_t  T3;
+        uint16_t P1;
+        int16_t  P2;
+        int16_t  P3;
+        int16_t  P4;
+        int16_t  P5;
+        int16_t  P6;
+        int16_t  P7;
+        int16_t  P8;
+        int16_t  P9;
+        uint8_t  H1;
+        int16_t  H2;
+        uint8_t  H3;
+        int16_t  H4;
+        int16_t  H5;
+        int8_t   H6;
+    };
+
+    struct Calibration680
+    {
+        uint16_t T1;
+        int16_t  T2;
+        int8_t   T3;
+        uint16_t P1;
+        int16_t  P2;
+        int8_t   P3;
+        int16_t  P4;
+        int16_t  P5;
+        int8_t   P6;
+        int8_t   P7;
+        int16_t  P8;
+        int16_t  P9;
+        uint8_t  P10;
+        uint16_t H1;
+        uint16_t H2;
+        int8_t   H3;
+        int8_t   H4;
+        int8_t   H5;
+        uint8_t  H6;
+        int8_t   H7;
+    };
+
+    /// @return [0.01 °C], @param tFine fine resolution temperature for the pressure and humidity
+    static int32_t compensateTemperature(const Calibration280& cal, int32_t adc, int32_t& tFine);
+    /// @return [Pa] Q24.8
+    static uint32_t compensatePressure(const Calibration280& cal, int32_t adc, int32_t tFine);
+    /// @return [%RH] Q22.10
+    static uint32_t compensateHumidity(const Calibration280& cal, int32_t adc, int32_t tFine);
+
+    /// @return [0.01 °C], @param tFine fine resolution temperature for the pressure and humidity
+    static int32_t compensateTemperature(const Calibration680& cal, int32_t adc, int32_t& tFine);
+    /// @return [Pa]
+    static uint32_t compensatePressure(const Calibration680& cal, int32_t adc, int32_t tFine);
+    /// @return [0.001 %RH]
+    static uint32_t compensateHumidity(const Calibration680& cal, int32_t adc, int32_t tFine);
+
+private:
+    I2CBus&        m_bus;
+    uint8_t        m_address{};
+    Chip           m_chip{Chip::None};
+    uint8_t        m_ctrlMeas{}; // oversampling of temperature and pressure, without the mode
+    uint32_t       m_duration{}; // [ms] of one conversion, rounded up
+    bool           m_inFlight{false};
+    int32_t        m_readyAt{};
+    int32_t        m_failAt{}; // [ms] gives up on a conversion that is not done by then
+    Calibration280 m_cal280{};
+    Calibration680 m_cal680{};
+
+    bool readCalibration();
+    bool writeRegister(uint8_t reg, uint8_t value);
+    bool readRegisters(uint8_t reg, uint8_t* data, size_t length);
+};
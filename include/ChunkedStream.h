@@ -0,0 +1,116 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "JSONWriter.h"
+#include "LogCapture.h"
+#include "Utilities.h"
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <algorithm>
+#include <array>
+#include <memory>
+
+/// Base for HTTP bodies that are rendered piece by piece while AsyncWebServer asks for the next TCP chunk
+/// A subclass renders one small piece (a header, a row, ...) per renderNext() call, this class cuts the pieces into chunks.
+/// The RAM used per response is the pending buffer plus whatever the subclass keeps, independent of the size of the body.
+///
+/// Each stream logs its throughput and the lowest free heap seen while it was running, once the response is done.
+class ChunkedStream
+{
+public:
+    static constexpr size_t PENDING_CAPACITY{384};
+
+    explicit ChunkedStream(const String& name)
+        : m_name(name), m_begin(millis()), m_minFreeHeap(ESP.getFreeHeap())
+    {
+    }
+
+    virtual ~ChunkedStream()
+    {
+        const auto duration{std::max<Timestamp>(static_cast<Timestamp>(millis()) - m_begin, 1)};
+        PLOGI << "Stream " << m_name.c_str() << ": " << m_bytes << " bytes in " << duration << " ms ("
+              << static_cast<uint32_t>(static_cast<uint64_t>(m_bytes) * 1000 / 1024 / duration) << " KiB/s), min free heap " << m_minFreeHeap;
+    }
+
+    ChunkedStream(const ChunkedStream&) = delete;
+    ChunkedStream& operator=(const ChunkedStream&) = delete;
+
+    /// Sends the stream as chunked response, the response keeps the stream alive until it is done
+    static void send(AsyncWebServerRequest* request, const char* contentType, const std::shared_ptr<ChunkedStream>& stream)
+    {
+        request->send(request->beginChunkedResponse(contentType,
+                                                    [stream](uint8_t* buffer, size_t maxLen, size_t /*index*/) -> size_t
+                                                    {
+                                                        return stream->fill(buffer, maxLen);
+                                                    }));
+    }
+
+    /// AwsResponseFiller, returns 0 when done
+    size_t fill(uint8_t* buffer, size_t maxLen)
+    {
+        size_t written{};
+        while (written < maxLen)
+        {
+            if (m_pendingPos == m_pendingLen)
+            {
+                JSONWriter writer{m_pending};
+                if (!renderNext(writer))
+                {
+                    break;
+                }
+                m_pendingLen = writer.length();
+                m_pendingPos = 0;
+                continue;
+            }
+
+            const auto len{std::min(maxLen - written, m_pendingLen - m_pendingPos)};
+            memcpy(buffer + written, m_pending.data() + m_pendingPos, len);
+            m_pendingPos += len;
+            written += len;
+        }
+
+        m_bytes += written;
+        m_minFreeHeap = std::min(m_minFreeHeap, ESP.getFreeHeap());
+        return written;
+    }
+
+protected:
+    /// Renders the next piece into writer, at most PENDING_CAPACITY - 1 bytes (an empty piece is fine)
+    /// @return false when there is nothing left to render
+    virtual bool renderNext(JSONWriter& writer) = 0;
+
+private:
+    String    m_name;
+    Timestamp m_begin;
+    size_t    m_bytes{};
+    uint32_t  m_minFreeHeap;
+
+    std::array<char, PENDING_CAPACITY> m_pending{};
+    size_t                             m_pendingLen{};
+    size_t                             m_pendingPos{};
+};
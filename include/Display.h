@@ -26,24 +26,43 @@
 
 #pragma once
 
+#include "MPMCQueue.h"
+#include "Metrics.h"
+#include "SensorData.h"
+#include "Utilities.h"
 #include <TFT_eSPI.h>
-#include <mutex>
-
-// Forward declare SensorData type
-struct SensorData;
+#include <array>
 
+/// The display is drawn by one render task only, see render()
+/// Everybody else posts to lock-free mailboxes (the latest sensor data and the newest log lines), so no producer ever waits for SPI.
+/// Whatever was posted between two frames ends up in one frame, i.e. a burst of log lines costs one redraw of the log area.
 class Display
 {
 public:
-    Display(TFT_eSPI& tft)
-        : tft(tft)
+    static constexpr size_t LOG_LINES{4};           // newest log lines on screen, the newest one on top
+    static constexpr size_t LOG_LINE_CAPACITY{224}; // the log area holds 10 lines of 22 characters, longer lines are cut
+
+    Display(TFT_eSPI& tft, Metrics& metrics)
+        : tft(tft), metrics(metrics)
     {
+        m_logMailbox.setPolicy(LogMailbox::Policy::DropOldest);
     }
 
-    void printDebugMessage(const String& text);
-    void printErrorMessage(const String& text);
+    /// Call after tft.begin() and before the render task starts, allocates the value sprites and enables DMA
+    /// Without them (e.g. out of memory) changed values are printed directly, which waits for SPI.
+    void init();
+
+    /// Queue a line for the log area, never blocks
+    void printDebugMessage(const char* text);
+    void printErrorMessage(const char* text);
+
+    /// Hand over the latest sensor data, never blocks
     void printSensorData(const SensorData& sensorData);
 
+    /// Compose one frame from what was posted since the last one, must only be called from the render task
+    /// Only the parts that changed are redrawn. The values are pushed via DMA, the last push may still run when this returns.
+    void render();
+
     inline void setDefaultColor()
     {
         tft.setTextColor(TFT_WHITE, TFT_BLACK);
@@ -55,19 +74,51 @@ public:
     }
 
 private:
-    TFT_eSPI&  tft;
-    std::mutex m_mtx;
+    using LogLine    = std::array<char, LOG_LINE_CAPACITY>;
+    using LogMailbox = MPMCQueue<LogLine, 8>;
 
-    /// Employ some caching
-    enum class DisplayTextConfig
+    /// A value on the sensor screen and what was drawn there last
+    struct Field
     {
-        POST, // right after startup
-        SensorData,
-        DebugText,
-    } currentDTC{DisplayTextConfig::POST};
+        int     y;
+        int32_t drawn{};
+        bool    isDrawn{false};
+    };
+
+    TFT_eSPI& tft;
+    Metrics&  metrics;
+
+    ////////////////////////////////
+    /// Mailboxes
+    ////////////////////////////////
+
+    SeqLock<SensorData> m_sensorMailbox{};
+    LogMailbox          m_logMailbox{};
+
+    ////////////////////////////////
+    /// Render task only
+    ////////////////////////////////
+
+    uint32_t                      m_renderedSequence{m_sensorMailbox.sequence()};
+    std::array<LogLine, LOG_LINES> m_logLines{}; // ring, m_logHead is the newest line
+    size_t                        m_logHead{};
+    size_t                        m_logCount{};
+
+    std::array<Field, 4>       m_fields{{{32}, {64}, {96}, {128}}}; // TVOC, eCO2, H2, ethanol
+    bool                       m_layoutDrawn{false};
+    std::array<TFT_eSprite, 2> m_sprites{{TFT_eSprite{&tft}, TFT_eSprite{&tft}}}; // one is drawn while the other one is pushed
+    size_t                     m_nextSprite{};
+    bool                       m_spritesReady{false};
+    bool                       m_dmaPending{false}; // the last push may still run, the SPI transaction is still open
 
     void setCursor(int x, int y);
     void setLineColumn(int line, int column);
     void drawLine(const char* text, double value, int line);
     void drawLine(const char* text, int line);
+
+    void   finishDMA();
+    size_t drawLog();
+    size_t drawSensorData(const SensorData& sensorData);
+    size_t drawLayout();
+    size_t drawValue(int y, int32_t value);
 };
@@ -0,0 +1,86 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// No Arduino includes on purpose, checked on the host against the float formulas
+#include <cstdint>
+
+/// Fixed point environmental math, no float and no exp() on the target
+///
+/// Inputs are the units of the BMExxx samples: temperature [0.01 °C], relative humidity [0.001 %RH].
+/// The saturation vapor pressure comes from a 1 °C table of the Magnus formula (Sensirion SGP30 Driver Integration 3.15:
+/// 6.112 hPa, 17.62, 243.12 °C) built at compile time, in between it is interpolated linearly.
+/// Valid from -40 °C to 85 °C (the BMExxx range), temperatures outside are clamped.
+///
+/// Error bounds against the float formulas, test_envmath checks them over the whole range:
+///   saturationVaporPressure  < 0.13 % (at -40 °C), < 0.05 % above 20 °C
+///   absoluteHumidity         same relative error, plus 0.5 mg/m^3 rounding
+///   dewPoint                 < 0.02 °C
+///   heatIndex                < 0.07 °C up to a heat index of 70 °C, apart from the step where NOAA switches formulas
+namespace EnvMath
+{
+constexpr int32_t TEMPERATURE_MIN{-4000}; // [0.01 °C]
+constexpr int32_t TEMPERATURE_MAX{8500};  // [0.01 °C]
+
+/// @param temperature [0.01 °C]
+/// @return [Pa] Q16.16
+uint32_t saturationVaporPressure(int32_t temperature);
+
+/// @param temperature [0.01 °C]
+/// @param humidity [0.001 %RH]
+/// @return [mg/m^3]
+uint32_t absoluteHumidity(int32_t temperature, uint32_t humidity);
+
+/// Temperature at which the air would be saturated, the inverse of the table instead of a logarithm
+/// @return [0.01 °C], TEMPERATURE_MIN for dry air
+int32_t dewPoint(int32_t temperature, uint32_t humidity);
+
+/// NOAA heat index (Rothfusz regression with its adjustments, Steadman below 80 °F)
+/// https://www.wpc.ncep.noaa.gov/html/heatindex_equation.shtml
+/// @return [0.01 °C]
+int32_t heatIndex(int32_t temperature, uint32_t humidity);
+
+/// Absolute humidity as the SGP30 takes it (set_absolute_humidity), [g/m^3] 8.8 fixed point, rounded
+/// @return false if out of range (256 g/m^3 and above)
+bool toSensirionHumidity(uint32_t absoluteHumidity, uint16_t& word);
+
+/// Indoor air quality after the UBA TVOC levels and the usual CO2 bands, the worse of both counts
+enum class AirQuality : uint8_t
+{
+    Unknown,   // no valid SGP30 data
+    Excellent, // TVOC <= 65 ppb,   eCO2 <= 600 ppm
+    Good,      // TVOC <= 220 ppb,  eCO2 <= 800 ppm
+    Moderate,  // TVOC <= 660 ppb,  eCO2 <= 1000 ppm
+    Poor,      // TVOC <= 2200 ppb, eCO2 <= 1500 ppm
+    Unhealthy,
+};
+
+/// @param eCO2 [ppm], @param TVOC [ppb]
+AirQuality airQuality(uint16_t eCO2, uint16_t TVOC);
+
+const char* toString(AirQuality airQuality);
+} // namespace EnvMath
@@ -0,0 +1,303 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// No Arduino includes on purpose, so the output can be checked against zlib on the host
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/// Minimal gzip (RFC 1952) writer for HTTP request bodies
+///
+/// One deflate block with the fixed Huffman codes and greedy LZ77 matching over a hash chain.
+/// That is a long way from zlib's ratio on arbitrary data, but line protocol and JSON repeat the same keys in every line,
+/// which is most of what there is to gain. In exchange the state is ~10 KiB and there are no dynamic trees to build.
+namespace Gzip
+{
+constexpr size_t HEADER_SIZE{10};
+constexpr size_t TRAILER_SIZE{8};
+constexpr size_t MAX_INPUT_SIZE{65534}; // positions are stored as uint16 + 1
+
+/// Output never exceeds this, even if nothing matches (every byte a 9 bit literal, plus block header and end of block)
+constexpr size_t maxCompressedSize(size_t length)
+{
+    return HEADER_SIZE + (3 + length * 9 + 7 + 7) / 8 + TRAILER_SIZE;
+}
+
+/// CRC-32 as in gzip and zip, bitwise is plenty for one request body every few minutes
+inline uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc & 1U) ? (crc >> 1) ^ 0xEDB88320U : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+/// Uncompressed size as stored in the trailer of a complete gzip member (modulo 2^32)
+inline uint32_t uncompressedSize(const uint8_t* gzip, size_t length)
+{
+    if (length < HEADER_SIZE + TRAILER_SIZE)
+    {
+        return 0;
+    }
+    const uint8_t* isize{gzip + length - 4};
+    return isize[0] | (isize[1] << 8) | (isize[2] << 16) | (static_cast<uint32_t>(isize[3]) << 24);
+}
+
+class Compressor
+{
+public:
+    static constexpr size_t WINDOW_SIZE{4096}; // matches reach at most this far back
+    static constexpr size_t MIN_MATCH{3};
+    static constexpr size_t MAX_MATCH{258};
+    static constexpr size_t MAX_CHAIN{32};           // candidates tried per position
+    static constexpr size_t MAX_SHORT_DISTANCE{256}; // a 3 byte match further back costs more bits than its literals
+
+    /// @return bytes written to out, 0 if the input is too large or out is smaller than maxCompressedSize(length)
+    size_t compress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity)
+    {
+        if (length > MAX_INPUT_SIZE || capacity < maxCompressedSize(length))
+        {
+            return 0;
+        }
+
+        m_head.fill(0);
+        m_out      = out;
+        m_pos      = 0;
+        m_bits     = 0;
+        m_bitCount = 0;
+
+        // ID1 ID2 CM=deflate FLG MTIME(4) XFL OS=unknown
+        for (const uint8_t byte : {0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF})
+        {
+            m_out[m_pos++] = byte;
+        }
+
+        putBits(1, 1); // BFINAL
+        putBits(1, 2); // BTYPE fixed Huffman
+
+        size_t pos{0};
+        while (pos < length)
+        {
+            size_t distance{};
+            const auto matched{findMatch(in, length, pos, distance)};
+            if (matched > MIN_MATCH || (matched == MIN_MATCH && distance <= MAX_SHORT_DISTANCE))
+            {
+                putLength(matched);
+                putDistance(distance);
+                for (size_t i = 0; i < matched; ++i)
+                {
+                    insert(in, length, pos++);
+                }
+            }
+            else
+            {
+                putLiteral(in[pos]);
+                insert(in, length, pos++);
+            }
+        }
+        putLiteral(256); // end of block
+        flushBits();
+
+        putU32(crc32(in, length));
+        putU32(static_cast<uint32_t>(length));
+        return m_pos;
+    }
+
+private:
+    static constexpr size_t HASH_BITS{10};
+
+    std::array<uint16_t, 1U << HASH_BITS> m_head{}; // latest position + 1 per hash, 0 => none
+    std::array<uint16_t, WINDOW_SIZE>     m_prev{}; // previous position + 1 with the same hash, indexed by position % WINDOW_SIZE
+
+    uint8_t* m_out{};
+    size_t   m_pos{};
+    uint32_t m_bits{};
+    uint8_t  m_bitCount{};
+
+    static size_t hash(const uint8_t* in)
+    {
+        return ((in[0] << 6) ^ (in[1] << 3) ^ in[2]) & ((1U << HASH_BITS) - 1);
+    }
+
+    void insert(const uint8_t* in, size_t length, size_t pos)
+    {
+        if (pos + MIN_MATCH > length)
+        {
+            return;
+        }
+        auto& head{m_head[hash(in + pos)]};
+        m_prev[pos % WINDOW_SIZE] = head;
+        head                      = static_cast<uint16_t>(pos + 1);
+    }
+
+    /// Longest match within the window that starts before pos
+    size_t findMatch(const uint8_t* in, size_t length, size_t pos, size_t& distance) const
+    {
+        if (pos + MIN_MATCH > length)
+        {
+            return 0;
+        }
+
+        const size_t maxLength{length - pos < MAX_MATCH ? length - pos : MAX_MATCH};
+        size_t       best{0};
+        size_t       candidate{m_head[hash(in + pos)]};
+        for (size_t chain = 0; chain < MAX_CHAIN && candidate != 0; ++chain)
+        {
+            const size_t start{candidate - 1};
+            if (pos - start > WINDOW_SIZE)
+            {
+                break;
+            }
+
+            size_t matched{0};
+            while (matched < maxLength && in[start + matched] == in[pos + matched])
+            {
+                ++matched;
+            }
+            if (matched > best)
+            {
+                best     = matched;
+                distance = pos - start;
+                if (matched == maxLength)
+                {
+                    break;
+                }
+            }
+
+            // Entries older than the window may have been overwritten by newer positions, those are never smaller
+            const size_t next{m_prev[start % WINDOW_SIZE]};
+            if (next >= candidate)
+            {
+                break;
+            }
+            candidate = next;
+        }
+        return best;
+    }
+
+    ////////////////////////////////
+    /// Fixed Huffman codes, RFC 1951 3.2.6
+    ////////////////////////////////
+
+    void putLiteral(uint16_t symbol)
+    {
+        if (symbol < 144)
+        {
+            putCode(0x30 + symbol, 8);
+        }
+        else if (symbol < 256)
+        {
+            putCode(0x190 + symbol - 144, 9);
+        }
+        else if (symbol < 280)
+        {
+            putCode(symbol - 256, 7);
+        }
+        else
+        {
+            putCode(0xC0 + symbol - 280, 8);
+        }
+    }
+
+    void putLength(size_t length)
+    {
+        static constexpr std::array<uint16_t, 29> BASE{3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static constexpr std::array<uint8_t, 29>  EXTRA{0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+        size_t code{BASE.size() - 1};
+        while (BASE[code] > length)
+        {
+            --code;
+        }
+        putLiteral(static_cast<uint16_t>(257 + code));
+        putBits(static_cast<uint32_t>(length - BASE[code]), EXTRA[code]);
+    }
+
+    void putDistance(size_t distance)
+    {
+        static constexpr std::array<uint16_t, 30> BASE{1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static constexpr std::array<uint8_t, 30>  EXTRA{0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        size_t code{BASE.size() - 1};
+        while (BASE[code] > distance)
+        {
+            --code;
+        }
+        putCode(static_cast<uint32_t>(code), 5);
+        putBits(static_cast<uint32_t>(distance - BASE[code]), EXTRA[code]);
+    }
+
+    /// Huffman codes go out most significant bit first
+    void putCode(uint32_t code, uint8_t count)
+    {
+        uint32_t reversed{};
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            reversed = (reversed << 1) | ((code >> i) & 1U);
+        }
+        putBits(reversed, count);
+    }
+
+    /// Everything else least significant bit first
+    void putBits(uint32_t value, uint8_t count)
+    {
+        m_bits |= value << m_bitCount;
+        m_bitCount += count;
+        while (m_bitCount >= 8)
+        {
+            m_out[m_pos++] = static_cast<uint8_t>(m_bits);
+            m_bits >>= 8;
+            m_bitCount -= 8;
+        }
+    }
+
+    void flushBits()
+    {
+        if (m_bitCount > 0)
+        {
+            m_out[m_pos++] = static_cast<uint8_t>(m_bits);
+        }
+        m_bits     = 0;
+        m_bitCount = 0;
+    }
+
+    void putU32(uint32_t value)
+    {
+        for (uint8_t i = 0; i < 4; ++i)
+        {
+            m_out[m_pos++] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+};
+} // namespace Gzip
@@ -0,0 +1,154 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Gzip.h"
+#include "Metrics.h"
+#include "SensorData.h"
+#include "Utilities.h"
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+/// Uploads the sensor samples to InfluxDB (or anything else that speaks its line protocol) via HTTP POST
+///
+/// Every sample becomes one line:
+///   <measurement>,device=hAIR_xxxxxx TVOC=12i,eCO2=412i,..,temperature=21.53,.. 1650000000
+/// The lines are collected until batchSize samples are there or the oldest is batchDelay old.
+/// Then the batch is gzipped and POSTed with "Content-Encoding: gzip" (and "Authorization: Token <token>" if set).
+///
+/// A batch that cannot be sent (no WiFi, server down, timeout, 5xx, ...) goes to the outbox in OUTBOX_DIR, one file per batch.
+/// Files are written under a temporary name and renamed, so a reset never leaves half a batch behind.
+/// The outbox is retried oldest first with an exponential backoff and survives a reboot. Once it exceeds outboxSize,
+/// the oldest batches are dropped. Batches the server rejects for their content (400, 413, 422) are dropped as well,
+/// sending them again would never succeed.
+///
+/// Runs on its own thread, since a request blocks for up to REQUEST_TIMEOUT. persist() may be called from any other.
+class InfluxUploader
+{
+public:
+    static constexpr auto   OUTBOX_DIR{"/influx"};
+    static constexpr size_t MAX_BATCH_SIZE{60};
+    static constexpr size_t MAX_MEASUREMENT_LENGTH{32};
+
+    struct Settings
+    {
+        String   url;         // write endpoint, e.g. http://influx:8086/api/v2/write?org=home&bucket=hAIR, empty disables the upload
+        String   token;       // empty => no Authorization header
+        String   measurement; // name of the measurement
+        size_t   batchSize;   // [samples] per request, at most MAX_BATCH_SIZE
+        uint32_t batchDelay;  // [s] a partial batch is sent once its oldest sample is that old
+        size_t   outboxSize;  // [bytes] on LittleFS, 0 disables the outbox
+    };
+
+    explicit InfluxUploader(Metrics& metrics)
+        : m_metrics(metrics)
+    {
+    }
+
+    /// @return false if the buffers could not be allocated, true if the upload is disabled
+    bool init(const Settings& settings);
+
+    bool isEnabled() const
+    {
+        return m_enabled;
+    }
+
+    /// Adds one sample to the current batch, ignored until the clock has been set via NTP
+    /// @param epoch [unix seconds]
+    void add(uint32_t epoch, const SensorData& data);
+
+    /// Sends the current batch once it is due, otherwise the oldest batch of the outbox (one request per call)
+    /// @param epoch [unix seconds]
+    void upload(Timestamp now, uint32_t epoch);
+
+    /// Moves the current batch into the outbox, before a restart
+    void persist();
+
+
+private:
+    static constexpr uint16_t  REQUEST_TIMEOUT{5000}; // [ms] connect and response each
+    static constexpr Timestamp RETRY_MIN_DELAY{5000}; // [ms] doubles with every failed request
+    static constexpr Timestamp RETRY_MAX_DELAY{300000};
+
+    // measurement,device=hAIR_xxxxxx plus 7 fields of at most 24 characters plus the timestamp
+    static constexpr size_t LINE_CAPACITY{256};
+
+    // Outbox file: [u16 LE samples][gzip body]
+    static constexpr size_t OUTBOX_HEADER_SIZE{2};
+
+    enum class Result
+    {
+        Sent,
+        Retry,    // try again later
+        Rejected, // the server will never take it
+    };
+
+    Metrics&   m_metrics;
+    HTTPClient m_http{};
+    bool       m_enabled{false};
+    Settings   m_settings{};
+    String     m_linePrefix{}; // "<measurement>,device=<id> "
+    std::mutex m_mutex{};
+
+    // Sized for batchSize, ~26 KiB for 30 samples
+    std::unique_ptr<Gzip::Compressor> m_compressor{};
+    std::unique_ptr<char[]>           m_lines{};
+    std::unique_ptr<uint8_t[]>        m_body{};
+    size_t                            m_linesCapacity{};
+    size_t                            m_bodyCapacity{};
+
+    // Current batch
+    size_t   m_samples{};
+    size_t   m_linesLength{};
+    uint32_t m_oldest{}; // [unix seconds]
+
+    // Retry
+    Timestamp m_nextAttempt{};
+    Timestamp m_retryDelay{RETRY_MIN_DELAY};
+
+    // Outbox, files are named by a sequence number, oldest is m_outboxFirst, the next one gets m_outboxNext
+    uint32_t m_outboxFirst{};
+    uint32_t m_outboxNext{};
+    size_t   m_outboxBytes{};
+
+    void   appendLine(uint32_t epoch, const SensorData& data);
+    size_t compressBatch();
+    void   clearBatch();
+    void   persistBatch();
+    Result post(const uint8_t* body, size_t length, size_t samples);
+    void   retryLater(Timestamp now);
+
+    void   scanOutbox();
+    bool   writeOutbox(const uint8_t* body, size_t length, size_t samples);
+    void   sendOutbox(Timestamp now);
+    void   removeOutbox(bool dropped);
+    String outboxPath(uint32_t sequence) const;
+    void   updateOutboxMetrics();
+};
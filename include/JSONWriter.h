@@ -0,0 +1,448 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Arduino.h>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+/// Fixed capacity JSON writer that formats straight into a caller provided buffer, no heap involved
+/// Without a sink, output that does not fit is dropped and overflow() is set.
+/// With a sink (e.g. an AsyncResponseStream), the buffer is flushed into it whenever it runs full, so the output size is unbounded.
+class JSONWriter
+{
+public:
+    JSONWriter(char* buffer, size_t capacity, Print* sink = nullptr)
+        : m_buffer(buffer), m_capacity(capacity), m_sink(sink)
+    {
+        terminate();
+    }
+
+    template<size_t N>
+    explicit JSONWriter(std::array<char, N>& buffer, Print* sink = nullptr)
+        : JSONWriter(buffer.data(), N, sink)
+    {
+    }
+
+    ~JSONWriter()
+    {
+        flush();
+    }
+
+    JSONWriter(const JSONWriter&) = delete;
+    JSONWriter& operator=(const JSONWriter&) = delete;
+
+    ////////////////////////////////
+    /// Structure
+    ////////////////////////////////
+
+    JSONWriter& beginObject()
+    {
+        separate();
+        put('{');
+        push();
+        return *this;
+    }
+
+    JSONWriter& endObject()
+    {
+        pop();
+        put('}');
+        return *this;
+    }
+
+    JSONWriter& beginArray()
+    {
+        separate();
+        put('[');
+        push();
+        return *this;
+    }
+
+    JSONWriter& endArray()
+    {
+        pop();
+        put(']');
+        return *this;
+    }
+
+    JSONWriter& key(const char* name)
+    {
+        separate();
+        putEscaped(name);
+        put(':');
+        m_afterKey = true;
+        return *this;
+    }
+
+    ////////////////////////////////
+    /// Values
+    ////////////////////////////////
+
+    template<typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+    JSONWriter& value(T val)
+    {
+        separate();
+        if (std::is_signed<T>::value && static_cast<int64_t>(val) < 0)
+        {
+            put('-');
+            putUnsigned(static_cast<uint64_t>(0) - static_cast<uint64_t>(val));
+        }
+        else
+        {
+            putUnsigned(static_cast<uint64_t>(val));
+        }
+        return *this;
+    }
+
+    JSONWriter& value(bool val)
+    {
+        separate();
+        val ? raw("true") : raw("false");
+        return *this;
+    }
+
+    /// Fixed precision, NaN and infinity are written as null
+    JSONWriter& value(float val, uint8_t decimals = 2)
+    {
+        separate();
+        putFixed(val, decimals);
+        return *this;
+    }
+
+    /// Exact output of a fixed point number, fixed(2150, 2) => 21.50
+    JSONWriter& fixed(int32_t scaled, uint8_t decimals)
+    {
+        separate();
+        if (scaled < 0)
+        {
+            put('-');
+        }
+        const auto magnitude{scaled < 0 ? 0U - static_cast<uint32_t>(scaled) : static_cast<uint32_t>(scaled)};
+
+        decimals = decimals > MAX_DECIMALS ? MAX_DECIMALS : decimals;
+        uint32_t scale{1};
+        for (uint8_t i = 0; i < decimals; ++i)
+        {
+            scale *= 10U;
+        }
+
+        putUnsigned(magnitude / scale);
+        putFraction(magnitude % scale, decimals);
+        return *this;
+    }
+
+    JSONWriter& value(const char* str)
+    {
+        separate();
+        putEscaped(str);
+        return *this;
+    }
+
+    JSONWriter& null()
+    {
+        separate();
+        raw("null");
+        return *this;
+    }
+
+    template<typename T>
+    JSONWriter& member(const char* name, T val)
+    {
+        return key(name).value(val);
+    }
+
+    JSONWriter& member(const char* name, float val, uint8_t decimals)
+    {
+        return key(name).value(val, decimals);
+    }
+
+    ////////////////////////////////
+    /// Raw output
+    ////////////////////////////////
+
+    JSONWriter& raw(const char* str)
+    {
+        return raw(str, strlen(str));
+    }
+
+    JSONWriter& raw(const char* str, size_t len)
+    {
+        // fast path, everything fits
+        if (m_length + len < m_capacity)
+        {
+            memcpy(m_buffer + m_length, str, len);
+            m_length += len;
+            m_buffer[m_length] = '\0';
+            return *this;
+        }
+
+        for (size_t i = 0; i < len; ++i)
+        {
+            put(str[i]);
+        }
+        return *this;
+    }
+
+    ////////////////////////////////
+    /// Result
+    ////////////////////////////////
+
+    /// Hands everything written so far to the sink, no-op without a sink
+    void flush()
+    {
+        if (m_sink != nullptr && m_length > 0)
+        {
+            m_sink->write(reinterpret_cast<const uint8_t*>(m_buffer), m_length);
+            m_flushed += m_length;
+            m_length = 0;
+            terminate();
+        }
+    }
+
+    /// Only meaningful without a sink
+    const char* c_str() const
+    {
+        return m_buffer;
+    }
+
+    /// Bytes currently held in the buffer
+    size_t length() const
+    {
+        return m_length;
+    }
+
+    /// Bytes produced in total, including everything flushed into the sink
+    size_t size() const
+    {
+        return m_flushed + m_length;
+    }
+
+    bool overflow() const
+    {
+        return m_overflow;
+    }
+
+private:
+    static constexpr uint8_t MAX_DEPTH{32};
+    static constexpr uint8_t MAX_DECIMALS{6};
+
+    char*  m_buffer;
+    size_t m_capacity;
+    Print* m_sink;
+
+    size_t m_length{};
+    size_t m_flushed{};
+    bool   m_overflow{false};
+
+    // One bit per nesting level, set if the level already holds an element and the next one needs a separator
+    uint32_t m_hasElement{};
+    uint8_t  m_depth{};
+    bool     m_afterKey{false};
+
+    void terminate()
+    {
+        if (m_capacity > 0)
+        {
+            m_buffer[m_length] = '\0';
+        }
+    }
+
+    void put(char c)
+    {
+        // keep one byte for the terminator
+        if (m_length + 1 >= m_capacity)
+        {
+            if (m_sink == nullptr || m_capacity < 2)
+            {
+                m_overflow = true;
+                return;
+            }
+            flush();
+        }
+
+        m_buffer[m_length++] = c;
+        m_buffer[m_length]   = '\0';
+    }
+
+    void separate()
+    {
+        if (m_afterKey)
+        {
+            m_afterKey = false;
+            return;
+        }
+
+        const uint32_t bit{1U << (m_depth % MAX_DEPTH)};
+        if (m_hasElement & bit)
+        {
+            put(',');
+        }
+        m_hasElement |= bit;
+    }
+
+    void push()
+    {
+        ++m_depth;
+        m_hasElement &= ~(1U << (m_depth % MAX_DEPTH));
+    }
+
+    void pop()
+    {
+        m_afterKey = false;
+        if (m_depth > 0)
+        {
+            --m_depth;
+        }
+    }
+
+    void putUnsigned(uint64_t val)
+    {
+        char digits[20];
+        int  n{0};
+
+        // stay in 32 bit arithmetic whenever possible, 64 bit divisions are expensive on the ESP32
+        auto val32{static_cast<uint32_t>(val)};
+        if (val > UINT32_MAX)
+        {
+            do
+            {
+                digits[n++] = static_cast<char>('0' + val % 10U);
+                val /= 10U;
+            } while (val > UINT32_MAX);
+            val32 = static_cast<uint32_t>(val);
+        }
+
+        do
+        {
+            digits[n++] = static_cast<char>('0' + val32 % 10U);
+            val32 /= 10U;
+        } while (val32 != 0U);
+
+        // digits are in reverse order
+        char ordered[20];
+        for (int i = 0; i < n; ++i)
+        {
+            ordered[i] = digits[n - 1 - i];
+        }
+        raw(ordered, n);
+    }
+
+    void putFixed(float val, uint8_t decimals)
+    {
+        if (!std::isfinite(val))
+        {
+            raw("null");
+            return;
+        }
+
+        decimals = decimals > MAX_DECIMALS ? MAX_DECIMALS : decimals;
+
+        uint32_t scale{1};
+        for (uint8_t i = 0; i < decimals; ++i)
+        {
+            scale *= 10U;
+        }
+
+        if (val < 0.0F)
+        {
+            put('-');
+            val = -val;
+        }
+
+        // round half up in the last decimal
+        const auto scaled{static_cast<uint64_t>(static_cast<double>(val) * scale + 0.5)};
+        const auto integral{scaled / scale};
+        const auto fraction{static_cast<uint32_t>(scaled % scale)};
+
+        putUnsigned(integral);
+        putFraction(fraction, decimals);
+    }
+
+    /// '.' and exactly 'decimals' digits, nothing for 0 decimals
+    void putFraction(uint32_t fraction, uint8_t decimals)
+    {
+        if (decimals > 0)
+        {
+            char digits[MAX_DECIMALS + 1];
+            digits[0] = '.';
+            auto rest{fraction};
+            for (uint8_t i = decimals; i > 0; --i)
+            {
+                digits[i] = static_cast<char>('0' + rest % 10U);
+                rest /= 10U;
+            }
+            raw(digits, decimals + 1U);
+        }
+    }
+
+    void putEscaped(const char* str)
+    {
+        static constexpr char HEX_DIGITS[]{"0123456789abcdef"};
+
+        put('"');
+        for (; *str != '\0'; ++str)
+        {
+            // copy runs that need no escaping in one go
+            const char* run{str};
+            while (static_cast<uint8_t>(*str) >= 0x20 && *str != '"' && *str != '\\')
+            {
+                ++str;
+            }
+            raw(run, str - run);
+            if (*str == '\0')
+            {
+                break;
+            }
+
+            const auto c{static_cast<uint8_t>(*str)};
+            switch (c)
+            {
+            case '"': raw("\\\""); break;
+            case '\\': raw("\\\\"); break;
+            case '\n': raw("\\n"); break;
+            case '\r': raw("\\r"); break;
+            case '\t': raw("\\t"); break;
+            default:
+                if (c < 0x20)
+                {
+                    raw("\\u00");
+                    put(HEX_DIGITS[c >> 4]);
+                    put(HEX_DIGITS[c & 0x0F]);
+                }
+                else
+                {
+                    put(static_cast<char>(c));
+                }
+                break;
+            }
+        }
+        put('"');
+    }
+};
@@ -0,0 +1,409 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include "LogFormat.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <plog/Log.h>
+#include <string>
+#include <type_traits>
+
+/// A log record while it waits for the drain thread, plain data so the logging thread only copies
+struct LogEntry
+{
+    static constexpr size_t FUNC_LENGTH{48};
+    static constexpr size_t MESSAGE_LENGTH{192};
+
+    /// As binary record: header plus function, line and message of a text record
+    static constexpr size_t RECORD_CAPACITY{LogFormat::MAX_HEADER_SIZE + FUNC_LENGTH + MESSAGE_LENGTH + 16};
+
+    uint8_t                          severity{};
+    uint8_t                          length{}; // binary records: bytes of arguments in message
+    uint32_t                         site{};   // LogFormat site id, LogFormat::TEXT_SITE if message holds text
+    uint32_t                         tid{};
+    uint32_t                         millis{};
+    int32_t                          line{};
+    std::array<char, FUNC_LENGTH>    func{};    // text records only
+    std::array<char, MESSAGE_LENGTH> message{}; // text or LogFormat arguments, longer messages are truncated
+};
+
+/// Receives the records captured by the PLOG macros, see LogCapture
+class LogSink
+{
+public:
+    virtual ~LogSink() = default;
+
+    /// Runs on the logging thread, must not block
+    virtual void write(const LogEntry& entry) = 0;
+};
+
+/// Appends text to a fixed buffer, output that does not fit is cut off and the buffer stays terminated
+class LineWriter
+{
+public:
+    LineWriter(char* buffer, size_t capacity)
+        : m_buffer(buffer), m_capacity(capacity)
+    {
+        m_buffer[0] = '\0';
+    }
+
+    LineWriter& put(char c)
+    {
+        if (m_length + 1 < m_capacity)
+        {
+            m_buffer[m_length++] = c;
+            m_buffer[m_length]   = '\0';
+        }
+        return *this;
+    }
+
+    LineWriter& put(const char* str)
+    {
+        return put(str, strlen(str));
+    }
+
+    LineWriter& put(const char* str, size_t len)
+    {
+        len = std::min(len, m_capacity - 1 - m_length);
+        memcpy(m_buffer + m_length, str, len);
+        m_length += len;
+        m_buffer[m_length] = '\0';
+        return *this;
+    }
+
+    /// Left aligned, padded with spaces up to width
+    LineWriter& putLeft(const char* str, size_t width)
+    {
+        const auto len{strlen(str)};
+        put(str, len);
+        return fill(' ', width > len ? width - len : 0);
+    }
+
+    /// Right aligned, padded with spaces up to width
+    LineWriter& putRight(uint32_t val, size_t width)
+    {
+        char       digits[10];
+        const auto len{toDigits(val, digits)};
+        fill(' ', width > len ? width - len : 0);
+        return put(digits + sizeof(digits) - len, len);
+    }
+
+    LineWriter& putUnsigned(uint64_t val)
+    {
+        char digits[20];
+        if (val <= UINT32_MAX)
+        {
+            // 64 bit divisions are expensive on the ESP32
+            const auto len{toDigits(static_cast<uint32_t>(val), digits + 10)};
+            return put(digits + sizeof(digits) - len, len);
+        }
+
+        size_t len{};
+        while (val != 0)
+        {
+            digits[sizeof(digits) - ++len] = static_cast<char>('0' + val % 10U);
+            val /= 10U;
+        }
+        return put(digits + sizeof(digits) - len, len);
+    }
+
+    LineWriter& putSigned(int64_t val)
+    {
+        if (val < 0)
+        {
+            put('-');
+            return putUnsigned(static_cast<uint64_t>(0) - static_cast<uint64_t>(val));
+        }
+        return putUnsigned(static_cast<uint64_t>(val));
+    }
+
+    /// Eight digits, zero padded
+    LineWriter& putHex(uint32_t val)
+    {
+        constexpr char DIGITS[]{"0123456789abcdef"};
+        for (int shift = 28; shift >= 0; shift -= 4)
+        {
+            put(DIGITS[(val >> shift) & 0xF]);
+        }
+        return *this;
+    }
+
+    /// Two decimals, printf("%f") is avoided on purpose: newlib allocates in its float conversion
+    LineWriter& putFixed(double val)
+    {
+        if (std::isnan(val))
+        {
+            return put("nan");
+        }
+        if (val < 0.0)
+        {
+            put('-');
+            val = -val;
+        }
+        if (val >= static_cast<double>(UINT64_MAX / 100))
+        {
+            return put("inf");
+        }
+
+        const auto scaled{static_cast<uint64_t>(val * 100.0 + 0.5)};
+        putUnsigned(scaled / 100);
+        put('.');
+        put(static_cast<char>('0' + scaled / 10 % 10));
+        return put(static_cast<char>('0' + scaled % 10));
+    }
+
+    LineWriter& fill(char c, size_t count)
+    {
+        while (count-- > 0)
+        {
+            put(c);
+        }
+        return *this;
+    }
+
+    size_t length() const
+    {
+        return m_length;
+    }
+
+private:
+    char*  m_buffer;
+    size_t m_capacity;
+    size_t m_length{};
+
+    /// Writes the digits right aligned to the end of out[10]
+    /// @return number of digits
+    static size_t toDigits(uint32_t val, char* out)
+    {
+        size_t len{};
+        do
+        {
+            out[9 - len++] = static_cast<char>('0' + val % 10U);
+            val /= 10U;
+        } while (val != 0U);
+        return len;
+    }
+};
+
+/// Stack-only replacement for plog::Record, used by the PLOG macros below
+/// plog::Record streams into a nostringstream and allocates again for getMessage() and getFunc(),
+/// this one formats straight into a LogEntry and hands it to the LogSink, the whole record never touches the heap.
+/// Supported are the types we log: strings, characters, integers, enums, bool (as 0/1) and floats (2 decimals).
+///
+/// In binary mode nothing is formatted at all: string literals are skipped (they are in the log table, see LogFormat.h)
+/// and every other argument is appended as raw bytes. A char array streamed in counts as literal if it is const.
+///
+/// Records logged before a sink is set are dropped.
+class LogCapture
+{
+public:
+    LogCapture(plog::Severity severity, const char* func, size_t line, uint32_t site = LogFormat::TEXT_SITE)
+        : m_binary(site != LogFormat::TEXT_SITE && s_binary.load(std::memory_order_relaxed)),
+          m_message(m_entry.message.data(), m_entry.message.size()),
+          m_args(reinterpret_cast<uint8_t*>(m_entry.message.data()), m_entry.message.size())
+    {
+        m_entry.severity = static_cast<uint8_t>(severity);
+        m_entry.tid      = plog::util::gettid();
+        m_entry.millis   = ::millis();
+        m_entry.line     = static_cast<int32_t>(line);
+        if (m_binary)
+        {
+            m_entry.site = site;
+        }
+        else
+        {
+            copyFuncName(func);
+        }
+    }
+
+    ~LogCapture()
+    {
+        auto* sink{s_sink.load(std::memory_order_acquire)};
+        if (sink != nullptr)
+        {
+            m_entry.length = static_cast<uint8_t>(m_args.length());
+            sink->write(m_entry);
+        }
+    }
+
+    LogCapture(const LogCapture&) = delete;
+    LogCapture& operator=(const LogCapture&) = delete;
+
+    static void setSink(LogSink* sink)
+    {
+        s_sink.store(sink, std::memory_order_release);
+    }
+
+    /// Takes effect for the records started afterwards
+    static void setBinary(bool binary)
+    {
+        s_binary.store(binary, std::memory_order_relaxed);
+    }
+
+    LogCapture& ref()
+    {
+        return *this;
+    }
+
+    /// String literals
+    template<size_t N>
+    LogCapture& operator<<(const char (&str)[N])
+    {
+        if (!m_binary)
+        {
+            m_message.put(str);
+        }
+        return *this;
+    }
+
+    template<size_t N>
+    LogCapture& operator<<(char (&str)[N])
+    {
+        return putString(str, strnlen(str, N));
+    }
+
+    template<typename T, typename std::enable_if<std::is_same<T, const char*>::value || std::is_same<T, char*>::value, int>::type = 0>
+    LogCapture& operator<<(T str)
+    {
+        return str != nullptr ? putString(str, strlen(str)) : putString("(null)", 6);
+    }
+
+    LogCapture& operator<<(const String& str)
+    {
+        return putString(str.c_str(), str.length());
+    }
+
+    LogCapture& operator<<(const std::string& str)
+    {
+        return putString(str.data(), str.size());
+    }
+
+    /// Characters are streamed as characters, like std::ostream does
+    template<typename T, typename std::enable_if<std::is_same<T, char>::value || std::is_same<T, signed char>::value || std::is_same<T, unsigned char>::value, int>::type = 0>
+    LogCapture& operator<<(T c)
+    {
+        if (m_binary)
+        {
+            m_args.putChar(static_cast<char>(c));
+        }
+        else
+        {
+            m_message.put(static_cast<char>(c));
+        }
+        return *this;
+    }
+
+    template<typename T, typename std::enable_if<std::is_integral<T>::value && sizeof(T) != 1, int>::type = 0>
+    LogCapture& operator<<(T val)
+    {
+        if (m_binary)
+        {
+            std::is_signed<T>::value ? m_args.putSigned(static_cast<int64_t>(val)) : m_args.putUnsigned(static_cast<uint64_t>(val));
+        }
+        else
+        {
+            std::is_signed<T>::value ? m_message.putSigned(static_cast<int64_t>(val)) : m_message.putUnsigned(static_cast<uint64_t>(val));
+        }
+        return *this;
+    }
+
+    LogCapture& operator<<(bool val)
+    {
+        return *this << static_cast<unsigned>(val);
+    }
+
+    template<typename T, typename std::enable_if<std::is_enum<T>::value, int>::type = 0>
+    LogCapture& operator<<(T val)
+    {
+        return *this << static_cast<std::underlying_type_t<T>>(val);
+    }
+
+    LogCapture& operator<<(double val)
+    {
+        if (m_binary)
+        {
+            m_args.putFloat(static_cast<float>(val));
+        }
+        else
+        {
+            m_message.putFixed(val);
+        }
+        return *this;
+    }
+
+private:
+    static inline std::atomic<LogSink*> s_sink{nullptr};
+    static inline std::atomic<bool>     s_binary{false};
+
+    LogEntry             m_entry{};
+    const bool           m_binary;
+    LineWriter           m_message; // text mode
+    LogFormat::ArgWriter m_args;    // binary mode, on the same buffer
+
+    LogCapture& putString(const char* str, size_t len)
+    {
+        if (m_binary)
+        {
+            m_args.putString(str, len);
+        }
+        else
+        {
+            m_message.put(str, len);
+        }
+        return *this;
+    }
+
+    /// "void hAIR_System::job_sda_publish(Timestamp)" => "hAIR_System::job_sda_publish", like plog::util::processFuncName()
+    void copyFuncName(const char* func)
+    {
+        const char* end{strchr(func, '(')};
+        if (end == nullptr)
+        {
+            end = func + strlen(func);
+        }
+
+        const char* begin{end};
+        while (begin > func && begin[-1] != ' ')
+        {
+            --begin;
+        }
+
+        LineWriter{m_entry.func.data(), m_entry.func.size()}.put(begin, static_cast<size_t>(end - begin));
+    }
+};
+
+// Route the PLOG macros through LogCapture instead of plog::Record, the severity check stays with plog
+// The site id is a constant, it costs nothing at runtime.
+#undef PLOG_
+#define PLOG_(instanceId, severity) IF_PLOG_(instanceId, severity) LogCapture(severity, PLOG_GET_FUNC(), __LINE__, std::integral_constant<uint32_t, LogFormat::siteId(__FILE__, __LINE__)>::value).ref()
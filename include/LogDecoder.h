@@ -0,0 +1,225 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// Host only (std::string, std::map), shared by tools/hAIR_log_decode and the native tests, never built for the target
+#include "LogFormat.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <plog/Severity.h>
+#include <string>
+#include <vector>
+
+/// Puts binary log records back together as text, with the log table that tools/log_table.py generates (see LogFormat.h)
+/// The lines have the layout of hAIR_Formatter without the date, the device only sends its millis.
+class LogDecoder
+{
+public:
+    /// One line of data/log_table.txt, comments and malformed lines are skipped
+    void addTableLine(std::string line)
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+
+        const auto tab1{line.find('\t')};
+        const auto tab2{line.find('\t', tab1 + 1)};
+        if (line.empty() || line[0] == '#' || tab1 == std::string::npos || tab2 == std::string::npos)
+        {
+            return;
+        }
+
+        const auto site{static_cast<uint32_t>(std::strtoul(line.substr(0, tab1).c_str(), nullptr, 16))};
+        m_table[site] = Site{line.substr(tab1 + 1, tab2 - tab1 - 1), unescape(line.substr(tab2 + 1))};
+    }
+
+    bool loadTable(const char* path)
+    {
+        std::ifstream file{path};
+        if (!file)
+        {
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            addTableLine(line);
+        }
+        return true;
+    }
+
+    /// @param partial the record may be cut off at the front, it is only decoded if its site is known
+    /// @return false for a broken record (or a partial one that does not look sane)
+    bool decode(const uint8_t* record, size_t length, bool partial, std::string& line) const
+    {
+        LogFormat::RecordReader reader{record, length};
+        LogFormat::Header       header{};
+        if (!reader.header(header) || (partial && m_table.count(header.site) == 0))
+        {
+            return false;
+        }
+
+        std::string location;
+        std::string message;
+        if (header.site == LogFormat::TEXT_SITE)
+        {
+            location = format("{}@{}", reader);
+            message  = format("{}", reader);
+        }
+        else
+        {
+            const auto site{m_table.find(header.site)};
+            if (site == m_table.end())
+            {
+                char buffer[64];
+                std::snprintf(buffer, sizeof(buffer), "site %08x", header.site);
+                location = buffer;
+                message  = "(not in the log table, does it match the firmware?)";
+            }
+            else
+            {
+                location = site->second.location;
+                message  = format(site->second.format, reader);
+            }
+        }
+
+        char prefix[64];
+        std::snprintf(prefix, sizeof(prefix), "[%10u] [%-5s] [%u] [", header.millis, plog::severityToString(plog::Severity(header.severity)), header.tid);
+        line = prefix + location + "] " + message;
+        return true;
+    }
+
+    /// Feeds a capture (Serial output or /logs) byte by byte, records end with 0x00 (COBS frames, see LogFormat.h)
+    /// A capture may start in the middle of a record, the first frame is only decoded if its site is known.
+    /// @param onLine(const std::string&) for every decoded record
+    /// @param onError(const char*) for a broken frame or record
+    template<typename OnLine, typename OnError>
+    void put(char c, OnLine&& onLine, OnError&& onError)
+    {
+        if (c != '\0')
+        {
+            m_frame.push_back(static_cast<uint8_t>(c));
+            return;
+        }
+
+        if (!m_frame.empty())
+        {
+            std::string line;
+            const auto  length{LogFormat::cobsDecode(m_frame.data(), m_frame.size())};
+            if (length > 0 && decode(m_frame.data(), length, m_first, line))
+            {
+                onLine(line);
+            }
+            else if (!m_first)
+            {
+                onError(length > 0 ? "broken record, skipped" : "broken frame, skipped");
+            }
+        }
+        m_first = false;
+        m_frame.clear();
+    }
+
+private:
+    struct Site
+    {
+        std::string location;
+        std::string format;
+    };
+
+    std::map<uint32_t, Site> m_table{};
+    std::vector<uint8_t>     m_frame{};
+    bool                     m_first{true};
+
+    /// "\n", "\t" and "\\" are escaped in the table, so every format fits on one line
+    static std::string unescape(const std::string& str)
+    {
+        std::string out;
+        for (size_t i = 0; i < str.size(); ++i)
+        {
+            if (str[i] == '\\' && i + 1 < str.size())
+            {
+                ++i;
+                out += str[i] == 'n' ? '\n' : str[i] == 't' ? '\t' : str[i];
+            }
+            else
+            {
+                out += str[i];
+            }
+        }
+        return out;
+    }
+
+    static std::string toString(const LogFormat::Arg& arg)
+    {
+        switch (arg.tag)
+        {
+        case LogFormat::Tag::Signed:
+            return std::to_string(arg.i);
+        case LogFormat::Tag::Unsigned:
+            return std::to_string(arg.u);
+        case LogFormat::Tag::Float:
+        {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.2f", arg.f);
+            return buffer;
+        }
+        case LogFormat::Tag::Char:
+            return std::string(1, arg.c);
+        case LogFormat::Tag::String:
+            return std::string(arg.str, arg.len);
+        }
+        return "?";
+    }
+
+    /// Replaces every "{}" with the next argument, "{{" and "}}" are literal braces
+    static std::string format(const std::string& fmt, LogFormat::RecordReader& reader)
+    {
+        std::string    out;
+        LogFormat::Arg arg{};
+        for (size_t i = 0; i < fmt.size(); ++i)
+        {
+            if ((fmt[i] == '{' || fmt[i] == '}') && i + 1 < fmt.size() && fmt[i + 1] == fmt[i])
+            {
+                out += fmt[i++];
+            }
+            else if (fmt[i] == '{' && i + 1 < fmt.size() && fmt[i + 1] == '}')
+            {
+                out += reader.next(arg) ? toString(arg) : "{?}";
+                ++i;
+            }
+            else
+            {
+                out += fmt[i];
+            }
+        }
+        return out;
+    }
+};
@@ -0,0 +1,409 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+// No Arduino includes on purpose, this header is shared with the host tools (see tools/hAIR_log_decode)
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/// Binary log records, the deferred formatting counterpart of hAIR_Formatter
+///
+/// In binary mode the PLOG call sites do not format anything, a record only carries the id of its call site and the raw arguments.
+/// The text is put back together on the host, from the table that tools/log_table.py generates from the sources at build time.
+/// data/log_table.txt has one line per call site: "<site id hex>\t<file>:<line>\t<format>", "{}" stands for an argument.
+/// String literals are part of the format, everything else streamed into a PLOG macro is an argument.
+///
+/// Record:   [u32 site id LE][varint millis][u8 severity][varint tid][argument]...
+/// Argument: [u8 tag][payload], see Tag
+/// Site id:  FNV-1a 32 of "<file name>:<line>"
+///           0 is a text record (e.g. a plog::Record that bypassed the macros), its arguments are function, line and message
+///
+/// Records are sent as they are via websocket, one per message.
+/// On Serial and in the /logs ring they are COBS encoded and end with 0x00, so a reader can (re)synchronize at any 0x00.
+namespace LogFormat
+{
+constexpr size_t   MAX_HEADER_SIZE{4 + 5 + 1 + 5};
+constexpr uint32_t TEXT_SITE{0};
+
+enum class Tag : uint8_t
+{
+    Signed   = 'i', // zigzag varint
+    Unsigned = 'u', // varint
+    Float    = 'f', // float32 LE
+    Char     = 'c', // u8
+    String   = 's', // varint length + bytes, without terminator
+};
+
+////////////////////////////////
+/// Site ids
+////////////////////////////////
+
+constexpr uint32_t FNV_OFFSET{2166136261U};
+constexpr uint32_t FNV_PRIME{16777619U};
+
+constexpr uint32_t fnv1a(uint32_t hash, char c)
+{
+    return (hash ^ static_cast<uint8_t>(c)) * FNV_PRIME;
+}
+
+/// __FILE__ is whatever path the compiler was given, only the file name is stable
+constexpr const char* fileName(const char* path)
+{
+    const char* name{path};
+    for (const char* c = path; *c != '\0'; ++c)
+    {
+        if (*c == '/' || *c == '\\')
+        {
+            name = c + 1;
+        }
+    }
+    return name;
+}
+
+constexpr uint32_t siteId(const char* path, uint32_t line)
+{
+    uint32_t hash{FNV_OFFSET};
+    for (const char* c = fileName(path); *c != '\0'; ++c)
+    {
+        hash = fnv1a(hash, *c);
+    }
+    hash = fnv1a(hash, ':');
+
+    uint32_t scale{1};
+    while (line / scale >= 10)
+    {
+        scale *= 10;
+    }
+    for (; scale > 0; scale /= 10)
+    {
+        hash = fnv1a(hash, static_cast<char>('0' + line / scale % 10));
+    }
+
+    // 0 is taken by text records
+    return hash != TEXT_SITE ? hash : 1;
+}
+
+////////////////////////////////
+/// Encoding
+////////////////////////////////
+
+inline size_t putVarint(uint8_t* out, uint64_t val)
+{
+    size_t n{};
+    while (val >= 0x80)
+    {
+        out[n++] = static_cast<uint8_t>(val | 0x80);
+        val >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(val);
+    return n;
+}
+
+/// @return bytes written to out (at most MAX_HEADER_SIZE)
+inline size_t putHeader(uint8_t* out, uint32_t site, uint32_t millis, uint8_t severity, uint32_t tid)
+{
+    out[0] = static_cast<uint8_t>(site);
+    out[1] = static_cast<uint8_t>(site >> 8);
+    out[2] = static_cast<uint8_t>(site >> 16);
+    out[3] = static_cast<uint8_t>(site >> 24);
+
+    size_t pos{4};
+    pos += putVarint(out + pos, millis);
+    out[pos++] = severity;
+    pos += putVarint(out + pos, tid);
+    return pos;
+}
+
+/// Appends tagged arguments to a fixed buffer
+/// An argument that does not fit is dropped (strings are cut instead), later ones still get a chance.
+class ArgWriter
+{
+public:
+    ArgWriter(uint8_t* buffer, size_t capacity)
+        : m_buffer(buffer), m_capacity(capacity)
+    {
+    }
+
+    void putSigned(int64_t val)
+    {
+        // wrapping arithmetic, so INT64_MIN works as well
+        putVarint(Tag::Signed, (static_cast<uint64_t>(val) << 1) ^ static_cast<uint64_t>(val >> 63));
+    }
+
+    void putUnsigned(uint64_t val)
+    {
+        putVarint(Tag::Unsigned, val);
+    }
+
+    void putFloat(float val)
+    {
+        if (m_length + 1 + 4 <= m_capacity)
+        {
+            uint32_t bits{};
+            memcpy(&bits, &val, sizeof(bits));
+            m_buffer[m_length++] = static_cast<uint8_t>(Tag::Float);
+            for (uint8_t i = 0; i < 4; ++i)
+            {
+                m_buffer[m_length++] = static_cast<uint8_t>(bits >> (8 * i));
+            }
+        }
+    }
+
+    void putChar(char c)
+    {
+        if (m_length + 2 <= m_capacity)
+        {
+            m_buffer[m_length++] = static_cast<uint8_t>(Tag::Char);
+            m_buffer[m_length++] = static_cast<uint8_t>(c);
+        }
+    }
+
+    void putString(const char* str, size_t len)
+    {
+        // tag plus a one or two byte length, strings are never longer than a LogEntry anyway
+        const size_t overhead{len < 0x80 ? 2U : 3U};
+        if (m_length + overhead > m_capacity)
+        {
+            return;
+        }
+
+        len = len < m_capacity - m_length - overhead ? len : m_capacity - m_length - overhead;
+        m_buffer[m_length++] = static_cast<uint8_t>(Tag::String);
+        m_length += LogFormat::putVarint(m_buffer + m_length, len);
+        memcpy(m_buffer + m_length, str, len);
+        m_length += len;
+    }
+
+    size_t length() const
+    {
+        return m_length;
+    }
+
+private:
+    uint8_t* m_buffer;
+    size_t   m_capacity;
+    size_t   m_length{};
+
+    void putVarint(Tag tag, uint64_t val)
+    {
+        uint8_t    tmp[10];
+        const auto len{LogFormat::putVarint(tmp, val)};
+        if (m_length + 1 + len <= m_capacity)
+        {
+            m_buffer[m_length++] = static_cast<uint8_t>(tag);
+            memcpy(m_buffer + m_length, tmp, len);
+            m_length += len;
+        }
+    }
+};
+
+/// Consistent Overhead Byte Stuffing, out holds no 0x00 afterwards (the delimiter is up to the caller)
+/// @param out at least length + length / 254 + 1 bytes
+/// @return bytes written to out
+inline size_t cobsEncode(const uint8_t* in, size_t length, uint8_t* out)
+{
+    size_t  code{0}; // position of the current code byte
+    size_t  pos{1};
+    uint8_t run{1};
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (in[i] != 0)
+        {
+            out[pos++] = in[i];
+            ++run;
+        }
+
+        if (in[i] == 0 || run == 0xFF)
+        {
+            out[code] = run;
+            code      = pos++;
+            run       = 1;
+        }
+    }
+    out[code] = run;
+    return pos;
+}
+
+////////////////////////////////
+/// Decoding
+////////////////////////////////
+
+/// Inverse of cobsEncode(), decodes in place
+/// @return decoded length, 0 for a broken frame
+inline size_t cobsDecode(uint8_t* data, size_t length)
+{
+    size_t out{};
+    size_t pos{};
+    while (pos < length)
+    {
+        const uint8_t code{data[pos++]};
+        if (code == 0 || pos + code - 1 > length)
+        {
+            return 0;
+        }
+
+        for (uint8_t i = 1; i < code; ++i)
+        {
+            data[out++] = data[pos++];
+        }
+        if (code != 0xFF && pos < length)
+        {
+            data[out++] = 0;
+        }
+    }
+    return out;
+}
+
+struct Header
+{
+    uint32_t site{};
+    uint32_t millis{};
+    uint8_t  severity{};
+    uint32_t tid{};
+};
+
+struct Arg
+{
+    Tag         tag{};
+    int64_t     i{};
+    uint64_t    u{};
+    float       f{};
+    char        c{};
+    const char* str{};
+    size_t      len{};
+};
+
+/// Reads one record, header first, then the arguments one by one
+class RecordReader
+{
+public:
+    RecordReader(const uint8_t* record, size_t length)
+        : m_in(record), m_end(record + length)
+    {
+    }
+
+    bool header(Header& header)
+    {
+        uint64_t millis{};
+        uint64_t tid{};
+        if (m_end - m_in < 4 + 1 + 1 + 1)
+        {
+            return false;
+        }
+
+        header.site = static_cast<uint32_t>(m_in[0] | (m_in[1] << 8) | (m_in[2] << 16)) | (static_cast<uint32_t>(m_in[3]) << 24);
+        m_in += 4;
+        if (!getVarint(millis) || m_in == m_end)
+        {
+            return false;
+        }
+        header.millis   = static_cast<uint32_t>(millis);
+        header.severity = *m_in++;
+        if (!getVarint(tid))
+        {
+            return false;
+        }
+        header.tid = static_cast<uint32_t>(tid);
+        return true;
+    }
+
+    /// @return false at the end of the record or at a broken argument
+    bool next(Arg& arg)
+    {
+        if (m_in == m_end)
+        {
+            return false;
+        }
+
+        arg.tag = static_cast<Tag>(*m_in++);
+        switch (arg.tag)
+        {
+        case Tag::Signed:
+            if (!getVarint(arg.u))
+            {
+                return false;
+            }
+            arg.i = static_cast<int64_t>((arg.u >> 1) ^ (0U - (arg.u & 1U)));
+            return true;
+        case Tag::Unsigned:
+            return getVarint(arg.u);
+        case Tag::Float:
+        {
+            if (m_end - m_in < 4)
+            {
+                return false;
+            }
+            const uint32_t bits{static_cast<uint32_t>(m_in[0] | (m_in[1] << 8) | (m_in[2] << 16)) | (static_cast<uint32_t>(m_in[3]) << 24)};
+            memcpy(&arg.f, &bits, sizeof(bits));
+            m_in += 4;
+            return true;
+        }
+        case Tag::Char:
+            if (m_in == m_end)
+            {
+                return false;
+            }
+            arg.c = static_cast<char>(*m_in++);
+            return true;
+        case Tag::String:
+        {
+            uint64_t len{};
+            if (!getVarint(len) || len > static_cast<uint64_t>(m_end - m_in))
+            {
+                return false;
+            }
+            arg.str = reinterpret_cast<const char*>(m_in);
+            arg.len = static_cast<size_t>(len);
+            m_in += len;
+            return true;
+        }
+        }
+        return false;
+    }
+
+private:
+    const uint8_t* m_in;
+    const uint8_t* m_end;
+
+    bool getVarint(uint64_t& val)
+    {
+        val = 0;
+        for (uint8_t shift = 0; shift < 70 && m_in != m_end; shift += 7)
+        {
+            const auto byte{*m_in++};
+            val |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+} // namespace LogFormat
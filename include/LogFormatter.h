@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// Kept apart from Logger.h, so the formatting can be checked on the host without the outputs
+#include "LogCapture.h"
+#include "Utilities.h"
+#include <NTPClient.h>
+
+/// Formats a LogEntry into one line of text, in a caller provided buffer
+/// Only used by the drain thread: the date prefix is cached between records, see DateTimeText.
+class hAIR_Formatter
+{
+public:
+    /// Date, millis, severity, thread, function and line, plus the message
+    static constexpr size_t LINE_CAPACITY{DateTimeText::LENGTH + 64 + LogEntry::FUNC_LENGTH + LogEntry::MESSAGE_LENGTH};
+
+    hAIR_Formatter(NTPClient& ntpclient)
+        : ntpclient(ntpclient)
+    {
+    }
+
+    //2004-02-12T15:19:21Z [  12345678] [INFO ] [0] [hAIR_System::job_sda_publish@315] MESSAGE
+    /// @return length of the line, truncated to capacity - 1
+    size_t format(const LogEntry& entry, char* out, size_t capacity)
+    {
+        // The entry may have waited in the queue for a bit, so go back from now to the time it was logged
+        const auto now{millis()};
+        const auto epoch{static_cast<uint32_t>(ntpclient.getEpochTime() - (now - entry.millis) / 1000)};
+
+        LineWriter line{out, capacity};
+        line.put(dateTime.format(epoch)).put(' ');                                            // Time
+        line.put('[').putRight(entry.millis, 10).put("] ");                                   // millis (will rollover after 49.7 days, hence 10 is enough)
+        line.put('[').putLeft(severityToString(plog::Severity(entry.severity)), 5).put("] "); // Severity
+        line.put('[').putUnsigned(entry.tid).put("] ");                                       // Thread ID
+        line.put('[').put(entry.func.data()).put('@').putSigned(entry.line).put("] ");        // Function
+        line.put(entry.message.data());                                                       // Message
+        return line.length();
+    }
+
+private:
+    NTPClient&   ntpclient;
+    DateTimeText dateTime{};
+};
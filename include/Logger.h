@@ -27,103 +27,299 @@
 #pragma once
 
 #include "Display.h"
+#include "JSONWriter.h"
+#include "LogCapture.h"
+#include "LogFormatter.h"
+#include "MPMCQueue.h"
+#include "Metrics.h"
 #include "Utilities.h"
-#include <NTPClient.h>
-#include <WebSocketsServer.h>
-#include <iomanip>
-#include <iostream>
+#include "WebsocketTopics.h"
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
 #include <plog/Appenders/IAppender.h>
 #include <plog/Util.h>
 
-class hAIR_Formatter
+/// Keeps the most recent log output in RAM, so it can be fetched via /logs
+/// Text ring with absolute positions, readers keep their position across calls and skip ahead if they were overwritten
+/// In binary mode the entries are COBS encoded records (see LogFormat.h), which end with 0x00 instead of a newline.
+class LogBuffer
 {
 public:
-    hAIR_Formatter(NTPClient& ntpclient)
-        : ntpclient(ntpclient)
+    static constexpr size_t CAPACITY{8 * 1024};
+
+    void append(const char* str, size_t len)
     {
+        AutoLock lock(m_mtx);
+        for (size_t i = 0; i < len; ++i)
+        {
+            m_data[m_total++ % CAPACITY] = str[i];
+        }
+        m_data[m_total++ % CAPACITY] = m_delimiter;
     }
 
-    plog::util::nstring header() const
+    void setBinary(bool binary)
     {
-        return plog::util::nstring();
+        AutoLock lock(m_mtx);
+        m_delimiter = binary ? '\0' : '\n';
     }
 
-    plog::util::nstring format(const plog::Record& record) const
+    bool isBinary() const
     {
-        const auto  dateTime{getFormattedDate(ntpclient.getEpochTime())};
-        const auto  now{millis()};
-        const auto* severity{severityToString(record.getSeverity())};
-        const auto  threadID{record.getTid()};
-        const auto* func{record.getFunc()};
-        const auto  line{record.getLine()};
-        const auto* message{record.getMessage()};
+        AutoLock lock(m_mtx);
+        return m_delimiter == '\0';
+    }
 
-        // TODO(hsbsw) get threadID/threadName for logging
-        //extern void vTaskGetInfo(TaskHandle_t xTask, TaskStatus_t* pxTaskStatus, BaseType_t xGetFreeStackSpace, eTaskState eState) PRIVILEGED_FUNCTION;
-        //extern void* pxCurrentTCB;
-        //TaskStatus_t xTaskDetails;
-        //vTaskGetInfo(xTaskGetCurrentTaskHandle(),
-        //             &xTaskDetails,
-        //             pdFALSE,   // Include the high water mark in xTaskDetails.
-        //             eRunning); // Include the task state in xTaskDetails.
-        //const auto threadID{xTaskDetails.uxTaskNumber};
-        //const auto threadName{pcTaskGetName(xTaskGetCurrentTaskHandle())};
+    /// Position behind the last line
+    uint32_t end() const
+    {
+        AutoLock lock(m_mtx);
+        return m_total;
+    }
 
-        //2004-02-12T15:19:21+00:00 [  12345678] [INFO ] [0] [hAIR_System::threadFunction_sensorDataDistribution@315] MESSAGE
-        plog::util::nostringstream ss;
-        ss << dateTime.c_str() << PLOG_NSTR(' ')                                                                         // Time
-           << PLOG_NSTR('[') << std::setfill(PLOG_NSTR(' ')) << std::setw(10) << std::right << now << PLOG_NSTR("] ")    // millis (will rollover after 49.7 days, hence 10 is enough)
-           << PLOG_NSTR('[') << std::setfill(PLOG_NSTR(' ')) << std::setw(5) << std::left << severity << PLOG_NSTR("] ") // Severity
-           << PLOG_NSTR('[') << threadID << PLOG_NSTR("] ")                                                              // Thread ID
-           << PLOG_NSTR('[') << func << PLOG_NSTR('@') << line << PLOG_NSTR("] ")                                        // Function
-           << message;                                                                                                   // Message
+    /// Copies from position up to end, a position that has been overwritten already skips ahead to the oldest complete line
+    /// @return bytes copied, position is advanced
+    size_t read(uint32_t& position, uint32_t end, char* out, size_t maxLen) const
+    {
+        AutoLock lock(m_mtx);
 
-        return ss.str();
+        const auto oldest{m_total > CAPACITY ? m_total - CAPACITY : 0};
+        if (position < oldest)
+        {
+            position = oldest;
+            while (position < end && m_data[position++ % CAPACITY] != m_delimiter)
+            {
+            }
+        }
+
+        size_t count{};
+        while (count < maxLen && position < end)
+        {
+            out[count++] = m_data[position++ % CAPACITY];
+        }
+        return count;
     }
 
 private:
-    NTPClient& ntpclient;
+    mutable std::mutex         m_mtx{};
+    std::array<char, CAPACITY> m_data{};
+    uint32_t                   m_total{}; // bytes ever appended
+    char                       m_delimiter{'\n'};
 };
 
+/// 32 * 260 bytes
+using LogQueue = MPMCQueue<LogEntry, 32>;
+
 // All appenders MUST inherit IAppender interface.
-class hAIR_Appender : public plog::IAppender
+/// write() runs on the logging thread and only copies the record into the LogQueue, so logging never waits for Serial, TFT or websocket.
+/// drain() runs on a low priority thread and fans the queued records out.
+/// The PLOG macros arrive as LogEntry (see LogCapture), plog::Record is only left for records that bypass them.
+class hAIR_Appender : public plog::IAppender, public LogSink
 {
 public:
-    hAIR_Appender(hAIR_Formatter& formatter, Display& display, WebSocketsServer& websocket)
-        : formatter(formatter), display(display), websocket(websocket)
+    hAIR_Appender(hAIR_Formatter& formatter, Display& display, WebsocketTopics& websocket, LogBuffer& logBuffer, Metrics& metrics)
+        : formatter(formatter), display(display), websocket(websocket), logBuffer(logBuffer), metrics(metrics)
     {
     }
 
     // This is a method from IAppender that MUST be implemented.
     virtual void write(const plog::Record& record)
     {
+        metrics.countLogRecord(record.getSeverity());
+
+        const auto now{millis()};
+        queue.push([&](LogEntry& entry)
+                   {
+                       entry.severity = static_cast<uint8_t>(record.getSeverity());
+                       entry.tid      = record.getTid();
+                       entry.millis   = now;
+                       entry.line     = static_cast<int32_t>(record.getLine());
+                       copyTruncated(entry.func, record.getFunc());
+                       copyTruncated(entry.message, record.getMessage());
+                   });
+
+        notifyDrain();
+    }
+
+    virtual void write(const LogEntry& captured)
+    {
+        metrics.countLogRecord(plog::Severity(captured.severity));
+
+        queue.push([&](LogEntry& entry)
+                   {
+                       entry = captured;
+                   });
+
+        notifyDrain();
+    }
+
+    /// Called after every write(), e.g. to wake the drain thread
+    void setDrainNotifier(std::function<void()> notifier)
+    {
+        drainNotifier = std::move(notifier);
+    }
+
+    void setPolicy(LogQueue::Policy policy)
+    {
+        queue.setPolicy(policy);
+    }
+
+    /// Binary log records instead of text on Serial, /logs and the websocket, see LogFormat.h
+    void setBinary(bool enable)
+    {
+        binary.store(enable, std::memory_order_relaxed);
+        logBuffer.setBinary(enable);
+        LogCapture::setBinary(enable);
+    }
+
+    /// Only from the drain thread, outputs everything that is queued
+    void drain()
+    {
+        const auto dropped{queue.getDropped()};
+        if (dropped != reportedDropped)
+        {
+            metrics.countLogDropped(dropped - reportedDropped);
+
+            drained          = {};
+            drained.severity = plog::warning;
+            drained.millis   = millis();
+            copyTruncated(drained.func, __FUNCTION__);
+            snprintf(drained.message.data(), drained.message.size(), "%u log records dropped, the log queue was full", static_cast<unsigned>(dropped - reportedDropped));
+            output(drained);
+
+            reportedDropped = dropped;
+        }
+
+        while (queue.pop(drained))
+        {
+            output(drained);
+        }
+    }
+
+private:
+    hAIR_Formatter&  formatter;
+    Display&         display;
+    WebsocketTopics& websocket;
+    LogBuffer&       logBuffer;
+    Metrics&         metrics;
+
+    LogQueue              queue{};
+    std::function<void()> drainNotifier{};
+    uint32_t              reportedDropped{};
+    std::atomic<bool>     binary{false};
+
+    // Scratch of the drain thread, too big for its stack to be used per record
+    LogEntry                                                       drained{};
+    std::array<char, hAIR_Formatter::LINE_CAPACITY>                line{};
+    std::array<char, 2 * hAIR_Formatter::LINE_CAPACITY + 24>       json{};   // every character may need escaping
+    std::array<uint8_t, LogEntry::RECORD_CAPACITY>                 record{};
+    std::array<uint8_t, LogEntry::RECORD_CAPACITY * 255 / 254 + 2> framed{}; // COBS adds a byte per 254
+
+    void notifyDrain()
+    {
+        if (drainNotifier)
+        {
+            drainNotifier();
+        }
+    }
+
+    template<size_t N>
+    static void copyTruncated(std::array<char, N>& out, const char* str)
+    {
+        size_t len{};
+        while (len < N - 1 && str[len] != '\0')
+        {
+            out[len] = str[len];
+            ++len;
+        }
+        out[len] = '\0';
+    }
+
+    void output(const LogEntry& entry)
+    {
+        if (binary.load(std::memory_order_relaxed))
+        {
+            outputBinary(entry);
+            return;
+        }
+
         // Use the formatter to get a string from a record.
-        plog::util::nstring str = formatter.format(record);
+        const auto length{formatter.format(entry, line.data(), line.size())};
 
         // Log to Serial
-        Serial.println(str.c_str());
+        Serial.write(reinterpret_cast<const uint8_t*>(line.data()), length);
+        Serial.println();
+
+        // Log to RAM, see /logs
+        logBuffer.append(line.data(), length);
 
         // Log to Display
-        if (record.getSeverity() <= plog::error)
+        if (entry.severity <= plog::error)
         {
-            display.printErrorMessage(str.c_str());
+            display.printErrorMessage(line.data());
         }
         else
         {
-            display.printDebugMessage(str.c_str());
+            display.printDebugMessage(line.data());
         }
 
         // Log to WebSocket
-        plog::util::nostringstream ss;
-        ss << "{\"logMessage\":\""
-           << str
-           << "\"}";
-        const auto jsonStr = ss.str();
-        websocket.broadcastTXT(jsonStr.c_str(), jsonStr.size());
+        JSONWriter writer{json};
+        writer.beginObject().member("logMessage", static_cast<const char*>(line.data())).endObject();
+        if (!writer.overflow())
+        {
+            websocket.publishLog(writer.c_str(), writer.length());
+        }
     }
 
-private:
-    hAIR_Formatter&   formatter;
-    Display&          display;
-    WebSocketsServer& websocket;
+    /// Serial and /logs get the COBS encoded record, the websocket gets it as it is
+    void outputBinary(const LogEntry& entry)
+    {
+        auto length{LogFormat::putHeader(record.data(), entry.site, entry.millis, entry.severity, entry.tid)};
+        if (entry.site != LogFormat::TEXT_SITE)
+        {
+            memcpy(record.data() + length, entry.message.data(), entry.length);
+            length += entry.length;
+        }
+        else
+        {
+            LogFormat::ArgWriter args{record.data() + length, record.size() - length};
+            args.putString(entry.func.data(), strlen(entry.func.data()));
+            args.putSigned(entry.line);
+            args.putString(entry.message.data(), strlen(entry.message.data()));
+            length += args.length();
+        }
+
+        // Log to Serial
+        const auto framedLength{LogFormat::cobsEncode(record.data(), length, framed.data())};
+        Serial.write(framed.data(), framedLength);
+        Serial.write(static_cast<uint8_t>(0));
+
+        // Log to RAM, see /logs
+        logBuffer.append(reinterpret_cast<const char*>(framed.data()), framedLength);
+
+        // Log to Display, it cannot decode the record, so it only shows where the record came from
+        LineWriter text{line.data(), line.size()};
+        text.put('[').putLeft(severityToString(plog::Severity(entry.severity)), 5).put("] ");
+        if (entry.site != LogFormat::TEXT_SITE)
+        {
+            text.put("site ").putHex(entry.site);
+        }
+        else
+        {
+            text.put(entry.message.data());
+        }
+        if (entry.severity <= plog::error)
+        {
+            display.printErrorMessage(line.data());
+        }
+        else
+        {
+            display.printDebugMessage(line.data());
+        }
+
+        // Log to WebSocket
+        websocket.publishLog(record.data(), length);
+    }
 };
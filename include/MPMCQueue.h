@@ -0,0 +1,181 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// No Arduino includes on purpose, so the queue can be checked on the host
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/// Bounded lock-free multi producer / multi consumer queue (Dmitry Vyukov's design)
+/// Every slot carries a sequence number, which tells producers and consumers whether the slot is theirs for the current lap.
+/// A push or pop is one CAS plus a copy, independent of how many elements are queued and of what the other threads do
+/// (a CAS may be retried under contention, but nobody ever waits for a lock holder).
+///
+/// When the queue is full, push() either drops the new element or makes room by dropping the oldest one, see Policy.
+template<typename T, size_t N>
+class MPMCQueue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N has to be a power of two");
+
+public:
+    enum class Policy : uint8_t
+    {
+        DropNewest, // keep what is queued, e.g. the start of an error burst
+        DropOldest, // keep the most recent elements
+    };
+
+    MPMCQueue()
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+    void setPolicy(Policy policy)
+    {
+        m_policy.store(policy, std::memory_order_relaxed);
+    }
+
+    /// Fills a free slot in place, fill(T&) must not block
+    /// @return false if the element was dropped (DropNewest and full)
+    template<typename F>
+    bool push(F&& fill)
+    {
+        // With DropOldest, every failed attempt frees one slot, a few attempts are plenty unless the oldest slot is held
+        // by a thread that was preempted mid-pop or mid-push, then we drop the new element instead of waiting for it
+        constexpr uint8_t MAX_ATTEMPTS{4};
+
+        for (uint8_t attempt = 0; attempt < MAX_ATTEMPTS; ++attempt)
+        {
+            Cell* cell{claim(m_enqueuePos, 0)};
+            if (cell != nullptr)
+            {
+                const auto pos{cell->sequence.load(std::memory_order_relaxed)};
+                fill(cell->data);
+                cell->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+            if (m_policy.load(std::memory_order_relaxed) == Policy::DropNewest || !discard())
+            {
+                break;
+            }
+        }
+
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    /// @return false if the queue is empty
+    bool pop(T& out)
+    {
+        Cell* cell{claim(m_dequeuePos, 1)};
+        if (cell == nullptr)
+        {
+            return false;
+        }
+
+        const auto pos{cell->sequence.load(std::memory_order_relaxed) - 1};
+        out = cell->data;
+        cell->sequence.store(pos + N, std::memory_order_release);
+        return true;
+    }
+
+    /// Elements dropped by push() in total, either new ones or old ones that were discarded for them
+    uint32_t getDropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    static constexpr size_t capacity()
+    {
+        return N;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T                   data;
+    };
+
+    std::array<Cell, N>   m_cells{};
+    std::atomic<size_t>   m_enqueuePos{0};
+    std::atomic<size_t>   m_dequeuePos{0};
+    std::atomic<uint32_t> m_dropped{0};
+    std::atomic<Policy>   m_policy{Policy::DropNewest};
+
+    /// Claims the cell at position by advancing position
+    /// A producer (offset 0) owns a cell whose sequence equals the position, a consumer (offset 1) one whose sequence is one ahead.
+    /// @return nullptr if the queue is full (producer) or empty (consumer)
+    Cell* claim(std::atomic<size_t>& position, size_t offset)
+    {
+        auto pos{position.load(std::memory_order_relaxed)};
+        while (true)
+        {
+            Cell&      cell{m_cells[pos & (N - 1)]};
+            const auto sequence{cell.sequence.load(std::memory_order_acquire)};
+            const auto diff{static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + offset)};
+            if (diff == 0)
+            {
+                if (position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    return &cell;
+                }
+            }
+            else if (diff < 0)
+            {
+                return nullptr;
+            }
+            else
+            {
+                pos = position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// Pops the oldest element without copying it, the caller counts it as dropped
+    bool discard()
+    {
+        Cell* cell{claim(m_dequeuePos, 1)};
+        if (cell == nullptr)
+        {
+            return false;
+        }
+
+        const auto pos{cell->sequence.load(std::memory_order_relaxed) - 1};
+        cell->sequence.store(pos + N, std::memory_order_release);
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+};
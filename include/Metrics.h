@@ -0,0 +1,354 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <Arduino.h>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <plog/Severity.h>
+
+/// Counters for /metrics that are not kept anywhere else (the tasks count in their TaskItem, see TaskStats)
+/// Incremented from any thread. Relaxed atomics are enough, a scrape only needs each counter to be monotonic.
+class Metrics
+{
+public:
+    /// Topics of the websocket, see WebsocketTopics
+    enum class Websocket
+    {
+        SensorData,
+        LogMessages,
+        COUNT
+    };
+
+    static constexpr size_t SEVERITY_COUNT{plog::verbose + 1};
+
+    void countLogRecord(plog::Severity severity)
+    {
+        if (static_cast<size_t>(severity) < SEVERITY_COUNT)
+        {
+            m_logRecords[severity].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void countLogDropped(uint32_t records)
+    {
+        m_logDropped.fetch_add(records, std::memory_order_relaxed);
+    }
+
+    void countWebsocketBytes(Websocket websocket, size_t bytes)
+    {
+        m_websocketBytes[static_cast<size_t>(websocket)].fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void countWebsocketDropped(Websocket websocket, size_t messages)
+    {
+        m_websocketDropped[static_cast<size_t>(websocket)].fetch_add(messages, std::memory_order_relaxed);
+    }
+
+    void setWebsocketClients(Websocket websocket, uint32_t clients)
+    {
+        m_websocketClients[static_cast<size_t>(websocket)].store(clients, std::memory_order_relaxed);
+    }
+
+    uint32_t getLogRecords(plog::Severity severity) const
+    {
+        return m_logRecords[severity].load(std::memory_order_relaxed);
+    }
+
+    uint32_t getLogDropped() const
+    {
+        return m_logDropped.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getWebsocketBytes(Websocket websocket) const
+    {
+        return m_websocketBytes[static_cast<size_t>(websocket)].load(std::memory_order_relaxed);
+    }
+
+    uint32_t getWebsocketDropped(Websocket websocket) const
+    {
+        return m_websocketDropped[static_cast<size_t>(websocket)].load(std::memory_order_relaxed);
+    }
+
+    uint32_t getWebsocketClients(Websocket websocket) const
+    {
+        return m_websocketClients[static_cast<size_t>(websocket)].load(std::memory_order_relaxed);
+    }
+
+    ////////////////////////////////
+    /// Display
+    ////////////////////////////////
+
+    /// @param bytes pixel data sent to the display, @param micros time spent in Display::printSensorData()
+    void countDisplayFrame(uint32_t bytes, uint32_t micros)
+    {
+        m_displayFrames.fetch_add(1, std::memory_order_relaxed);
+        m_displayBytes.fetch_add(bytes, std::memory_order_relaxed);
+        m_displayMicros.fetch_add(micros, std::memory_order_relaxed);
+        m_displayLastFrameMicros.store(micros, std::memory_order_relaxed);
+    }
+
+    uint32_t getDisplayFrames() const
+    {
+        return m_displayFrames.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getDisplayBytes() const
+    {
+        return m_displayBytes.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getDisplayMicros() const
+    {
+        return m_displayMicros.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getDisplayLastFrameMicros() const
+    {
+        return m_displayLastFrameMicros.load(std::memory_order_relaxed);
+    }
+
+    ////////////////////////////////
+    /// MQTT
+    ////////////////////////////////
+
+    /// @param samples in a message that was published (QoS 0) or acknowledged (QoS 1)
+    void countMqttPublished(uint32_t samples)
+    {
+        m_mqttMessages.fetch_add(1, std::memory_order_relaxed);
+        m_mqttSamples.fetch_add(samples, std::memory_order_relaxed);
+    }
+
+    /// @param millis from publishing a QoS 1 message to its PUBACK
+    void countMqttAck(uint32_t millis)
+    {
+        m_mqttAckMillis.fetch_add(millis, std::memory_order_relaxed);
+    }
+
+    void countMqttDropped(uint32_t samples)
+    {
+        m_mqttDropped.fetch_add(samples, std::memory_order_relaxed);
+    }
+
+    /// @param samples in the RAM queue, @param spilledBytes in the spill file
+    void setMqttQueued(uint32_t samples, uint32_t spilledBytes)
+    {
+        m_mqttQueued.store(samples, std::memory_order_relaxed);
+        m_mqttSpilledBytes.store(spilledBytes, std::memory_order_relaxed);
+    }
+
+    uint32_t getMqttMessages() const
+    {
+        return m_mqttMessages.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getMqttSamples() const
+    {
+        return m_mqttSamples.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getMqttAckMillis() const
+    {
+        return m_mqttAckMillis.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getMqttDropped() const
+    {
+        return m_mqttDropped.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getMqttQueued() const
+    {
+        return m_mqttQueued.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getMqttSpilledBytes() const
+    {
+        return m_mqttSpilledBytes.load(std::memory_order_relaxed);
+    }
+
+    ////////////////////////////////
+    /// InfluxDB
+    ////////////////////////////////
+
+    /// @param lineBytes uncompressed, @param bodyBytes gzipped, @param millis of the request
+    void countInfluxUploaded(uint32_t samples, uint32_t lineBytes, uint32_t bodyBytes, uint32_t millis)
+    {
+        m_influxSamples.fetch_add(samples, std::memory_order_relaxed);
+        m_influxLineBytes.fetch_add(lineBytes, std::memory_order_relaxed);
+        m_influxBodyBytes.fetch_add(bodyBytes, std::memory_order_relaxed);
+        m_influxRequestMillis.fetch_add(millis, std::memory_order_relaxed);
+    }
+
+    void countInfluxFailed()
+    {
+        m_influxFailed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void countInfluxDropped(uint32_t samples)
+    {
+        m_influxDropped.fetch_add(samples, std::memory_order_relaxed);
+    }
+
+    void setInfluxOutbox(uint32_t batches, uint32_t bytes)
+    {
+        m_influxOutboxBatches.store(batches, std::memory_order_relaxed);
+        m_influxOutboxBytes.store(bytes, std::memory_order_relaxed);
+    }
+
+    uint32_t getInfluxSamples() const
+    {
+        return m_influxSamples.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getInfluxLineBytes() const
+    {
+        return m_influxLineBytes.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getInfluxBodyBytes() const
+    {
+        return m_influxBodyBytes.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getInfluxRequestMillis() const
+    {
+        return m_influxRequestMillis.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getInfluxFailed() const
+    {
+        return m_influxFailed.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getInfluxDropped() const
+    {
+        return m_influxDropped.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getInfluxOutboxBatches() const
+    {
+        return m_influxOutboxBatches.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getInfluxOutboxBytes() const
+    {
+        return m_influxOutboxBytes.load(std::memory_order_relaxed);
+    }
+
+    ////////////////////////////////
+    /// HTTP
+    ////////////////////////////////
+
+    // Not thread safe, the webserver handlers all run in the async_tcp task (including the one rendering /metrics)
+
+    static constexpr size_t ROUTE_CAPACITY{24};
+    static constexpr auto   ROUTE_OTHER{"(other)"};
+
+    /// Routes beyond the capacity share the last counter, so random URLs can't grow the table
+    void countRequest(const char* route)
+    {
+        for (size_t i = 0; i < m_routeCount; ++i)
+        {
+            if (strcmp(m_routes[i].name.data(), route) == 0)
+            {
+                ++m_routes[i].requests;
+                return;
+            }
+        }
+
+        if (m_routeCount == ROUTE_CAPACITY)
+        {
+            ++m_routes[ROUTE_CAPACITY - 1].requests;
+            return;
+        }
+
+        auto&       counter{m_routes[m_routeCount++]};
+        const auto* name{m_routeCount == ROUTE_CAPACITY ? ROUTE_OTHER : route};
+        strncpy(counter.name.data(), name, counter.name.size() - 1);
+        for (auto& c : counter.name)
+        {
+            // it ends up as label value, which must not contain quotes, backslashes or newlines
+            if (c == '"' || c == '\\' || c == '\n')
+            {
+                c = '_';
+            }
+        }
+        counter.requests = 1;
+    }
+
+    size_t getRouteCount() const
+    {
+        return m_routeCount;
+    }
+
+    const char* getRoute(size_t index) const
+    {
+        return m_routes[index].name.data();
+    }
+
+    uint32_t getRequests(size_t index) const
+    {
+        return m_routes[index].requests;
+    }
+
+private:
+    static constexpr size_t WEBSOCKET_COUNT{static_cast<size_t>(Websocket::COUNT)};
+
+    struct RouteCounter
+    {
+        std::array<char, 32> name;
+        uint32_t             requests;
+    };
+
+    std::array<std::atomic<uint32_t>, WEBSOCKET_COUNT> m_websocketClients{};
+    std::array<std::atomic<uint32_t>, WEBSOCKET_COUNT> m_websocketBytes{};
+    std::array<std::atomic<uint32_t>, WEBSOCKET_COUNT> m_websocketDropped{};
+    std::array<std::atomic<uint32_t>, SEVERITY_COUNT>  m_logRecords{};
+    std::atomic<uint32_t>                              m_logDropped{};
+    std::atomic<uint32_t>                              m_displayFrames{};
+    std::atomic<uint32_t>                              m_displayBytes{};
+    std::atomic<uint32_t>                              m_displayMicros{};
+    std::atomic<uint32_t>                              m_displayLastFrameMicros{};
+    std::atomic<uint32_t>                              m_mqttMessages{};
+    std::atomic<uint32_t>                              m_mqttSamples{};
+    std::atomic<uint32_t>                              m_mqttAckMillis{};
+    std::atomic<uint32_t>                              m_mqttDropped{};
+    std::atomic<uint32_t>                              m_mqttQueued{};
+    std::atomic<uint32_t>                              m_mqttSpilledBytes{};
+    std::atomic<uint32_t>                              m_influxSamples{};
+    std::atomic<uint32_t>                              m_influxLineBytes{};
+    std::atomic<uint32_t>                              m_influxBodyBytes{};
+    std::atomic<uint32_t>                              m_influxRequestMillis{};
+    std::atomic<uint32_t>                              m_influxFailed{};
+    std::atomic<uint32_t>                              m_influxDropped{};
+    std::atomic<uint32_t>                              m_influxOutboxBatches{};
+    std::atomic<uint32_t>                              m_influxOutboxBytes{};
+    std::array<RouteCounter, ROUTE_CAPACITY>           m_routes{};
+    size_t                                             m_routeCount{};
+};
@@ -0,0 +1,168 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ArchiveFormat.h"
+#include "Metrics.h"
+#include "SensorData.h"
+#include "Utilities.h"
+#include <Arduino.h>
+#include <AsyncMqttClient.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <new>
+
+/// Publishes the sensor samples and health metrics to an MQTT broker (building management, Home Assistant, ...)
+///
+/// Topics below the configured prefix:
+///   <prefix>/status   "online" or "offline" (retained, the latter is the last will)
+///   <prefix>/samples  {"samples":[{"timestamp":..,"TVOC":..,..},..]} with up to batchSize samples
+///   <prefix>/state    the latest sample (retained), what Home Assistant shows
+///   <prefix>/health   uptime, heap, WiFi and the state of the queue, every mqtt.healthInterval seconds (0 => never)
+/// Home Assistant discovery goes to homeassistant/sensor/<device id>/<channel>/config.
+///
+/// Samples wait in a bounded RAM queue until they are published (QoS 0) or acknowledged (QoS 1).
+/// While WiFi or the broker is down the queue fills up. Once it is full, new samples go to SPILL_FILE (if spillSize > 0),
+/// and once that is full as well, new samples are dropped. After a reconnect the backlog drains at drainRate messages
+/// per second, oldest first, and the spill file is read back as the RAM queue makes room (it also survives a reboot).
+///
+/// Everything runs on the loop thread except for the callbacks of the client, which only set atomics.
+class MqttPublisher
+{
+public:
+    static constexpr auto   SPILL_FILE{"/mqtt_spill.bin"};
+    static constexpr size_t MAX_BATCH_SIZE{20};
+
+    struct Settings
+    {
+        String   host;           // empty disables MQTT
+        uint16_t port;
+        String   user;           // empty => no credentials
+        String   password;
+        String   topic;          // prefix of all topics
+        uint8_t  qos;            // of the samples, 0 or 1
+        size_t   batchSize;      // [samples] per message, at most MAX_BATCH_SIZE
+        uint32_t batchDelay;     // [s] a partial batch goes out once its oldest sample is that old
+        size_t   queueSize;      // [samples] in RAM
+        size_t   spillSize;      // [bytes] of SPILL_FILE, 0 disables it
+        float    drainRate;      // [messages/s]
+        bool     discovery;      // Home Assistant discovery
+    };
+
+    explicit MqttPublisher(Metrics& metrics)
+        : m_metrics(metrics)
+    {
+    }
+
+    /// @return false if the queue could not be allocated, true if MQTT is disabled
+    bool init(const Settings& settings);
+
+    bool isEnabled() const
+    {
+        return m_enabled;
+    }
+
+    /// Queues one sample, ignored until the clock has been set via NTP
+    /// @param epoch [unix seconds] UTC, see getUnixTime()
+    void add(uint32_t epoch, const SensorData& data);
+
+    /// (Re)connects and publishes whatever is due
+    /// @param epoch [unix seconds] UTC, see getUnixTime()
+    void poll(Timestamp now, uint32_t epoch);
+
+    void publishHealth();
+
+
+private:
+    static constexpr Timestamp ACK_TIMEOUT{10000};       // [ms] a QoS 1 message without PUBACK is sent again
+    static constexpr Timestamp RECONNECT_MIN_DELAY{2000}; // [ms] doubles with every failed attempt
+    static constexpr Timestamp RECONNECT_MAX_DELAY{60000};
+
+    // {"timestamp":4294967295,"TVOC":65535,..}
+    static constexpr size_t SAMPLE_CAPACITY{160};
+    static constexpr size_t PAYLOAD_CAPACITY{16 + MAX_BATCH_SIZE * SAMPLE_CAPACITY};
+
+    Metrics&        m_metrics;
+    AsyncMqttClient m_client{};
+    bool            m_enabled{false};
+    Settings        m_settings{};
+
+    // The client keeps the pointers, so these must not change after init()
+    String m_clientId{};
+    String m_topicStatus{};
+    String m_topicSamples{};
+    String m_topicState{};
+    String m_topicHealth{};
+
+    // Set by the callbacks of the client
+    std::atomic<bool>     m_connected{false};
+    std::atomic<bool>     m_sessionStarted{false};
+    std::atomic<uint16_t> m_ackedPacket{};
+
+    // Connection
+    Timestamp m_nextConnect{};
+    Timestamp m_reconnectDelay{RECONNECT_MIN_DELAY};
+    size_t    m_discoveryNext{ArchiveFormat::CHANNEL_COUNT}; // next channel to announce, CHANNEL_COUNT => done
+    bool      m_statusPending{false};
+    uint32_t  m_sessions{};
+
+    // RAM queue, the first m_inFlight samples have been published and wait for their PUBACK
+    std::unique_ptr<ArchiveFormat::Record[]> m_queue{};
+    size_t                                   m_head{};
+    size_t                                   m_count{};
+    size_t                                   m_inFlight{};
+    uint16_t                                 m_inFlightPacket{};
+    Timestamp                                m_inFlightSince{};
+    Timestamp                                m_nextPublish{};
+
+    // Spill file, records in ArchiveFormat (every one of them absolute), read from m_spillRead on
+    bool                                                    m_spilling{false};
+    size_t                                                  m_spillRead{};
+    size_t                                                  m_spillWritten{};
+    ArchiveFormat::Encoder                                  m_encoder{};
+    std::array<uint8_t, 8 * ArchiveFormat::MAX_RECORD_SIZE> m_spillBuffer{};
+
+    std::array<char, PAYLOAD_CAPACITY> m_payload{};
+
+    void connect(Timestamp now);
+    bool publishStatus();
+    bool publishDiscovery();
+    bool publishBatch(Timestamp now, uint32_t epoch);
+    void publishState(const ArchiveFormat::Record& record);
+
+    void completeInFlight(Timestamp now);
+    void push(const ArchiveFormat::Record& record);
+    bool spill(const ArchiveFormat::Record& record);
+    void refill();
+    void removeSpill();
+
+    ArchiveFormat::Record& at(size_t index)
+    {
+        return m_queue[(m_head + index) % m_settings.queueSize];
+    }
+};
@@ -0,0 +1,161 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// No Arduino includes on purpose, the driver runs on the host against a mocked I2CBus
+#include "I2CBus.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/// Sensirion SGP30 gas sensor (TVOC and eCO2), without waiting for its conversions
+///
+/// Every measurement is split into an issue and a collect phase. The first call writes the command and returns
+/// Status::Pending, the caller comes back at readyAt() (see TaskItem::runExtraAt) and gets the result.
+/// In between the thread is free for other jobs, instead of sitting in a delay for the 12 ms (air quality)
+/// or 25 ms (raw signals) the sensor converts.
+///
+/// The sensor takes one command at a time. A measurement that finds another one converting gets Status::Busy and
+/// comes back at readyAt() as well. A result that is due is read by whichever call comes first and kept for its owner.
+///
+/// The absolute humidity for the on-chip compensation is cached, set_absolute_humidity only goes out
+/// (before the next air quality measurement) if its 8.8 fixed point word changed.
+///
+/// Times are [ms] like millis(), see the datasheet linked in hAIR.h for the commands.
+class SGP30
+{
+public:
+    static constexpr uint8_t ADDRESS{0x58};
+
+    enum class Status
+    {
+        Pending, // issued, call again at readyAt() for the result
+        Busy,    // another command converts, call again at readyAt()
+        Done,    // the result is there
+        Failed,  // no ACK or CRC mismatch
+    };
+
+    /// Blocks, sleeps the given milliseconds (delay() on the target)
+    using Delay = void (*)(uint32_t);
+
+    explicit SGP30(I2CBus& bus)
+        : m_bus(bus)
+    {
+    }
+
+    /// Blocking (~30 ms) for the setup: checks serial id and feature set, then starts the air quality algorithm
+    bool begin(Delay delay);
+
+    /// Blocking, restores the baseline of an earlier run (see getBaseline())
+    bool setBaseline(uint16_t eCO2, uint16_t TVOC, Delay delay);
+
+    /// @param eCO2 [ppm], @param TVOC [ppb], both only set on Status::Done
+    Status measureAirQuality(int32_t now, uint16_t& eCO2, uint16_t& TVOC);
+
+    /// Raw signals of the H2 and ethanol sensing elements
+    Status measureRawSignals(int32_t now, uint16_t& rawH2, uint16_t& rawEthanol);
+
+    /// Baseline of the compensation algorithm, worth storing every once in a while
+    Status getBaseline(int32_t now, uint16_t& eCO2, uint16_t& TVOC);
+
+    /// Takes effect with the next air quality measurement, 0 switches the compensation off
+    /// @param absoluteHumidity [mg/m^3]
+    /// @return false if out of range (256 g/m^3 and above)
+    bool setAbsoluteHumidity(uint32_t absoluteHumidity);
+
+    /// [ms] when the command in flight is done
+    int32_t readyAt() const
+    {
+        return m_readyAt;
+    }
+
+    uint64_t getSerialId() const
+    {
+        return m_serialId;
+    }
+
+    /// CRC-8 of the sensor, polynomial 0x31, init 0xFF
+    static uint8_t crc8(const uint8_t* data, size_t length);
+
+private:
+    static constexpr size_t MAX_WORDS{3};
+
+    enum Command : uint8_t
+    {
+        None,
+        GetSerialId,
+        GetFeatureSet,
+        InitAirQuality,
+        MeasureAirQuality,
+        MeasureRawSignals,
+        GetBaseline,
+        SetBaseline,
+        SetHumidity,
+        COMMAND_COUNT
+    };
+
+    struct CommandInfo
+    {
+        uint16_t code;
+        uint8_t  duration; // [ms] max. conversion time
+        uint8_t  words;    // in the response
+    };
+
+    // Same order as Command
+    static constexpr std::array<CommandInfo, COMMAND_COUNT> COMMANDS{{
+        {0x0000, 0, 0},
+        {0x3682, 1, 3},
+        {0x202F, 10, 1},
+        {0x2003, 10, 0},
+        {0x2008, 12, 2},
+        {0x2050, 25, 2},
+        {0x2015, 10, 2},
+        {0x201E, 10, 0},
+        {0x2061, 10, 0},
+    }};
+
+    struct Result
+    {
+        bool                            complete{false};
+        bool                            valid{false};
+        std::array<uint16_t, MAX_WORDS> words{};
+    };
+
+    I2CBus&                           m_bus;
+    Command                           m_inFlight{None};
+    int32_t                           m_readyAt{};
+    std::array<Result, COMMAND_COUNT> m_results{};  // collected, not yet handed out
+    uint16_t                          m_humidity{}; // [g/m^3] 8.8 fixed point
+    bool                              m_humidityChanged{false};
+    uint64_t                          m_serialId{};
+
+    Status measure(Command command, int32_t now, uint16_t& first, uint16_t& second);
+    bool   issue(Command command, int32_t now, const uint16_t* params = nullptr, size_t count = 0);
+    void   collect();
+    bool   execute(Command command, Delay delay, uint16_t* words = nullptr, const uint16_t* params = nullptr, size_t count = 0);
+    bool   readWords(uint16_t* words, size_t count);
+};
@@ -0,0 +1,215 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "JSONWriter.h"
+#include "Utilities.h"
+#include <Arduino.h>
+#include <atomic>
+#include <esp_timer.h>
+#include <functional>
+#include <vector>
+
+/// Time source of a Scheduler, the host tests substitute a virtual clock
+class SchedulerClock
+{
+public:
+    virtual ~SchedulerClock() = default;
+
+    /// Binds the clock to the calling thread, which is the one that sleeps and gets woken
+    virtual void attach() = 0;
+
+    /// [us], monotonic
+    virtual int64_t now() = 0;
+
+    /// Blocks until deadline [us] or until wake() was called, whatever comes first
+    virtual void sleepUntil(int64_t deadline) = 0;
+
+    /// Thread safe, a wake() before sleepUntil() makes the next sleepUntil() return immediately
+    virtual void wake() = 0;
+
+    /// [bytes] stack of the attached thread that was never used, 0 if unknown
+    virtual uint32_t getStackHighWaterMark() const
+    {
+        return 0;
+    }
+};
+
+/// esp_timer for the time, the FreeRTOS task notification for sleeping and waking
+class RTOSClock : public SchedulerClock
+{
+public:
+    void attach() override
+    {
+        m_task = xTaskGetCurrentTaskHandle();
+    }
+
+    int64_t now() override
+    {
+        return esp_timer_get_time();
+    }
+
+    void sleepUntil(int64_t deadline) override
+    {
+        const auto remaining{deadline - now()};
+        if (remaining > 0)
+        {
+            // Round up, waking a tick early would only cost another pass that finds nothing due
+            const auto ticks{(remaining + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000)};
+            ulTaskNotifyTake(pdTRUE, static_cast<TickType_t>(ticks));
+        }
+    }
+
+    void wake() override
+    {
+        const auto task{m_task.load()};
+        if (task != nullptr)
+        {
+            xTaskNotifyGive(task);
+        }
+    }
+
+    uint32_t getStackHighWaterMark() const override
+    {
+        // StackType_t is a byte on the ESP32, so this is [bytes] already
+        const auto task{m_task.load()};
+        return task != nullptr ? uxTaskGetStackHighWaterMark(task) : 0;
+    }
+
+private:
+    std::atomic<TaskHandle_t> m_task{nullptr};
+};
+
+/// Runs the jobs of one thread at the deadlines of their TaskItems
+/// The deadlines are kept in a min-heap, so a pass only touches the jobs that are due and the thread sleeps until the
+/// earliest deadline (or until notify()) instead of polling every task at a fixed rate.
+/// Periods are phase locked (see TaskItem::advance), a job that ran late does not shift the following runs.
+///
+/// Every run is recorded in the TaskStats of its TaskItem (lateness, duration, overruns, skipped periods).
+///
+/// Jobs are added before start(), after that a Scheduler is only used from its own thread (notify() and the stats aside).
+class Scheduler
+{
+public:
+    /// @param now [ms] like millis(), so the jobs can keep using TaskItem::updateSuccess(), dt_max(), ...
+    using Job = std::function<void(Timestamp now)>;
+
+    /// Longest sleep even if nothing is due, keeps a lost wake up from stalling the thread for good
+    static constexpr int64_t MAX_SLEEP{1000000}; // [us]
+
+    /// @param name of the thread, for the stats
+    Scheduler(const char* name, SchedulerClock& clock)
+        : m_name(name), m_clock(clock)
+    {
+    }
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    /// Tasks with a period of 0 are disabled, unless runOnNotify is set
+    /// @param name for the stats, has to outlive the scheduler (string literal)
+    /// @param runOnNotify also run the job on every notify(), independent of its period
+    void add(const char* name, TaskItem& task, Job job, bool runOnNotify = false);
+
+    /// Runs after every pass that ran at least one job, e.g. to publish what the jobs produced
+    void setPassHook(Job hook);
+
+    /// Attaches the clock to the calling thread and schedules the first deadlines
+    void start();
+
+    /// Runs the due jobs, then sleeps until the next deadline or notification
+    void runOnce();
+
+    /// start() and runOnce() forever, signature fits xTaskCreatePinnedToCore (param is the Scheduler)
+    static void run(void* scheduler);
+
+    /// Thread safe, wakes the scheduler and runs the runOnNotify jobs
+    void notify();
+
+    ////////////////////////////////
+    /// Stats
+    ////////////////////////////////
+
+    /// Thread safe, the stats are cleared by the scheduler thread at its next pass
+    void resetStats();
+
+    /// {"name":..,"tasks":[{"name":..,"period":..,"runs":..,"rate":..,"skipped":..,"overruns":..,"lateness":{..},"duration":{..}},..]}
+    /// Times are [us], lateness and duration are {"p50":..,"p90":..,"p99":..,"max":..}
+    void toJSON(JSONWriter& writer) const;
+
+    /// Same as toJSON(), as table for the serial console
+    void printStats(Print& out) const;
+
+    const char* getName() const
+    {
+        return m_name;
+    }
+
+    /// [bytes], see SchedulerClock::getStackHighWaterMark()
+    uint32_t getStackHighWaterMark() const
+    {
+        return m_clock.getStackHighWaterMark();
+    }
+
+    /// The tasks in the order they were added, for other exports (see /metrics)
+    size_t getTaskCount() const
+    {
+        return m_entries.size();
+    }
+
+    const char* getTaskName(size_t index) const
+    {
+        return m_entries[index].name;
+    }
+
+    const TaskItem& getTask(size_t index) const
+    {
+        return *m_entries[index].task;
+    }
+
+private:
+    struct Entry
+    {
+        const char* name;
+        TaskItem*   task;
+        Job         job;
+        bool        runOnNotify;
+    };
+
+    const char*          m_name;
+    SchedulerClock&      m_clock;
+    std::vector<Entry>   m_entries{};
+    std::vector<size_t>  m_heap{}; // indices into m_entries, earliest deadline at the front
+    Job                  m_passHook{};
+    std::atomic<bool>    m_notified{false};
+    std::atomic<int64_t> m_notifiedAt{}; // [us], the "deadline" of the runOnNotify jobs
+    std::atomic<bool>    m_resetStats{false};
+
+    Timestamp nowMillis();
+    void      runJob(Entry& entry, int64_t deadline);
+    bool      isLater(size_t lhs, size_t rhs) const;
+};
@@ -0,0 +1,138 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ArchiveFormat.h"
+#include "JSONWriter.h"
+#include "SensorData.h"
+#include "Utilities.h"
+#include <Arduino.h>
+#include <FS.h>
+#include <array>
+#include <memory>
+#include <mutex>
+
+/// Append-only sensor archive on LittleFS that survives reboots, see ArchiveFormat.h for the layout
+/// Records are collected in a RAM write-back buffer, which goes to flash at most every flushInterval
+/// (or when a block is complete), so the flash sees one small append per interval instead of one per record.
+/// Segments rotate at segmentSize, the oldest one is deleted once there are more than segmentCount.
+class SensorArchive
+{
+public:
+    static constexpr auto DIRECTORY{"/archive"};
+
+    // 2020-01-01, anything before means NTP did not set the clock yet
+    static constexpr uint32_t MIN_VALID_EPOCH{1577836800};
+
+    /// @param segmentCount 0 disables the archive
+    /// @param flushInterval [ms]
+    bool init(size_t segmentSize, size_t segmentCount, Timestamp flushInterval);
+
+    /// Buffers one record, ignored until the clock has been set via NTP
+    /// @param epoch [unix seconds] UTC, see getUnixTime()
+    void add(Timestamp now, uint32_t epoch, const SensorData& data);
+
+    void flushIfDue(Timestamp now);
+    void flush(Timestamp now);
+
+    /// {"segments":[{"name":..,"size":..},..],"pending":..}
+    void toJSON(JSONWriter& writer) const;
+
+    size_t getSegmentCount() const;
+    size_t getSizeOnFlash() const;
+
+    /// Reads the records within [from, to] in chronological order, one block at a time
+    /// Only flushed records are visible, the write-back buffer is not included.
+    class Reader
+    {
+    public:
+        /// @param from [unix seconds]
+        /// @param to [unix seconds]
+        Reader(const SensorArchive& archive, uint32_t from, uint32_t to);
+
+        /// false if the block buffer could not be allocated
+        bool isValid() const;
+
+        /// Records outside [from, to] are skipped, the scan only ends with the newest segment
+        /// @return false when there are no more records
+        bool next(ArchiveFormat::Record& record);
+
+    private:
+        const SensorArchive& m_archive;
+        const uint32_t       m_from;
+        const uint32_t       m_to;
+
+        bool     m_started{false};
+        bool     m_done{false};
+        uint32_t m_segment{};
+        fs::File m_file{};
+        size_t   m_block{};
+        size_t   m_blockCount{};
+
+        std::unique_ptr<uint8_t[]>  m_buffer;
+        ArchiveFormat::BlockDecoder m_decoder{nullptr, 0};
+
+        bool nextSegment();
+        bool loadBlock();
+        bool readFirstRecord(size_t block, ArchiveFormat::Record& record);
+    };
+
+private:
+    mutable std::mutex m_mtx{};
+    bool               m_enabled{false};
+
+    size_t    m_segmentCapacity{};
+    size_t    m_segmentCount{};
+    Timestamp m_flushInterval{};
+
+    // Segments are numbered consecutively, the files in between oldest and newest exist (deletion failures aside)
+    bool     m_hasSegments{false};
+    bool     m_segmentOpen{false}; // newest segment is valid and we append to it
+    uint32_t m_oldestSegment{};
+    uint32_t m_newestSegment{};
+    size_t   m_segmentSize{}; // [bytes] of the newest segment on flash
+    size_t   m_sizeOnFlash{}; // [bytes] of all older segments
+
+    // Write-back buffer, never crosses a block boundary
+    std::array<uint8_t, ArchiveFormat::BLOCK_SIZE> m_pending{};
+    size_t                                         m_pendingLength{};
+    Timestamp                                      m_lastFlush{};
+    bool                                           m_forceBlockStart{false};
+    ArchiveFormat::Encoder                         m_encoder{};
+
+    static String getPath(uint32_t segment);
+    static size_t getBlockBegin(size_t block);
+
+    bool getSegmentRange(uint32_t& oldest, uint32_t& newest) const;
+
+    size_t getPosition() const;
+    void   startSegment(uint32_t epoch);
+    void   padToBlockBoundary(Timestamp now);
+    void   flushLocked(Timestamp now);
+    void   deleteOldestSegment();
+    bool   recoverNewestSegment();
+};
@@ -26,28 +26,103 @@
 
 #pragma once
 
+#include "EnvMath.h"
+#include "JSONWriter.h"
 #include "Utilities.h"
 #include <Arduino.h>
-#include <sstream>
+#include <array>
+#include <atomic>
+#include <memory>
+
+/// The sensor data groups, used to select what goes into a binary frame
+enum class SensorChannel : uint8_t
+{
+    None         = 0,
+    SGP30_IAQ    = 1 << 0,
+    SGP30_IAQraw = 1 << 1,
+    BMExxx_Data  = 1 << 2,
+    Derived      = 1 << 3,
+    All          = SGP30_IAQ | SGP30_IAQraw | BMExxx_Data | Derived
+};
+ENABLE_BITMASK_OPERATORS(SensorChannel);
+
+inline bool hasChannel(SensorChannel channels, SensorChannel channel)
+{
+    return (channels & channel) != SensorChannel::None;
+}
 
 struct SensorData
 {
+    /// Enough for the whole SensorData object, see toJSONtxt
+    static constexpr size_t JSON_CAPACITY{320};
+
+    ////////////////////////////////
+    /// Binary Frame
+    ////////////////////////////////
+
+    // Compact binary encoding, all values little endian and fixed point, decoded by index.html
+    //
+    // Header (8 bytes)
+    //   u8  'h'
+    //   u8  'A'
+    //   u8  version (BINARY_VERSION)
+    //   u8  channels present in this frame (SensorChannel bitmask)
+    //   u8  channels that hold valid data (SensorChannel bitmask)
+    //   u8  reserved (0)
+    //   u16 generation (lower 16 bits), lets clients detect dropped frames
+    // SGP30_IAQ (4 bytes)
+    //   u16 TVOC [ppb]
+    //   u16 eCO2 [ppm]
+    // SGP30_IAQraw (4 bytes)
+    //   u16 rawH2 [AU]
+    //   u16 rawEthanol [AU]
+    // BMExxx_Data (8 bytes)
+    //   i16 temperature [0.01 °C]
+    //   u16 humidity [0.01 %RH]
+    //   u32 pressure [Pa] (= 0.01 hPa)
+    // Derived (8 bytes)
+    //   i16 dewPoint [0.01 °C]
+    //   i16 heatIndex [0.01 °C]
+    //   u16 absoluteHumidity [0.01 g/m^3]
+    //   u8  airQuality (EnvMath::AirQuality)
+    //   u8  reserved (0)
+    static constexpr uint8_t BINARY_MAGIC_0{'h'};
+    static constexpr uint8_t BINARY_MAGIC_1{'A'};
+    static constexpr uint8_t BINARY_VERSION{1};
+    static constexpr size_t  BINARY_CAPACITY{8 + 4 + 4 + 8 + 8};
+
+    template<typename T>
+    static size_t helper_toJSONtxt_raw(const T& obj, char* buffer, size_t capacity)
+    {
+        JSONWriter writer{buffer, capacity};
+        obj.appendJSONtxt(writer);
+        return writer.length();
+    }
+
+    template<typename T>
+    static size_t helper_toJSONtxt(const T& obj, char* buffer, size_t capacity)
+    {
+        JSONWriter writer{buffer, capacity};
+        writer.beginObject();
+        obj.appendJSONtxt(writer);
+        writer.endObject();
+        return writer.length();
+    }
+
     template<typename T>
     static String helper_toJSONtxt_raw(const T& obj)
     {
-        std::stringstream ss;
-        obj.appendJSONtxt(ss);
-        return ss.str().c_str();
+        std::array<char, JSON_CAPACITY> buffer;
+        helper_toJSONtxt_raw(obj, buffer.data(), buffer.size());
+        return String{buffer.data()};
     }
 
     template<typename T>
     static String helper_toJSONtxt(const T& obj)
     {
-        std::stringstream ss;
-        ss << '{';
-        obj.appendJSONtxt(ss);
-        ss << '}';
-        return ss.str().c_str();
+        std::array<char, JSON_CAPACITY> buffer;
+        helper_toJSONtxt(obj, buffer.data(), buffer.size());
+        return String{buffer.data()};
     }
 
     struct SGP_IAQ
@@ -57,12 +132,18 @@ struct SensorData
         uint16_t TVOC; // [ppb]
         uint16_t eCO2; // [ppm]
 
-        void appendJSONtxt(std::stringstream& ss) const
+        bool operator==(const SGP_IAQ& other) const
         {
-            ss << "\"SGP30_IAQ\": {"
-               << " \"TVOC\": " << TVOC << ","
-               << " \"eCO2\": " << eCO2 << " "
-               << "}";
+            return isValid == other.isValid && TVOC == other.TVOC && eCO2 == other.eCO2;
+        }
+
+        void appendJSONtxt(JSONWriter& writer) const
+        {
+            writer.key("SGP30_IAQ")
+                .beginObject()
+                .member("TVOC", TVOC)
+                .member("eCO2", eCO2)
+                .endObject();
         }
 
         String toJSONtxt_raw() const
@@ -82,12 +163,18 @@ struct SensorData
         uint16_t rawH2;      // [AU]
         uint16_t rawEthanol; // [AU]
 
-        void appendJSONtxt(std::stringstream& ss) const
+        bool operator==(const SGP_IAQraw& other) const
+        {
+            return isValid == other.isValid && rawH2 == other.rawH2 && rawEthanol == other.rawEthanol;
+        }
+
+        void appendJSONtxt(JSONWriter& writer) const
         {
-            ss << "\"SGP30_IAQraw\": {"
-               << " \"rawH2\": " << rawH2 << ","
-               << " \"rawEthanol\": " << rawEthanol << " "
-               << "}";
+            writer.key("SGP30_IAQraw")
+                .beginObject()
+                .member("rawH2", rawH2)
+                .member("rawEthanol", rawEthanol)
+                .endObject();
         }
 
         String toJSONtxt_raw() const
@@ -108,13 +195,19 @@ struct SensorData
         float humidity{45.2};    // [%] / [%RH]
         float pressure{1013.25}; // [hPa]
 
-        void appendJSONtxt(std::stringstream& ss) const
+        bool operator==(const BME_Data& other) const
+        {
+            return isValid == other.isValid && temperature == other.temperature && humidity == other.humidity && pressure == other.pressure;
+        }
+
+        void appendJSONtxt(JSONWriter& writer) const
         {
-            ss << "\"BMExxx_Data\": {"
-               << " \"temperature\": " << temperature << ","
-               << " \"humidity\": " << humidity << ","
-               << " \"pressure\": " << pressure << " "
-               << "}";
+            writer.key("BMExxx_Data")
+                .beginObject()
+                .member("temperature", temperature, 2)
+                .member("humidity", humidity, 2)
+                .member("pressure", pressure, 2)
+                .endObject();
         }
 
         String toJSONtxt_raw() const
@@ -127,15 +220,79 @@ struct SensorData
         }
     };
 
-    void appendJSONtxt(std::stringstream& ss) const
+    /// Computed from the other groups by updateDerived, valid if the BMExxx data is
+    struct Derived_Data
+    {
+        bool isValid;
+
+        int32_t             dewPoint;         // [0.01 °C]
+        int32_t             heatIndex;        // [0.01 °C]
+        uint32_t            absoluteHumidity; // [mg/m^3]
+        EnvMath::AirQuality airQuality{EnvMath::AirQuality::Unknown};
+
+        // Inputs of the last computation, see updateDerived
+        int32_t  temperature{INT32_MIN}; // [0.01 °C]
+        uint32_t humidity{};             // [0.001 %RH]
+
+        /// The published values only, not the inputs of the last computation
+        bool operator==(const Derived_Data& other) const
+        {
+            return isValid == other.isValid && dewPoint == other.dewPoint && heatIndex == other.heatIndex &&
+                   absoluteHumidity == other.absoluteHumidity && airQuality == other.airQuality;
+        }
+
+        void appendJSONtxt(JSONWriter& writer) const
+        {
+            writer.key("Derived")
+                .beginObject()
+                .member("dewPoint", dewPoint / 100.0F, 2)
+                .member("heatIndex", heatIndex / 100.0F, 2)
+                .member("absoluteHumidity", absoluteHumidity / 1000.0F, 2)
+                .member("airQuality", EnvMath::toString(airQuality))
+                .endObject();
+        }
+
+        String toJSONtxt_raw() const
+        {
+            return SensorData::helper_toJSONtxt_raw<Derived_Data>(*this);
+        }
+        String toJSONtxt() const
+        {
+            return SensorData::helper_toJSONtxt<Derived_Data>(*this);
+        }
+    };
+
+    void appendJSONtxt(JSONWriter& writer, SensorChannel channels = SensorChannel::All) const
+    {
+        writer.key("hAIR").beginObject();
+        if (hasChannel(channels, SensorChannel::SGP30_IAQ))
+        {
+            sgp_iaq.appendJSONtxt(writer);
+        }
+        if (hasChannel(channels, SensorChannel::SGP30_IAQraw))
+        {
+            sgp_iaqRaw.appendJSONtxt(writer);
+        }
+        if (hasChannel(channels, SensorChannel::BMExxx_Data))
+        {
+            bme_data.appendJSONtxt(writer);
+        }
+        if (hasChannel(channels, SensorChannel::Derived))
+        {
+            derived.appendJSONtxt(writer);
+        }
+        writer.endObject();
+    }
+
+    /// Writes into the given buffer without touching the heap
+    /// @return length without the terminating '\0'
+    size_t toJSONtxt(char* buffer, size_t capacity, SensorChannel channels = SensorChannel::All) const
     {
-        ss << "\"hAIR\": {";
-        sgp_iaq.appendJSONtxt(ss);
-        ss << ", ";
-        sgp_iaqRaw.appendJSONtxt(ss);
-        ss << ", ";
-        bme_data.appendJSONtxt(ss);
-        ss << "}";
+        JSONWriter writer{buffer, capacity};
+        writer.beginObject();
+        appendJSONtxt(writer, channels);
+        writer.endObject();
+        return writer.length();
     }
 
     String toJSONtxt_raw() const
@@ -147,40 +304,195 @@ struct SensorData
         return SensorData::helper_toJSONtxt<SensorData>(*this);
     }
 
+    /// Writes the binary frame described above, without touching the heap
+    /// @return frame length, 0 if the buffer is too small
+    size_t toBinaryFrame(uint8_t* buffer, size_t capacity, uint32_t generation, SensorChannel channels = SensorChannel::All) const
+    {
+        if (capacity < BINARY_CAPACITY)
+        {
+            return 0;
+        }
+
+        auto put16 = [&buffer](uint16_t val)
+        {
+            *buffer++ = static_cast<uint8_t>(val);
+            *buffer++ = static_cast<uint8_t>(val >> 8);
+        };
+        auto put32 = [&put16](uint32_t val)
+        {
+            put16(static_cast<uint16_t>(val));
+            put16(static_cast<uint16_t>(val >> 16));
+        };
+        auto toFixed = [](float val, float scale) -> int32_t
+        {
+            return static_cast<int32_t>(lroundf(val * scale));
+        };
+
+        auto valid{SensorChannel::None};
+        valid |= sgp_iaq.isValid ? SensorChannel::SGP30_IAQ : SensorChannel::None;
+        valid |= sgp_iaqRaw.isValid ? SensorChannel::SGP30_IAQraw : SensorChannel::None;
+        valid |= bme_data.isValid ? SensorChannel::BMExxx_Data : SensorChannel::None;
+        valid |= derived.isValid ? SensorChannel::Derived : SensorChannel::None;
+
+        const auto* begin{buffer};
+
+        *buffer++ = BINARY_MAGIC_0;
+        *buffer++ = BINARY_MAGIC_1;
+        *buffer++ = BINARY_VERSION;
+        *buffer++ = enum_cast_to_underlying(channels);
+        *buffer++ = enum_cast_to_underlying(valid & channels);
+        *buffer++ = 0;
+        put16(static_cast<uint16_t>(generation));
+
+        if (hasChannel(channels, SensorChannel::SGP30_IAQ))
+        {
+            put16(sgp_iaq.TVOC);
+            put16(sgp_iaq.eCO2);
+        }
+        if (hasChannel(channels, SensorChannel::SGP30_IAQraw))
+        {
+            put16(sgp_iaqRaw.rawH2);
+            put16(sgp_iaqRaw.rawEthanol);
+        }
+        if (hasChannel(channels, SensorChannel::BMExxx_Data))
+        {
+            put16(static_cast<uint16_t>(static_cast<int16_t>(toFixed(bme_data.temperature, 100.0F))));
+            put16(static_cast<uint16_t>(toFixed(bme_data.humidity, 100.0F)));
+            put32(static_cast<uint32_t>(toFixed(bme_data.pressure, 100.0F)));
+        }
+        if (hasChannel(channels, SensorChannel::Derived))
+        {
+            put16(static_cast<uint16_t>(static_cast<int16_t>(derived.dewPoint)));
+            put16(static_cast<uint16_t>(static_cast<int16_t>(derived.heatIndex)));
+            put16(static_cast<uint16_t>((derived.absoluteHumidity + 5) / 10));
+            *buffer++ = enum_cast_to_underlying(derived.airQuality);
+            *buffer++ = 0;
+        }
+
+        return buffer - begin;
+    }
+
+    /// Same values and validity in all channels, i.e. the sinks would get the same payload
+    bool operator==(const SensorData& other) const
+    {
+        return sgp_iaq == other.sgp_iaq && sgp_iaqRaw == other.sgp_iaqRaw && bme_data == other.bme_data && derived == other.derived;
+    }
+
+    bool operator!=(const SensorData& other) const
+    {
+        return !(*this == other);
+    }
+
     bool isValid() const
     {
         return sgp_iaq.isValid && sgp_iaqRaw.isValid && bme_data.isValid;
     }
 
-    SGP_IAQ    sgp_iaq;
-    SGP_IAQraw sgp_iaqRaw;
-    BME_Data   bme_data;
+    void invalidate(SensorChannel channels)
+    {
+        sgp_iaq.isValid    = sgp_iaq.isValid && !hasChannel(channels, SensorChannel::SGP30_IAQ);
+        sgp_iaqRaw.isValid = sgp_iaqRaw.isValid && !hasChannel(channels, SensorChannel::SGP30_IAQraw);
+        bme_data.isValid   = bme_data.isValid && !hasChannel(channels, SensorChannel::BMExxx_Data);
+    }
+
+    /// Brings the derived values up to date, the fixed point math only runs if the BMExxx sample changed
+    void updateDerived()
+    {
+        derived.airQuality = sgp_iaq.isValid ? EnvMath::airQuality(sgp_iaq.eCO2, sgp_iaq.TVOC) : EnvMath::AirQuality::Unknown;
+
+        derived.isValid = bme_data.isValid;
+        if (!bme_data.isValid)
+        {
+            return;
+        }
+
+        const auto temperature{static_cast<int32_t>(lroundf(bme_data.temperature * 100.0F))};
+        const auto humidity{static_cast<uint32_t>(lroundf(bme_data.humidity * 1000.0F))};
+        if (temperature == derived.temperature && humidity == derived.humidity)
+        {
+            return;
+        }
+
+        derived.temperature      = temperature;
+        derived.humidity         = humidity;
+        derived.absoluteHumidity = EnvMath::absoluteHumidity(temperature, humidity);
+        derived.dewPoint         = EnvMath::dewPoint(temperature, humidity);
+        derived.heatIndex        = EnvMath::heatIndex(temperature, humidity);
+    }
+
+    SGP_IAQ      sgp_iaq;
+    SGP_IAQraw   sgp_iaqRaw;
+    BME_Data     bme_data;
+    Derived_Data derived;
+};
+
+/// Serialized sensor data of one generation, immutable once created and shared by all sinks
+struct SerializedSensorData
+{
+    uint32_t generation;
+    bool     isValid;
+
+    size_t                                      length;
+    std::array<char, SensorData::JSON_CAPACITY> json;
+
+    size_t                                           binaryLength;
+    std::array<uint8_t, SensorData::BINARY_CAPACITY> binary;
 };
 
+/// Latest sensor data snapshot
+/// Written by the SDA thread only, read by everyone else (SDD, webserver, ...). Readers never block the writer.
 class SensorDataStorage
 {
 public:
-    SensorData getCopy()
+    /// @param generation optional, receives the generation of the returned data
+    SensorData getCopy(uint32_t* generation = nullptr) const
+    {
+        uint32_t   sequence{};
+        const auto data{m_data.load(&sequence)};
+        if (generation != nullptr)
+        {
+            *generation = sequence / 2;
+        }
+        return data;
+    }
+
+    void update(const SensorData& data)
     {
-        m_mtx.lock();
-        SensorData tmp{m_data};
-        m_mtx.unlock();
-        return tmp;
+        m_data.store(data);
     }
 
-    void update(SensorData data)
+    /// Incremented with every update
+    uint32_t getGeneration() const
     {
-        m_mtx.lock();
-        m_data = data;
-        m_mtx.unlock();
+        return m_data.sequence() / 2;
     }
 
-    String getCopyAsJSONtxt()
+    /// The data is serialized (JSON and binary frame) at most once per generation and only if somebody asks for it
+    std::shared_ptr<const SerializedSensorData> getSerialized()
     {
-        return getCopy().toJSONtxt();
+        auto cached = std::atomic_load(&m_jsonCache);
+        if (cached && cached->generation == getGeneration())
+        {
+            return cached;
+        }
+
+        uint32_t   sequence{};
+        const auto data{m_data.load(&sequence)};
+
+        auto tmp{std::make_shared<SerializedSensorData>()};
+        tmp->generation   = sequence / 2;
+        tmp->isValid      = data.isValid();
+        tmp->length       = data.toJSONtxt(tmp->json.data(), tmp->json.size());
+        tmp->binaryLength = data.toBinaryFrame(tmp->binary.data(), tmp->binary.size(), tmp->generation);
+
+        std::shared_ptr<const SerializedSensorData> fresh{std::move(tmp)};
+
+        // If somebody else was faster, keep theirs, ours is still correct for the generation it was made for
+        std::atomic_compare_exchange_strong(&m_jsonCache, &cached, fresh);
+        return fresh;
     }
 
 private:
-    SensorData m_data;
-    std::mutex m_mtx{};
+    SeqLock<SensorData>                         m_data{};
+    std::shared_ptr<const SerializedSensorData> m_jsonCache{};
 };
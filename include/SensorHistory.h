@@ -0,0 +1,165 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SensorData.h"
+#include "Utilities.h"
+#include <Arduino.h>
+#include <array>
+#include <memory>
+#include <mutex>
+
+/// Fixed memory, multi resolution time series of the sensor data
+/// Tier 0 keeps every sample, the other tiers keep min/avg/max rollups over 10s, 1min and 1h.
+/// Rollups are maintained incrementally, so adding a sample is O(1) (amortized, a rollup cascades only once per bucket).
+/// All memory is allocated once in init().
+class SensorHistory
+{
+public:
+    enum class Resolution : uint8_t
+    {
+        Raw,
+        Seconds10,
+        Minute1,
+        Hour1,
+        COUNT
+    };
+
+    /// Values are kept as 16 bit fixed point, see CHANNELS for name and scale
+    static constexpr size_t CHANNEL_COUNT{7};
+
+    struct Channel
+    {
+        const char* name;
+        uint8_t     decimals; // value = encoded / 10^decimals
+        bool        isSigned;
+    };
+    static const std::array<Channel, CHANNEL_COUNT> CHANNELS;
+
+    /// One row as handed out to readers, raw samples have min == avg == max
+    struct Row
+    {
+        Timestamp                          timestamp; // [ms] millis() of the sample or begin of the bucket
+        uint8_t                            valid;     // bit per channel
+        std::array<int32_t, CHANNEL_COUNT> min;
+        std::array<int32_t, CHANNEL_COUNT> avg;
+        std::array<int32_t, CHANNEL_COUNT> max;
+    };
+
+    /// @param memoryBudget [bytes] split over all tiers, 0 disables the history
+    bool init(size_t memoryBudget);
+
+    void add(Timestamp now, const SensorData& data);
+
+    /// Copies rows of one resolution within [from, to] in chronological order
+    /// Start with cursor = 0 and call repeatedly until it returns 0. The cursor stays valid while new samples are added.
+    size_t read(Resolution resolution, Timestamp from, Timestamp to, Row* rows, size_t maxRows, uint32_t& cursor) const;
+
+    /// [ms] 0 for Raw
+    static Timestamp getBucketDuration(Resolution resolution);
+    static bool      parseResolution(const String& str, Resolution& resolution);
+
+    size_t getCapacity(Resolution resolution) const;
+    size_t getMemoryUsage() const;
+
+    /// SensorData in the fixed point scaling of CHANNELS, also used by the SensorArchive
+    static std::array<int32_t, CHANNEL_COUNT> toFixed(const SensorData& data, uint8_t& valid);
+
+private:
+    static constexpr size_t TIER_COUNT{static_cast<size_t>(Resolution::COUNT)};
+
+    struct RawSample
+    {
+        Timestamp                           timestamp;
+        std::array<uint16_t, CHANNEL_COUNT> values;
+        uint8_t                             valid;
+    };
+
+    struct Bucket
+    {
+        Timestamp                           begin;
+        std::array<uint16_t, CHANNEL_COUNT> min;
+        std::array<uint16_t, CHANNEL_COUNT> avg;
+        std::array<uint16_t, CHANNEL_COUNT> max;
+        uint8_t                             valid;
+    };
+
+    /// Rollup in progress, holds the exact sum so averages stay exact across tiers
+    struct Accumulator
+    {
+        Timestamp                           begin;
+        bool                                isOpen;
+        std::array<uint32_t, CHANNEL_COUNT> count;
+        std::array<int64_t, CHANNEL_COUNT>  sum;
+        std::array<int32_t, CHANNEL_COUNT>  min;
+        std::array<int32_t, CHANNEL_COUNT>  max;
+    };
+
+    /// Ring with absolute sequence numbers, element n lives in slot n % capacity
+    template<typename T>
+    struct Ring
+    {
+        std::unique_ptr<T[]> data;
+        size_t               capacity{};
+        uint32_t             total{}; // elements ever pushed
+
+        void push(const T& element)
+        {
+            data[total % capacity] = element;
+            ++total;
+        }
+
+        uint32_t oldest() const
+        {
+            return total > capacity ? total - capacity : 0;
+        }
+
+        const T& at(uint32_t sequence) const
+        {
+            return data[sequence % capacity];
+        }
+    };
+
+    mutable std::mutex m_mtx{};
+    bool               m_enabled{false};
+
+    Ring<RawSample>                      m_raw{};
+    std::array<Ring<Bucket>, TIER_COUNT> m_buckets{};      // index 0 unused
+    std::array<Accumulator, TIER_COUNT>  m_accumulators{}; // index 0 unused
+
+    static int32_t  decode(size_t channel, uint16_t encoded);
+    static uint16_t encode(size_t channel, int32_t value);
+
+    void accumulate(size_t tier, Timestamp timestamp, const Accumulator& source);
+    void closeBucket(size_t tier);
+
+    template<typename T>
+    uint32_t findFirst(const Ring<T>& ring, Timestamp from) const;
+
+    Row toRow(const RawSample& sample) const;
+    Row toRow(const Bucket& bucket) const;
+};
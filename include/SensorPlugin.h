@@ -0,0 +1,78 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SensorData.h"
+#include "Utilities.h"
+#include <Arduino.h>
+
+/// One measurement stream of a sensor, driven by the SensorRegistry
+///
+/// probe() runs once at boot, a sensor that is not found is never scheduled. Then every period start() triggers a
+/// measurement and the registry comes back at readyAt() (see TaskItem::runExtraAt) to read() it into the channel store.
+/// read() may return Status::Pending again if the sensor is not done yet.
+///
+/// Everything but probe() runs on the sda thread and must not block.
+class SensorPlugin
+{
+public:
+    enum class Status
+    {
+        Pending, // call read() again at readyAt()
+        Done,    // the channels are updated
+        Failed,
+    };
+
+    /// Blocks, sleeps the given milliseconds (delay() on the target)
+    using Delay = void (*)(uint32_t);
+
+    virtual ~SensorPlugin() = default;
+
+    /// For the POST and the logs
+    virtual const char* getName() const = 0;
+
+    /// What read() updates in the SensorData
+    virtual SensorChannel getChannels() const = 0;
+
+    /// Blocking, at boot: finds and sets up the sensor
+    virtual bool probe(Delay delay) = 0;
+
+    /// For the POST once probe() succeeded, e.g. the chip variant
+    virtual String getInfo() const
+    {
+        return "OK";
+    }
+
+    /// @param data latest values of all sensors, e.g. for a compensation
+    /// @return false if the measurement could not be triggered
+    virtual bool start(Timestamp now, const SensorData& data) = 0;
+
+    /// [ms] when the measurement can be read
+    virtual Timestamp readyAt() const = 0;
+
+    virtual Status read(Timestamp now, SensorData& data) = 0;
+};
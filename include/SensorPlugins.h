@@ -0,0 +1,146 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "BMExxx.h"
+#include "I2CBus.h"
+#include "SGP30.h"
+#include "SensorPlugin.h"
+
+/// SGP30 air quality (eCO2, TVOC), humidity compensated with the BMExxx data
+/// Restores the baseline of an earlier run at probe(), see hAIR_System::job_sda_sgp_baseline() for storing it.
+class SGP30Plugin : public SensorPlugin
+{
+public:
+    explicit SGP30Plugin(I2CBus& bus)
+        : m_sgp(bus)
+    {
+    }
+
+    const char* getName() const override
+    {
+        return "SGP30";
+    }
+
+    SensorChannel getChannels() const override
+    {
+        return SensorChannel::SGP30_IAQ;
+    }
+
+    bool      probe(Delay delay) override;
+    String    getInfo() const override;
+    bool      start(Timestamp now, const SensorData& data) override;
+    Timestamp readyAt() const override;
+    Status    read(Timestamp now, SensorData& data) override;
+
+    bool isPresent() const
+    {
+        return m_present;
+    }
+
+    /// Shared with SGP30RawPlugin and the baseline job, the driver arbitrates between them
+    SGP30& getDriver()
+    {
+        return m_sgp;
+    }
+
+private:
+    SGP30    m_sgp;
+    bool     m_present{false};
+    bool     m_baselineRestored{false};
+    bool     m_done{false}; // start() already got a result (collected by a measurement of the other plugin)
+    uint16_t m_eCO2{};
+    uint16_t m_TVOC{};
+};
+
+/// SGP30 raw signals (H2, ethanol), on the driver of the SGP30Plugin, which has to be added to the registry first
+class SGP30RawPlugin : public SensorPlugin
+{
+public:
+    explicit SGP30RawPlugin(SGP30Plugin& sgp)
+        : m_sgp(sgp)
+    {
+    }
+
+    const char* getName() const override
+    {
+        return "SGP30 raw";
+    }
+
+    SensorChannel getChannels() const override
+    {
+        return SensorChannel::SGP30_IAQraw;
+    }
+
+    bool      probe(Delay delay) override;
+    bool      start(Timestamp now, const SensorData& data) override;
+    Timestamp readyAt() const override;
+    Status    read(Timestamp now, SensorData& data) override;
+
+private:
+    SGP30Plugin& m_sgp;
+    bool         m_done{false}; // see SGP30Plugin
+    uint16_t     m_rawH2{};
+    uint16_t     m_rawEthanol{};
+};
+
+/// BME280 / BME680 temperature, humidity and pressure
+class BMExxxPlugin : public SensorPlugin
+{
+public:
+    explicit BMExxxPlugin(I2CBus& bus)
+        : m_bme(bus)
+    {
+    }
+
+    /// Before probe(), the config is loaded after the components are constructed
+    void setSettings(const BMExxx::Settings& settings)
+    {
+        m_settings = settings;
+    }
+
+    const char* getName() const override
+    {
+        return "BMExxx";
+    }
+
+    SensorChannel getChannels() const override
+    {
+        return SensorChannel::BMExxx_Data;
+    }
+
+    bool      probe(Delay delay) override;
+    String    getInfo() const override;
+    bool      start(Timestamp now, const SensorData& data) override;
+    Timestamp readyAt() const override;
+    Status    read(Timestamp now, SensorData& data) override;
+
+private:
+    BMExxx           m_bme;
+    BMExxx::Settings m_settings{};
+    BMExxx::Sample   m_sample{};
+};
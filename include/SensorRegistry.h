@@ -0,0 +1,91 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "I2CBus.h"
+#include "Scheduler.h"
+#include "SensorData.h"
+#include "SensorPlugin.h"
+#include "Utilities.h"
+#include <array>
+
+/// The sensors of the firmware, probed at boot and scheduled on the sda thread
+///
+/// Adding a sensor is a SensorPlugin plus one add() in hAIR_System::initSensors(). Plugins whose sensor is not found
+/// cost nothing at runtime, they never get a job (and don't show up in the scheduler stats).
+///
+/// Not thread safe, add() and probe() during the setup, after schedule() the jobs run on the scheduler's thread.
+class SensorRegistry
+{
+public:
+    static constexpr size_t MAX_PLUGINS{8};
+
+    /// @param name of the scheduler task, has to outlive the registry (string literal)
+    /// @param frequency [Hz] of the measurements, 0 => probed but not scheduled
+    /// @return false if there are MAX_PLUGINS already
+    bool add(const char* name, SensorPlugin& plugin, float frequency);
+
+    /// Blocking, at boot: logs the devices that answer on the bus, then probes the plugins in the order they were added
+    /// (a plugin may depend on one added before, see SGP30RawPlugin)
+    void probe(I2CBus& bus, SensorPlugin::Delay delay);
+
+    /// One job per plugin that was found
+    /// @param data working copy of the sda thread, the channel store the plugins read into
+    /// @param changed set if a job changed a value or a validity flag, a read that returns the same values leaves it alone
+    void schedule(Scheduler& scheduler, SensorData& data, bool& changed);
+
+    size_t getCount() const
+    {
+        return m_count;
+    }
+
+    const SensorPlugin& getPlugin(size_t index) const
+    {
+        return *m_entries[index].plugin;
+    }
+
+    bool isPresent(size_t index) const
+    {
+        return m_entries[index].present;
+    }
+
+private:
+    struct Entry
+    {
+        const char*   name{};
+        SensorPlugin* plugin{};
+        float         frequency{};
+        TaskItem      task{};
+        bool          present{false};
+        bool          started{false}; // start() succeeded, read() is next
+    };
+
+    std::array<Entry, MAX_PLUGINS> m_entries{};
+    size_t                         m_count{};
+
+    void run(Entry& entry, Timestamp now, SensorData& data, bool& changed);
+};
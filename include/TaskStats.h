@@ -0,0 +1,183 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// No Arduino includes on purpose, so the histograms can be checked on the host
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/// Fixed bucket histogram of times [us], HDR style: exact below 8 us, above that 4 buckets per power of two,
+/// so a bucket is at most 25% wide. Values beyond ~134 s land in the last bucket, max() stays exact.
+/// 424 bytes, no heap.
+class LatencyHistogram
+{
+public:
+    static constexpr uint8_t SUB_BITS{2};
+    static constexpr size_t  SUB_COUNT{1U << SUB_BITS};
+    static constexpr size_t  LINEAR_COUNT{2 * SUB_COUNT};
+    static constexpr uint8_t MAX_EXPONENT{26};
+    static constexpr size_t  BUCKET_COUNT{LINEAR_COUNT + (MAX_EXPONENT - SUB_BITS) * SUB_COUNT};
+
+    void record(int64_t value)
+    {
+        const auto clamped{static_cast<uint32_t>(value < 0 ? 0 : (value > UINT32_MAX ? UINT32_MAX : value))};
+
+        ++m_counts[getBucket(clamped)];
+        ++m_count;
+        if (clamped > m_max)
+        {
+            m_max = clamped;
+        }
+    }
+
+    void reset()
+    {
+        m_counts = {};
+        m_count  = 0;
+        m_max    = 0;
+    }
+
+    uint32_t count() const
+    {
+        return m_count;
+    }
+
+    uint32_t max() const
+    {
+        return m_max;
+    }
+
+    /// Upper bound of the bucket that holds the given percentile, capped at max()
+    /// @param percentile [0, 100]
+    uint32_t percentile(float percentile) const
+    {
+        if (m_count == 0)
+        {
+            return 0;
+        }
+
+        const auto target{static_cast<uint32_t>(static_cast<float>(m_count) * percentile / 100.0F + 0.999F)};
+        uint32_t   seen{};
+        for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket)
+        {
+            seen += m_counts[bucket];
+            if (seen >= target && seen > 0)
+            {
+                const auto upper{getUpperBound(bucket)};
+                return upper < m_max ? upper : m_max;
+            }
+        }
+        return m_max;
+    }
+
+    static size_t getBucket(uint32_t value)
+    {
+        if (value < LINEAR_COUNT)
+        {
+            return value;
+        }
+
+        uint8_t exponent{31};
+        while ((value >> exponent) == 0)
+        {
+            --exponent;
+        }
+        if (exponent > MAX_EXPONENT)
+        {
+            return BUCKET_COUNT - 1;
+        }
+
+        const auto sub{(value >> (exponent - SUB_BITS)) & (SUB_COUNT - 1)};
+        return LINEAR_COUNT + (exponent - SUB_BITS - 1) * SUB_COUNT + sub;
+    }
+
+    static uint32_t getUpperBound(size_t bucket)
+    {
+        if (bucket < LINEAR_COUNT)
+        {
+            return static_cast<uint32_t>(bucket);
+        }
+
+        const auto exponent{static_cast<uint8_t>((bucket - LINEAR_COUNT) / SUB_COUNT + SUB_BITS + 1)};
+        const auto sub{(bucket - LINEAR_COUNT) % SUB_COUNT};
+        const auto width{1U << (exponent - SUB_BITS)};
+        return static_cast<uint32_t>((SUB_COUNT + sub) * width + width - 1);
+    }
+
+private:
+    std::array<uint32_t, BUCKET_COUNT> m_counts{};
+    uint32_t                           m_count{};
+    uint32_t                           m_max{};
+};
+
+/// What the Scheduler measured for one TaskItem
+/// Written by the thread of the scheduler only, readers on other threads may see a run half recorded, which is fine for statistics.
+struct TaskStats
+{
+    LatencyHistogram lateness{}; // [us] actual start - deadline
+    LatencyHistogram duration{}; // [us] execution time
+
+    uint32_t runs{};
+    uint32_t overruns{}; // runs that took longer than the period
+    uint32_t skipped{};  // periods that were dropped because the task was more than a period late
+    int64_t  firstStart{};
+    int64_t  lastStart{};
+
+    /// @param deadline [us] when the run was due
+    /// @param start [us]
+    /// @param end [us]
+    /// @param period [us] 0 for runs on notification
+    void record(int64_t deadline, int64_t start, int64_t end, int64_t period)
+    {
+        lateness.record(start - deadline);
+        duration.record(end - start);
+
+        if (runs == 0)
+        {
+            firstStart = start;
+        }
+        lastStart = start;
+        ++runs;
+
+        if (period > 0 && end - start > period)
+        {
+            ++overruns;
+        }
+    }
+
+    void reset()
+    {
+        *this = {};
+    }
+
+    /// [Hz] actual rate between the first and the last run, 0 until there are two runs
+    float getRate() const
+    {
+        return runs > 1 && lastStart > firstStart ? (runs - 1) * 1000000.0F / static_cast<float>(lastStart - firstStart) : 0.0F;
+    }
+};
@@ -26,11 +26,17 @@
 
 #pragma once
 
+#include "TaskStats.h"
 #include <Arduino.h>
-#include <Fs.h>
+#include <FS.h>
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <mutex>
 #include <type_traits>
 
+class NTPClient;
+
 ////////////////////////////////
 /// Misc
 ////////////////////////////////
@@ -54,6 +60,92 @@ private:
     std::mutex& m_mtx;
 };
 
+/// Single writer / multiple reader snapshot store (seqlock)
+/// The writer never waits. A reader retries if it raced with the writer, so a slow reader can never delay the writer.
+/// The payload is kept in atomic words, so concurrent access is well defined even while a read is torn.
+template<typename T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock requires a trivially copyable type");
+
+public:
+    SeqLock()
+    {
+        store(T{});
+    }
+
+    /// Must only ever be called from one thread at a time
+    void store(const T& value)
+    {
+        std::array<uint32_t, WORDS> tmp{};
+        memcpy(tmp.data(), &value, sizeof(T));
+
+        const auto seq{m_seq.load(std::memory_order_relaxed)};
+        m_seq.store(seq + 1, std::memory_order_relaxed); // odd => write in progress
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < WORDS; ++i)
+        {
+            m_words[i].store(tmp[i], std::memory_order_relaxed);
+        }
+
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    /// @param sequence optional, receives the sequence number the returned value was stored with
+    T load(uint32_t* sequence = nullptr) const
+    {
+        std::array<uint32_t, WORDS> tmp{};
+
+        for (uint32_t tries = 0;; ++tries)
+        {
+            // The writer might have been preempted by us on the same core, so give it a chance to finish every now and then
+            if (tries > SPINS_BEFORE_SLEEP)
+            {
+                delay(1);
+            }
+
+            const auto seqBegin{m_seq.load(std::memory_order_acquire)};
+            if (seqBegin & 1U)
+            {
+                continue;
+            }
+
+            for (size_t i = 0; i < WORDS; ++i)
+            {
+                tmp[i] = m_words[i].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seqBegin == m_seq.load(std::memory_order_relaxed))
+            {
+                if (sequence != nullptr)
+                {
+                    *sequence = seqBegin;
+                }
+                break;
+            }
+        }
+
+        T value;
+        memcpy(static_cast<void*>(&value), tmp.data(), sizeof(T));
+        return value;
+    }
+
+    /// Even number, incremented by 2 for every store
+    uint32_t sequence() const
+    {
+        return m_seq.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr size_t   WORDS{(sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t)};
+    static constexpr uint32_t SPINS_BEFORE_SLEEP{8};
+
+    std::atomic<uint32_t>                    m_seq{0};
+    std::array<std::atomic<uint32_t>, WORDS> m_words{};
+};
+
 ////////////////////////////////
 /// Timing
 ////////////////////////////////
@@ -103,6 +195,23 @@ public:
     inline void updateSuccess(Timestamp now = millis())
     {
         m_ts_lastSuccess = now;
+        ++m_successes;
+    }
+
+    /// Only counts, the last success stays as it is
+    inline void updateFailure()
+    {
+        ++m_failures;
+    }
+
+    inline uint32_t getSuccessCount() const
+    {
+        return m_successes;
+    }
+
+    inline uint32_t getFailureCount() const
+    {
+        return m_failures;
     }
 
     inline Timestamp getLastTry() const
@@ -119,19 +228,117 @@ public:
     {
         m_frequency = frequency;
         m_delayTime = 1000.0F / frequency;
+        m_period    = frequency > 0 ? static_cast<int64_t>(1000000.0F / frequency + 0.5F) : 0;
     }
 
     inline void setDelayTime(int32_t delayTime)
     {
-        m_frequency = static_cast<int32_t>(1000.0F / delayTime);
+        m_frequency = delayTime > 0 ? 1000.0F / delayTime : 0;
         m_delayTime = delayTime;
+        m_period    = delayTime > 0 ? static_cast<int64_t>(delayTime) * 1000 : 0;
+    }
+
+    ////////////////////////////////
+    /// Deadlines, used by the Scheduler
+    ////////////////////////////////
+
+    /// [us], 0 => disabled
+    inline int64_t getPeriod() const
+    {
+        return m_period;
+    }
+
+    /// [us] on the scheduler clock
+    inline int64_t getDeadline() const
+    {
+        return m_deadline;
+    }
+
+    /// First deadline is one period after the last try (boot for tasks that never ran), at the earliest now
+    inline void schedule(int64_t now)
+    {
+        m_deadline = static_cast<int64_t>(m_ts_lastTry) * 1000 + m_period;
+        if (m_deadline < now)
+        {
+            m_deadline = now;
+        }
+        m_extraDelay      = -1;
+        m_extraDeadline   = INT64_MAX;
+        m_regularDeadline = 0;
+    }
+
+    /// One extra run at readyAt [ms] before the next regular one, the regular runs keep their phase
+    /// For jobs that start something and come back for the result (see SGP30), called by the job itself with its now.
+    /// Timestamps wrap, so only the difference to now is kept and the Scheduler adds it to the start of the run.
+    inline void runExtraAt(Timestamp readyAt, Timestamp now)
+    {
+        const auto remaining{static_cast<int32_t>(static_cast<uint32_t>(readyAt) - static_cast<uint32_t>(now))};
+        m_extraDelay = remaining > 0 ? static_cast<int64_t>(remaining) * 1000 : 0;
+    }
+
+    /// Turns the extra run requested by the job that started at start [us] into a deadline on the scheduler clock
+    inline void armExtra(int64_t start)
+    {
+        if (m_extraDelay >= 0)
+        {
+            m_extraDeadline = start + m_extraDelay;
+            m_extraDelay    = -1;
+        }
+    }
+
+    /// Next deadline is phase locked to the previous one, so late runs don't accumulate drift
+    /// If we are more than a period late, the missed runs are skipped instead of being run back to back.
+    inline void advance(int64_t now)
+    {
+        if (m_regularDeadline != 0)
+        {
+            // Back from an extra run, the regular deadline is still ahead (or just due)
+            m_deadline        = m_regularDeadline;
+            m_regularDeadline = 0;
+        }
+        else
+        {
+            m_deadline += m_period;
+            if (m_deadline <= now)
+            {
+                const auto missed{(now - m_deadline) / m_period + 1};
+                m_deadline += missed * m_period;
+                m_stats.skipped += static_cast<uint32_t>(missed);
+            }
+        }
+
+        if (m_extraDeadline < m_deadline)
+        {
+            m_regularDeadline = m_deadline;
+            m_deadline        = m_extraDeadline;
+        }
+        m_extraDeadline = INT64_MAX;
+    }
+
+    inline TaskStats& getStats()
+    {
+        return m_stats;
+    }
+
+    inline const TaskStats& getStats() const
+    {
+        return m_stats;
     }
 
 private:
-    int32_t m_ts_lastTry{};
-    int32_t m_ts_lastSuccess{};
-    int32_t m_delayTime{};
-    float   m_frequency{};
+    int32_t  m_ts_lastTry{};
+    int32_t  m_ts_lastSuccess{};
+    int32_t  m_delayTime{};
+    float    m_frequency{};
+    int64_t  m_period{};                 // [us]
+    int64_t  m_deadline{};               // [us]
+    int64_t  m_extraDelay{-1};           // [us] requested by runExtraAt(), -1 => none
+    int64_t  m_extraDeadline{INT64_MAX}; // [us] armed by armExtra(), INT64_MAX => none
+    int64_t  m_regularDeadline{};        // [us] postponed by an extra run, 0 => none
+    uint32_t m_successes{};
+    uint32_t m_failures{};
+
+    TaskStats m_stats{};
 };
 
 ////////////////////////////////
@@ -144,9 +351,31 @@ void listDir(fs::FS& fs, const char* dirname, uint8_t levels);
 /// Date & Time
 ////////////////////////////////
 
+// [s] UTC + 2, the NTP client hands out local time for the display and the log
+constexpr int32_t NTP_TIME_OFFSET{7200};
+
 String getFormattedTime(unsigned long secs);
 String getFormattedDate(unsigned long secs);
 
+/// [unix seconds] UTC, for everything that is stored or leaves the device (archive, exports, MQTT, InfluxDB)
+uint32_t getUnixTime(const NTPClient& ntpclient);
+
+/// "YYYY-MM-DDTHH:MM:SSZ" (UTC) in a fixed buffer
+/// Keeps the last result: within the same second nothing is done, within the same day only the time is rewritten.
+class DateTimeText
+{
+public:
+    static constexpr size_t LENGTH{20};
+
+    /// @param secs [unix seconds]
+    const char* format(uint32_t secs);
+
+private:
+    std::array<char, LENGTH + 1> m_text{};
+    uint32_t                     m_secs{};
+    uint32_t                     m_day{UINT32_MAX};
+};
+
 ////////////////////////////////
 /// Enums
 ////////////////////////////////
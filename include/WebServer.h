@@ -26,43 +26,93 @@
 
 #pragma once
 
+#include "Logger.h"
+#include "Metrics.h"
+#include "Scheduler.h"
+#include "SensorArchive.h"
 #include "SensorData.h"
+#include "SensorHistory.h"
 #include <Arduino.h>
 #include <ESPAsyncWebServer.h>
+#include <NTPClient.h>
+#include <functional>
+#include <vector>
 
 class WebServer
 {
 public:
     enum class HTTPStatusCode
     {
-        Ok            = 200,
-        NotFound      = 404,
-        NotAcceptable = 406
+        Ok                 = 200,
+        NotModified        = 304,
+        BadRequest         = 400,
+        NotFound           = 404,
+        NotAcceptable      = 406,
+        ServiceUnavailable = 503
     };
 
-    WebServer(SensorDataStorage& sensorData, AsyncWebServer& asyncWebserver)
-        : sensorData(sensorData), asyncWebserver(asyncWebserver)
+    WebServer(SensorDataStorage& sensorData, SensorHistory& sensorHistory, SensorArchive& sensorArchive, LogBuffer& logBuffer, Metrics& metrics, AsyncWebServer& asyncWebserver, NTPClient& ntpclient)
+        : sensorData(sensorData), sensorHistory(sensorHistory), sensorArchive(sensorArchive), logBuffer(logBuffer), metrics(metrics), asyncWebserver(asyncWebserver), ntpclient(ntpclient)
     {
     }
 
     bool init();
 
+    /// Called by /restartHAIR, the handler shall restart outside of the webserver task (which must not block)
+    /// Without a handler the webserver restarts right away.
+    void setRestartHandler(std::function<void()> handler)
+    {
+        restartHandler = std::move(handler);
+    }
+
+    /// The stats of the scheduler are served on /taskstats
+    void addScheduler(Scheduler& scheduler)
+    {
+        schedulers.push_back(&scheduler);
+    }
+
 private:
     SensorDataStorage& sensorData;
+    SensorHistory&     sensorHistory;
+    SensorArchive&     sensorArchive;
+    LogBuffer&         logBuffer;
+    Metrics&           metrics;
     AsyncWebServer&    asyncWebserver;
+    NTPClient&         ntpclient;
+
+    std::function<void()>   restartHandler{};
+    std::vector<Scheduler*> schedulers{};
+
+    ////////////////////////////////
+    /// Assets
+    ////////////////////////////////
+
+    /// A file of the filesystem image, stored gzipped as <url>.gz (see tools/compress_fs.py)
+    struct Asset
+    {
+        String url;
+        String version;     // content hash
+        String etag;        // the version in quotes
+        String contentType;
+    };
+
+    std::vector<Asset> assets{}; // not modified after init(), the handlers keep references
+
+    bool loadAssets();
+    void onAsset(AsyncWebServerRequest* request, const Asset& asset);
 
     ////////////////////////////////
     /// Logging
     ////////////////////////////////
 
-    void logRequest(AsyncWebServerRequest* request);
+    void logRequest(AsyncWebServerRequest* request, const char* route = nullptr); // route for /metrics, default is the URL
     auto logReply(AsyncWebServerRequest* request, HTTPStatusCode code) -> int32_t;
 
     ////////////////////////////////
     /// Root Callbacks
     ////////////////////////////////
 
-    void onRoot(AsyncWebServerRequest* request);         // return index.html
+    void onRoot(AsyncWebServerRequest* request);         // return index.html (the asset if there is one)
     void onPageNotFound(AsyncWebServerRequest* request); // display 404
 
     ////////////////////////////////
@@ -72,6 +122,19 @@ private:
     // Misc
     void onRestartHAIR(AsyncWebServerRequest* request);
     void onSensordata(AsyncWebServerRequest* request); // return json str of sensor data
+    void onHistory(AsyncWebServerRequest* request);    // stream json of the sensor history
+    void onArchive(AsyncWebServerRequest* request);    // json list of the archive segments, the files are served below /archive/
+    void onTaskStats(AsyncWebServerRequest* request);  // json of the scheduling latency and duration per task
+
+    // Export, all of them stream chunk by chunk
+    enum class ExportFormat
+    {
+        CSV,
+        NDJSON
+    };
+    void onExport(AsyncWebServerRequest* request, ExportFormat format); // archive as csv or ndjson
+    void onLogs(AsyncWebServerRequest* request);                        // recent log output, text or binary records
+    void onMetrics(AsyncWebServerRequest* request);                     // OpenMetrics for Prometheus
 
     // Logger
     void onGetLoggerSeverity(AsyncWebServerRequest* request);
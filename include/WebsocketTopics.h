@@ -0,0 +1,136 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "LogCapture.h"
+#include "Metrics.h"
+#include "SensorData.h"
+#include "Utilities.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <array>
+#include <mutex>
+
+/// What a client of the sensordata topic gets
+/// channels default to all of them, rate [Hz] defaults to every tick of the websocket task (which also caps it), onChange and binary to false.
+struct Subscription
+{
+    SensorChannel channels{SensorChannel::All};
+    bool          binary{false};
+    uint32_t      interval{0};     // [ms] between two messages, 0 => every tick
+    bool          onChange{false}; // only send if a subscribed value changed
+};
+
+/// Sensor data and log messages as topics of the one websocket on the webserver (ws://hAIR.local/ws)
+/// A client gets nothing until it subscribes to a topic with a message:
+///   {"subscribe":{"topic":"sensordata","channels":["SGP30_IAQ"],"rate":0.2,"onChange":true,"binary":true}}
+///   {"subscribe":{"topic":"logs"}}
+///   {"unsubscribe":{"topic":"logs"}}
+/// Text messages are the JSON of the topic ({"hAIR":...} or {"logMessage":...}).
+/// Binary messages start with the topic byte followed by the sensor data frame or the log record (the logs are binary if the appender is).
+///
+/// The events arrive on the async_tcp task, publish() and publishLog() run on the threads that produce the data.
+/// The client table is guarded by a mutex, so a client is never used after its disconnect event.
+/// A client whose send queue is full misses the message instead of queueing more heap, see hair_websocket_dropped_messages in /metrics.
+class WebsocketTopics
+{
+public:
+    /// Every client holds one of the few TCP connections of lwIP, the webserver needs some as well. Any further client is closed right away.
+    static constexpr size_t CLIENT_COUNT{DEFAULT_MAX_WS_CLIENTS};
+
+    /// First byte of a binary message
+    static constexpr uint8_t BINARY_SENSORDATA{1};
+    static constexpr uint8_t BINARY_LOGS{2};
+
+    WebsocketTopics(AsyncWebSocket& websocket, Metrics& metrics)
+        : m_websocket(websocket), m_metrics(metrics)
+    {
+    }
+
+    /// Websocket event handler, runs on the async_tcp task
+    void onEvent(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t length);
+
+    /// One tick of the websocket task, sends the sensor data to every subscriber that is due
+    /// Each distinct subscription (channels and encoding) is encoded once per tick, no matter how many clients share it.
+    void publish(Timestamp now, const SensorDataStorage& sensorData);
+
+    /// Sends a log message to every subscriber, the JSON text or the binary record (see LogFormat.h)
+    void publishLog(const char* json, size_t length);
+    void publishLog(const uint8_t* record, size_t length);
+
+private:
+    using Topic = Metrics::Websocket;
+
+    static constexpr size_t TOPIC_COUNT{static_cast<size_t>(Topic::COUNT)};
+    static constexpr size_t CHANNEL_SETS{enum_cast_to_underlying(SensorChannel::All) + 1};
+
+    struct Client
+    {
+        AsyncWebSocketClient* client;       // nullptr => free
+        uint8_t               topics;       // bit per Topic
+        Subscription          subscription; // sensordata
+        bool                  subscribed;   // since the last publish(), it is due right away
+
+        // publish() only
+        Timestamp                                        nextDue;
+        size_t                                           lastLength; // 0 => nothing sent yet
+        std::array<uint8_t, SensorData::BINARY_CAPACITY> lastFrame;  // binary frame of the last message, for onChange
+    };
+
+    AsyncWebSocket& m_websocket;
+    Metrics&        m_metrics;
+
+    std::mutex                                         m_mutex{};
+    std::array<Client, CLIENT_COUNT>                   m_clients{};
+    std::array<uint32_t, TOPIC_COUNT>                  m_subscribers{};
+    std::array<uint8_t, 1 + LogEntry::RECORD_CAPACITY> m_logMessage{}; // binary log record with its topic byte
+
+    ////////////////////////////////
+    /// publish() only
+    ////////////////////////////////
+
+    // Encoded during the current tick, index is the SensorChannel bitmask, the binary messages include the topic byte
+    uint8_t                                                                        m_binaryEncoded{};
+    uint8_t                                                                        m_jsonEncoded{};
+    std::array<std::array<uint8_t, 1 + SensorData::BINARY_CAPACITY>, CHANNEL_SETS> m_binary{};
+    std::array<size_t, CHANNEL_SETS>                                               m_binaryLength{};
+    std::array<std::array<char, SensorData::JSON_CAPACITY>, CHANNEL_SETS>          m_json{};
+    std::array<size_t, CHANNEL_SETS>                                               m_jsonLength{};
+
+    void connect(AsyncWebSocketClient* client);
+    void disconnect(AsyncWebSocketClient* client);
+    void receive(AsyncWebSocketClient* client, const char* message, size_t length);
+    void subscribe(Client& client, Topic topic, const JsonVariantConst& request);
+    void countSubscribers();
+
+    /// @return false if the message was dropped
+    bool send(AsyncWebSocketClient* client, Topic topic, const void* message, size_t length, bool binary);
+
+    const uint8_t* getBinary(const SensorData& data, uint32_t generation, SensorChannel channels, size_t& length);
+    const char*    getJSON(const SensorData& data, SensorChannel channels, size_t& length);
+};
@@ -0,0 +1,66 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "I2CBus.h"
+#include <Arduino.h>
+#include <Wire.h>
+
+/// I2CBus on the Arduino TwoWire
+/// Not thread safe, every device on the bus is driven from the sda thread.
+class WireBus : public I2CBus
+{
+public:
+    explicit WireBus(TwoWire& wire)
+        : m_wire(wire)
+    {
+    }
+
+    bool write(uint8_t address, const uint8_t* data, size_t length) override
+    {
+        m_wire.beginTransmission(address);
+        m_wire.write(data, length);
+        return m_wire.endTransmission() == 0;
+    }
+
+    bool read(uint8_t address, uint8_t* data, size_t length) override
+    {
+        if (m_wire.requestFrom(address, static_cast<uint8_t>(length)) != length)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < length; ++i)
+        {
+            data[i] = static_cast<uint8_t>(m_wire.read());
+        }
+        return true;
+    }
+
+private:
+    TwoWire& m_wire;
+};
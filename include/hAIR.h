@@ -28,17 +28,25 @@
 
 #include "Display.h"
 #include "Logger.h"
+#include "InfluxUploader.h"
+#include "MqttPublisher.h"
+#include "Scheduler.h"
+#include "SensorArchive.h"
 #include "SensorData.h"
+#include "SensorHistory.h"
+#include "SensorPlugins.h"
+#include "SensorRegistry.h"
 #include "Utilities.h"
 #include "WebServer.h"
-#include <Adafruit_SGP30.h>
+#include "WebsocketTopics.h"
+#include "WireBus.h"
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 #include <NTPClient.h>
 #include <TFT_eSPI.h>
-#include <WebSocketsServer.h>
 #include <WiFiUdp.h>
+#include <atomic>
 #include <mutex>
 
 constexpr auto HAIR_VERSION_STRING{"0.1"};
@@ -60,6 +68,8 @@ public:
         int32_t serial_baudrate{115200};
 
         int32_t logger_severity{plog::debug}; // see https://github.com/SergiusTheBest/plog/blob/master/include/plog/Severity.h
+        bool    logger_dropOldest{false};     // if the log queue is full: true => drop the oldest records; false => drop new ones
+        bool    logger_binary{false};         // true => binary records instead of text, decoded on the host (see LogFormat.h)
 
         ////////////////////////////////
         /// Application Layer
@@ -69,36 +79,101 @@ public:
         float sgp_IAQ_frequency{1};
         float sgp_IAQraw_frequency{10};
 
-        float bme_measure_frequency{10};
+        float   bme_measure_frequency{10};
+        int32_t bme_oversamplingT{2}; // 1, 2, 4, 8 or 16, one conversion takes ~2 ms per sample of T, P and H
+        int32_t bme_oversamplingP{4};
+        int32_t bme_oversamplingH{1};
+        int32_t bme_filter{2};        // IIR coefficient setting 0 (off) .. 4
 
         float sdd_serial_frequency{0};
         float sdd_display_frequency{5};
         float sdd_websocket_frequency{1};
 
+        int32_t history_memoryBudget{64 * 1024}; // [bytes], 0 disables the history
+
+        float   archive_frequency{1.0F / 60.0F}; // one record per minute is ~25 KiB per day
+        int32_t archive_flushInterval{300};      // [s]
+        int32_t archive_segmentSize{64 * 1024};  // [bytes]
+        int32_t archive_segmentCount{8};         // 0 disables the archive
+
+        int32_t taskStats_serialInterval{300}; // [s] how often the scheduling stats are printed, 0 disables
+
+        String  mqtt_host{""};             // empty disables MQTT
+        int32_t mqtt_port{1883};
+        String  mqtt_user{""};             // empty => anonymous
+        String  mqtt_password{""};
+        String  mqtt_topic{"hAIR"};        // prefix of all topics, see MqttPublisher
+        int32_t mqtt_qos{1};               // of the samples, 0 or 1
+        float   mqtt_frequency{0.1F};      // samples per second
+        int32_t mqtt_batchSize{6};         // [samples] per message
+        int32_t mqtt_healthInterval{60};   // [s] 0 disables the health messages
+        int32_t mqtt_queueSize{360};       // [samples] in RAM while the broker is unreachable
+        int32_t mqtt_spillSize{64 * 1024}; // [bytes] on LittleFS once the RAM queue is full, 0 disables
+        float   mqtt_drainRate{5};         // [messages/s] while catching up after a reconnect
+        bool    mqtt_discovery{true};      // Home Assistant discovery
+
+        String  influx_url{""};                // write endpoint, empty disables the upload, see InfluxUploader
+        String  influx_token{""};              // empty => no Authorization header
+        String  influx_measurement{"air"};
+        float   influx_frequency{0.1F};        // samples per second
+        int32_t influx_batchSize{30};          // [samples] per request
+        int32_t influx_outboxSize{128 * 1024}; // [bytes] on LittleFS for the batches that could not be sent, 0 disables
+
         ////////////////////////////////
         /// JSON
         ////////////////////////////////
 
+        static constexpr int JSON_CAPACITY{3072}; // an InfluxDB URL and token are ~200 characters
+
         static bool fromJSON(Config& config, const String& jsonStr)
         {
             // https: //arduinojson.org/v6/doc/deserialization/
-            StaticJsonDocument<512> doc;
+            DynamicJsonDocument doc(JSON_CAPACITY);
 
             DeserializationError err = deserializeJson(doc, jsonStr);
             if (err == DeserializationError::Ok)
             {
-                Config tmp{};
-
-                config.wifi_ssid               = doc["wifi"]["ssid"].as<String>();
-                config.wifi_password           = doc["wifi"]["password"].as<String>();
-                config.serial_baudrate         = doc["serial"]["baudrate"];
-                config.logger_severity         = doc["logger"]["severity"];
-                config.sgp_IAQ_frequency       = doc["sgp30"]["iaqFrequency"];
-                config.sgp_IAQraw_frequency    = doc["sgp30"]["iaqRawFrequency"];
-                config.bme_measure_frequency   = doc["bmexxx"]["dataFrequency"];
-                config.sdd_serial_frequency    = doc["sdd"]["serial_frequency"];
-                config.sdd_display_frequency   = doc["sdd"]["display_frequency"];
-                config.sdd_websocket_frequency = doc["sdd"]["websocket_frequency"];
+                config.wifi_ssid                = doc["wifi"]["ssid"].as<String>();
+                config.wifi_password            = doc["wifi"]["password"].as<String>();
+                config.serial_baudrate          = doc["serial"]["baudrate"];
+                config.logger_severity          = doc["logger"]["severity"];
+                config.logger_dropOldest        = doc["logger"]["dropOldest"] | config.logger_dropOldest;
+                config.logger_binary            = doc["logger"]["binary"] | config.logger_binary;
+                config.sgp_IAQ_frequency        = doc["sgp30"]["iaqFrequency"];
+                config.sgp_IAQraw_frequency     = doc["sgp30"]["iaqRawFrequency"];
+                config.bme_measure_frequency    = doc["bmexxx"]["dataFrequency"];
+                config.bme_oversamplingT        = doc["bmexxx"]["oversamplingT"] | config.bme_oversamplingT;
+                config.bme_oversamplingP        = doc["bmexxx"]["oversamplingP"] | config.bme_oversamplingP;
+                config.bme_oversamplingH        = doc["bmexxx"]["oversamplingH"] | config.bme_oversamplingH;
+                config.bme_filter               = doc["bmexxx"]["filter"] | config.bme_filter;
+                config.sdd_serial_frequency     = doc["sdd"]["serial_frequency"];
+                config.sdd_display_frequency    = doc["sdd"]["display_frequency"];
+                config.sdd_websocket_frequency  = doc["sdd"]["websocket_frequency"];
+                config.history_memoryBudget     = doc["history"]["memoryBudget"] | config.history_memoryBudget;
+                config.archive_frequency        = doc["archive"]["frequency"] | config.archive_frequency;
+                config.archive_flushInterval    = doc["archive"]["flushInterval"] | config.archive_flushInterval;
+                config.archive_segmentSize      = doc["archive"]["segmentSize"] | config.archive_segmentSize;
+                config.archive_segmentCount     = doc["archive"]["segmentCount"] | config.archive_segmentCount;
+                config.taskStats_serialInterval = doc["taskStats"]["serialInterval"] | config.taskStats_serialInterval;
+                config.mqtt_host                = doc["mqtt"]["host"] | config.mqtt_host;
+                config.mqtt_port                = doc["mqtt"]["port"] | config.mqtt_port;
+                config.mqtt_user                = doc["mqtt"]["user"] | config.mqtt_user;
+                config.mqtt_password            = doc["mqtt"]["password"] | config.mqtt_password;
+                config.mqtt_topic               = doc["mqtt"]["topic"] | config.mqtt_topic;
+                config.mqtt_qos                 = doc["mqtt"]["qos"] | config.mqtt_qos;
+                config.mqtt_frequency           = doc["mqtt"]["frequency"] | config.mqtt_frequency;
+                config.mqtt_batchSize           = doc["mqtt"]["batchSize"] | config.mqtt_batchSize;
+                config.mqtt_healthInterval      = doc["mqtt"]["healthInterval"] | config.mqtt_healthInterval;
+                config.mqtt_queueSize           = doc["mqtt"]["queueSize"] | config.mqtt_queueSize;
+                config.mqtt_spillSize           = doc["mqtt"]["spillSize"] | config.mqtt_spillSize;
+                config.mqtt_drainRate           = doc["mqtt"]["drainRate"] | config.mqtt_drainRate;
+                config.mqtt_discovery           = doc["mqtt"]["discovery"] | config.mqtt_discovery;
+                config.influx_url               = doc["influx"]["url"] | config.influx_url;
+                config.influx_token             = doc["influx"]["token"] | config.influx_token;
+                config.influx_measurement       = doc["influx"]["measurement"] | config.influx_measurement;
+                config.influx_frequency         = doc["influx"]["frequency"] | config.influx_frequency;
+                config.influx_batchSize         = doc["influx"]["batchSize"] | config.influx_batchSize;
+                config.influx_outboxSize        = doc["influx"]["outboxSize"] | config.influx_outboxSize;
 
                 if (validate(config))
                 {
@@ -109,35 +184,64 @@ public:
             return false;
         }
 
-        template<int N = 512>
-        static size_t toJSON(Config config, char* jsonStr)
+        /// Pretty printed straight into out (e.g. the config file), no copy of the text is kept
+        /// @return bytes written, 0 if the document could not be allocated
+        static size_t toJSON(const Config& config, Print& out)
         {
-            // https://arduinojson.org/v6/doc/serialization/
-            StaticJsonDocument<N> doc;
-
-            doc["wifi"]["ssid"]               = config.wifi_ssid;
-            doc["wifi"]["password"]           = config.wifi_password;
-            doc["serial"]["baudrate"]         = config.serial_baudrate;
-            doc["logger"]["severity"]         = config.logger_severity;
-            doc["sgp30"]["iaqFrequency"]      = config.sgp_IAQ_frequency;
-            doc["sgp30"]["iaqRawFrequency"]   = config.sgp_IAQraw_frequency;
-            doc["bmexxx"]["dataFrequency"]    = config.bme_measure_frequency;
-            doc["sdd"]["serial_frequency"]    = config.sdd_serial_frequency;
-            doc["sdd"]["display_frequency"]   = config.sdd_display_frequency;
-            doc["sdd"]["websocket_frequency"] = config.sdd_websocket_frequency;
-
-            char tmp[N]{}; // stupid type forwarding...
-            auto size = serializeJsonPretty(doc, tmp);
-            memcpy(jsonStr, tmp, N);
-            return size;
+            DynamicJsonDocument doc(JSON_CAPACITY);
+            if (doc.capacity() == 0)
+            {
+                return 0;
+            }
+
+            toDocument(config, doc);
+            return serializeJsonPretty(doc, out);
         }
 
-        template<int N = 512>
-        static String toJSON(Config config)
+        // https://arduinojson.org/v6/doc/serialization/
+        static void toDocument(const Config& config, JsonDocument& doc)
         {
-            std::array<char, N> jsonStr{};
-            toJSON<N>(config, jsonStr.data());
-            return String{jsonStr.data()};
+            doc["wifi"]["ssid"]                = config.wifi_ssid;
+            doc["wifi"]["password"]            = config.wifi_password;
+            doc["serial"]["baudrate"]          = config.serial_baudrate;
+            doc["logger"]["severity"]          = config.logger_severity;
+            doc["logger"]["dropOldest"]        = config.logger_dropOldest;
+            doc["logger"]["binary"]            = config.logger_binary;
+            doc["sgp30"]["iaqFrequency"]       = config.sgp_IAQ_frequency;
+            doc["sgp30"]["iaqRawFrequency"]    = config.sgp_IAQraw_frequency;
+            doc["bmexxx"]["dataFrequency"]     = config.bme_measure_frequency;
+            doc["bmexxx"]["oversamplingT"]     = config.bme_oversamplingT;
+            doc["bmexxx"]["oversamplingP"]     = config.bme_oversamplingP;
+            doc["bmexxx"]["oversamplingH"]     = config.bme_oversamplingH;
+            doc["bmexxx"]["filter"]            = config.bme_filter;
+            doc["sdd"]["serial_frequency"]     = config.sdd_serial_frequency;
+            doc["sdd"]["display_frequency"]    = config.sdd_display_frequency;
+            doc["sdd"]["websocket_frequency"]  = config.sdd_websocket_frequency;
+            doc["history"]["memoryBudget"]     = config.history_memoryBudget;
+            doc["archive"]["frequency"]        = config.archive_frequency;
+            doc["archive"]["flushInterval"]    = config.archive_flushInterval;
+            doc["archive"]["segmentSize"]      = config.archive_segmentSize;
+            doc["archive"]["segmentCount"]     = config.archive_segmentCount;
+            doc["taskStats"]["serialInterval"] = config.taskStats_serialInterval;
+            doc["mqtt"]["host"]                = config.mqtt_host;
+            doc["mqtt"]["port"]                = config.mqtt_port;
+            doc["mqtt"]["user"]                = config.mqtt_user;
+            doc["mqtt"]["password"]            = config.mqtt_password;
+            doc["mqtt"]["topic"]               = config.mqtt_topic;
+            doc["mqtt"]["qos"]                 = config.mqtt_qos;
+            doc["mqtt"]["frequency"]           = config.mqtt_frequency;
+            doc["mqtt"]["batchSize"]           = config.mqtt_batchSize;
+            doc["mqtt"]["healthInterval"]      = config.mqtt_healthInterval;
+            doc["mqtt"]["queueSize"]           = config.mqtt_queueSize;
+            doc["mqtt"]["spillSize"]           = config.mqtt_spillSize;
+            doc["mqtt"]["drainRate"]           = config.mqtt_drainRate;
+            doc["mqtt"]["discovery"]           = config.mqtt_discovery;
+            doc["influx"]["url"]               = config.influx_url;
+            doc["influx"]["token"]             = config.influx_token;
+            doc["influx"]["measurement"]       = config.influx_measurement;
+            doc["influx"]["frequency"]         = config.influx_frequency;
+            doc["influx"]["batchSize"]         = config.influx_batchSize;
+            doc["influx"]["outboxSize"]        = config.influx_outboxSize;
         }
 
         ////////////////////////////////
@@ -153,16 +257,38 @@ public:
                    isWithin(config.sgp_IAQ_frequency, FREQ_MIN, FREQ_MAX) &&
                    isWithin(config.sgp_IAQraw_frequency, FREQ_MIN, FREQ_MAX) &&
                    isWithin(config.bme_measure_frequency, FREQ_MIN, FREQ_MAX) &&
+                   BMExxx::isValidOversampling(config.bme_oversamplingT) &&
+                   BMExxx::isValidOversampling(config.bme_oversamplingP) &&
+                   BMExxx::isValidOversampling(config.bme_oversamplingH) &&
+                   isWithin(config.bme_filter, 0, 4) &&
                    isWithin(config.sdd_serial_frequency, FREQ_MIN, FREQ_MAX) &&
                    isWithin(config.sdd_display_frequency, FREQ_MIN, FREQ_MAX) &&
-                   isWithin(config.sdd_websocket_frequency, FREQ_MIN, FREQ_MAX);
+                   isWithin(config.sdd_websocket_frequency, FREQ_MIN, FREQ_MAX) &&
+                   isWithin(config.history_memoryBudget, 0, 128 * 1024) &&
+                   isWithin(config.archive_frequency, FREQ_MIN, 1.0F) &&
+                   isWithin(config.archive_flushInterval, 1, 3600) &&
+                   isWithin(config.archive_segmentSize, 8 * 1024, 1024 * 1024) &&
+                   isWithin(config.archive_segmentCount, 0, 64) &&
+                   isWithin(config.taskStats_serialInterval, 0, 86400) &&
+                   isWithin(config.mqtt_port, 1, 65535) &&
+                   isWithin(config.mqtt_qos, 0, 1) &&
+                   isWithin(config.mqtt_frequency, FREQ_MIN, 10.0F) &&
+                   isWithin(config.mqtt_batchSize, 1, static_cast<int32_t>(MqttPublisher::MAX_BATCH_SIZE)) &&
+                   isWithin(config.mqtt_healthInterval, 0, 86400) &&
+                   isWithin(config.mqtt_queueSize, config.mqtt_batchSize, 4096) &&
+                   isWithin(config.mqtt_spillSize, 0, 1024 * 1024) &&
+                   isWithin(config.mqtt_drainRate, 0.1F, 100.0F) &&
+                   isWithin(static_cast<size_t>(config.influx_measurement.length()), size_t{1}, InfluxUploader::MAX_MEASUREMENT_LENGTH) &&
+                   isWithin(config.influx_frequency, FREQ_MIN, 10.0F) &&
+                   isWithin(config.influx_batchSize, 1, static_cast<int32_t>(InfluxUploader::MAX_BATCH_SIZE)) &&
+                   isWithin(config.influx_outboxSize, 0, 1024 * 1024);
         }
     };
 
     struct Components
     {
-        Components(SensorDataStorage& sensorData)
-            : webserver{sensorData, asyncWebserver}
+        Components(SensorDataStorage& sensorData, SensorHistory& sensorHistory, SensorArchive& sensorArchive)
+            : webserver{sensorData, sensorHistory, sensorArchive, logBuffer, metrics, asyncWebserver, ntpclient}
         {
         }
 
@@ -179,17 +305,27 @@ public:
         // Application Layer
         ////////////////////////////////
 
+        Metrics        metrics{};
         hAIR_Formatter formatter{ntpclient};
-        hAIR_Appender  appender{formatter, display, websocketLogMessages};
+        hAIR_Appender  appender{formatter, display, websocketTopics, logBuffer, metrics};
+        LogBuffer      logBuffer{};
+
+        WebServer       webserver;
+        AsyncWebSocket  websocket{"/ws"}; // on the webserver, sensor data and logs are topics, see WebsocketTopics
+        WebsocketTopics websocketTopics{websocket, metrics};
 
-        WebServer        webserver;
-        WebSocketsServer websocketSensorData{81};
-        WebSocketsServer websocketLogMessages{82};
+        MqttPublisher  mqtt{metrics};
+        InfluxUploader influx{metrics};
 
-        Display display{tft};
+        Display display{tft, metrics};
 
+        // Sensors, see initSensors() for the registration
         // https://www.sensirion.com/fileadmin/user_upload/customers/sensirion/Dokumente/9_Gas_Sensors/Datasheets/Sensirion_Gas_Sensors_Datasheet_SGP30.pdf
-        Adafruit_SGP30 sgp{};
+        WireBus        i2c{Wire};
+        SGP30Plugin    sgp30{i2c};
+        SGP30RawPlugin sgp30raw{sgp30};
+        BMExxxPlugin   bme{i2c};
+        SensorRegistry sensors{};
     };
 
     struct Runtime
@@ -198,24 +334,51 @@ public:
         /// Base Layer
         ////////////////////////////////
 
+        TaskItem task_system_poll{}; // OTA has no events, it has to be polled
+        TaskItem task_system_ntp{};
         TaskItem task_system_restartBecauseWiFiFailed{};
+        TaskItem task_system_restartRequested{}; // runs on notification only
+
+        std::atomic<bool> restartRequested{false};
 
         ////////////////////////////////
         /// Application Layer
         ////////////////////////////////
 
-        // Sensor Data Acquisition - SGP30
-        TaskItem task_sda_sqp_IAQ{};
-        TaskItem task_sda_sqp_IAQraw{};
+        // Sensor Data Acquisition, the measurements have their tasks in the SensorRegistry
         TaskItem task_sda_sqp_baseline{};
 
-        // Sensor Data Acquisition - BMExxx
-        TaskItem task_sda_bme_measure{};
+        // Working copy of the sda thread, the jobs update it and the pass hook publishes it if something changed
+        // We need to preserve old values, since the SGP methods fail kind of often :(
+        SensorData sda_data{};
+        bool       sda_changed{false};
 
         // Sensor Data Distribution
         TaskItem task_sdd_serial{};
         TaskItem task_sdd_display{};
         TaskItem task_sdd_websocket{};
+
+        // Sensor Archive
+        TaskItem task_archive_add{};
+        TaskItem task_archive_flush{};
+
+        // MQTT, see MqttPublisher
+        TaskItem task_mqtt_add{};
+        TaskItem task_mqtt_poll{};
+        TaskItem task_mqtt_health{};
+
+        // InfluxDB, see InfluxUploader
+        TaskItem task_influx_add{};
+        TaskItem task_influx_upload{};
+
+        // Scheduling stats on the serial console
+        TaskItem task_taskStats_serial{};
+
+        // Log output, see hAIR_Appender
+        TaskItem task_log_drain{};
+
+        // Display, see Display::render()
+        TaskItem task_display_render{};
     };
 
     struct POST
@@ -231,8 +394,10 @@ public:
         bool logger;         /// true => success;   false => failed
 
         bool webserver;      /// true => success;   false => failed
-        bool sgp30;          /// true => success;   false => failed
-        bool sgp30_baseline; /// true => prefs set; false => failed
+        bool history;        /// true => allocated; false => failed
+        bool archive;        /// true => opened;    false => failed
+        bool mqtt;           /// true => started;   false => failed
+        bool influx;         /// true => started;   false => failed
     };
 
     void setup();
@@ -244,42 +409,75 @@ private:
     ////////////////////////////////
 
     Config            config{};
-    Components        components{sensorData};
+    Components        components{sensorData, sensorHistory, sensorArchive};
     Runtime           runtime{};
     SensorDataStorage sensorData{};
+    SensorHistory     sensorHistory{};
+    SensorArchive     sensorArchive{};
     POST              post{};
 
     ////////////////////////////////
-    /// Thread Functions
+    /// Jobs
     ////////////////////////////////
 
-    void threadFunction_sensorDataAcquisition(Timestamp now);
-    void threadFunction_sensorDataDistribution(Timestamp now);
-    void threadFunction_loop(Timestamp now);
+    Scheduler::Job bindJob(void (hAIR_System::*job)(Timestamp));
+    void           restart(Timestamp now); // flushes the archive and the current InfluxDB batch first
 
-    // We need to use these task params because unlike std::thread, xTaskCreatePinnedToCore won't take a capturing lambda. So 'this' pointer has to live somewhere 'static'
-    struct TaskParams
-    {
-        using fp_t = void (hAIR_System::*)(Timestamp);
+    // Sensor Data Acquisition
+    void job_sda_sgp_baseline(Timestamp now);
+    void job_sda_publish(Timestamp now); // pass hook
 
-        TaskParams(hAIR_System& instance, fp_t fp)
-            : m_instance(instance), m_fp(fp)
-        {
-        }
+    // Sensor Data Distribution
+    void job_sdd_serial(Timestamp now);
+    void job_sdd_display(Timestamp now);
+    void job_sdd_websocket(Timestamp now);
 
-        hAIR_System& m_instance;
-        fp_t         m_fp;
+    // Loop
+    void job_system_poll(Timestamp now);
+    void job_system_ntp(Timestamp now);
+    void job_system_restartBecauseWiFiFailed(Timestamp now);
+    void job_system_restartRequested(Timestamp now); // on notification
+    void job_archive_add(Timestamp now);
+    void job_archive_flush(Timestamp now);
+    void job_mqtt_add(Timestamp now);
+    void job_mqtt_poll(Timestamp now);
+    void job_mqtt_health(Timestamp now);
+    void job_taskStats_serial(Timestamp now);
 
-        void callThreadFunction(Timestamp now) const
-        {
-            (m_instance.*m_fp)(now);
-        }
-    };
+    // Log
+    void job_log_drain(Timestamp now); // on notification
+
+    // Display
+    void job_display_render(Timestamp now);
+
+    // Upload
+    void job_influx_add(Timestamp now);
+    void job_influx_upload(Timestamp now);
+
+    ////////////////////////////////
+    /// Threads
+    ////////////////////////////////
+
+    // One scheduler per thread, the thread sleeps until the next deadline of its jobs
+    // The loop scheduler runs in the Arduino loop task, setup() and loop() share that thread.
+    RTOSClock clock_sensorDataAcquisition{};
+    RTOSClock clock_sensorDataDistribution{};
+    RTOSClock clock_loop{};
+    RTOSClock clock_log{};
+    RTOSClock clock_display{};
+    RTOSClock clock_upload{};
+    Scheduler scheduler_sensorDataAcquisition{"sda", clock_sensorDataAcquisition};
+    Scheduler scheduler_sensorDataDistribution{"sdd", clock_sensorDataDistribution};
+    Scheduler scheduler_loop{"loop", clock_loop};
+    Scheduler scheduler_log{"log", clock_log};
+    Scheduler scheduler_display{"dsp", clock_display};
+    Scheduler scheduler_upload{"upl", clock_upload};
 
     TaskHandle_t thread_sensorDataAcquisition{};
     TaskHandle_t thread_sensorDataDistribution{};
-    TaskParams   threadParams_sensorDataAcquisition{*this, &hAIR_System::threadFunction_sensorDataAcquisition};
-    TaskParams   threadParams_sensorDataDistribution{*this, &hAIR_System::threadFunction_sensorDataDistribution};
+    TaskHandle_t thread_log{};
+    TaskHandle_t thread_display{};
+    TaskHandle_t thread_upload{};
 
     ////////////////////////////////
     /// Init
@@ -297,7 +495,11 @@ private:
     void initLogger();
 
     // Application
-    void initSGP();
+    void initSensors();
+    void initHistory();
+    void initArchive();
+    void initMqtt();
+    void initInflux();
 
     ////////////////////////////////
     // Post
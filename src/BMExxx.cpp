@@ -0,0 +1,429 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "BMExxx.h"
+#include <initializer_list>
+
+namespace
+{
+constexpr uint8_t REG_CHIP_ID{0xD0};
+constexpr uint8_t REG_RESET{0xE0};
+constexpr uint8_t RESET_COMMAND{0xB6};
+constexpr uint8_t MODE_FORCED{0x01};
+
+// Both chips have the same data layout (press, temp, hum MSB first), behind a status register at a different offset
+struct Registers
+{
+    uint8_t chipId;
+    uint8_t ctrlHum;
+    uint8_t ctrlMeas;
+    uint8_t config;
+    uint8_t burst;      // first register of the burst read, the status
+    uint8_t dataOffset; // of press_msb in the burst
+};
+
+constexpr Registers BME280{0x60, 0xF2, 0xF4, 0xF5, 0xF3, 4};
+constexpr Registers BME680{0x61, 0x72, 0x74, 0x75, 0x1D, 2};
+
+constexpr size_t DATA_LENGTH{8};
+constexpr size_t MAX_BURST_LENGTH{4 + DATA_LENGTH};
+
+// The caller's clock is millis(), the sensor may need all of the last millisecond
+constexpr int32_t CLOCK_MARGIN{1}; // [ms]
+
+const Registers& registersOf(BMExxx::Chip chip)
+{
+    return chip == BMExxx::Chip::BME680 ? BME680 : BME280;
+}
+
+/// 1, 2, 4, 8, 16 => register value 1 .. 5; 0 => invalid
+uint8_t oversamplingOf(uint8_t factor)
+{
+    switch (factor)
+    {
+    case 1:
+        return 1;
+    case 2:
+        return 2;
+    case 4:
+        return 3;
+    case 8:
+        return 4;
+    case 16:
+        return 5;
+    default:
+        return 0;
+    }
+}
+
+bool isDue(int32_t now, int32_t due)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(now) - static_cast<uint32_t>(due)) >= 0;
+}
+
+uint16_t u16(const uint8_t* lsb)
+{
+    return static_cast<uint16_t>((lsb[1] << 8) | lsb[0]);
+}
+
+int16_t s16(const uint8_t* lsb)
+{
+    return static_cast<int16_t>(u16(lsb));
+}
+} // namespace
+
+////////////////////////////////
+/// Setup, blocking
+////////////////////////////////
+
+bool BMExxx::begin(const Settings& settings, Delay delay)
+{
+    const auto osrsT{oversamplingOf(settings.temperatureOversampling)};
+    const auto osrsP{oversamplingOf(settings.pressureOversampling)};
+    const auto osrsH{oversamplingOf(settings.humidityOversampling)};
+    if (osrsT == 0 || osrsP == 0 || osrsH == 0 || settings.filter > 4)
+    {
+        return false;
+    }
+
+    m_chip = Chip::None;
+    for (const auto address : {ADDRESS_PRIMARY, ADDRESS_SECONDARY})
+    {
+        m_address = address;
+
+        uint8_t chipId{};
+        if (readRegisters(REG_CHIP_ID, &chipId, 1) && (chipId == BME280.chipId || chipId == BME680.chipId))
+        {
+            m_chip = chipId == BME280.chipId ? Chip::BME280 : Chip::BME680;
+            break;
+        }
+    }
+    if (m_chip == Chip::None)
+    {
+        return false;
+    }
+
+    // Power-on reset, the NVM copy of the calibration takes 2 ms (BME280) to 10 ms (BME680)
+    if (!writeRegister(REG_RESET, RESET_COMMAND))
+    {
+        return false;
+    }
+    delay(10);
+
+    if (!readCalibration())
+    {
+        return false;
+    }
+
+    // ctrl_hum only takes effect with the next write of ctrl_meas, which every measurement does
+    const auto& regs{registersOf(m_chip)};
+    m_ctrlMeas = static_cast<uint8_t>((osrsT << 5) | (osrsP << 2));
+    m_duration = (measurementTime(m_chip, settings) + 999) / 1000;
+    m_inFlight = false;
+    return writeRegister(regs.ctrlHum, osrsH) &&
+           writeRegister(regs.config, static_cast<uint8_t>(settings.filter << 2)) &&
+           writeRegister(regs.ctrlMeas, m_ctrlMeas);
+}
+
+bool BMExxx::readCalibration()
+{
+    uint8_t c1[26]{};
+    uint8_t c2[16]{};
+
+    if (m_chip == Chip::BME280)
+    {
+        if (!readRegisters(0x88, c1, 26) || !readRegisters(0xE1, c2, 7))
+        {
+            return false;
+        }
+
+        m_cal280.T1 = u16(&c1[0]);
+        m_cal280.T2 = s16(&c1[2]);
+        m_cal280.T3 = s16(&c1[4]);
+        m_cal280.P1 = u16(&c1[6]);
+        m_cal280.P2 = s16(&c1[8]);
+        m_cal280.P3 = s16(&c1[10]);
+        m_cal280.P4 = s16(&c1[12]);
+        m_cal280.P5 = s16(&c1[14]);
+        m_cal280.P6 = s16(&c1[16]);
+        m_cal280.P7 = s16(&c1[18]);
+        m_cal280.P8 = s16(&c1[20]);
+        m_cal280.P9 = s16(&c1[22]);
+        m_cal280.H1 = c1[25];
+        m_cal280.H2 = s16(&c2[0]);
+        m_cal280.H3 = c2[2];
+        m_cal280.H4 = static_cast<int16_t>((static_cast<int8_t>(c2[3]) * 16) | (c2[4] & 0x0F));
+        m_cal280.H5 = static_cast<int16_t>((static_cast<int8_t>(c2[5]) * 16) | (c2[4] >> 4));
+        m_cal280.H6 = static_cast<int8_t>(c2[6]);
+        return true;
+    }
+
+    // BME680, c1 starts at 0x89
+    if (!readRegisters(0x89, c1, 25) || !readRegisters(0xE1, c2, 16))
+    {
+        return false;
+    }
+
+    m_cal680.T1  = u16(&c2[8]);
+    m_cal680.T2  = s16(&c1[1]);
+    m_cal680.T3  = static_cast<int8_t>(c1[3]);
+    m_cal680.P1  = u16(&c1[5]);
+    m_cal680.P2  = s16(&c1[7]);
+    m_cal680.P3  = static_cast<int8_t>(c1[9]);
+    m_cal680.P4  = s16(&c1[11]);
+    m_cal680.P5  = s16(&c1[13]);
+    m_cal680.P6  = static_cast<int8_t>(c1[16]);
+    m_cal680.P7  = static_cast<int8_t>(c1[15]);
+    m_cal680.P8  = s16(&c1[19]);
+    m_cal680.P9  = s16(&c1[21]);
+    m_cal680.P10 = c1[23];
+    m_cal680.H1  = static_cast<uint16_t>((c2[2] << 4) | (c2[1] & 0x0F));
+    m_cal680.H2  = static_cast<uint16_t>((c2[0] << 4) | (c2[1] >> 4));
+    m_cal680.H3  = static_cast<int8_t>(c2[3]);
+    m_cal680.H4  = static_cast<int8_t>(c2[4]);
+    m_cal680.H5  = static_cast<int8_t>(c2[5]);
+    m_cal680.H6  = c2[6];
+    m_cal680.H7  = static_cast<int8_t>(c2[7]);
+    return true;
+}
+
+const char* BMExxx::getChipName() const
+{
+    switch (m_chip)
+    {
+    case Chip::BME280:
+        return "BME280";
+    case Chip::BME680:
+        return "BME680";
+    default:
+        return "None";
+    }
+}
+
+uint32_t BMExxx::measurementTime(Chip chip, const Settings& settings)
+{
+    const uint32_t cycles{static_cast<uint32_t>(settings.temperatureOversampling) + settings.pressureOversampling + settings.humidityOversampling};
+    if (chip == Chip::BME680)
+    {
+        // TPH conversion plus the wake up, BME68x API bme68x_get_meas_dur()
+        return cycles * 1963 + 477 * 4 + 477 * 5 + 500 + 1000;
+    }
+    return 1250 + cycles * 2300 + 575 + 575;
+}
+
+bool BMExxx::isValidOversampling(int32_t factor)
+{
+    return factor > 0 && factor <= 16 && oversamplingOf(static_cast<uint8_t>(factor)) != 0;
+}
+
+////////////////////////////////
+/// Measurement, split-phase
+////////////////////////////////
+
+BMExxx::Status BMExxx::measure(int32_t now, Sample& sample)
+{
+    if (m_chip == Chip::None)
+    {
+        return Status::Failed;
+    }
+
+    const auto& regs{registersOf(m_chip)};
+    if (!m_inFlight)
+    {
+        if (!writeRegister(regs.ctrlMeas, m_ctrlMeas | MODE_FORCED))
+        {
+            return Status::Failed;
+        }
+        m_inFlight = true;
+        m_readyAt  = now + static_cast<int32_t>(m_duration) + CLOCK_MARGIN;
+        m_failAt   = m_readyAt + static_cast<int32_t>(m_duration);
+        return Status::Pending;
+    }
+
+    if (!isDue(now, m_readyAt))
+    {
+        return Status::Pending;
+    }
+
+    // Status and data in one go, the sensor shadows the data registers while the burst runs
+    uint8_t    burst[MAX_BURST_LENGTH]{};
+    const auto length{regs.dataOffset + DATA_LENGTH};
+    if (!readRegisters(regs.burst, burst, length))
+    {
+        m_inFlight = false;
+        return Status::Failed;
+    }
+
+    // BME280: measuring bit and back in sleep mode; BME680: new_data and not measuring
+    const auto done{m_chip == Chip::BME280 ? (burst[0] & 0x08) == 0 && (burst[1] & 0x03) == 0
+                                           : (burst[0] & 0x80) != 0 && (burst[0] & 0x20) == 0};
+    if (!done)
+    {
+        if (isDue(now, m_failAt))
+        {
+            m_inFlight = false;
+            return Status::Failed;
+        }
+        m_readyAt = now + CLOCK_MARGIN;
+        return Status::Pending;
+    }
+    m_inFlight = false;
+
+    const auto* data{burst + regs.dataOffset};
+    const auto  adcP{static_cast<int32_t>((data[0] << 12) | (data[1] << 4) | (data[2] >> 4))};
+    const auto  adcT{static_cast<int32_t>((data[3] << 12) | (data[4] << 4) | (data[5] >> 4))};
+    const auto  adcH{static_cast<int32_t>((data[6] << 8) | data[7])};
+
+    int32_t tFine{};
+    if (m_chip == Chip::BME280)
+    {
+        sample.temperature = compensateTemperature(m_cal280, adcT, tFine);
+        sample.pressure    = (compensatePressure(m_cal280, adcP, tFine) + 128) >> 8;
+        sample.humidity    = (compensateHumidity(m_cal280, adcH, tFine) * 1000 + 512) >> 10;
+    }
+    else
+    {
+        sample.temperature = compensateTemperature(m_cal680, adcT, tFine);
+        sample.pressure    = compensatePressure(m_cal680, adcP, tFine);
+        sample.humidity    = compensateHumidity(m_cal680, adcH, tFine);
+    }
+    return Status::Done;
+}
+
+////////////////////////////////
+/// Compensation BME280, datasheet 4.2.3 and 8.2
+////////////////////////////////
+
+int32_t BMExxx::compensateTemperature(const Calibration280& cal, int32_t adc, int32_t& tFine)
+{
+    const int32_t var1{(((adc >> 3) - (static_cast<int32_t>(cal.T1) << 1)) * cal.T2) >> 11};
+    const int32_t var2{(((((adc >> 4) - cal.T1) * ((adc >> 4) - cal.T1)) >> 12) * cal.T3) >> 14};
+    tFine = var1 + var2;
+    return (tFine * 5 + 128) >> 8;
+}
+
+uint32_t BMExxx::compensatePressure(const Calibration280& cal, int32_t adc, int32_t tFine)
+{
+    int64_t var1{static_cast<int64_t>(tFine) - 128000};
+    int64_t var2{var1 * var1 * cal.P6};
+    var2 = var2 + ((var1 * cal.P5) << 17);
+    var2 = var2 + (static_cast<int64_t>(cal.P4) << 35);
+    var1 = ((var1 * var1 * cal.P3) >> 8) + ((var1 * cal.P2) << 12);
+    var1 = (((int64_t{1} << 47) + var1) * cal.P1) >> 33;
+    if (var1 == 0)
+    {
+        return 0; // avoid a division by zero
+    }
+
+    int64_t p{1048576 - adc};
+    p    = (((p << 31) - var2) * 3125) / var1;
+    var1 = (static_cast<int64_t>(cal.P9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (static_cast<int64_t>(cal.P8) * p) >> 19;
+    p    = ((p + var1 + var2) >> 8) + (static_cast<int64_t>(cal.P7) << 4);
+    return static_cast<uint32_t>(p);
+}
+
+uint32_t BMExxx::compensateHumidity(const Calibration280& cal, int32_t adc, int32_t tFine)
+{
+    int32_t v{tFine - 76800};
+    v = ((((adc << 14) - (static_cast<int32_t>(cal.H4) << 20) - (cal.H5 * v)) + 16384) >> 15) *
+        (((((((v * cal.H6) >> 10) * (((v * cal.H3) >> 11) + 32768)) >> 10) + 2097152) * cal.H2 + 8192) >> 14);
+    v = v - (((((v >> 15) * (v >> 15)) >> 7) * cal.H1) >> 4);
+    v = v < 0 ? 0 : v;
+    v = v > 419430400 ? 419430400 : v;
+    return static_cast<uint32_t>(v >> 12);
+}
+
+////////////////////////////////
+/// Compensation BME680, integer variant of the BME68x API
+////////////////////////////////
+
+int32_t BMExxx::compensateTemperature(const Calibration680& cal, int32_t adc, int32_t& tFine)
+{
+    const int32_t var1{(adc >> 3) - (static_cast<int32_t>(cal.T1) << 1)};
+    const int32_t var2{(var1 * cal.T2) >> 11};
+    int32_t       var3{((var1 >> 1) * (var1 >> 1)) >> 12};
+    var3  = (var3 * (static_cast<int32_t>(cal.T3) << 4)) >> 14;
+    tFine = var2 + var3;
+    return (tFine * 5 + 128) >> 8;
+}
+
+uint32_t BMExxx::compensatePressure(const Calibration680& cal, int32_t adc, int32_t tFine)
+{
+    int32_t var1{(tFine >> 1) - 64000};
+    int32_t var2{((((var1 >> 2) * (var1 >> 2)) >> 11) * cal.P6) >> 2};
+    var2 = var2 + ((var1 * cal.P5) << 1);
+    var2 = (var2 >> 2) + (static_cast<int32_t>(cal.P4) << 16);
+    var1 = (((((var1 >> 2) * (var1 >> 2)) >> 13) * (static_cast<int32_t>(cal.P3) << 5)) >> 3) + ((cal.P2 * var1) >> 1);
+    var1 = var1 >> 18;
+    var1 = ((32768 + var1) * cal.P1) >> 15;
+    if (var1 == 0)
+    {
+        return 0; // avoid a division by zero
+    }
+
+    // int64_t unlike the API, which wraps above 2^31 at high pressure and low temperature
+    int32_t p{static_cast<int32_t>(((int64_t{1048576} - adc - (var2 >> 12)) * 3125 * 2) / var1)};
+
+    var1 = (cal.P9 * (((p >> 3) * (p >> 3)) >> 13)) >> 12;
+    var2 = ((p >> 2) * cal.P8) >> 13;
+    // int64_t unlike the API, the cube overflows above ~1000 hPa with a large P10 (and without the p >> 8 of the API,
+    // which costs up to 50 Pa then)
+    const auto var3{static_cast<int32_t>((static_cast<int64_t>(p) * p * p * cal.P10) >> 41)};
+    p = p + ((var1 + var2 + var3 + (static_cast<int32_t>(cal.P7) << 7)) >> 4);
+    return static_cast<uint32_t>(p);
+}
+
+uint32_t BMExxx::compensateHumidity(const Calibration680& cal, int32_t adc, int32_t tFine)
+{
+    const int32_t tempScaled{(tFine * 5 + 128) >> 8};
+    const int32_t var1{adc - static_cast<int32_t>(cal.H1) * 16 - (((tempScaled * cal.H3) / 100) >> 1)};
+    const int32_t var2{(cal.H2 * (((tempScaled * cal.H4) / 100) + (((tempScaled * ((tempScaled * cal.H5) / 100)) >> 6) / 100) + (1 << 14))) >> 10};
+    // int64_t unlike the API, which wraps towards saturation and reports 0 %RH instead of 100 %RH
+    const int64_t var3{static_cast<int64_t>(var1) * var2};
+    const int32_t var4{((static_cast<int32_t>(cal.H6) << 7) + ((tempScaled * cal.H7) / 100)) >> 4};
+    const int64_t var5{((var3 >> 14) * (var3 >> 14)) >> 10};
+    const int64_t var6{(var4 * var5) >> 1};
+    int64_t       humidity{(((var3 + var6) >> 10) * 1000) >> 12};
+    humidity = humidity < 0 ? 0 : humidity;
+    humidity = humidity > 100000 ? 100000 : humidity;
+    return static_cast<uint32_t>(humidity);
+}
+
+////////////////////////////////
+/// Registers
+////////////////////////////////
+
+bool BMExxx::writeRegister(uint8_t reg, uint8_t value)
+{
+    const uint8_t frame[2]{reg, value};
+    return m_bus.write(m_address, frame, sizeof(frame));
+}
+
+bool BMExxx::readRegisters(uint8_t reg, uint8_t* data, size_t length)
+{
+    return m_bus.write(m_address, &reg, 1) && m_bus.read(m_address, data, length);
+}
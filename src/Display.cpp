@@ -27,12 +27,62 @@
 #include "Display.h"
 #include "Utilities.h"
 #include "hAIR.h"
+#include <esp_timer.h>
 
 constexpr auto XMIN{10};
 constexpr auto YMIN{20};
 constexpr auto LINE_INC{30};
 constexpr auto COLUMN_INC{30};
 
+// Sensor screen, font 1 at text size 2
+constexpr auto GLYPH_WIDTH{12};
+constexpr auto GLYPH_HEIGHT{16};
+constexpr auto GLYPH_BYTES{GLYPH_WIDTH * GLYPH_HEIGHT * 2}; // text is drawn with background, i.e. the whole cell
+constexpr auto VALUE_X{GLYPH_WIDTH};                        // values are indented by one space
+constexpr auto VALUE_WIDTH{8 * GLYPH_WIDTH};
+constexpr auto VALUE_BYTES{VALUE_WIDTH * GLYPH_HEIGHT * 2};
+
+// Log area, font 1 at text size 1
+constexpr auto LOG_GLYPH_BYTES{6 * 8 * 2};
+
+void Display::init()
+{
+    m_spritesReady = true;
+    for (auto& sprite : m_sprites)
+    {
+        sprite.setColorDepth(16);
+        if (sprite.createSprite(VALUE_WIDTH, GLYPH_HEIGHT) == nullptr)
+        {
+            m_spritesReady = false;
+            break;
+        }
+        sprite.setTextFont(1);
+        sprite.setTextSize(2);
+        sprite.setTextWrap(false, false);
+        sprite.setTextColor(TFT_WHITE, TFT_BLACK);
+    }
+
+    m_spritesReady = m_spritesReady && tft.initDMA();
+    if (!m_spritesReady)
+    {
+        for (auto& sprite : m_sprites)
+        {
+            sprite.deleteSprite();
+        }
+    }
+}
+
+/// Ends the SPI transaction of the last frame, has to be called before anything else is drawn
+void Display::finishDMA()
+{
+    if (m_dmaPending)
+    {
+        tft.dmaWait();
+        tft.endWrite();
+        m_dmaPending = false;
+    }
+}
+
 void Display::setCursor(int x, int y)
 {
     tft.setCursor(XMIN + x, YMIN + y);
@@ -57,56 +107,163 @@ void Display::drawLine(const char* text, int line)
     tft.print(text);
 }
 
-void Display::printDebugMessage(const String& text)
+void Display::printDebugMessage(const char* text)
 {
-    AutoLock lock(m_mtx);
+    m_logMailbox.push([text](LogLine& line)
+                      {
+                          strncpy(line.data(), text, line.size() - 1);
+                          line.back() = '\0';
+                      });
+}
+
+void Display::printErrorMessage(const char* text)
+{
+    printDebugMessage(text);
+}
+
+void Display::printSensorData(const SensorData& sensorData)
+{
+    m_sensorMailbox.store(sensorData);
+}
+
+void Display::render()
+{
+    const auto begin{esp_timer_get_time()};
+
+    // Drain the log mailbox, lines that scrolled out before this frame are never drawn
+    bool    logChanged{false};
+    LogLine line;
+    while (m_logMailbox.pop(line))
+    {
+        m_logHead             = (m_logHead + 1) % m_logLines.size();
+        m_logLines[m_logHead] = line;
+        m_logCount            = std::min(m_logCount + 1, m_logLines.size());
+        logChanged            = true;
+    }
+
+    uint32_t   sequence{};
+    const auto sensorData{m_sensorMailbox.load(&sequence)};
+    const bool sensorDataChanged{sequence != m_renderedSequence};
+    m_renderedSequence = sequence;
+
+    if (!logChanged && !sensorDataChanged)
+    {
+        return;
+    }
 
-    if (currentDTC != DisplayTextConfig::DebugText)
+    // The log area is drawn directly, so it goes first and the value pushes can still run after this returns
+    size_t pushed{};
+    finishDMA();
+    if (logChanged)
+    {
+        pushed += drawLog();
+    }
+    if (sensorDataChanged)
     {
-        setRedColor();
-        tft.setTextSize(1);
-        tft.setTextWrap(true, false);
-        currentDTC = DisplayTextConfig::DebugText;
+        pushed += drawSensorData(sensorData);
     }
 
-    tft.fillRect(0, tft.getViewportHeight() * 2 / 3, tft.getViewportWidth(), tft.getViewportHeight(), TFT_BLACK);
-    tft.setCursor(0, tft.getViewportHeight() * 2 / 3);
-    tft.println(text.c_str());
+    metrics.countDisplayFrame(pushed, static_cast<uint32_t>(esp_timer_get_time() - begin));
 }
 
-void Display::printErrorMessage(const String& text)
+/// Bottom third of the screen
+/// @return bytes sent to the display
+size_t Display::drawLog()
 {
-    printDebugMessage(text);
+    const auto top{tft.getViewportHeight() * 2 / 3};
+    const auto width{tft.getViewportWidth()};
+    const auto height{tft.getViewportHeight() - top};
+
+    setRedColor();
+    tft.setTextSize(1);
+    tft.setTextWrap(true, false);
+    tft.fillRect(0, top, width, height, TFT_BLACK);
+    tft.setCursor(0, top);
+
+    // Whatever doesn't fit is clipped at the bottom, so the newest line goes on top
+    size_t chars{};
+    for (size_t i = 0; i < m_logCount; ++i)
+    {
+        chars += tft.println(m_logLines[(m_logHead + m_logLines.size() - i) % m_logLines.size()].data());
+    }
+    return width * height * 2 + chars * LOG_GLYPH_BYTES;
 }
 
-void Display::printSensorData(const SensorData& sensorData)
+/// Only the values that changed since the last frame are redrawn, the labels are drawn once
+/// @return bytes sent to the display
+size_t Display::drawSensorData(const SensorData& sensorData)
 {
-    AutoLock lock(m_mtx);
+    size_t pushed{};
+    if (!m_layoutDrawn)
+    {
+        pushed += drawLayout();
+        m_layoutDrawn = true;
+    }
 
-    if (currentDTC != DisplayTextConfig::SensorData)
+    const std::array<int32_t, 4> values{{sensorData.sgp_iaq.TVOC, sensorData.sgp_iaq.eCO2, sensorData.sgp_iaqRaw.rawH2, sensorData.sgp_iaqRaw.rawEthanol}};
+    for (size_t i = 0; i < m_fields.size(); ++i)
     {
+        auto& field{m_fields[i]};
+        if (!field.isDrawn || field.drawn != values[i])
+        {
+            pushed += drawValue(field.y, values[i]);
+            field.drawn   = values[i];
+            field.isDrawn = true;
+        }
+    }
+    return pushed;
+}
+
+/// Everything but the values
+/// @return bytes sent to the display
+size_t Display::drawLayout()
+{
+    static constexpr std::array<const char*, 4> LABELS{{"TVOC [ppb]", "eCO2 [ppm]", "H2 [1]", "ethanol [1]"}};
+
+    setDefaultColor();
+    tft.setTextSize(2);
+    tft.setTextWrap(false, false);
+    tft.setCursor(0, 0);
+    tft.print("hAIR - ");
+    tft.print(HAIR_VERSION_STRING);
+    size_t chars{strlen("hAIR - ") + strlen(HAIR_VERSION_STRING)};
+
+    for (size_t i = 0; i < LABELS.size(); ++i)
+    {
+        tft.setCursor(0, m_fields[i].y - GLYPH_HEIGHT);
+        tft.print(LABELS[i]);
+        chars += strlen(LABELS[i]);
+    }
+    return chars * GLYPH_BYTES;
+}
+
+/// @return bytes sent to the display
+size_t Display::drawValue(int y, int32_t value)
+{
+    if (!m_spritesReady)
+    {
+        // pad with spaces to erase the old value
         setDefaultColor();
         tft.setTextSize(2);
         tft.setTextWrap(false, false);
-        currentDTC = DisplayTextConfig::SensorData;
+        tft.setCursor(VALUE_X, y);
+        const auto chars{tft.print(value) + tft.print("      ")};
+        return chars * GLYPH_BYTES;
     }
 
-    //tft.fillScreen(TFT_BLACK);
-    //tft.fillRect(0, 0, tft.getViewportWidth(), tft.getViewportHeight() * 2 / 3, TFT_BLACK);
-    tft.setCursor(0, 0);
+    // pushImageDMA() waits for the previous push, which used the other sprite, so this one is free again
+    auto& sprite{m_sprites[m_nextSprite]};
+    m_nextSprite = (m_nextSprite + 1) % m_sprites.size();
 
-    tft.print("hAIR - ");
-    tft.println(HAIR_VERSION_STRING);
-    tft.print("TVOC [ppb]\n ");
-    tft.print(sensorData.sgp_iaq.TVOC);
-    tft.println("      ");
-    tft.print("eCO2 [ppm]\n ");
-    tft.print(sensorData.sgp_iaq.eCO2);
-    tft.println("      ");
-    tft.print("H2 [1]\n ");
-    tft.print(sensorData.sgp_iaqRaw.rawH2);
-    tft.println("      ");
-    tft.print("ethanol [1]\n ");
-    tft.print(sensorData.sgp_iaqRaw.rawEthanol);
-    tft.println("      ");
+    sprite.fillSprite(TFT_BLACK);
+    sprite.setCursor(0, 0);
+    sprite.print(value);
+
+    if (!m_dmaPending)
+    {
+        tft.startWrite();
+        m_dmaPending = true;
+    }
+    tft.pushImageDMA(VALUE_X, y, VALUE_WIDTH, GLYPH_HEIGHT, static_cast<uint16_t*>(sprite.getPointer()));
+    return VALUE_BYTES;
 }
@@ -0,0 +1,249 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "EnvMath.h"
+#include <algorithm>
+#include <array>
+
+namespace
+{
+////////////////////////////////
+/// Saturation vapor pressure table, built by the compiler
+////////////////////////////////
+
+/// exp() for the table only, range reduction by ln(2) and a Taylor series
+constexpr double constexprExp(double x)
+{
+    constexpr double LN2{0.69314718055994530942};
+
+    const auto n{static_cast<int>(x / LN2 + (x >= 0 ? 0.5 : -0.5))};
+    const auto r{x - n * LN2};
+
+    double sum{1.0};
+    double term{1.0};
+    for (int i = 1; i < 20; ++i)
+    {
+        term *= r / i;
+        sum += term;
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        sum *= 2.0;
+    }
+    for (int i = 0; i > n; --i)
+    {
+        sum /= 2.0;
+    }
+    return sum;
+}
+
+constexpr int32_t TABLE_FIRST{-40}; // [°C]
+constexpr size_t  TABLE_SIZE{EnvMath::TEMPERATURE_MAX / 100 - TABLE_FIRST + 2}; // one past the last degree for the interpolation
+
+/// [Pa] Q16.16 per full degree, the largest value (86 °C, ~60 kPa) still fits
+constexpr std::array<uint32_t, TABLE_SIZE> makeTable()
+{
+    std::array<uint32_t, TABLE_SIZE> table{};
+    for (size_t i = 0; i < table.size(); ++i)
+    {
+        const double temperature{static_cast<double>(TABLE_FIRST + static_cast<int>(i))};
+        const double pressure{611.2 * constexprExp(17.62 * temperature / (243.12 + temperature))};
+        table[i] = static_cast<uint32_t>(pressure * 65536.0 + 0.5);
+    }
+    return table;
+}
+
+constexpr auto SVP_TABLE{makeTable()};
+
+int32_t clampTemperature(int32_t temperature)
+{
+    return std::min(std::max(temperature, EnvMath::TEMPERATURE_MIN), EnvMath::TEMPERATURE_MAX);
+}
+
+/// floor(sqrt(value))
+uint32_t isqrt(uint64_t value)
+{
+    uint64_t result{0};
+    uint64_t bit{uint64_t{1} << 62};
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (value >= result + bit)
+        {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+        {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return static_cast<uint32_t>(result);
+}
+} // namespace
+
+namespace EnvMath
+{
+uint32_t saturationVaporPressure(int32_t temperature)
+{
+    const auto offset{clampTemperature(temperature) - TABLE_FIRST * 100}; // [0.01 °C] above the first entry
+    const auto index{static_cast<size_t>(offset / 100)};
+    const auto fraction{static_cast<uint64_t>(offset % 100)};
+
+    const auto low{SVP_TABLE[index]};
+    const auto high{SVP_TABLE[index + 1]};
+    return low + static_cast<uint32_t>(((high - low) * fraction + 50) / 100);
+}
+
+uint32_t absoluteHumidity(int32_t temperature, uint32_t humidity)
+{
+    // 2.167 [g K / J] * e [Pa] / T [K], e = humidity * svp
+    // = 2167 * humidity [0.001 %] * svp [Pa Q16] / (1000 * 65536 * T [0.01 K]) [mg/m^3]
+    const uint64_t numerator{uint64_t{2167} * std::min(humidity, uint32_t{100000}) * saturationVaporPressure(temperature)};
+    const uint64_t denominator{uint64_t{65536000} * static_cast<uint64_t>(clampTemperature(temperature) + 27315)};
+    return static_cast<uint32_t>((numerator + denominator / 2) / denominator);
+}
+
+int32_t dewPoint(int32_t temperature, uint32_t humidity)
+{
+    // Actual vapor pressure [Pa] Q16.16, then back through the table
+    const auto pressure{static_cast<uint32_t>(uint64_t{saturationVaporPressure(temperature)} * std::min(humidity, uint32_t{100000}) / 100000)};
+    if (pressure <= SVP_TABLE.front())
+    {
+        return TEMPERATURE_MIN;
+    }
+
+    // First entry above the pressure, the dew point is in the degree below it
+    const auto above{std::upper_bound(SVP_TABLE.begin(), SVP_TABLE.end() - 1, pressure)};
+    const auto index{static_cast<int32_t>(above - SVP_TABLE.begin()) - 1};
+    const auto low{SVP_TABLE[index]};
+    const auto high{SVP_TABLE[index + 1]};
+    const auto fraction{static_cast<int32_t>((uint64_t{pressure - low} * 100 + (high - low) / 2) / (high - low))};
+    return std::min((TABLE_FIRST + index) * 100 + fraction, clampTemperature(temperature));
+}
+
+int32_t heatIndex(int32_t temperature, uint32_t humidity)
+{
+    // The regression is in °F and %RH
+    const int64_t T{static_cast<int64_t>(clampTemperature(temperature)) * 9 / 5 + 3200}; // [0.01 °F]
+    const int64_t R{std::min(humidity, uint32_t{100000}) / 10};                           // [0.01 %RH]
+
+    auto toCelsius = [](int64_t fahrenheit) -> int32_t
+    {
+        return static_cast<int32_t>((fahrenheit - 3200) * 5 / 9);
+    };
+
+    // Steadman, if the average with the temperature is below 80 °F that's it
+    const int64_t simple{(T + 6100 + (T - 6800) * 12 / 10 + R * 94 / 1000) / 2};
+    if ((simple + T) / 2 < 8000)
+    {
+        return toCelsius(simple);
+    }
+
+    // Rothfusz, coefficients Q32, T and R Q16 in °F and %, all products stay below 2^61
+    constexpr int64_t C0{-182016419037}; // -42.379
+    constexpr int64_t C1{8800453402};    // 2.04901523
+    constexpr int64_t C2{43565276077};   // 10.14333127
+    constexpr int64_t C3{-965317136};    // -0.22475541
+    constexpr int64_t C4{-29368256};     // -0.00683783
+    constexpr int64_t C5{-235437952};    // -0.05481717
+    constexpr int64_t C6{5277398};       // 0.00122874
+    constexpr int64_t C7{3662834};       // 0.00085282
+    constexpr int64_t C8{-8547};         // -0.00000199
+
+    const int64_t t{T * 65536 / 100};
+    const int64_t r{R * 65536 / 100};
+    const int64_t tr{(t * r) >> 16};
+
+    // c0 + T (c1 + c4 T) + R (c2 + c5 R) + T R (c3 + c6 T + c7 R + c8 T R)
+    const int64_t inner{C3 + ((C6 * t + C7 * r) >> 16) + ((C8 * tr) >> 16)};
+    const int64_t sum{C0 + (((C1 + ((C4 * t) >> 16)) * t) >> 16) + (((C2 + ((C5 * r) >> 16)) * r) >> 16) + ((inner * tr) >> 16)};
+    int64_t       index{(sum * 100) >> 32}; // [0.01 °F]
+
+    if (R < 1300 && T >= 8000 && T <= 11200)
+    {
+        // - (13 - RH) / 4 * sqrt((17 - |T - 95|) / 17)
+        const auto root{isqrt((static_cast<uint64_t>(1700 - (T > 9500 ? T - 9500 : 9500 - T)) << 32) / 1700)}; // Q16
+        index -= ((1300 - R) * root / 4) >> 16;
+    }
+    else if (R > 8500 && T >= 8000 && T <= 8700)
+    {
+        // + (RH - 85) / 10 * (87 - T) / 5
+        index += (R - 8500) * (8700 - T) / 5000;
+    }
+    return toCelsius(index);
+}
+
+bool toSensirionHumidity(uint32_t absoluteHumidity, uint16_t& word)
+{
+    // [mg/m^3] => [g/m^3] 8.8 fixed point, rounded
+    const auto value{(static_cast<uint64_t>(absoluteHumidity) * 256 + 500) / 1000};
+    if (value > UINT16_MAX)
+    {
+        return false;
+    }
+    word = static_cast<uint16_t>(value);
+    return true;
+}
+
+AirQuality airQuality(uint16_t eCO2, uint16_t TVOC)
+{
+    constexpr std::array<uint16_t, 4> TVOC_LEVELS{65, 220, 660, 2200};
+    constexpr std::array<uint16_t, 4> ECO2_LEVELS{600, 800, 1000, 1500};
+
+    auto level = [](const std::array<uint16_t, 4>& levels, uint16_t value) -> uint8_t
+    {
+        return static_cast<uint8_t>(std::lower_bound(levels.begin(), levels.end(), value) - levels.begin());
+    };
+
+    const auto worst{std::max(level(TVOC_LEVELS, TVOC), level(ECO2_LEVELS, eCO2))};
+    return static_cast<AirQuality>(static_cast<uint8_t>(AirQuality::Excellent) + worst);
+}
+
+const char* toString(AirQuality airQuality)
+{
+    switch (airQuality)
+    {
+    case AirQuality::Excellent:
+        return "Excellent";
+    case AirQuality::Good:
+        return "Good";
+    case AirQuality::Moderate:
+        return "Moderate";
+    case AirQuality::Poor:
+        return "Poor";
+    case AirQuality::Unhealthy:
+        return "Unhealthy";
+    default:
+        return "Unknown";
+    }
+}
+} // namespace EnvMath
@@ -0,0 +1,484 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "InfluxUploader.h"
+#include "ArchiveFormat.h"
+#include "LogCapture.h"
+#include "SensorArchive.h"
+#include "SensorHistory.h"
+#include <LITTLEFS.h>
+#include <WiFi.h>
+
+namespace
+{
+bool isDue(Timestamp now, Timestamp due)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(now) - static_cast<uint32_t>(due)) >= 0;
+}
+
+/// Commas and spaces end a measurement name in line protocol, so they are escaped
+String escapeMeasurement(const String& measurement)
+{
+    String escaped{};
+    for (size_t i = 0; i < measurement.length(); ++i)
+    {
+        const auto c{measurement[i]};
+        if (c == ',' || c == ' ')
+        {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+/// 2xx is success, these will fail the same way every time (broken line, body too large, outside the retention period)
+bool isRejected(int code)
+{
+    return code == 400 || code == 413 || code == 422;
+}
+} // namespace
+
+bool InfluxUploader::init(const Settings& settings)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    m_enabled = false;
+    if (settings.url.length() == 0)
+    {
+        return true;
+    }
+
+    m_settings           = settings;
+    m_settings.batchSize = std::max<size_t>(1, std::min(m_settings.batchSize, MAX_BATCH_SIZE));
+    m_linesCapacity      = m_settings.batchSize * LINE_CAPACITY;
+    m_bodyCapacity       = Gzip::maxCompressedSize(m_linesCapacity);
+    m_compressor.reset(new (std::nothrow) Gzip::Compressor{});
+    m_lines.reset(new (std::nothrow) char[m_linesCapacity]);
+    m_body.reset(new (std::nothrow) uint8_t[m_bodyCapacity]);
+    if (!m_compressor || !m_lines || !m_body)
+    {
+        PLOGE << "InfluxDB: could not allocate the buffers for " << m_settings.batchSize << " samples";
+        m_compressor.reset();
+        m_lines.reset();
+        m_body.reset();
+        return false;
+    }
+
+    // The timestamps are seconds, without precision the server would take them as nanoseconds
+    if (m_settings.url.indexOf("precision=") < 0)
+    {
+        m_settings.url += m_settings.url.indexOf('?') < 0 ? "?precision=s" : "&precision=s";
+    }
+
+    // Same device id as the MQTT client
+    char deviceId[16]{};
+    snprintf(deviceId, sizeof(deviceId), "hAIR_%06x", static_cast<unsigned>(ESP.getEfuseMac() >> 24) & 0xFFFFFF);
+    m_linePrefix = escapeMeasurement(m_settings.measurement) + ",device=" + deviceId + " ";
+
+    m_http.setReuse(true);
+    m_http.setConnectTimeout(REQUEST_TIMEOUT);
+    m_http.setTimeout(REQUEST_TIMEOUT);
+
+    if (m_settings.outboxSize > 0)
+    {
+        scanOutbox();
+    }
+
+    m_enabled = true;
+    return true;
+}
+
+////////////////////////////////
+/// Batch
+////////////////////////////////
+
+void InfluxUploader::add(uint32_t epoch, const SensorData& data)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (!m_enabled || epoch < SensorArchive::MIN_VALID_EPOCH)
+    {
+        return;
+    }
+
+    // upload() has not come around in time, the batch must not grow any further
+    if (m_samples >= m_settings.batchSize)
+    {
+        persistBatch();
+    }
+    appendLine(epoch, data);
+}
+
+void InfluxUploader::appendLine(uint32_t epoch, const SensorData& data)
+{
+    uint8_t    valid{};
+    const auto values{SensorHistory::toFixed(data, valid)};
+    if (valid == 0)
+    {
+        return;
+    }
+
+    // The capacity holds batchSize lines of LINE_CAPACITY, so snprintf never truncates
+    char*        line{m_lines.get() + m_linesLength};
+    const size_t capacity{m_linesCapacity - m_linesLength};
+    size_t       length{static_cast<size_t>(snprintf(line, capacity, "%s", m_linePrefix.c_str()))};
+    const char*  separator{""};
+    for (size_t channel = 0; channel < ArchiveFormat::CHANNEL_COUNT; ++channel)
+    {
+        if ((valid & (1U << channel)) == 0)
+        {
+            continue;
+        }
+
+        // Integer fields need the i suffix, otherwise InfluxDB stores them as float
+        const auto& info{ArchiveFormat::CHANNELS[channel]};
+        const auto  value{values[channel]};
+        if (info.decimals == 0)
+        {
+            length += snprintf(line + length, capacity - length, "%s%s=%di", separator, info.name, static_cast<int>(value));
+        }
+        else
+        {
+            uint32_t scale{1};
+            for (uint8_t i = 0; i < info.decimals; ++i)
+            {
+                scale *= 10U;
+            }
+            const auto magnitude{value < 0 ? 0U - static_cast<uint32_t>(value) : static_cast<uint32_t>(value)};
+            length += snprintf(line + length, capacity - length, "%s%s=%s%u.%0*u", separator, info.name, value < 0 ? "-" : "", static_cast<unsigned>(magnitude / scale), info.decimals, static_cast<unsigned>(magnitude % scale));
+        }
+        separator = ",";
+    }
+    length += snprintf(line + length, capacity - length, " %u\n", static_cast<unsigned>(epoch));
+
+    if (m_samples == 0)
+    {
+        m_oldest = epoch;
+    }
+    ++m_samples;
+    m_linesLength += length;
+}
+
+size_t InfluxUploader::compressBatch()
+{
+    return m_compressor->compress(reinterpret_cast<const uint8_t*>(m_lines.get()), m_linesLength, m_body.get(), m_bodyCapacity);
+}
+
+void InfluxUploader::clearBatch()
+{
+    m_samples     = 0;
+    m_linesLength = 0;
+}
+
+void InfluxUploader::persistBatch()
+{
+    if (m_samples == 0)
+    {
+        return;
+    }
+
+    const auto length{compressBatch()};
+    if (length == 0 || !writeOutbox(m_body.get(), length, m_samples))
+    {
+        m_metrics.countInfluxDropped(m_samples);
+    }
+    clearBatch();
+}
+
+void InfluxUploader::persist()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (m_enabled)
+    {
+        persistBatch();
+    }
+}
+
+////////////////////////////////
+/// Upload
+////////////////////////////////
+
+void InfluxUploader::upload(Timestamp now, uint32_t epoch)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    const bool online{WiFi.isConnected() && isDue(now, m_nextAttempt)};
+    const bool full{m_samples >= m_settings.batchSize};
+    const bool due{full || (m_samples > 0 && epoch - m_oldest >= m_settings.batchDelay)};
+
+    // Offline only full batches go to the outbox, fewer and larger files
+    if (due && (online || full))
+    {
+        const auto length{compressBatch()};
+        const auto result{online && length > 0 ? post(m_body.get(), length, m_samples) : Result::Retry};
+        if (result == Result::Retry)
+        {
+            if (online)
+            {
+                retryLater(now);
+            }
+            if (length == 0 || !writeOutbox(m_body.get(), length, m_samples))
+            {
+                m_metrics.countInfluxDropped(m_samples);
+            }
+        }
+        else if (result == Result::Rejected)
+        {
+            m_metrics.countInfluxDropped(m_samples);
+        }
+        clearBatch();
+        return;
+    }
+
+    if (online && m_outboxFirst != m_outboxNext)
+    {
+        sendOutbox(now);
+    }
+}
+
+InfluxUploader::Result InfluxUploader::post(const uint8_t* body, size_t length, size_t samples)
+{
+    const auto start{millis()};
+    if (!m_http.begin(m_settings.url))
+    {
+        PLOGE << "InfluxDB: invalid URL " << m_settings.url;
+        return Result::Retry;
+    }
+    m_http.addHeader("Content-Type", "text/plain; charset=utf-8");
+    m_http.addHeader("Content-Encoding", "gzip");
+    if (m_settings.token.length() > 0)
+    {
+        m_http.addHeader("Authorization", "Token " + m_settings.token);
+    }
+
+    // HTTPClient does not modify the payload, its signature just lacks the const
+    const auto code{m_http.POST(const_cast<uint8_t*>(body), length)};
+    m_http.end();
+
+    if (code >= 200 && code < 300)
+    {
+        m_retryDelay = RETRY_MIN_DELAY;
+        m_metrics.countInfluxUploaded(samples, Gzip::uncompressedSize(body, length), length, millis() - start);
+        return Result::Sent;
+    }
+
+    m_metrics.countInfluxFailed();
+    if (isRejected(code))
+    {
+        PLOGE << "InfluxDB: " << samples << " samples rejected with HTTP " << code << ", dropping them";
+        return Result::Rejected;
+    }
+
+    // Negative codes are HTTPClient errors, no connection, timeout, ...
+    PLOGW << "InfluxDB: upload of " << samples << " samples failed (" << code << (code < 0 ? String{" "} + HTTPClient::errorToString(code) : String{}) << ")";
+    return Result::Retry;
+}
+
+void InfluxUploader::retryLater(Timestamp now)
+{
+    // Some jitter, so the devices of a building do not all come back at once after the server was down
+    m_nextAttempt = now + m_retryDelay + static_cast<Timestamp>(esp_random() % (m_retryDelay / 4 + 1));
+    m_retryDelay  = std::min<Timestamp>(m_retryDelay * 2, RETRY_MAX_DELAY);
+}
+
+////////////////////////////////
+/// Outbox
+////////////////////////////////
+
+String InfluxUploader::outboxPath(uint32_t sequence) const
+{
+    char name[16]{};
+    snprintf(name, sizeof(name), "/%08x", static_cast<unsigned>(sequence));
+    return String{OUTBOX_DIR} + name;
+}
+
+void InfluxUploader::scanOutbox()
+{
+    if (!LITTLEFS.exists(OUTBOX_DIR))
+    {
+        LITTLEFS.mkdir(OUTBOX_DIR);
+        return;
+    }
+
+    // A batch that was being written when the power went, it never made it into the outbox
+    const String temporary{String{OUTBOX_DIR} + "/tmp"};
+    if (LITTLEFS.exists(temporary))
+    {
+        LITTLEFS.remove(temporary);
+    }
+
+    auto     dir{LITTLEFS.open(OUTBOX_DIR)};
+    bool     found{false};
+    uint32_t first{};
+    uint32_t last{};
+    for (auto file = dir.openNextFile(); file; file = dir.openNextFile())
+    {
+        // Depending on the core version name() is the full path or just the name
+        const char* name{file.name()};
+        const char* slash{strrchr(name, '/')};
+        name = slash != nullptr ? slash + 1 : name;
+
+        char*      end{};
+        const auto sequence{static_cast<uint32_t>(strtoul(name, &end, 16))};
+        if (end == name || *end != '\0')
+        {
+            continue;
+        }
+
+        m_outboxBytes += file.size();
+        first = !found || sequence < first ? sequence : first;
+        last  = !found || sequence > last ? sequence : last;
+        found = true;
+    }
+
+    if (found)
+    {
+        m_outboxFirst = first;
+        m_outboxNext  = last + 1;
+        PLOGI << "InfluxDB: " << (m_outboxNext - m_outboxFirst) << " batches (" << m_outboxBytes << " bytes) left in the outbox";
+    }
+    updateOutboxMetrics();
+}
+
+bool InfluxUploader::writeOutbox(const uint8_t* body, size_t length, size_t samples)
+{
+    const size_t size{OUTBOX_HEADER_SIZE + length};
+    if (size > m_settings.outboxSize)
+    {
+        return false;
+    }
+
+    // Oldest first, the newer samples are worth more
+    while (m_outboxBytes + size > m_settings.outboxSize && m_outboxFirst != m_outboxNext)
+    {
+        removeOutbox(true);
+    }
+
+    // Written under a temporary name and renamed, the rename is atomic on LittleFS
+    const String temporary{String{OUTBOX_DIR} + "/tmp"};
+    const String path{outboxPath(m_outboxNext)};
+    const std::array<uint8_t, OUTBOX_HEADER_SIZE> header{static_cast<uint8_t>(samples), static_cast<uint8_t>(samples >> 8)};
+
+    auto   file{LITTLEFS.open(temporary, "w")};
+    size_t written{};
+    if (file)
+    {
+        written = file.write(header.data(), header.size());
+        written += file.write(body, length);
+        file.close();
+    }
+    if (written != size || !LITTLEFS.rename(temporary, path))
+    {
+        PLOGE << "InfluxDB: could not write " << path << ", " << samples << " samples are lost";
+        LITTLEFS.remove(temporary);
+        return false;
+    }
+
+    ++m_outboxNext;
+    m_outboxBytes += size;
+    updateOutboxMetrics();
+    return true;
+}
+
+void InfluxUploader::sendOutbox(Timestamp now)
+{
+    auto file{LITTLEFS.open(outboxPath(m_outboxFirst))};
+    if (!file)
+    {
+        // A gap in the sequence, a file that could not be written
+        ++m_outboxFirst;
+        updateOutboxMetrics();
+        return;
+    }
+
+    std::array<uint8_t, OUTBOX_HEADER_SIZE> header{};
+    const size_t                            length{file.size() > OUTBOX_HEADER_SIZE ? file.size() - OUTBOX_HEADER_SIZE : 0};
+    bool                                    valid{length > 0 && length <= m_bodyCapacity};
+    valid = valid && file.read(header.data(), header.size()) == header.size();
+    valid = valid && file.read(m_body.get(), length) == length;
+    file.close();
+    if (!valid)
+    {
+        // Also a batch of a previous run with a larger batchSize, that does not fit into the buffer
+        PLOGE << "InfluxDB: could not read " << outboxPath(m_outboxFirst) << ", dropping it";
+        removeOutbox(true);
+        return;
+    }
+
+    const size_t samples{static_cast<size_t>(header[0] | (header[1] << 8))};
+    switch (post(m_body.get(), length, samples))
+    {
+    case Result::Sent:
+        removeOutbox(false);
+        break;
+    case Result::Rejected:
+        removeOutbox(true);
+        break;
+    case Result::Retry:
+        retryLater(now);
+        break;
+    }
+}
+
+void InfluxUploader::removeOutbox(bool dropped)
+{
+    const String path{outboxPath(m_outboxFirst)};
+    auto         file{LITTLEFS.open(path)};
+    if (file)
+    {
+        const size_t size{file.size()};
+        if (dropped)
+        {
+            std::array<uint8_t, OUTBOX_HEADER_SIZE> header{};
+            if (file.read(header.data(), header.size()) == header.size())
+            {
+                m_metrics.countInfluxDropped(header[0] | (header[1] << 8));
+            }
+        }
+        file.close();
+        LITTLEFS.remove(path);
+        m_outboxBytes -= std::min(size, m_outboxBytes);
+    }
+
+    ++m_outboxFirst;
+    if (m_outboxFirst == m_outboxNext)
+    {
+        m_outboxBytes = 0; // whatever was counted for files that vanished
+    }
+    updateOutboxMetrics();
+}
+
+void InfluxUploader::updateOutboxMetrics()
+{
+    m_metrics.setInfluxOutbox(m_outboxNext - m_outboxFirst, m_outboxBytes);
+}
@@ -0,0 +1,454 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MqttPublisher.h"
+#include "JSONWriter.h"
+#include "LogCapture.h"
+#include "SensorArchive.h"
+#include "SensorHistory.h"
+#include <LITTLEFS.h>
+#include <WiFi.h>
+#include <esp_timer.h>
+
+namespace
+{
+/// Home Assistant metadata per channel, same order as ArchiveFormat::CHANNELS
+struct DiscoveryChannel
+{
+    const char* unit;        // nullptr => none
+    const char* deviceClass; // nullptr => none
+};
+constexpr std::array<DiscoveryChannel, ArchiveFormat::CHANNEL_COUNT> DISCOVERY_CHANNELS{{
+    {"ppb", nullptr},
+    {"ppm", "carbon_dioxide"},
+    {nullptr, nullptr},
+    {nullptr, nullptr},
+    {"°C", "temperature"},
+    {"%", "humidity"},
+    {"hPa", "pressure"},
+}};
+
+constexpr auto DISCOVERY_PREFIX{"homeassistant/sensor/"};
+
+bool isDue(Timestamp now, Timestamp due)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(now) - static_cast<uint32_t>(due)) >= 0;
+}
+
+/// {"timestamp":..,"TVOC":..,..} with the valid channels only
+void sampleToJSON(JSONWriter& writer, const ArchiveFormat::Record& record)
+{
+    writer.beginObject().member("timestamp", record.timestamp);
+    for (size_t channel = 0; channel < ArchiveFormat::CHANNEL_COUNT; ++channel)
+    {
+        if (record.valid & (1U << channel))
+        {
+            writer.key(ArchiveFormat::CHANNELS[channel].name).fixed(record.values[channel], ArchiveFormat::CHANNELS[channel].decimals);
+        }
+    }
+    writer.endObject();
+}
+} // namespace
+
+bool MqttPublisher::init(const Settings& settings)
+{
+    m_enabled = false;
+    if (settings.host.length() == 0)
+    {
+        return true;
+    }
+
+    m_settings = settings;
+    m_queue.reset(new (std::nothrow) ArchiveFormat::Record[m_settings.queueSize]);
+    if (!m_queue)
+    {
+        PLOGE << "MQTT: could not allocate the queue for " << m_settings.queueSize << " samples";
+        return false;
+    }
+
+    // A spill file of the last run is sent first
+    if (LITTLEFS.exists(SPILL_FILE))
+    {
+        auto file{LITTLEFS.open(SPILL_FILE)};
+        m_spillWritten = file.size();
+        file.close();
+        m_spilling = m_spillWritten > 0;
+        PLOGI << "MQTT: " << m_spillWritten << " bytes of samples left in " << SPILL_FILE;
+    }
+
+    // The lower half of the MAC address tells the devices apart
+    char deviceId[16]{};
+    snprintf(deviceId, sizeof(deviceId), "hAIR_%06x", static_cast<unsigned>(ESP.getEfuseMac() >> 24) & 0xFFFFFF);
+    m_clientId     = deviceId;
+    m_topicStatus  = m_settings.topic + "/status";
+    m_topicSamples = m_settings.topic + "/samples";
+    m_topicState   = m_settings.topic + "/state";
+    m_topicHealth  = m_settings.topic + "/health";
+
+    m_client.setServer(m_settings.host.c_str(), m_settings.port);
+    m_client.setClientId(m_clientId.c_str());
+    m_client.setWill(m_topicStatus.c_str(), 1, true, "offline");
+    if (m_settings.user.length() > 0)
+    {
+        m_client.setCredentials(m_settings.user.c_str(), m_settings.password.c_str());
+    }
+
+    m_client.onConnect([this](bool /*sessionPresent*/)
+                       {
+                           m_connected      = true;
+                           m_sessionStarted = true;
+                       });
+    m_client.onDisconnect([this](AsyncMqttClientDisconnectReason reason)
+                          {
+                              m_connected = false;
+                              PLOGW << "MQTT: disconnected (" << static_cast<int>(reason) << ")";
+                          });
+    m_client.onPublish([this](uint16_t packetId)
+                       {
+                           m_ackedPacket = packetId;
+                       });
+
+    m_enabled = true;
+    return true;
+}
+
+////////////////////////////////
+/// Queue
+////////////////////////////////
+
+void MqttPublisher::add(uint32_t epoch, const SensorData& data)
+{
+    if (!m_enabled || epoch < SensorArchive::MIN_VALID_EPOCH)
+    {
+        return;
+    }
+
+    ArchiveFormat::Record record{};
+    record.timestamp = epoch;
+    record.values    = SensorHistory::toFixed(data, record.valid);
+    if (record.valid == 0)
+    {
+        return;
+    }
+
+    if (m_connected)
+    {
+        publishState(record);
+    }
+
+    // Once samples are in the spill file, the new ones have to go behind them
+    if (!m_spilling && m_count < m_settings.queueSize)
+    {
+        push(record);
+    }
+    else if (!spill(record))
+    {
+        m_metrics.countMqttDropped(1);
+    }
+    m_metrics.setMqttQueued(m_count, m_spillWritten - m_spillRead);
+}
+
+void MqttPublisher::push(const ArchiveFormat::Record& record)
+{
+    at(m_count) = record;
+    ++m_count;
+}
+
+bool MqttPublisher::spill(const ArchiveFormat::Record& record)
+{
+    std::array<uint8_t, ArchiveFormat::MAX_RECORD_SIZE> encoded{};
+    m_encoder.reset();
+    const auto length{m_encoder.encode(record, encoded.data())};
+    if (m_spillWritten + length > m_settings.spillSize)
+    {
+        return false;
+    }
+
+    auto file{LITTLEFS.open(SPILL_FILE, "a")};
+    const auto written{file ? file.write(encoded.data(), length) : 0};
+    file.close();
+    if (written != length)
+    {
+        PLOGE << "MQTT: could not write to " << SPILL_FILE;
+        return false;
+    }
+
+    if (!m_spilling)
+    {
+        PLOGI << "MQTT: queue is full, spilling to " << SPILL_FILE;
+    }
+    m_spilling = true;
+    m_spillWritten += length;
+    return true;
+}
+
+void MqttPublisher::refill()
+{
+    auto file{LITTLEFS.open(SPILL_FILE)};
+    if (!file || !file.seek(m_spillRead))
+    {
+        PLOGE << "MQTT: could not read " << SPILL_FILE << ", the samples in it are lost";
+        removeSpill();
+        return;
+    }
+
+    const auto read{file.read(m_spillBuffer.data(), m_spillBuffer.size())};
+    file.close();
+
+    // Every record is absolute, so the decoder can start at any record
+    ArchiveFormat::BlockDecoder decoder{m_spillBuffer.data(), read};
+    ArchiveFormat::Record       record{};
+    size_t                      consumed{};
+    while (m_count < m_settings.queueSize && decoder.next(record))
+    {
+        push(record);
+        consumed = decoder.position();
+    }
+
+    // A record always fits into the buffer, so nothing decoded means a broken file
+    if (consumed == 0 && m_count < m_settings.queueSize)
+    {
+        PLOGE << "MQTT: " << SPILL_FILE << " is broken at " << m_spillRead << ", the samples behind are lost";
+        removeSpill();
+        return;
+    }
+
+    m_spillRead += consumed;
+    if (m_spillRead >= m_spillWritten)
+    {
+        removeSpill();
+    }
+}
+
+void MqttPublisher::removeSpill()
+{
+    LITTLEFS.remove(SPILL_FILE);
+    m_spilling     = false;
+    m_spillRead    = 0;
+    m_spillWritten = 0;
+}
+
+////////////////////////////////
+/// Publishing
+////////////////////////////////
+
+void MqttPublisher::poll(Timestamp now, uint32_t epoch)
+{
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    if (!m_connected)
+    {
+        connect(now);
+        return;
+    }
+
+    // A new session re-announces everything and sends the unacknowledged samples again
+    if (m_sessionStarted.exchange(false))
+    {
+        PLOGI << "MQTT: connected to " << m_settings.host << ":" << m_settings.port << ", " << m_count << " samples queued" << (m_spilling ? " and more in the spill file" : "");
+        ++m_sessions;
+        m_reconnectDelay = RECONNECT_MIN_DELAY;
+        m_statusPending  = true;
+        m_discoveryNext  = m_settings.discovery ? 0 : ArchiveFormat::CHANNEL_COUNT;
+        m_inFlight       = 0;
+        m_ackedPacket    = 0;
+    }
+
+    if (m_statusPending && !publishStatus())
+    {
+        return;
+    }
+    if (m_discoveryNext < ArchiveFormat::CHANNEL_COUNT && !publishDiscovery())
+    {
+        return;
+    }
+
+    completeInFlight(now);
+    if (m_spilling && m_count + m_settings.batchSize <= m_settings.queueSize)
+    {
+        refill();
+    }
+
+    if (m_inFlight == 0 && m_count > 0 && isDue(now, m_nextPublish) && publishBatch(now, epoch))
+    {
+        m_nextPublish = now + static_cast<Timestamp>(1000.0F / m_settings.drainRate);
+    }
+    m_metrics.setMqttQueued(m_count, m_spillWritten - m_spillRead);
+}
+
+void MqttPublisher::connect(Timestamp now)
+{
+    if (!WiFi.isConnected() || !isDue(now, m_nextConnect))
+    {
+        return;
+    }
+
+    PLOGD << "MQTT: connecting to " << m_settings.host << ":" << m_settings.port;
+    m_client.connect();
+
+    // Until onConnect, the next attempt backs off
+    m_nextConnect    = now + m_reconnectDelay;
+    m_reconnectDelay = std::min<Timestamp>(m_reconnectDelay * 2, RECONNECT_MAX_DELAY);
+}
+
+bool MqttPublisher::publishStatus()
+{
+    m_statusPending = m_client.publish(m_topicStatus.c_str(), 1, true, "online") == 0;
+    return !m_statusPending;
+}
+
+bool MqttPublisher::publishDiscovery()
+{
+    const auto  channel{m_discoveryNext};
+    const auto& info{DISCOVERY_CHANNELS[channel]};
+    const auto* name{ArchiveFormat::CHANNELS[channel].name};
+
+    const String topic{String{DISCOVERY_PREFIX} + m_clientId + "/" + name + "/config"};
+    const String uniqueId{m_clientId + "_" + name};
+    const String valueTemplate{String{"{{ value_json."} + name + " }}"};
+
+    JSONWriter writer{m_payload};
+    writer.beginObject()
+        .member("name", name)
+        .member("unique_id", uniqueId.c_str())
+        .member("state_topic", m_topicState.c_str())
+        .member("value_template", valueTemplate.c_str())
+        .member("availability_topic", m_topicStatus.c_str())
+        .member("state_class", "measurement");
+    if (info.unit != nullptr)
+    {
+        writer.member("unit_of_measurement", info.unit);
+    }
+    if (info.deviceClass != nullptr)
+    {
+        writer.member("device_class", info.deviceClass);
+    }
+    writer.key("device").beginObject();
+    writer.key("identifiers").beginArray().value(m_clientId.c_str()).endArray();
+    writer.member("name", m_clientId.c_str()).member("manufacturer", "hsbsw").member("model", "hAIR");
+    writer.endObject().endObject();
+
+    if (m_client.publish(topic.c_str(), 1, true, writer.c_str(), writer.length()) == 0)
+    {
+        return false;
+    }
+    ++m_discoveryNext;
+    return true;
+}
+
+bool MqttPublisher::publishBatch(Timestamp now, uint32_t epoch)
+{
+    // Full batches only, unless the oldest sample has waited long enough
+    const auto samples{std::min(m_count, m_settings.batchSize)};
+    if (samples < m_settings.batchSize && !m_spilling && epoch - at(0).timestamp < m_settings.batchDelay)
+    {
+        return false;
+    }
+
+    JSONWriter writer{m_payload};
+    writer.beginObject().key("samples").beginArray();
+    for (size_t sample = 0; sample < samples; ++sample)
+    {
+        sampleToJSON(writer, at(sample));
+    }
+    writer.endArray().endObject();
+
+    const auto packetId{m_client.publish(m_topicSamples.c_str(), m_settings.qos, false, writer.c_str(), writer.length())};
+    if (packetId == 0)
+    {
+        return false;
+    }
+
+    m_inFlight       = samples;
+    m_inFlightPacket = packetId;
+    m_inFlightSince  = now;
+    if (m_settings.qos == 0)
+    {
+        completeInFlight(now);
+    }
+    return true;
+}
+
+void MqttPublisher::completeInFlight(Timestamp now)
+{
+    if (m_inFlight == 0)
+    {
+        return;
+    }
+
+    if (m_settings.qos > 0 && m_ackedPacket != m_inFlightPacket)
+    {
+        if (isDue(now, m_inFlightSince + ACK_TIMEOUT))
+        {
+            PLOGW << "MQTT: no PUBACK for message " << m_inFlightPacket << ", sending it again";
+            m_inFlight = 0;
+        }
+        return;
+    }
+
+    if (m_settings.qos > 0)
+    {
+        m_metrics.countMqttAck(now - m_inFlightSince);
+    }
+    m_metrics.countMqttPublished(m_inFlight);
+
+    m_head = (m_head + m_inFlight) % m_settings.queueSize;
+    m_count -= m_inFlight;
+    m_inFlight = 0;
+}
+
+void MqttPublisher::publishState(const ArchiveFormat::Record& record)
+{
+    std::array<char, SAMPLE_CAPACITY> state{};
+    JSONWriter                        writer{state};
+    sampleToJSON(writer, record);
+    m_client.publish(m_topicState.c_str(), 0, true, writer.c_str(), writer.length());
+}
+
+void MqttPublisher::publishHealth()
+{
+    if (!m_enabled || !m_connected)
+    {
+        return;
+    }
+
+    std::array<char, 256> health{};
+    JSONWriter            writer{health};
+    writer.beginObject()
+        .member("uptime", static_cast<uint32_t>(esp_timer_get_time() / 1000000))
+        .member("heapFree", ESP.getFreeHeap())
+        .member("heapMinFree", ESP.getMinFreeHeap())
+        .member("rssi", static_cast<int32_t>(WiFi.RSSI()))
+        .member("queued", static_cast<uint32_t>(m_count))
+        .member("spilledBytes", static_cast<uint32_t>(m_spillWritten - m_spillRead))
+        .member("dropped", m_metrics.getMqttDropped())
+        .member("sessions", m_sessions)
+        .endObject();
+    m_client.publish(m_topicHealth.c_str(), 0, false, writer.c_str(), writer.length());
+}
@@ -0,0 +1,248 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "SGP30.h"
+
+#include "EnvMath.h"
+
+namespace
+{
+constexpr std::array<uint8_t, 256> makeCrcTable()
+{
+    std::array<uint8_t, 256> table{};
+    for (size_t i = 0; i < table.size(); ++i)
+    {
+        auto crc{static_cast<uint8_t>(i)};
+        for (uint8_t bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x31) : static_cast<uint8_t>(crc << 1);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+// Built by the compiler, ends up in flash
+constexpr auto CRC_TABLE{makeCrcTable()};
+
+// The caller's clock is millis(), the sensor may need all of the last millisecond
+constexpr int32_t CLOCK_MARGIN{1}; // [ms]
+
+bool isDue(int32_t now, int32_t due)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(now) - static_cast<uint32_t>(due)) >= 0;
+}
+} // namespace
+
+uint8_t SGP30::crc8(const uint8_t* data, size_t length)
+{
+    uint8_t crc{0xFF};
+    for (size_t i = 0; i < length; ++i)
+    {
+        crc = CRC_TABLE[crc ^ data[i]];
+    }
+    return crc;
+}
+
+////////////////////////////////
+/// Setup, blocking
+////////////////////////////////
+
+bool SGP30::begin(Delay delay)
+{
+    std::array<uint16_t, 3> serialId{};
+    if (!execute(GetSerialId, delay, serialId.data()))
+    {
+        return false;
+    }
+    m_serialId = (static_cast<uint64_t>(serialId[0]) << 32) | (static_cast<uint64_t>(serialId[1]) << 16) | serialId[2];
+
+    // Product version 0x2x like the Adafruit driver checks it, the product type (upper nibble of the word) is 0 for the SGP30 anyway
+    std::array<uint16_t, 1> featureSet{};
+    if (!execute(GetFeatureSet, delay, featureSet.data()) || (featureSet[0] & 0xF0) != 0x20)
+    {
+        return false;
+    }
+
+    return execute(InitAirQuality, delay);
+}
+
+bool SGP30::setBaseline(uint16_t eCO2, uint16_t TVOC, Delay delay)
+{
+    // Reverse order of get_baseline
+    const std::array<uint16_t, 2> params{TVOC, eCO2};
+    return execute(SetBaseline, delay, nullptr, params.data(), params.size());
+}
+
+bool SGP30::execute(Command command, Delay delay, uint16_t* words, const uint16_t* params, size_t count)
+{
+    if (!issue(command, 0, params, count))
+    {
+        return false;
+    }
+    delay(COMMANDS[command].duration + CLOCK_MARGIN);
+    m_inFlight = None;
+    return words == nullptr || readWords(words, COMMANDS[command].words);
+}
+
+////////////////////////////////
+/// Measurements, split-phase
+////////////////////////////////
+
+SGP30::Status SGP30::measureAirQuality(int32_t now, uint16_t& eCO2, uint16_t& TVOC)
+{
+    return measure(MeasureAirQuality, now, eCO2, TVOC);
+}
+
+SGP30::Status SGP30::measureRawSignals(int32_t now, uint16_t& rawH2, uint16_t& rawEthanol)
+{
+    return measure(MeasureRawSignals, now, rawH2, rawEthanol);
+}
+
+SGP30::Status SGP30::getBaseline(int32_t now, uint16_t& eCO2, uint16_t& TVOC)
+{
+    return measure(GetBaseline, now, eCO2, TVOC);
+}
+
+bool SGP30::setAbsoluteHumidity(uint32_t absoluteHumidity)
+{
+    uint16_t word{};
+    if (!EnvMath::toSensirionHumidity(absoluteHumidity, word))
+    {
+        return false;
+    }
+
+    if (word != m_humidity)
+    {
+        m_humidity        = word;
+        m_humidityChanged = true;
+    }
+    return true;
+}
+
+SGP30::Status SGP30::measure(Command command, int32_t now, uint16_t& first, uint16_t& second)
+{
+    if (m_inFlight != None && isDue(now, m_readyAt))
+    {
+        collect();
+    }
+
+    // Collected by this call or an earlier one (maybe one for another measurement)
+    auto& result{m_results[command]};
+    if (result.complete)
+    {
+        result.complete = false;
+        if (!result.valid)
+        {
+            return Status::Failed;
+        }
+        first  = result.words[0];
+        second = result.words[1];
+        return Status::Done;
+    }
+
+    if (m_inFlight == command)
+    {
+        return Status::Pending;
+    }
+    if (m_inFlight != None)
+    {
+        return Status::Busy;
+    }
+
+    // The compensation goes first, the measurement follows once it is through
+    if (command == MeasureAirQuality && m_humidityChanged)
+    {
+        const std::array<uint16_t, 1> params{m_humidity};
+        if (!issue(SetHumidity, now, params.data(), params.size()))
+        {
+            return Status::Failed;
+        }
+        m_humidityChanged = false;
+        return Status::Busy;
+    }
+
+    return issue(command, now) ? Status::Pending : Status::Failed;
+}
+
+bool SGP30::issue(Command command, int32_t now, const uint16_t* params, size_t count)
+{
+    // [command MSB][command LSB] then per parameter [MSB][LSB][CRC]
+    std::array<uint8_t, 2 + 3 * MAX_WORDS> frame{};
+    frame[0] = static_cast<uint8_t>(COMMANDS[command].code >> 8);
+    frame[1] = static_cast<uint8_t>(COMMANDS[command].code);
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto* word{frame.data() + 2 + 3 * i};
+        word[0] = static_cast<uint8_t>(params[i] >> 8);
+        word[1] = static_cast<uint8_t>(params[i]);
+        word[2] = crc8(word, 2);
+    }
+
+    if (!m_bus.write(ADDRESS, frame.data(), 2 + 3 * count))
+    {
+        return false;
+    }
+
+    m_inFlight = command;
+    m_readyAt  = now + COMMANDS[command].duration + CLOCK_MARGIN;
+    return true;
+}
+
+void SGP30::collect()
+{
+    const auto command{m_inFlight};
+    m_inFlight = None;
+
+    // Commands without a response are done once their time is over
+    if (COMMANDS[command].words > 0)
+    {
+        auto& result{m_results[command]};
+        result.valid    = readWords(result.words.data(), COMMANDS[command].words);
+        result.complete = true;
+    }
+}
+
+bool SGP30::readWords(uint16_t* words, size_t count)
+{
+    // Per word [MSB][LSB][CRC]
+    std::array<uint8_t, 3 * MAX_WORDS> response{};
+    if (!m_bus.read(ADDRESS, response.data(), 3 * count))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto* word{response.data() + 3 * i};
+        if (crc8(word, 2) != word[2])
+        {
+            return false;
+        }
+        words[i] = static_cast<uint16_t>((word[0] << 8) | word[1]);
+    }
+    return true;
+}
@@ -0,0 +1,219 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Scheduler.h"
+#include <algorithm>
+
+void Scheduler::add(const char* name, TaskItem& task, Job job, bool runOnNotify)
+{
+    m_entries.push_back({name, &task, std::move(job), runOnNotify});
+}
+
+void Scheduler::setPassHook(Job hook)
+{
+    m_passHook = std::move(hook);
+}
+
+void Scheduler::start()
+{
+    m_clock.attach();
+
+    const auto now{m_clock.now()};
+    const auto later{[this](size_t lhs, size_t rhs)
+                     {
+                         return isLater(lhs, rhs);
+                     }};
+
+    m_heap.clear();
+    for (size_t i = 0; i < m_entries.size(); ++i)
+    {
+        if (m_entries[i].task->getPeriod() > 0)
+        {
+            m_entries[i].task->schedule(now);
+            m_heap.push_back(i);
+        }
+    }
+    std::make_heap(m_heap.begin(), m_heap.end(), later);
+}
+
+void Scheduler::runOnce()
+{
+    const auto now{m_clock.now()};
+    const auto later{[this](size_t lhs, size_t rhs)
+                     {
+                         return isLater(lhs, rhs);
+                     }};
+
+    bool ran{false};
+
+    if (m_resetStats.exchange(false))
+    {
+        for (auto& entry : m_entries)
+        {
+            entry.task->getStats().reset();
+        }
+    }
+
+    if (m_notified.exchange(false))
+    {
+        const auto notifiedAt{m_notifiedAt.load()};
+        for (auto& entry : m_entries)
+        {
+            if (entry.runOnNotify)
+            {
+                runJob(entry, notifiedAt);
+                ran = true;
+            }
+        }
+    }
+
+    // Everything that is due as of the start of the pass, a job that becomes due while others run waits for the next pass
+    while (!m_heap.empty() && m_entries[m_heap.front()].task->getDeadline() <= now)
+    {
+        std::pop_heap(m_heap.begin(), m_heap.end(), later);
+        auto& entry{m_entries[m_heap.back()]};
+
+        runJob(entry, entry.task->getDeadline());
+        ran = true;
+
+        entry.task->advance(now);
+        std::push_heap(m_heap.begin(), m_heap.end(), later);
+    }
+
+    if (ran && m_passHook)
+    {
+        m_passHook(nowMillis());
+    }
+
+    auto wakeup{now + MAX_SLEEP};
+    if (!m_heap.empty())
+    {
+        wakeup = std::min(wakeup, m_entries[m_heap.front()].task->getDeadline());
+    }
+    if (!m_notified.load())
+    {
+        m_clock.sleepUntil(wakeup);
+    }
+}
+
+void Scheduler::run(void* scheduler)
+{
+    auto* self = static_cast<Scheduler*>(scheduler);
+
+    self->start();
+    while (true)
+    {
+        self->runOnce();
+    }
+}
+
+void Scheduler::notify()
+{
+    m_notifiedAt = m_clock.now();
+    m_notified   = true;
+    m_clock.wake();
+}
+
+void Scheduler::resetStats()
+{
+    m_resetStats = true;
+}
+
+void Scheduler::toJSON(JSONWriter& writer) const
+{
+    auto percentiles = [&writer](const char* name, const LatencyHistogram& histogram)
+    {
+        writer.key(name).beginObject();
+        writer.member("p50", histogram.percentile(50));
+        writer.member("p90", histogram.percentile(90));
+        writer.member("p99", histogram.percentile(99));
+        writer.member("max", histogram.max());
+        writer.endObject();
+    };
+
+    writer.beginObject();
+    writer.member("name", m_name);
+    writer.key("tasks").beginArray();
+    for (const auto& entry : m_entries)
+    {
+        const auto& stats{entry.task->getStats()};
+
+        writer.beginObject();
+        writer.member("name", entry.name);
+        writer.member("period", entry.task->getPeriod());
+        writer.member("runs", stats.runs);
+        writer.member("rate", stats.getRate(), 3);
+        writer.member("skipped", stats.skipped);
+        writer.member("overruns", stats.overruns);
+        percentiles("lateness", stats.lateness);
+        percentiles("duration", stats.duration);
+        writer.endObject();
+    }
+    writer.endArray();
+    writer.endObject();
+}
+
+void Scheduler::printStats(Print& out) const
+{
+    out.printf("[Tasks] %s\n", m_name);
+    out.printf("  %-16s %10s %8s %9s %8s %8s %21s %21s\n", "task", "period", "runs", "rate[Hz]", "skipped", "overruns", "late p50/p99/max[us]", "dur p50/p99/max[us]");
+    for (const auto& entry : m_entries)
+    {
+        const auto& stats{entry.task->getStats()};
+        out.printf("  %-16s %10lld %8u %9.3f %8u %8u %7u/%6u/%6u %7u/%6u/%6u\n",
+                   entry.name,
+                   static_cast<long long>(entry.task->getPeriod()),
+                   stats.runs,
+                   stats.getRate(),
+                   stats.skipped,
+                   stats.overruns,
+                   stats.lateness.percentile(50),
+                   stats.lateness.percentile(99),
+                   stats.lateness.max(),
+                   stats.duration.percentile(50),
+                   stats.duration.percentile(99),
+                   stats.duration.max());
+    }
+}
+
+Timestamp Scheduler::nowMillis()
+{
+    return static_cast<Timestamp>(m_clock.now() / 1000);
+}
+
+void Scheduler::runJob(Entry& entry, int64_t deadline)
+{
+    const auto start{m_clock.now()};
+    entry.task->updateTry(static_cast<Timestamp>(start / 1000));
+    entry.job(static_cast<Timestamp>(start / 1000));
+    entry.task->armExtra(start);
+    entry.task->getStats().record(deadline, start, m_clock.now(), entry.task->getPeriod());
+}
+
+bool Scheduler::isLater(size_t lhs, size_t rhs) const
+{
+    return m_entries[lhs].task->getDeadline() > m_entries[rhs].task->getDeadline();
+}
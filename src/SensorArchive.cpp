@@ -0,0 +1,507 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "SensorArchive.h"
+#include "LogCapture.h"
+#include "SensorHistory.h"
+#include <LITTLEFS.h>
+
+using ArchiveFormat::BLOCK_SIZE;
+
+static_assert(ArchiveFormat::CHANNEL_COUNT == SensorHistory::CHANNEL_COUNT, "The archive stores the fixed point channels of the history");
+
+////////////////////////////////
+/// Setup
+////////////////////////////////
+
+bool SensorArchive::init(size_t segmentSize, size_t segmentCount, Timestamp flushInterval)
+{
+    AutoLock lock(m_mtx);
+
+    m_enabled = false;
+    if (segmentCount == 0)
+    {
+        return true;
+    }
+
+    // whole blocks only, and at least two of them
+    m_segmentCapacity = std::max<size_t>((segmentSize + BLOCK_SIZE - 1) / BLOCK_SIZE, 2) * BLOCK_SIZE;
+    m_segmentCount    = segmentCount;
+    m_flushInterval   = flushInterval;
+
+    if (!LITTLEFS.exists(DIRECTORY) && !LITTLEFS.mkdir(DIRECTORY))
+    {
+        PLOGE << "Archive: could not create " << DIRECTORY;
+        return false;
+    }
+
+    // Find the range of existing segments
+    m_hasSegments = false;
+    m_segmentOpen = false;
+    m_sizeOnFlash = 0;
+
+    auto dir = LITTLEFS.open(DIRECTORY);
+    for (auto file = dir.openNextFile(); file; file = dir.openNextFile())
+    {
+        // depending on the LittleFS version, name() is either the full path or the file name
+        String name{file.name()};
+        name = name.substring(name.lastIndexOf('/') + 1);
+
+        if (!name.endsWith(".hsa"))
+        {
+            continue;
+        }
+
+        const auto segment{static_cast<uint32_t>(strtoul(name.c_str(), nullptr, 16))};
+        if (!m_hasSegments || segment < m_oldestSegment)
+        {
+            m_oldestSegment = segment;
+        }
+        if (!m_hasSegments || segment > m_newestSegment)
+        {
+            m_newestSegment = segment;
+        }
+        m_hasSegments = true;
+        m_sizeOnFlash += file.size();
+    }
+    dir.close();
+
+    if (m_hasSegments)
+    {
+        m_segmentOpen = recoverNewestSegment();
+        if (m_segmentOpen)
+        {
+            m_sizeOnFlash -= m_segmentSize;
+        }
+        else
+        {
+            // leave the broken segment to the readers, the next record starts a new one
+            m_segmentSize     = 0;
+            m_forceBlockStart = false;
+        }
+
+        while (m_newestSegment - m_oldestSegment + 1 > m_segmentCount)
+        {
+            deleteOldestSegment();
+        }
+    }
+
+    m_enabled = true;
+    return true;
+}
+
+bool SensorArchive::recoverNewestSegment()
+{
+    // After a power loss, the tail of the newest segment may hold a torn record.
+    // The file can't be truncated, so we validate the last block and, if it is broken, continue at the next block boundary.
+    // Readers skip the broken rest of that block the same way.
+    auto file = LITTLEFS.open(getPath(m_newestSegment), "r");
+    if (!file)
+    {
+        return false;
+    }
+
+    m_segmentSize = file.size();
+
+    std::array<uint8_t, ArchiveFormat::SegmentHeader::SIZE> headerBytes{};
+    ArchiveFormat::SegmentHeader                            header{};
+    if (file.read(headerBytes.data(), headerBytes.size()) != headerBytes.size() || !header.fromBytes(headerBytes.data()))
+    {
+        PLOGW << "Archive: segment " << m_newestSegment << " has no valid header, starting a new one";
+        file.close();
+        return false;
+    }
+
+    // Scan the last (partial) block, m_pending is still unused at this point
+    const auto blockBegin{m_segmentSize / BLOCK_SIZE * BLOCK_SIZE};
+    const auto dataBegin{std::max(blockBegin, ArchiveFormat::SegmentHeader::SIZE)};
+    const auto length{m_segmentSize - dataBegin};
+
+    file.seek(dataBegin);
+    const auto read{file.read(m_pending.data(), length)};
+    file.close();
+
+    ArchiveFormat::BlockDecoder decoder{m_pending.data(), read};
+    ArchiveFormat::Record       record{};
+    while (decoder.next(record))
+    {
+    }
+
+    m_forceBlockStart = read != length || decoder.position() != length;
+    if (m_forceBlockStart)
+    {
+        PLOGW << "Archive: segment " << m_newestSegment << " has a broken tail at " << dataBegin + decoder.position() << ", continuing at the next block";
+    }
+
+    m_pending.fill(0);
+    m_pendingLength = 0;
+    m_encoder.reset();
+    return true;
+}
+
+////////////////////////////////
+/// Writing
+////////////////////////////////
+
+void SensorArchive::add(Timestamp now, uint32_t epoch, const SensorData& data)
+{
+    if (epoch < MIN_VALID_EPOCH)
+    {
+        return;
+    }
+
+    ArchiveFormat::Record record{};
+    record.timestamp = epoch;
+    record.values    = SensorHistory::toFixed(data, record.valid);
+
+    AutoLock lock(m_mtx);
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    // Records never straddle a block, after a failed write we also continue at the next block
+    if (m_forceBlockStart || BLOCK_SIZE - getPosition() % BLOCK_SIZE < ArchiveFormat::MAX_RECORD_SIZE)
+    {
+        padToBlockBoundary(now);
+        m_forceBlockStart = false;
+    }
+
+    if (getPosition() % BLOCK_SIZE == 0)
+    {
+        // Rotate only at block boundaries, so the cap is met exactly
+        if (!m_segmentOpen || getPosition() >= m_segmentCapacity)
+        {
+            startSegment(epoch);
+        }
+        m_encoder.reset();
+    }
+
+    m_pendingLength += m_encoder.encode(record, m_pending.data() + m_pendingLength);
+}
+
+void SensorArchive::flushIfDue(Timestamp now)
+{
+    AutoLock lock(m_mtx);
+    if (m_pendingLength > 0 && now - m_lastFlush >= m_flushInterval)
+    {
+        flushLocked(now);
+    }
+}
+
+void SensorArchive::flush(Timestamp now)
+{
+    AutoLock lock(m_mtx);
+    flushLocked(now);
+}
+
+size_t SensorArchive::getPosition() const
+{
+    return m_segmentSize + m_pendingLength;
+}
+
+void SensorArchive::startSegment(uint32_t epoch)
+{
+    flushLocked(m_lastFlush);
+
+    if (m_hasSegments)
+    {
+        m_sizeOnFlash += m_segmentOpen ? m_segmentSize : 0;
+        ++m_newestSegment;
+    }
+    else
+    {
+        m_oldestSegment = m_newestSegment = 0;
+    }
+
+    m_hasSegments = true;
+    m_segmentOpen = true;
+    m_segmentSize = 0;
+
+    ArchiveFormat::SegmentHeader header{};
+    header.segmentId = m_newestSegment;
+    header.created   = epoch;
+    header.toBytes(m_pending.data());
+    m_pendingLength = ArchiveFormat::SegmentHeader::SIZE;
+
+    while (m_newestSegment - m_oldestSegment + 1 > m_segmentCount)
+    {
+        deleteOldestSegment();
+    }
+
+    PLOGI << "Archive: started segment " << getPath(m_newestSegment).c_str();
+}
+
+void SensorArchive::padToBlockBoundary(Timestamp now)
+{
+    const auto used{getPosition() % BLOCK_SIZE};
+    if (used == 0)
+    {
+        return;
+    }
+
+    const auto padding{BLOCK_SIZE - used};
+    memset(m_pending.data() + m_pendingLength, ArchiveFormat::PADDING, padding);
+    m_pendingLength += padding;
+
+    // The block is complete, no reason to keep it in RAM
+    flushLocked(now);
+}
+
+void SensorArchive::flushLocked(Timestamp now)
+{
+    if (m_pendingLength == 0)
+    {
+        return;
+    }
+
+    // Opening in append mode per flush lets LittleFS commit the metadata on close, so a power loss loses at most this flush
+    size_t written{};
+    auto   file = LITTLEFS.open(getPath(m_newestSegment), "a");
+    if (file)
+    {
+        written = file.write(m_pending.data(), m_pendingLength);
+        file.close();
+    }
+
+    if (written != m_pendingLength)
+    {
+        PLOGE << "Archive: wrote " << written << " of " << m_pendingLength << " bytes to " << getPath(m_newestSegment).c_str();
+
+        // If the flash is full, make room. Either way resume at the next block, so the partial record does not take the rest of this block with it.
+        if (LITTLEFS.totalBytes() - LITTLEFS.usedBytes() < m_segmentCapacity && m_newestSegment != m_oldestSegment)
+        {
+            deleteOldestSegment();
+        }
+        m_forceBlockStart = true;
+    }
+
+    m_segmentSize += written;
+    m_pendingLength = 0;
+    m_lastFlush     = now;
+}
+
+void SensorArchive::deleteOldestSegment()
+{
+    const auto path{getPath(m_oldestSegment)};
+
+    auto file = LITTLEFS.open(path, "r");
+    if (file)
+    {
+        const auto size{file.size()};
+        file.close();
+        m_sizeOnFlash -= std::min(m_sizeOnFlash, size);
+    }
+
+    if (!LITTLEFS.remove(path))
+    {
+        PLOGW << "Archive: could not delete " << path.c_str();
+    }
+    ++m_oldestSegment;
+}
+
+size_t SensorArchive::getBlockBegin(size_t block)
+{
+    // block 0 starts behind the segment header
+    return std::max(block * BLOCK_SIZE, ArchiveFormat::SegmentHeader::SIZE);
+}
+
+String SensorArchive::getPath(uint32_t segment)
+{
+    std::array<char, 32> path{};
+    snprintf(path.data(), path.size(), "%s/%08x.hsa", DIRECTORY, segment);
+    return String{path.data()};
+}
+
+////////////////////////////////
+/// Info
+////////////////////////////////
+
+void SensorArchive::toJSON(JSONWriter& writer) const
+{
+    AutoLock lock(m_mtx);
+
+    writer.beginObject();
+    writer.key("segments").beginArray();
+    if (m_hasSegments)
+    {
+        for (auto segment = m_oldestSegment; segment != m_newestSegment + 1; ++segment)
+        {
+            const auto path{getPath(segment)};
+            auto       file = LITTLEFS.open(path, "r");
+            if (file)
+            {
+                writer.beginObject().member("name", path.c_str()).member("size", file.size()).endObject();
+                file.close();
+            }
+        }
+    }
+    writer.endArray();
+    writer.member("pending", m_pendingLength);
+    writer.endObject();
+}
+
+bool SensorArchive::getSegmentRange(uint32_t& oldest, uint32_t& newest) const
+{
+    AutoLock lock(m_mtx);
+    oldest = m_oldestSegment;
+    newest = m_newestSegment;
+    return m_enabled && m_hasSegments;
+}
+
+size_t SensorArchive::getSegmentCount() const
+{
+    AutoLock lock(m_mtx);
+    return m_hasSegments ? m_newestSegment - m_oldestSegment + 1 : 0;
+}
+
+size_t SensorArchive::getSizeOnFlash() const
+{
+    AutoLock lock(m_mtx);
+    return m_sizeOnFlash + (m_segmentOpen ? m_segmentSize : 0);
+}
+
+////////////////////////////////
+/// Reader
+////////////////////////////////
+
+SensorArchive::Reader::Reader(const SensorArchive& archive, uint32_t from, uint32_t to)
+    : m_archive(archive), m_from(from), m_to(to), m_buffer(new (std::nothrow) uint8_t[BLOCK_SIZE])
+{
+}
+
+bool SensorArchive::Reader::isValid() const
+{
+    return m_buffer != nullptr;
+}
+
+bool SensorArchive::Reader::next(ArchiveFormat::Record& record)
+{
+    while (!m_done && isValid())
+    {
+        if (m_decoder.next(record))
+        {
+            // No early exit behind 'to': an NTP correction can step the absolute timestamps backwards
+            if (record.timestamp < m_from || record.timestamp > m_to)
+            {
+                continue;
+            }
+            return true;
+        }
+
+        // A broken record ends its block, loadBlock() resyncs at the next one
+        const bool hasBlock{++m_block < m_blockCount && loadBlock()};
+        if (!hasBlock && !nextSegment())
+        {
+            break;
+        }
+    }
+
+    m_done = true;
+    m_file.close();
+    return false;
+}
+
+bool SensorArchive::Reader::nextSegment()
+{
+    uint32_t oldest{};
+    uint32_t newest{};
+    if (!m_archive.getSegmentRange(oldest, newest))
+    {
+        return false;
+    }
+
+    // Segments may have been rotated away in the meantime
+    auto segment{m_started ? m_segment + 1 : oldest};
+    segment   = std::max(segment, oldest);
+    m_started = true;
+
+    for (; segment <= newest; ++segment)
+    {
+        m_file.close();
+        m_file = LITTLEFS.open(getPath(segment), "r");
+        if (!m_file)
+        {
+            continue;
+        }
+
+        m_segment    = segment;
+        m_blockCount = (m_file.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+        // Sparse index, binary search for the last block that starts at or before 'from'
+        // A block with a broken first record counts as 'after', so we rather start a block too early than too late
+        size_t lo{0};
+        size_t hi{m_blockCount};
+        while (hi - lo > 1)
+        {
+            const auto            mid{lo + (hi - lo) / 2};
+            ArchiveFormat::Record first{};
+            if (readFirstRecord(mid, first) && first.timestamp <= m_from)
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        m_block = lo;
+        if (m_blockCount > 0 && loadBlock())
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool SensorArchive::Reader::loadBlock()
+{
+    const auto begin{getBlockBegin(m_block)};
+    const auto end{std::min((m_block + 1) * BLOCK_SIZE, m_file.size())};
+    if (begin >= end || !m_file.seek(begin))
+    {
+        return false;
+    }
+
+    const auto read{m_file.read(m_buffer.get(), end - begin)};
+    m_decoder = ArchiveFormat::BlockDecoder{m_buffer.get(), read};
+    return true;
+}
+
+bool SensorArchive::Reader::readFirstRecord(size_t block, ArchiveFormat::Record& record)
+{
+    std::array<uint8_t, ArchiveFormat::MAX_RECORD_SIZE> bytes{};
+    if (!m_file.seek(getBlockBegin(block)))
+    {
+        return false;
+    }
+
+    const auto                  read{m_file.read(bytes.data(), bytes.size())};
+    ArchiveFormat::BlockDecoder decoder{bytes.data(), read};
+    return decoder.next(record);
+}
@@ -0,0 +1,362 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "SensorHistory.h"
+#include <algorithm>
+#include <limits>
+#include <new>
+
+const std::array<SensorHistory::Channel, SensorHistory::CHANNEL_COUNT> SensorHistory::CHANNELS{{
+    {"TVOC", 0, false},        // [ppb]
+    {"eCO2", 0, false},        // [ppm]
+    {"rawH2", 0, false},       // [AU]
+    {"rawEthanol", 0, false},  // [AU]
+    {"temperature", 2, true},  // [°C]
+    {"humidity", 2, false},    // [%RH]
+    {"pressure", 1, false},    // [hPa]
+}};
+
+namespace
+{
+// Share of the memory budget per tier, in percent
+constexpr std::array<size_t, 4> TIER_SHARE{50, 20, 15, 15};
+
+template<typename T>
+bool allocate(std::unique_ptr<T[]>& data, size_t& capacity, size_t bytes)
+{
+    capacity = std::max<size_t>(bytes / sizeof(T), 1);
+    data.reset(new (std::nothrow) T[capacity]);
+    return data != nullptr;
+}
+
+/// Wrap safe comparison of millis() based timestamps
+inline bool isBefore(Timestamp lhs, Timestamp rhs)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(lhs) - static_cast<uint32_t>(rhs)) < 0;
+}
+
+inline Timestamp timestampOf(const SensorHistory::Row& row)
+{
+    return row.timestamp;
+}
+} // namespace
+
+////////////////////////////////
+/// Setup
+////////////////////////////////
+
+bool SensorHistory::init(size_t memoryBudget)
+{
+    AutoLock lock(m_mtx);
+
+    m_enabled = false;
+    if (memoryBudget == 0)
+    {
+        return true;
+    }
+
+    bool ok{allocate(m_raw.data, m_raw.capacity, memoryBudget * TIER_SHARE[0] / 100)};
+    for (size_t tier = 1; tier < TIER_COUNT; ++tier)
+    {
+        ok = ok && allocate(m_buckets[tier].data, m_buckets[tier].capacity, memoryBudget * TIER_SHARE[tier] / 100);
+    }
+
+    m_enabled = ok;
+    return ok;
+}
+
+size_t SensorHistory::getCapacity(Resolution resolution) const
+{
+    const auto tier{static_cast<size_t>(resolution)};
+    return tier == 0 ? m_raw.capacity : m_buckets[tier].capacity;
+}
+
+size_t SensorHistory::getMemoryUsage() const
+{
+    size_t bytes{m_raw.capacity * sizeof(RawSample)};
+    for (size_t tier = 1; tier < TIER_COUNT; ++tier)
+    {
+        bytes += m_buckets[tier].capacity * sizeof(Bucket);
+    }
+    return bytes;
+}
+
+Timestamp SensorHistory::getBucketDuration(Resolution resolution)
+{
+    switch (resolution)
+    {
+    case Resolution::Seconds10: return 10 * 1000;
+    case Resolution::Minute1: return 60 * 1000;
+    case Resolution::Hour1: return 60 * 60 * 1000;
+    default: return 0;
+    }
+}
+
+bool SensorHistory::parseResolution(const String& str, Resolution& resolution)
+{
+    static constexpr std::array<const char*, TIER_COUNT> NAMES{"raw", "10s", "1m", "1h"};
+    for (size_t tier = 0; tier < TIER_COUNT; ++tier)
+    {
+        if (str == NAMES[tier])
+        {
+            resolution = static_cast<Resolution>(tier);
+            return true;
+        }
+    }
+    return false;
+}
+
+////////////////////////////////
+/// Writing
+////////////////////////////////
+
+void SensorHistory::add(Timestamp now, const SensorData& data)
+{
+    uint8_t    valid{};
+    const auto values{toFixed(data, valid)};
+
+    RawSample sample{};
+    sample.timestamp = now;
+    sample.valid     = valid;
+
+    Accumulator single{};
+    single.begin  = now;
+    single.isOpen = true;
+
+    for (size_t channel = 0; channel < CHANNEL_COUNT; ++channel)
+    {
+        sample.values[channel] = encode(channel, values[channel]);
+
+        if (valid & (1U << channel))
+        {
+            single.count[channel] = 1;
+            single.sum[channel]   = values[channel];
+            single.min[channel]   = values[channel];
+            single.max[channel]   = values[channel];
+        }
+    }
+
+    AutoLock lock(m_mtx);
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    m_raw.push(sample);
+    accumulate(1, now, single);
+}
+
+void SensorHistory::accumulate(size_t tier, Timestamp timestamp, const Accumulator& source)
+{
+    auto&      acc{m_accumulators[tier]};
+    const auto duration{static_cast<uint32_t>(getBucketDuration(static_cast<Resolution>(tier)))};
+    const auto begin{static_cast<Timestamp>(static_cast<uint32_t>(timestamp) - static_cast<uint32_t>(timestamp) % duration)};
+
+    if (acc.isOpen && acc.begin != begin)
+    {
+        closeBucket(tier);
+    }
+
+    if (!acc.isOpen)
+    {
+        acc        = {};
+        acc.begin  = begin;
+        acc.isOpen = true;
+        acc.min.fill(std::numeric_limits<int32_t>::max());
+        acc.max.fill(std::numeric_limits<int32_t>::min());
+    }
+
+    for (size_t channel = 0; channel < CHANNEL_COUNT; ++channel)
+    {
+        if (source.count[channel] == 0)
+        {
+            continue;
+        }
+
+        acc.count[channel] += source.count[channel];
+        acc.sum[channel] += source.sum[channel];
+        acc.min[channel] = std::min(acc.min[channel], source.min[channel]);
+        acc.max[channel] = std::max(acc.max[channel], source.max[channel]);
+    }
+}
+
+void SensorHistory::closeBucket(size_t tier)
+{
+    auto& acc{m_accumulators[tier]};
+
+    Bucket bucket{};
+    bucket.begin = acc.begin;
+
+    for (size_t channel = 0; channel < CHANNEL_COUNT; ++channel)
+    {
+        const auto count{static_cast<int64_t>(acc.count[channel])};
+        if (count == 0)
+        {
+            continue;
+        }
+
+        const auto sum{acc.sum[channel]};
+        const auto avg{static_cast<int32_t>((sum >= 0 ? sum + count / 2 : sum - count / 2) / count)};
+
+        bucket.valid |= 1U << channel;
+        bucket.min[channel] = encode(channel, acc.min[channel]);
+        bucket.avg[channel] = encode(channel, avg);
+        bucket.max[channel] = encode(channel, acc.max[channel]);
+    }
+
+    m_buckets[tier].push(bucket);
+
+    // Cascade into the next coarser tier, with the exact sums
+    if (tier + 1 < TIER_COUNT)
+    {
+        accumulate(tier + 1, acc.begin, acc);
+    }
+
+    acc.isOpen = false;
+}
+
+////////////////////////////////
+/// Reading
+////////////////////////////////
+
+size_t SensorHistory::read(Resolution resolution, Timestamp from, Timestamp to, Row* rows, size_t maxRows, uint32_t& cursor) const
+{
+    AutoLock lock(m_mtx);
+    if (!m_enabled)
+    {
+        return 0;
+    }
+
+    const auto tier{static_cast<size_t>(resolution)};
+
+    // cursor is sequence + 1, so 0 means 'not started yet'
+    auto readRing = [&](const auto& ring) -> size_t
+    {
+        auto sequence{cursor == 0 ? findFirst(ring, from) : cursor - 1};
+        sequence = std::max(sequence, ring.oldest()); // we were too slow, the ring overtook us
+
+        size_t count{};
+        while (count < maxRows && sequence < ring.total)
+        {
+            const auto row{toRow(ring.at(sequence))};
+            if (isBefore(to, timestampOf(row)))
+            {
+                break;
+            }
+
+            rows[count++] = row;
+            ++sequence;
+        }
+
+        cursor = sequence + 1;
+        return count;
+    };
+
+    return tier == 0 ? readRing(m_raw) : readRing(m_buckets[tier]);
+}
+
+template<typename T>
+uint32_t SensorHistory::findFirst(const Ring<T>& ring, Timestamp from) const
+{
+    // Timestamps within a ring are monotonic, so binary search for the first one >= from
+    auto lo{ring.oldest()};
+    auto hi{ring.total};
+    while (lo < hi)
+    {
+        const auto mid{lo + (hi - lo) / 2};
+        if (isBefore(timestampOf(toRow(ring.at(mid))), from))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+SensorHistory::Row SensorHistory::toRow(const RawSample& sample) const
+{
+    Row row{};
+    row.timestamp = sample.timestamp;
+    row.valid     = sample.valid;
+    for (size_t channel = 0; channel < CHANNEL_COUNT; ++channel)
+    {
+        row.min[channel] = row.avg[channel] = row.max[channel] = decode(channel, sample.values[channel]);
+    }
+    return row;
+}
+
+SensorHistory::Row SensorHistory::toRow(const Bucket& bucket) const
+{
+    Row row{};
+    row.timestamp = bucket.begin;
+    row.valid     = bucket.valid;
+    for (size_t channel = 0; channel < CHANNEL_COUNT; ++channel)
+    {
+        row.min[channel] = decode(channel, bucket.min[channel]);
+        row.avg[channel] = decode(channel, bucket.avg[channel]);
+        row.max[channel] = decode(channel, bucket.max[channel]);
+    }
+    return row;
+}
+
+////////////////////////////////
+/// Fixed Point
+////////////////////////////////
+
+std::array<int32_t, SensorHistory::CHANNEL_COUNT> SensorHistory::toFixed(const SensorData& data, uint8_t& valid)
+{
+    valid = 0;
+    valid |= data.sgp_iaq.isValid ? 0b0000011 : 0;
+    valid |= data.sgp_iaqRaw.isValid ? 0b0001100 : 0;
+    valid |= data.bme_data.isValid ? 0b1110000 : 0;
+
+    return {
+        data.sgp_iaq.TVOC,
+        data.sgp_iaq.eCO2,
+        data.sgp_iaqRaw.rawH2,
+        data.sgp_iaqRaw.rawEthanol,
+        static_cast<int32_t>(lroundf(data.bme_data.temperature * 100.0F)),
+        static_cast<int32_t>(lroundf(data.bme_data.humidity * 100.0F)),
+        static_cast<int32_t>(lroundf(data.bme_data.pressure * 10.0F)),
+    };
+}
+
+uint16_t SensorHistory::encode(size_t channel, int32_t value)
+{
+    if (CHANNELS[channel].isSigned)
+    {
+        return static_cast<uint16_t>(static_cast<int16_t>(std::min<int32_t>(std::max<int32_t>(value, INT16_MIN), INT16_MAX)));
+    }
+    return static_cast<uint16_t>(std::min<int32_t>(std::max<int32_t>(value, 0), UINT16_MAX));
+}
+
+int32_t SensorHistory::decode(size_t channel, uint16_t encoded)
+{
+    return CHANNELS[channel].isSigned ? static_cast<int16_t>(encoded) : encoded;
+}
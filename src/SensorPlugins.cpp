@@ -0,0 +1,184 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "SensorPlugins.h"
+#include <Preferences.h>
+
+namespace
+{
+/// Busy means another command of the shared SGP30 converts, for the registry that is just a longer Pending
+SensorPlugin::Status toPluginStatus(SGP30::Status status)
+{
+    switch (status)
+    {
+    case SGP30::Status::Done:
+        return SensorPlugin::Status::Done;
+    case SGP30::Status::Failed:
+        return SensorPlugin::Status::Failed;
+    default:
+        return SensorPlugin::Status::Pending;
+    }
+}
+} // namespace
+
+////////////////////////////////
+/// SGP30
+////////////////////////////////
+
+bool SGP30Plugin::probe(Delay delay)
+{
+    m_present = m_sgp.begin(delay);
+
+    if (m_present)
+    {
+        // See Baseline acquisition in SDA
+        Preferences preferences;
+        preferences.begin("SGP30", true);
+        uint16_t TVOC_baseline = preferences.getUShort("TVOC_baseline", 0U);
+        uint16_t eCO2_baseline = preferences.getUShort("eCO2_baseline", 0U);
+        preferences.end();
+
+        // https://learn.adafruit.com/adafruit-sgp30-gas-tvoc-eco2-mox-sensor/arduino-code, should be around 400 if it was ever initialized
+        if (eCO2_baseline != 0)
+        {
+            m_baselineRestored = m_sgp.setBaseline(eCO2_baseline, TVOC_baseline, delay);
+        }
+    }
+    return m_present;
+}
+
+String SGP30Plugin::getInfo() const
+{
+    return m_baselineRestored ? "OK, BL from Prefs" : "OK, no BL";
+}
+
+bool SGP30Plugin::start(Timestamp now, const SensorData& data)
+{
+    // Compensate humidity prior to measuring, only goes out to the sensor if it changed; 0 switches it off without BME data
+    m_sgp.setAbsoluteHumidity(data.derived.isValid ? data.derived.absoluteHumidity : 0);
+
+    const auto status{m_sgp.measureAirQuality(now, m_eCO2, m_TVOC)};
+    m_done = status == SGP30::Status::Done;
+    return status != SGP30::Status::Failed;
+}
+
+Timestamp SGP30Plugin::readyAt() const
+{
+    return m_sgp.readyAt();
+}
+
+SensorPlugin::Status SGP30Plugin::read(Timestamp now, SensorData& data)
+{
+    const auto status{m_done ? Status::Done : toPluginStatus(m_sgp.measureAirQuality(now, m_eCO2, m_TVOC))};
+    m_done = false;
+
+    if (status == Status::Done)
+    {
+        data.sgp_iaq.TVOC    = m_TVOC;
+        data.sgp_iaq.eCO2    = m_eCO2;
+        data.sgp_iaq.isValid = true;
+    }
+    return status;
+}
+
+////////////////////////////////
+/// SGP30 raw signals
+////////////////////////////////
+
+bool SGP30RawPlugin::probe(Delay /*delay*/)
+{
+    return m_sgp.isPresent();
+}
+
+bool SGP30RawPlugin::start(Timestamp now, const SensorData& /*data*/)
+{
+    const auto status{m_sgp.getDriver().measureRawSignals(now, m_rawH2, m_rawEthanol)};
+    m_done = status == SGP30::Status::Done;
+    return status != SGP30::Status::Failed;
+}
+
+Timestamp SGP30RawPlugin::readyAt() const
+{
+    return m_sgp.readyAt();
+}
+
+SensorPlugin::Status SGP30RawPlugin::read(Timestamp now, SensorData& data)
+{
+    const auto status{m_done ? Status::Done : toPluginStatus(m_sgp.getDriver().measureRawSignals(now, m_rawH2, m_rawEthanol))};
+    m_done = false;
+
+    if (status == Status::Done)
+    {
+        data.sgp_iaqRaw.rawH2      = m_rawH2;
+        data.sgp_iaqRaw.rawEthanol = m_rawEthanol;
+        data.sgp_iaqRaw.isValid    = true;
+    }
+    return status;
+}
+
+////////////////////////////////
+/// BMExxx
+////////////////////////////////
+
+bool BMExxxPlugin::probe(Delay delay)
+{
+    return m_bme.begin(m_settings, delay);
+}
+
+String BMExxxPlugin::getInfo() const
+{
+    return m_bme.getChipName();
+}
+
+bool BMExxxPlugin::start(Timestamp now, const SensorData& /*data*/)
+{
+    return m_bme.measure(now, m_sample) != BMExxx::Status::Failed;
+}
+
+Timestamp BMExxxPlugin::readyAt() const
+{
+    return m_bme.readyAt();
+}
+
+SensorPlugin::Status BMExxxPlugin::read(Timestamp now, SensorData& data)
+{
+    const auto status{m_bme.measure(now, m_sample)};
+    if (status == BMExxx::Status::Pending)
+    {
+        return Status::Pending;
+    }
+    if (status == BMExxx::Status::Failed)
+    {
+        return Status::Failed;
+    }
+
+    // Integer all the way from the ADC, float only for SensorData
+    data.bme_data.temperature = m_sample.temperature / 100.0F;
+    data.bme_data.humidity    = m_sample.humidity / 1000.0F;
+    data.bme_data.pressure    = m_sample.pressure / 100.0F;
+    data.bme_data.isValid     = true;
+    return Status::Done;
+}
@@ -0,0 +1,132 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "SensorRegistry.h"
+#include "LogCapture.h"
+
+bool SensorRegistry::add(const char* name, SensorPlugin& plugin, float frequency)
+{
+    if (m_count >= MAX_PLUGINS)
+    {
+        return false;
+    }
+
+    auto& entry{m_entries[m_count++]};
+    entry.name      = name;
+    entry.plugin    = &plugin;
+    entry.frequency = frequency;
+    return true;
+}
+
+void SensorRegistry::probe(I2CBus& bus, SensorPlugin::Delay delay)
+{
+    // An empty write is acknowledged by any device on the address, 0x08 .. 0x77 are the non-reserved ones
+    String devices{};
+    for (uint8_t address = 0x08; address < 0x78; ++address)
+    {
+        if (bus.write(address, nullptr, 0))
+        {
+            devices += " 0x" + String(address, HEX);
+        }
+    }
+    PLOGI << "I2C devices:" << (devices.length() == 0 ? " none" : devices.c_str());
+
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        auto& entry{m_entries[i]};
+        entry.present = entry.plugin->probe(delay);
+        if (entry.present)
+        {
+            PLOGI << entry.plugin->getName() << " found: " << entry.plugin->getInfo().c_str();
+        }
+        else
+        {
+            PLOGW << entry.plugin->getName() << " not found";
+        }
+    }
+}
+
+void SensorRegistry::schedule(Scheduler& scheduler, SensorData& data, bool& changed)
+{
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        auto& entry{m_entries[i]};
+        if (!entry.present)
+        {
+            continue;
+        }
+
+        entry.task.setFrequency(entry.frequency);
+        scheduler.add(entry.name, entry.task, [this, &entry, &data, &changed](Timestamp now)
+                      {
+                          run(entry, now, data, changed);
+                      });
+    }
+}
+
+void SensorRegistry::run(Entry& entry, Timestamp now, SensorData& data, bool& changed)
+{
+    auto&            plugin{*entry.plugin};
+    const SensorData previous{data};
+
+    auto status{SensorPlugin::Status::Failed};
+    if (!entry.started)
+    {
+        entry.started = plugin.start(now, data);
+        status        = entry.started ? SensorPlugin::Status::Pending : SensorPlugin::Status::Failed;
+    }
+    else
+    {
+        status = plugin.read(now, data);
+    }
+
+    if (status == SensorPlugin::Status::Pending)
+    {
+        entry.task.runExtraAt(plugin.readyAt(), now);
+        return;
+    }
+    entry.started = false;
+
+    if (status == SensorPlugin::Status::Done)
+    {
+        entry.task.updateSuccess(now);
+        data.updateDerived();
+        changed = changed || data != previous;
+        return;
+    }
+
+    entry.task.updateFailure();
+
+    // only print a warning if sensor has not been read within the last minute, since some produce a lot of errors
+    if (dt_max(now, entry.task.getLastSuccess(), 60000))
+    {
+        PLOGW << plugin.getName() << " data acquisition failed\n";
+
+        data.invalidate(plugin.getChannels());
+        data.updateDerived();
+        changed = changed || data != previous;
+    }
+}
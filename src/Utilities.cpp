@@ -25,6 +25,7 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "Utilities.h"
+#include <NTPClient.h>
 
 ////////////////////////////////
 /// Filesystem
@@ -90,10 +91,6 @@ void listDir(fs::FS& fs, const char* dirname, uint8_t levels)
 /// Date & Time
 ////////////////////////////////
 
-#ifndef LEAP_YEAR
-#define LEAP_YEAR(Y) ((Y > 0) && !(Y % 4) && ((Y % 100) || !(Y % 400)))
-#endif
-
 // https://github.com/arduino-libraries/NTPClient/pull/94
 String getFormattedTime(unsigned long secs)
 {
@@ -110,41 +107,67 @@ String getFormattedTime(unsigned long secs)
     return hoursStr + ":" + minuteStr + ":" + secondStr;
 }
 
-// https://github.com/arduino-libraries/NTPClient/pull/94
-// Based on https://github.com/PaulStoffregen/Time/blob/master/Time.cpp
-// currently assumes UTC timezone, instead of using this->_timeOffset
+// currently assumes UTC timezone, instead of using NTPClient's time offset
 String getFormattedDate(unsigned long secs)
 {
-    unsigned long        rawTime     = secs / 86400L; // in days
-    unsigned long        days        = 0;
-    unsigned long        year        = 1970;
-    uint8_t              month       = 0;
-    static const uint8_t monthDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    DateTimeText text{};
+    return String(text.format(secs));
+}
+
+uint32_t getUnixTime(const NTPClient& ntpclient)
+{
+    return static_cast<uint32_t>(ntpclient.getEpochTime() - NTP_TIME_OFFSET);
+}
+
+namespace
+{
+void putTwoDigits(char* out, uint32_t val)
+{
+    out[0] = static_cast<char>('0' + val / 10);
+    out[1] = static_cast<char>('0' + val % 10);
+}
+} // namespace
 
-    while ((days += (LEAP_YEAR(year) ? 366 : 365)) <= rawTime)
+const char* DateTimeText::format(uint32_t secs)
+{
+    if (secs == m_secs && m_day != UINT32_MAX)
     {
-        year++;
+        return m_text.data();
     }
-    rawTime -= days - (LEAP_YEAR(year) ? 366 : 365); // now it is days in this year, starting at 0
-    days = 0;
-    for (month = 0; month < 12; month++)
+    m_secs = secs;
+
+    const auto day{secs / 86400U};
+    if (day != m_day)
     {
-        uint8_t monthLength;
-        if (month == 1)
-        { // february
-            monthLength = LEAP_YEAR(year) ? 29 : 28;
-        }
-        else
-        {
-            monthLength = monthDays[month];
-        }
-        if (rawTime < monthLength)
-        {
-            break;
-        }
-        rawTime -= monthLength;
+        m_day = day;
+
+        // civil_from_days, http://howardhinnant.github.io/date_algorithms.html (days since 1970 are never negative here)
+        const auto z{day + 719468U};
+        const auto era{z / 146097U};
+        const auto doe{z - era * 146097U};                                         // [0, 146096]
+        const auto yoe{(doe - doe / 1460U + doe / 36524U - doe / 146096U) / 365U}; // [0, 399]
+        const auto doy{doe - (365U * yoe + yoe / 4U - yoe / 100U)};                // [0, 365], starting at March 1st
+        const auto mp{(5U * doy + 2U) / 153U};                                     // [0, 11]
+        const auto dayOfMonth{doy - (153U * mp + 2U) / 5U + 1U};                   // [1, 31]
+        const auto month{mp < 10U ? mp + 3U : mp - 9U};                            // [1, 12]
+        const auto year{yoe + era * 400U + (month <= 2U ? 1U : 0U)};
+
+        putTwoDigits(&m_text[0], year / 100U % 100U);
+        putTwoDigits(&m_text[2], year % 100U);
+        m_text[4] = '-';
+        putTwoDigits(&m_text[5], month);
+        m_text[7] = '-';
+        putTwoDigits(&m_text[8], dayOfMonth);
+        m_text[10] = 'T';
+        m_text[13] = ':';
+        m_text[16] = ':';
+        m_text[19] = 'Z';
+        m_text[20] = '\0';
     }
-    String monthStr = ++month < 10 ? "0" + String(month) : String(month);       // jan is month 1
-    String dayStr   = ++rawTime < 10 ? "0" + String(rawTime) : String(rawTime); // day of month
-    return String(year) + "-" + monthStr + "-" + dayStr + "T" + getFormattedTime(secs ? secs : 0) + "Z";
+
+    const auto secondOfDay{secs % 86400U};
+    putTwoDigits(&m_text[11], secondOfDay / 3600U);
+    putTwoDigits(&m_text[14], secondOfDay / 60U % 60U);
+    putTwoDigits(&m_text[17], secondOfDay % 60U);
+    return m_text.data();
 }
@@ -25,11 +25,15 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "WebServer.h"
+#include "ChunkedStream.h"
+#include "JSONWriter.h"
+#include "LogCapture.h"
 #include "hAIR.h"
 #include <ArduinoJson.h>
 #include <LITTLEFS.h>
+#include <WiFi.h>
+#include <esp_timer.h>
 #include <plog/Init.h>
-#include <plog/Log.h>
 #include <plog/Logger.h>
 
 bool WebServer::init()
@@ -38,11 +42,21 @@ bool WebServer::init()
     /// Root
     ////////////////////////////////
 
+    loadAssets();
     asyncWebserver.on("/",
                       [&](AsyncWebServerRequest* request)
                       {
                           onRoot(request);
                       });
+    for (const auto& asset : assets)
+    {
+        asyncWebserver.on(asset.url.c_str(),
+                          HTTP_GET,
+                          [this, &asset](AsyncWebServerRequest* request)
+                          {
+                              onAsset(request, asset);
+                          });
+    }
     asyncWebserver.onNotFound([&](AsyncWebServerRequest* request)
                               {
                                   onPageNotFound(request);
@@ -62,6 +76,51 @@ bool WebServer::init()
                       {
                           onSensordata(request);
                       });
+    asyncWebserver.on("/history",
+                      [&](AsyncWebServerRequest* request)
+                      {
+                          onHistory(request);
+                      });
+    // Handlers match in order and "/archive" would also take "/archive/...", so the segment files come first
+    asyncWebserver.serveStatic("/archive/", LITTLEFS, "/archive/");
+    asyncWebserver.on("/archive",
+                      [&](AsyncWebServerRequest* request)
+                      {
+                          onArchive(request);
+                      });
+
+    ////////////////////////////////
+    /// Export
+    ////////////////////////////////
+
+    asyncWebserver.on("/export.csv",
+                      [&](AsyncWebServerRequest* request)
+                      {
+                          onExport(request, ExportFormat::CSV);
+                      });
+    asyncWebserver.on("/export.ndjson",
+                      [&](AsyncWebServerRequest* request)
+                      {
+                          onExport(request, ExportFormat::NDJSON);
+                      });
+    asyncWebserver.on("/logs",
+                      [&](AsyncWebServerRequest* request)
+                      {
+                          onLogs(request);
+                      });
+    // Format strings of the binary log records, generated by tools/log_table.py
+    // Usually an asset, this only serves it from an image that was built without tools/compress_fs.py
+    asyncWebserver.serveStatic("/log_table.txt", LITTLEFS, "/log_table.txt");
+    asyncWebserver.on("/metrics",
+                      [&](AsyncWebServerRequest* request)
+                      {
+                          onMetrics(request);
+                      });
+    asyncWebserver.on("/taskstats",
+                      [&](AsyncWebServerRequest* request)
+                      {
+                          onTaskStats(request);
+                      });
 
     ////////////////////////////////
     /// Logger
@@ -108,8 +167,10 @@ bool WebServer::init()
 /// Logging
 ////////////////////////////////
 
-void WebServer::logRequest(AsyncWebServerRequest* request)
+void WebServer::logRequest(AsyncWebServerRequest* request, const char* route)
 {
+    metrics.countRequest(route != nullptr ? route : request->url().c_str());
+
     PLOGD << "HTTP ["
           << request->methodToString()
           << "] Request from ["
@@ -135,15 +196,101 @@ auto WebServer::logReply(AsyncWebServerRequest* request, HTTPStatusCode code) ->
 /// Main page (more or less index.html)
 void WebServer::onRoot(AsyncWebServerRequest* request)
 {
+    for (const auto& asset : assets)
+    {
+        if (asset.url == "/index.html")
+        {
+            onAsset(request, asset);
+            return;
+        }
+    }
+
     logRequest(request);
 
     request->send(LITTLEFS, "/index.html", "text/html");
 }
 
+////////////////////////////////
+/// Assets
+////////////////////////////////
+
+constexpr auto ASSET_MANIFEST{"/assets.txt"};
+
+/// Reads the manifest written by tools/compress_fs.py, "<url>\t<hash>\t<content type>" per line
+/// @return false if there is none, i.e. the image was built without the script and the files are served as they are
+bool WebServer::loadAssets()
+{
+    if (!LITTLEFS.exists(ASSET_MANIFEST))
+    {
+        PLOGW << "No " << ASSET_MANIFEST << " in the filesystem, the web assets are served uncompressed";
+        return false;
+    }
+
+    auto file = LITTLEFS.open(ASSET_MANIFEST, "r");
+    while (file.available())
+    {
+        const auto line{file.readStringUntil('\n')};
+        if (line.length() == 0 || line[0] == '#')
+        {
+            continue;
+        }
+
+        const auto typeBegin{line.lastIndexOf('\t')};
+        const auto versionBegin{line.indexOf('\t')};
+        if (versionBegin <= 0 || typeBegin <= versionBegin)
+        {
+            PLOGW << "Invalid line in " << ASSET_MANIFEST << ": " << line;
+            continue;
+        }
+
+        const auto version{line.substring(versionBegin + 1, typeBegin)};
+        assets.push_back({line.substring(0, versionBegin), version, "\"" + version + "\"", line.substring(typeBegin + 1)});
+    }
+    file.close();
+
+    PLOGI << "Serving " << assets.size() << " compressed assets";
+    return true;
+}
+
+/// Sends the gzipped file, or 304 if the client has it already
+/// Requests with the current version (?v=<hash>, added to the URLs in the HTML by tools/compress_fs.py) may be cached forever,
+/// everything else has to be revalidated, which costs a 304 at most.
+void WebServer::onAsset(AsyncWebServerRequest* request, const Asset& asset)
+{
+    logRequest(request);
+
+    const auto isVersioned{request->hasParam("v") && request->getParam("v")->value() == asset.version};
+    const auto cacheControl{isVersioned ? "public, max-age=31536000, immutable" : "no-cache"};
+
+    if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value().indexOf(asset.etag) >= 0)
+    {
+        auto* response = request->beginResponse(logReply(request, HTTPStatusCode::NotModified));
+        response->addHeader("ETag", asset.etag);
+        response->addHeader("Cache-Control", cacheControl);
+        request->send(response);
+        return;
+    }
+
+    // There is no uncompressed copy, every browser accepts gzip anyway
+    if (!request->hasHeader("Accept-Encoding") || request->getHeader("Accept-Encoding")->value().indexOf("gzip") < 0)
+    {
+        request->send(logReply(request, HTTPStatusCode::NotAcceptable), "text/plain", "406: Only available with Content-Encoding gzip");
+        return;
+    }
+
+    // Only <url>.gz exists, so the file response picks it and adds Content-Encoding: gzip (the name in Content-Disposition stays <url>)
+    auto* response = request->beginResponse(LITTLEFS, asset.url, asset.contentType);
+    response->addHeader("ETag", asset.etag);
+    response->addHeader("Cache-Control", cacheControl);
+    response->addHeader("Vary", "Accept-Encoding");
+    logReply(request, HTTPStatusCode::Ok);
+    request->send(response);
+}
+
 /// Send 404 if requested file does not exist
 void WebServer::onPageNotFound(AsyncWebServerRequest* request)
 {
-    logRequest(request);
+    logRequest(request, "(notFound)");
 
     PLOGI << "Unknown URL " << request->url().c_str();
     request->send(logReply(request, HTTPStatusCode::NotFound), "text/plain", "404: Not found");
@@ -157,7 +304,15 @@ void WebServer::onRestartHAIR(AsyncWebServerRequest* request)
 {
     logRequest(request);
 
+    if (restartHandler)
+    {
+        request->send(logReply(request, HTTPStatusCode::Ok), "text/plain", "Restarting hAIR...");
+        restartHandler();
+        return;
+    }
+
     PLOGN << "Restarting hAIR...";
+    sensorArchive.flush(millis());
     delay(1000);
     ESP.restart();
 }
@@ -166,8 +321,709 @@ void WebServer::onSensordata(AsyncWebServerRequest* request)
 {
     logRequest(request);
 
-    const auto json = sensorData.getCopyAsJSONtxt();
-    request->send(logReply(request, HTTPStatusCode::Ok), "application/json", json.c_str());
+    // Clients opt into the compact binary frame (see SensorData::toBinaryFrame) via the Accept header
+    const auto wantsBinary{request->hasHeader("Accept") && request->getHeader("Accept")->value().indexOf("application/octet-stream") >= 0};
+
+    // The response reads straight out of the shared payload, which it keeps alive until it's sent
+    const auto serialized = sensorData.getSerialized();
+    const auto* data{wantsBinary ? reinterpret_cast<const uint8_t*>(serialized->binary.data()) : reinterpret_cast<const uint8_t*>(serialized->json.data())};
+    const auto  length{wantsBinary ? serialized->binaryLength : serialized->length};
+
+    logReply(request, HTTPStatusCode::Ok);
+    request->send(request->beginResponse(wantsBinary ? "application/octet-stream" : "application/json",
+                                         length,
+                                         [serialized, data, length](uint8_t* buffer, size_t maxLen, size_t index) -> size_t
+                                         {
+                                             const auto len{std::min(maxLen, length - index)};
+                                             memcpy(buffer, data + index, len);
+                                             return len;
+                                         }));
+}
+
+namespace
+{
+/// Renders the history as JSON piece by piece, so a response never holds more than one batch of rows in RAM
+/// {"now":<millis>,"epoch":<unix seconds at now>,"resolution":<bucket [ms]>,"channels":[{"name":..,"decimals":..},..],"rows":[..]}
+/// Raw rows are [timestamp, valid, values..], rollup rows are [timestamp, valid, min.., avg.., max..]
+class HistoryStream : public ChunkedStream
+{
+public:
+    HistoryStream(const SensorHistory& history, SensorHistory::Resolution resolution, Timestamp from, Timestamp to, Timestamp now, uint32_t epoch)
+        : ChunkedStream("/history"), m_history(history), m_resolution(resolution), m_from(from), m_to(to), m_now(now), m_epoch(epoch)
+    {
+    }
+
+protected:
+    bool renderNext(JSONWriter& writer) override
+    {
+        switch (m_stage)
+        {
+        case Stage::Header:
+        {
+            writer.beginObject()
+                .member("now", m_now)
+                .member("epoch", m_epoch)
+                .member("resolution", SensorHistory::getBucketDuration(m_resolution));
+            writer.key("channels").beginArray();
+            for (const auto& channel : SensorHistory::CHANNELS)
+            {
+                writer.beginObject().member("name", channel.name).member("decimals", channel.decimals).endObject();
+            }
+            writer.endArray();
+            writer.key("rows").raw("[");
+            m_stage = Stage::Rows;
+            return true;
+        }
+        case Stage::Rows:
+        {
+            if (m_rowPos == m_rowCount)
+            {
+                m_rowCount = m_history.read(m_resolution, m_from, m_to, m_rows.data(), m_rows.size(), m_cursor);
+                m_rowPos   = 0;
+                if (m_rowCount == 0)
+                {
+                    m_stage = Stage::Footer;
+                    return true;
+                }
+            }
+
+            const auto& row{m_rows[m_rowPos++]};
+            if (!m_firstRow)
+            {
+                writer.raw(",");
+            }
+            m_firstRow = false;
+
+            writer.beginArray().value(row.timestamp).value(row.valid);
+            if (m_resolution == SensorHistory::Resolution::Raw)
+            {
+                for (const auto val : row.avg)
+                {
+                    writer.value(val);
+                }
+            }
+            else
+            {
+                for (const auto* values : {&row.min, &row.avg, &row.max})
+                {
+                    for (const auto val : *values)
+                    {
+                        writer.value(val);
+                    }
+                }
+            }
+            writer.endArray();
+            return true;
+        }
+        case Stage::Footer:
+            writer.raw("]}");
+            m_stage = Stage::Done;
+            return true;
+        case Stage::Done:
+        default:
+            return false;
+        }
+    }
+
+private:
+    static constexpr size_t ROW_BATCH{8};
+
+    enum class Stage
+    {
+        Header,
+        Rows,
+        Footer,
+        Done
+    };
+
+    const SensorHistory&            m_history;
+    const SensorHistory::Resolution m_resolution;
+    const Timestamp                 m_from;
+    const Timestamp                 m_to;
+    const Timestamp                 m_now;
+    const uint32_t                  m_epoch;
+
+    Stage    m_stage{Stage::Header};
+    uint32_t m_cursor{};
+    bool     m_firstRow{true};
+
+    std::array<SensorHistory::Row, ROW_BATCH> m_rows{};
+    size_t                                    m_rowCount{};
+    size_t                                    m_rowPos{};
+};
+
+/// Renders the archive as CSV (with a header line) or as NDJSON (one object per line), one record per piece
+/// Invalid channels are empty in CSV and missing in NDJSON.
+class ArchiveExportStream : public ChunkedStream
+{
+public:
+    ArchiveExportStream(const SensorArchive& archive, bool isCSV, uint32_t from, uint32_t to)
+        : ChunkedStream(isCSV ? "/export.csv" : "/export.ndjson"), m_reader(archive, from, to), m_isCSV(isCSV)
+    {
+    }
+
+    bool isValid() const
+    {
+        return m_reader.isValid();
+    }
+
+protected:
+    bool renderNext(JSONWriter& writer) override
+    {
+        if (!m_headerDone)
+        {
+            m_headerDone = true;
+            if (m_isCSV)
+            {
+                writer.raw("timestamp");
+                for (const auto& channel : ArchiveFormat::CHANNELS)
+                {
+                    writer.raw(",").raw(channel.name);
+                }
+                writer.raw("\n");
+            }
+            return true;
+        }
+
+        ArchiveFormat::Record record{};
+        if (!m_reader.next(record))
+        {
+            return false;
+        }
+
+        m_isCSV ? renderCSV(writer, record) : renderNDJSON(writer, record);
+        return true;
+    }
+
+private:
+    SensorArchive::Reader m_reader;
+    const bool            m_isCSV;
+    bool                  m_headerDone{false};
+
+    static void renderCSV(JSONWriter& writer, const ArchiveFormat::Record& record)
+    {
+        // Every cell gets its own writer, otherwise JSONWriter would put its own separators in between
+        std::array<char, 16> cell{};
+        {
+            JSONWriter cellWriter{cell};
+            cellWriter.value(record.timestamp);
+            writer.raw(cell.data(), cellWriter.length());
+        }
+        for (size_t channel = 0; channel < ArchiveFormat::CHANNEL_COUNT; ++channel)
+        {
+            writer.raw(",");
+            if (record.valid & (1U << channel))
+            {
+                JSONWriter cellWriter{cell};
+                cellWriter.fixed(record.values[channel], ArchiveFormat::CHANNELS[channel].decimals);
+                writer.raw(cell.data(), cellWriter.length());
+            }
+        }
+        writer.raw("\n");
+    }
+
+    static void renderNDJSON(JSONWriter& writer, const ArchiveFormat::Record& record)
+    {
+        writer.beginObject().member("timestamp", record.timestamp);
+        for (size_t channel = 0; channel < ArchiveFormat::CHANNEL_COUNT; ++channel)
+        {
+            if (record.valid & (1U << channel))
+            {
+                writer.key(ArchiveFormat::CHANNELS[channel].name).fixed(record.values[channel], ArchiveFormat::CHANNELS[channel].decimals);
+            }
+        }
+        writer.endObject().raw("\n");
+    }
+};
+
+/// Streams the log lines that are in the LogBuffer when the request arrives
+class LogStream : public ChunkedStream
+{
+public:
+    explicit LogStream(const LogBuffer& logBuffer)
+        : ChunkedStream("/logs"), m_logBuffer(logBuffer), m_end(logBuffer.end())
+    {
+    }
+
+protected:
+    bool renderNext(JSONWriter& writer) override
+    {
+        std::array<char, PENDING_CAPACITY - 1> chunk{};
+        const auto                             len{m_logBuffer.read(m_position, m_end, chunk.data(), chunk.size())};
+        writer.raw(chunk.data(), len);
+        return len > 0;
+    }
+
+private:
+    const LogBuffer& m_logBuffer;
+    const uint32_t   m_end;
+    uint32_t         m_position{};
+};
+
+/// Renders /metrics in the OpenMetrics text format, one line per renderNext()
+/// Everything is read at the moment its line is rendered, nothing is collected up front.
+class MetricsStream : public ChunkedStream
+{
+public:
+    MetricsStream(Metrics& metrics, const std::vector<Scheduler*>& schedulers)
+        : ChunkedStream("/metrics"), m_metrics(metrics), m_schedulers(schedulers)
+    {
+    }
+
+protected:
+    bool renderNext(JSONWriter& writer) override
+    {
+        while (m_family < FAMILIES.size())
+        {
+            // index 0 is the header of the family, then its samples
+            if (m_index == 0)
+            {
+                const auto& family{FAMILIES[m_family]};
+                writer.raw("# TYPE ").raw(family.name).raw(" ").raw(family.type).raw("\n");
+                writer.raw("# HELP ").raw(family.name).raw(" ").raw(family.help).raw("\n");
+                ++m_index;
+                return true;
+            }
+
+            if (renderSample(writer, m_index - 1))
+            {
+                ++m_index;
+                return true;
+            }
+
+            ++m_family;
+            m_index = 0;
+        }
+
+        if (!m_done)
+        {
+            writer.raw("# EOF\n");
+            m_done = true;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    struct Family
+    {
+        const char* name;
+        const char* type;
+        const char* help;
+    };
+
+    enum FamilyIndex : size_t
+    {
+        UPTIME,
+        HEAP_FREE,
+        HEAP_MIN_FREE,
+        HEAP_LARGEST_FREE_BLOCK,
+        STACK_HIGH_WATER_MARK,
+        TASK_RUNS,
+        TASK_OVERRUNS,
+        TASK_SKIPPED,
+        TASK_SUCCESSES,
+        TASK_FAILURES,
+        WEBSOCKET_CLIENTS,
+        WEBSOCKET_SENT,
+        WEBSOCKET_DROPPED,
+        LOG_RECORDS,
+        LOG_DROPPED,
+        HTTP_REQUESTS,
+        WIFI_RSSI,
+        DISPLAY_FRAMES,
+        DISPLAY_PUSHED,
+        DISPLAY_FRAME_TIME,
+        DISPLAY_LAST_FRAME_TIME,
+        MQTT_MESSAGES,
+        MQTT_SAMPLES,
+        MQTT_ACK_TIME,
+        MQTT_DROPPED,
+        MQTT_QUEUED,
+        MQTT_SPILLED,
+        INFLUX_SAMPLES,
+        INFLUX_LINE_BYTES,
+        INFLUX_BODY_BYTES,
+        INFLUX_REQUEST_TIME,
+        INFLUX_FAILED,
+        INFLUX_DROPPED,
+        INFLUX_OUTBOX_BATCHES,
+        INFLUX_OUTBOX_BYTES,
+        FAMILY_COUNT
+    };
+
+    // Counters get the _total suffix on their samples
+    static constexpr std::array<Family, FAMILY_COUNT> FAMILIES{{
+        {"hair_uptime_seconds", "gauge", "Time since boot."},
+        {"hair_heap_free_bytes", "gauge", "Free heap."},
+        {"hair_heap_min_free_bytes", "gauge", "Lowest free heap since boot."},
+        {"hair_heap_largest_free_block_bytes", "gauge", "Largest block that can be allocated."},
+        {"hair_thread_stack_free_min_bytes", "gauge", "Stack of the thread that was never used."},
+        {"hair_task_runs", "counter", "Runs of the task."},
+        {"hair_task_overruns", "counter", "Runs that took longer than the period of the task."},
+        {"hair_task_skipped", "counter", "Periods that were skipped because the task was late."},
+        {"hair_task_successes", "counter", "Successful runs, for the tasks that read a sensor."},
+        {"hair_task_failures", "counter", "Failed runs, for the tasks that read a sensor."},
+        {"hair_websocket_clients", "gauge", "Websocket clients subscribed per topic."},
+        {"hair_websocket_sent_bytes", "counter", "Payload bytes sent to websocket clients."},
+        {"hair_websocket_dropped_messages", "counter", "Websocket messages dropped because the send queue of the client was full."},
+        {"hair_log_records", "counter", "Log records per severity."},
+        {"hair_log_dropped", "counter", "Log records dropped because the log queue was full."},
+        {"hair_http_requests", "counter", "HTTP requests per route."},
+        {"hair_wifi_rssi_dbm", "gauge", "WiFi signal strength."},
+        {"hair_display_frames", "counter", "Frames of the sensor screen."},
+        {"hair_display_pushed_bytes", "counter", "Pixel data sent to the display for the sensor screen."},
+        {"hair_display_frame_time_microseconds", "counter", "Time spent drawing the sensor screen."},
+        {"hair_display_last_frame_microseconds", "gauge", "Time spent drawing the last frame of the sensor screen."},
+        {"hair_mqtt_published_messages", "counter", "Sample messages published (QoS 0) or acknowledged (QoS 1)."},
+        {"hair_mqtt_published_samples", "counter", "Samples in the published messages."},
+        {"hair_mqtt_ack_time_milliseconds", "counter", "Time from publishing a QoS 1 message to its PUBACK."},
+        {"hair_mqtt_dropped_samples", "counter", "Samples dropped because the queue and the spill file were full."},
+        {"hair_mqtt_queued_samples", "gauge", "Samples waiting in the RAM queue."},
+        {"hair_mqtt_spilled_bytes", "gauge", "Samples waiting in the spill file."},
+        {"hair_influx_uploaded_samples", "counter", "Samples accepted by the InfluxDB server."},
+        {"hair_influx_line_protocol_bytes", "counter", "Line protocol of the accepted samples, uncompressed."},
+        {"hair_influx_uploaded_bytes", "counter", "Gzipped request bodies accepted by the InfluxDB server."},
+        {"hair_influx_request_time_milliseconds", "counter", "Time spent in the accepted requests."},
+        {"hair_influx_failed_requests", "counter", "Requests that failed or were rejected."},
+        {"hair_influx_dropped_samples", "counter", "Samples dropped because they were rejected or the outbox was full."},
+        {"hair_influx_outbox_batches", "gauge", "Batches waiting in the outbox."},
+        {"hair_influx_outbox_bytes", "gauge", "Size of the outbox on flash."},
+    }};
+
+    Metrics&                       m_metrics;
+    const std::vector<Scheduler*>& m_schedulers;
+
+    size_t m_family{};
+    size_t m_index{};
+    bool   m_done{false};
+
+    /// name[_total]{label="value",..} value
+    template<typename T>
+    void sample(JSONWriter& writer, std::initializer_list<std::pair<const char*, const char*>> labels, T value) const
+    {
+        const auto& family{FAMILIES[m_family]};
+        writer.raw(family.name);
+        if (family.type[0] == 'c')
+        {
+            writer.raw("_total");
+        }
+
+        if (labels.size() > 0)
+        {
+            char separator{'{'};
+            for (const auto& label : labels)
+            {
+                writer.raw(&separator, 1).raw(label.first).raw("=\"").raw(label.second).raw("\"");
+                separator = ',';
+            }
+            writer.raw("}");
+        }
+
+        writer.raw(" ").value(value);
+        writer.raw("\n");
+    }
+
+    /// Flat index over the tasks of all schedulers
+    bool findTask(size_t index, const Scheduler*& scheduler, size_t& task) const
+    {
+        for (const auto* candidate : m_schedulers)
+        {
+            if (index < candidate->getTaskCount())
+            {
+                scheduler = candidate;
+                task      = index;
+                return true;
+            }
+            index -= candidate->getTaskCount();
+        }
+        return false;
+    }
+
+    /// @return false if the family has no sample with that index
+    bool renderSample(JSONWriter& writer, size_t index) const
+    {
+        static constexpr std::array<const char*, static_cast<size_t>(Metrics::Websocket::COUNT)> WEBSOCKETS{{"sensordata", "logs"}};
+
+        // the families without labels have exactly one sample
+        if (m_family <= HEAP_LARGEST_FREE_BLOCK || m_family == LOG_DROPPED || m_family >= WIFI_RSSI)
+        {
+            if (index > 0)
+            {
+                return false;
+            }
+        }
+
+        switch (m_family)
+        {
+        case UPTIME:
+            sample(writer, {}, esp_timer_get_time() / 1000000);
+            return true;
+        case HEAP_FREE:
+            sample(writer, {}, ESP.getFreeHeap());
+            return true;
+        case HEAP_MIN_FREE:
+            sample(writer, {}, ESP.getMinFreeHeap());
+            return true;
+        case HEAP_LARGEST_FREE_BLOCK:
+            sample(writer, {}, ESP.getMaxAllocHeap());
+            return true;
+        case STACK_HIGH_WATER_MARK:
+            if (index >= m_schedulers.size())
+            {
+                return false;
+            }
+            sample(writer, {{"thread", m_schedulers[index]->getName()}}, m_schedulers[index]->getStackHighWaterMark());
+            return true;
+        case TASK_RUNS:
+        case TASK_OVERRUNS:
+        case TASK_SKIPPED:
+        case TASK_SUCCESSES:
+        case TASK_FAILURES:
+        {
+            const Scheduler* scheduler{};
+            size_t           task{};
+            if (!findTask(index, scheduler, task))
+            {
+                return false;
+            }
+
+            const auto& item{scheduler->getTask(task)};
+            const auto& stats{item.getStats()};
+            const auto  value{m_family == TASK_RUNS        ? stats.runs
+                              : m_family == TASK_OVERRUNS  ? stats.overruns
+                              : m_family == TASK_SKIPPED   ? stats.skipped
+                              : m_family == TASK_SUCCESSES ? item.getSuccessCount()
+                                                           : item.getFailureCount()};
+            sample(writer, {{"thread", scheduler->getName()}, {"task", scheduler->getTaskName(task)}}, value);
+            return true;
+        }
+        case WEBSOCKET_CLIENTS:
+        case WEBSOCKET_SENT:
+        case WEBSOCKET_DROPPED:
+        {
+            if (index >= WEBSOCKETS.size())
+            {
+                return false;
+            }
+
+            const auto websocket{static_cast<Metrics::Websocket>(index)};
+            const auto value{m_family == WEBSOCKET_CLIENTS ? m_metrics.getWebsocketClients(websocket) : m_family == WEBSOCKET_SENT ? m_metrics.getWebsocketBytes(websocket) : m_metrics.getWebsocketDropped(websocket)};
+            sample(writer, {{"topic", WEBSOCKETS[index]}}, value);
+            return true;
+        }
+        case LOG_RECORDS:
+        {
+            // skip plog::none, nothing is logged with it
+            if (index + 1 >= Metrics::SEVERITY_COUNT)
+            {
+                return false;
+            }
+            const auto severity{static_cast<plog::Severity>(index + 1)};
+            sample(writer, {{"severity", plog::severityToString(severity)}}, m_metrics.getLogRecords(severity));
+            return true;
+        }
+        case LOG_DROPPED:
+            sample(writer, {}, m_metrics.getLogDropped());
+            return true;
+        case HTTP_REQUESTS:
+            if (index >= m_metrics.getRouteCount())
+            {
+                return false;
+            }
+            sample(writer, {{"route", m_metrics.getRoute(index)}}, m_metrics.getRequests(index));
+            return true;
+        case WIFI_RSSI:
+            if (WiFi.status() != WL_CONNECTED)
+            {
+                return false;
+            }
+            sample(writer, {}, static_cast<int32_t>(WiFi.RSSI()));
+            return true;
+        case DISPLAY_FRAMES:
+            sample(writer, {}, m_metrics.getDisplayFrames());
+            return true;
+        case DISPLAY_PUSHED:
+            sample(writer, {}, m_metrics.getDisplayBytes());
+            return true;
+        case DISPLAY_FRAME_TIME:
+            sample(writer, {}, m_metrics.getDisplayMicros());
+            return true;
+        case DISPLAY_LAST_FRAME_TIME:
+            sample(writer, {}, m_metrics.getDisplayLastFrameMicros());
+            return true;
+        case MQTT_MESSAGES:
+            sample(writer, {}, m_metrics.getMqttMessages());
+            return true;
+        case MQTT_SAMPLES:
+            sample(writer, {}, m_metrics.getMqttSamples());
+            return true;
+        case MQTT_ACK_TIME:
+            sample(writer, {}, m_metrics.getMqttAckMillis());
+            return true;
+        case MQTT_DROPPED:
+            sample(writer, {}, m_metrics.getMqttDropped());
+            return true;
+        case MQTT_QUEUED:
+            sample(writer, {}, m_metrics.getMqttQueued());
+            return true;
+        case MQTT_SPILLED:
+            sample(writer, {}, m_metrics.getMqttSpilledBytes());
+            return true;
+        case INFLUX_SAMPLES:
+            sample(writer, {}, m_metrics.getInfluxSamples());
+            return true;
+        case INFLUX_LINE_BYTES:
+            sample(writer, {}, m_metrics.getInfluxLineBytes());
+            return true;
+        case INFLUX_BODY_BYTES:
+            sample(writer, {}, m_metrics.getInfluxBodyBytes());
+            return true;
+        case INFLUX_REQUEST_TIME:
+            sample(writer, {}, m_metrics.getInfluxRequestMillis());
+            return true;
+        case INFLUX_FAILED:
+            sample(writer, {}, m_metrics.getInfluxFailed());
+            return true;
+        case INFLUX_DROPPED:
+            sample(writer, {}, m_metrics.getInfluxDropped());
+            return true;
+        case INFLUX_OUTBOX_BATCHES:
+            sample(writer, {}, m_metrics.getInfluxOutboxBatches());
+            return true;
+        case INFLUX_OUTBOX_BYTES:
+            sample(writer, {}, m_metrics.getInfluxOutboxBytes());
+            return true;
+        default:
+            return false;
+        }
+    }
+};
+} // namespace
+
+/// /history?from=<ms>&to=<ms>&res=<raw|10s|1m|1h>
+/// from and to are millis() timestamps of the device, negative values are relative to now (from=-600000 => last 10 minutes)
+void WebServer::onHistory(AsyncWebServerRequest* request)
+{
+    logRequest(request);
+
+    const Timestamp now{static_cast<Timestamp>(millis())};
+
+    auto getTimestamp = [&](const char* name, Timestamp fallback) -> Timestamp
+    {
+        if (!request->hasParam(name))
+        {
+            return fallback;
+        }
+        const auto val{static_cast<Timestamp>(request->getParam(name)->value().toInt())};
+        return val < 0 ? now + val : val;
+    };
+
+    auto resolution{SensorHistory::Resolution::Raw};
+    if (request->hasParam("res") && !SensorHistory::parseResolution(request->getParam("res")->value(), resolution))
+    {
+        request->send(logReply(request, HTTPStatusCode::BadRequest), "text/plain", "res must be one of raw, 10s, 1m, 1h");
+        return;
+    }
+
+    const auto from{getTimestamp("from", now - 24 * 60 * 60 * 1000)};
+    const auto to{getTimestamp("to", now)};
+
+    logReply(request, HTTPStatusCode::Ok);
+    ChunkedStream::send(request, "application/json", std::make_shared<HistoryStream>(sensorHistory, resolution, from, to, now, getUnixTime(ntpclient)));
+}
+
+void WebServer::onArchive(AsyncWebServerRequest* request)
+{
+    logRequest(request);
+
+    auto* response = request->beginResponseStream("application/json");
+
+    std::array<char, 128> buffer{};
+    {
+        JSONWriter writer{buffer, response};
+        sensorArchive.toJSON(writer);
+    }
+
+    logReply(request, HTTPStatusCode::Ok);
+    request->send(response);
+}
+
+/// /taskstats, /taskstats?reset clears the stats after sending them (e.g. to measure again after a config change)
+void WebServer::onTaskStats(AsyncWebServerRequest* request)
+{
+    logRequest(request);
+
+    auto* response = request->beginResponseStream("application/json");
+
+    std::array<char, 128> buffer{};
+    {
+        JSONWriter writer{buffer, response};
+        writer.beginObject();
+        writer.member("uptime", millis());
+        writer.key("threads").beginArray();
+        for (const auto* scheduler : schedulers)
+        {
+            scheduler->toJSON(writer);
+        }
+        writer.endArray();
+        writer.endObject();
+    }
+
+    if (request->hasParam("reset"))
+    {
+        for (auto* scheduler : schedulers)
+        {
+            scheduler->resetStats();
+        }
+    }
+
+    logReply(request, HTTPStatusCode::Ok);
+    request->send(response);
+}
+
+/// /export.csv?from=<unix seconds>&to=<unix seconds>, same for /export.ndjson
+/// Negative values are relative to now (from=-86400 => last day), the default is everything
+void WebServer::onExport(AsyncWebServerRequest* request, ExportFormat format)
+{
+    logRequest(request);
+
+    const auto epoch{static_cast<int64_t>(getUnixTime(ntpclient))};
+
+    auto getTimestamp = [&](const char* name, uint32_t fallback) -> uint32_t
+    {
+        if (!request->hasParam(name))
+        {
+            return fallback;
+        }
+        const auto val{static_cast<int64_t>(request->getParam(name)->value().toInt())};
+        return static_cast<uint32_t>(std::max<int64_t>(val < 0 ? epoch + val : val, 0));
+    };
+
+    auto stream{std::make_shared<ArchiveExportStream>(sensorArchive, format == ExportFormat::CSV, getTimestamp("from", 0), getTimestamp("to", UINT32_MAX))};
+    if (!stream->isValid())
+    {
+        request->send(logReply(request, HTTPStatusCode::ServiceUnavailable), "text/plain", "Out of memory");
+        return;
+    }
+
+    logReply(request, HTTPStatusCode::Ok);
+    ChunkedStream::send(request, format == ExportFormat::CSV ? "text/csv" : "application/x-ndjson", stream);
+}
+
+void WebServer::onLogs(AsyncWebServerRequest* request)
+{
+    logRequest(request);
+    logReply(request, HTTPStatusCode::Ok);
+    ChunkedStream::send(request, logBuffer.isBinary() ? "application/octet-stream" : "text/plain", std::make_shared<LogStream>(logBuffer));
+}
+
+/// Prometheus scrape target, OpenMetrics text format
+void WebServer::onMetrics(AsyncWebServerRequest* request)
+{
+    logRequest(request);
+    logReply(request, HTTPStatusCode::Ok);
+    ChunkedStream::send(request, "application/openmetrics-text; version=1.0.0; charset=utf-8", std::make_shared<MetricsStream>(metrics, schedulers));
 }
 
 ////////////////////////////////
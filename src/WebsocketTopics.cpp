@@ -0,0 +1,400 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "WebsocketTopics.h"
+
+namespace
+{
+constexpr std::array<std::pair<const char*, SensorChannel>, 4> CHANNEL_NAMES{{
+    {"SGP30_IAQ", SensorChannel::SGP30_IAQ},
+    {"SGP30_IAQraw", SensorChannel::SGP30_IAQraw},
+    {"BMExxx_Data", SensorChannel::BMExxx_Data},
+    {"Derived", SensorChannel::Derived},
+}};
+
+/// Same order as Metrics::Websocket, also the label in /metrics
+constexpr std::array<const char*, static_cast<size_t>(Metrics::Websocket::COUNT)> TOPIC_NAMES{{"sensordata", "logs"}};
+
+/// @return SensorChannel::None if there is no channel of that name
+SensorChannel parseChannel(const char* name)
+{
+    for (const auto& channel : CHANNEL_NAMES)
+    {
+        if (strcmp(channel.first, name) == 0)
+        {
+            return channel.second;
+        }
+    }
+    return SensorChannel::None;
+}
+
+/// @return Metrics::Websocket::COUNT if there is no topic of that name
+Metrics::Websocket parseTopic(const char* name)
+{
+    for (size_t topic = 0; topic < TOPIC_NAMES.size(); ++topic)
+    {
+        if (strcmp(TOPIC_NAMES[topic], name) == 0)
+        {
+            return static_cast<Metrics::Websocket>(topic);
+        }
+    }
+    return Metrics::Websocket::COUNT;
+}
+
+uint8_t topicBit(Metrics::Websocket topic)
+{
+    return static_cast<uint8_t>(1U << static_cast<size_t>(topic));
+}
+
+/// Offset of the generation in the binary frame, it differs with every frame and is not a value
+constexpr size_t GENERATION_OFFSET{6};
+
+/// Close code for the clients beyond CLIENT_COUNT (RFC 6455 "Try Again Later")
+constexpr uint16_t CLOSE_TRY_AGAIN_LATER{1013};
+
+bool isDue(Timestamp now, Timestamp due)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(now) - static_cast<uint32_t>(due)) >= 0;
+}
+
+bool haveSameValues(const uint8_t* lhs, const uint8_t* rhs, size_t length)
+{
+    return memcmp(lhs, rhs, GENERATION_OFFSET) == 0 && memcmp(lhs + GENERATION_OFFSET + 2, rhs + GENERATION_OFFSET + 2, length - GENERATION_OFFSET - 2) == 0;
+}
+} // namespace
+
+void WebsocketTopics::onEvent(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t length)
+{
+    switch (type)
+    {
+    case WS_EVT_CONNECT:
+        connect(client);
+        break;
+    case WS_EVT_DISCONNECT:
+        disconnect(client);
+        break;
+    case WS_EVT_DATA:
+    {
+        // The messages of the dashboard are tiny, anything that does not fit a single frame is not a subscription
+        const auto* info{static_cast<const AwsFrameInfo*>(arg)};
+        if (info->final == 0 || info->index != 0 || info->len != length || info->opcode != WS_TEXT)
+        {
+            PLOGW << "Websocket client [" << client->id() << "] sent a fragmented or binary message";
+            break;
+        }
+        receive(client, reinterpret_cast<const char*>(data), length);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void WebsocketTopics::connect(AsyncWebSocketClient* client)
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        for (auto& slot : m_clients)
+        {
+            if (slot.client == nullptr)
+            {
+                slot        = Client{};
+                slot.client = client;
+                PLOGD << "Websocket client [" << client->id() << "] connected from " << client->remoteIP().toString();
+                return;
+            }
+        }
+    }
+
+    // Outside of the lock, closing may end up in disconnect()
+    PLOGW << "Websocket client [" << client->id() << "] rejected, there are already " << CLIENT_COUNT << " clients";
+    client->close(CLOSE_TRY_AGAIN_LATER, "Too many clients");
+}
+
+void WebsocketTopics::disconnect(AsyncWebSocketClient* client)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    for (auto& slot : m_clients)
+    {
+        if (slot.client == client)
+        {
+            slot.client = nullptr;
+            slot.topics = 0;
+            countSubscribers();
+            PLOGD << "Websocket client [" << client->id() << "] disconnected";
+            return;
+        }
+    }
+}
+
+void WebsocketTopics::receive(AsyncWebSocketClient* client, const char* message, size_t length)
+{
+    StaticJsonDocument<256> doc;
+    const auto              isSubscribe{deserializeJson(doc, message, length) == DeserializationError::Ok && !doc["subscribe"].isNull()};
+    if (!isSubscribe && doc["unsubscribe"].isNull())
+    {
+        PLOGW << "Websocket client [" << client->id() << "] sent something else than a subscription";
+        return;
+    }
+
+    const JsonVariantConst request{doc[isSubscribe ? "subscribe" : "unsubscribe"]};
+    const auto*            name{request["topic"] | ""};
+    const auto             topic{parseTopic(name)};
+    if (topic == Topic::COUNT)
+    {
+        PLOGW << "Websocket client [" << client->id() << "] asked for unknown topic " << name;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    for (auto& slot : m_clients)
+    {
+        if (slot.client != client)
+        {
+            continue;
+        }
+
+        if (isSubscribe)
+        {
+            subscribe(slot, topic, request);
+        }
+        else
+        {
+            slot.topics &= ~topicBit(topic);
+            PLOGI << "Websocket client [" << client->id() << "] unsubscribed from " << name;
+        }
+        countSubscribers();
+        return;
+    }
+}
+
+void WebsocketTopics::subscribe(Client& client, Topic topic, const JsonVariantConst& request)
+{
+    client.topics |= topicBit(topic);
+    if (topic != Topic::SensorData)
+    {
+        PLOGI << "Websocket client [" << client.client->id() << "] subscribed to " << TOPIC_NAMES[static_cast<size_t>(topic)];
+        return;
+    }
+
+    Subscription subscription{};
+    if (!request["channels"].isNull())
+    {
+        subscription.channels = SensorChannel::None;
+        for (const JsonVariantConst entry : request["channels"].as<JsonArrayConst>())
+        {
+            const auto* name{entry | ""};
+            const auto  channel{parseChannel(name)};
+            if (channel == SensorChannel::None)
+            {
+                PLOGW << "Websocket client [" << client.client->id() << "] subscribed to unknown channel " << name;
+            }
+            subscription.channels |= channel;
+        }
+    }
+
+    const auto rate{request["rate"] | 0.0F};
+    subscription.interval = rate > 0.0F ? static_cast<uint32_t>(lroundf(1000.0F / rate)) : 0;
+    subscription.onChange = request["onChange"] | false;
+    subscription.binary   = request["binary"] | false;
+    client.subscription   = subscription;
+    client.subscribed     = true;
+
+    PLOGI << "Websocket client [" << client.client->id() << "] subscribed to channels [" << static_cast<unsigned>(enum_cast_to_underlying(subscription.channels)) << "]"
+          << " every " << subscription.interval << " ms" << (subscription.onChange ? " on change" : "") << (subscription.binary ? " (binary)" : "");
+}
+
+void WebsocketTopics::countSubscribers()
+{
+    for (size_t topic = 0; topic < TOPIC_COUNT; ++topic)
+    {
+        uint32_t subscribers{};
+        for (const auto& slot : m_clients)
+        {
+            subscribers += slot.client != nullptr && (slot.topics & topicBit(static_cast<Topic>(topic))) != 0 ? 1 : 0;
+        }
+        m_subscribers[topic] = subscribers;
+        m_metrics.setWebsocketClients(static_cast<Topic>(topic), subscribers);
+    }
+}
+
+bool WebsocketTopics::send(AsyncWebSocketClient* client, Topic topic, const void* message, size_t length, bool binary)
+{
+    // Every queued message is a heap copy, a client that does not keep up (a tab in the background) misses messages instead
+    if (client->queueIsFull())
+    {
+        m_metrics.countWebsocketDropped(topic, 1);
+        return false;
+    }
+
+    if (binary)
+    {
+        client->binary(static_cast<const char*>(message), length);
+    }
+    else
+    {
+        client->text(static_cast<const char*>(message), length);
+    }
+    m_metrics.countWebsocketBytes(topic, length);
+    return true;
+}
+
+void WebsocketTopics::publish(Timestamp now, const SensorDataStorage& sensorData)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (m_subscribers[static_cast<size_t>(Topic::SensorData)] == 0)
+    {
+        return;
+    }
+
+    uint32_t   generation{};
+    const auto data{sensorData.getCopy(&generation)};
+    m_binaryEncoded = 0;
+    m_jsonEncoded   = 0;
+
+    for (auto& client : m_clients)
+    {
+        if (client.client == nullptr || (client.topics & topicBit(Topic::SensorData)) == 0)
+        {
+            continue;
+        }
+
+        // A new subscription is due right away
+        const auto& subscription{client.subscription};
+        if (client.subscribed)
+        {
+            client.subscribed = false;
+            client.nextDue    = now;
+            client.lastLength = 0;
+        }
+
+        if (subscription.channels == SensorChannel::None || !isDue(now, client.nextDue))
+        {
+            continue;
+        }
+
+        // The binary frame is needed anyway, it tells whether the channels are valid and whether anything changed
+        size_t      binaryLength{};
+        const auto* binary{getBinary(data, generation, subscription.channels, binaryLength)};
+        if (binary[4] != enum_cast_to_underlying(subscription.channels))
+        {
+            continue;
+        }
+        if (subscription.onChange && client.lastLength == binaryLength && haveSameValues(binary, client.lastFrame.data(), binaryLength))
+        {
+            continue;
+        }
+
+        // The binary message is the frame after its topic byte
+        auto sent{false};
+        if (subscription.binary)
+        {
+            sent = send(client.client, Topic::SensorData, binary - 1, binaryLength + 1, true);
+        }
+        else
+        {
+            size_t      jsonLength{};
+            const auto* json{getJSON(data, subscription.channels, jsonLength)};
+            sent = send(client.client, Topic::SensorData, json, jsonLength, false);
+        }
+        if (!sent)
+        {
+            continue;
+        }
+
+        memcpy(client.lastFrame.data(), binary, binaryLength);
+        client.lastLength = binaryLength;
+
+        // Keeps the rate on average, unless the client was skipped for more than an interval (e.g. onChange)
+        client.nextDue += static_cast<Timestamp>(subscription.interval);
+        if (isDue(now, client.nextDue) && subscription.interval > 0)
+        {
+            client.nextDue = now + static_cast<Timestamp>(subscription.interval);
+        }
+    }
+}
+
+void WebsocketTopics::publishLog(const char* json, size_t length)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (m_subscribers[static_cast<size_t>(Topic::LogMessages)] == 0)
+    {
+        return;
+    }
+
+    for (const auto& client : m_clients)
+    {
+        if (client.client != nullptr && (client.topics & topicBit(Topic::LogMessages)) != 0)
+        {
+            send(client.client, Topic::LogMessages, json, length, false);
+        }
+    }
+}
+
+void WebsocketTopics::publishLog(const uint8_t* record, size_t length)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (m_subscribers[static_cast<size_t>(Topic::LogMessages)] == 0 || length >= m_logMessage.size())
+    {
+        return;
+    }
+
+    m_logMessage[0] = BINARY_LOGS;
+    memcpy(m_logMessage.data() + 1, record, length);
+    for (const auto& client : m_clients)
+    {
+        if (client.client != nullptr && (client.topics & topicBit(Topic::LogMessages)) != 0)
+        {
+            send(client.client, Topic::LogMessages, m_logMessage.data(), length + 1, true);
+        }
+    }
+}
+
+const uint8_t* WebsocketTopics::getBinary(const SensorData& data, uint32_t generation, SensorChannel channels, size_t& length)
+{
+    const auto index{enum_cast_to_underlying(channels)};
+    auto&      message{m_binary[index]};
+    if ((m_binaryEncoded & (1U << index)) == 0)
+    {
+        message[0]            = BINARY_SENSORDATA;
+        m_binaryLength[index] = data.toBinaryFrame(message.data() + 1, message.size() - 1, generation, channels);
+        m_binaryEncoded |= 1U << index;
+    }
+    length = m_binaryLength[index];
+    return message.data() + 1;
+}
+
+const char* WebsocketTopics::getJSON(const SensorData& data, SensorChannel channels, size_t& length)
+{
+    const auto index{enum_cast_to_underlying(channels)};
+    if ((m_jsonEncoded & (1U << index)) == 0)
+    {
+        m_jsonLength[index] = data.toJSONtxt(m_json[index].data(), m_json[index].size(), channels);
+        m_jsonEncoded |= 1U << index;
+    }
+    length = m_jsonLength[index];
+    return m_json[index].data();
+}
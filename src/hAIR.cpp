@@ -25,6 +25,7 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "hAIR.h"
+#include "LogCapture.h"
 #include "Utilities.h"
 #include <Arduino.h>
 #include <ArduinoJson.h>
@@ -39,11 +40,15 @@
 #include <WiFi.h>
 #include <iostream>
 #include <plog/Init.h>
-#include <plog/Log.h>
 
-// IDK, 100hz maybe?
-constexpr auto THREAD_FREQUENCY{100};
-constexpr auto THREAD_DELAYTIME{static_cast<int32_t>(1000.0F / THREAD_FREQUENCY)};
+// IDK, 100hz maybe? Only the polling of OTA runs that often, everything else has its own period
+constexpr auto POLL_FREQUENCY{100};
+
+// At least, so reconnects and PUBACKs are noticed quickly. It runs faster if the drain rate of the MQTT backlog asks for it.
+constexpr auto MQTT_POLL_FREQUENCY{10.0F};
+
+// Frame budget of the display, posted data and log lines are coalesced until the next frame
+constexpr auto DISPLAY_FRAME_RATE{10};
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Main
@@ -110,6 +115,7 @@ void hAIR_System::setup()
     initLogger();
     printAndDisplayPOSTline("Logger", post.logger ? "OK" : "Failed", !post.logger);
     printAndDisplayPOSTline("Severity", severityToString(plog::Severity(config.logger_severity)), !post.logger);
+    printAndDisplayPOSTline("Format", config.logger_binary ? "Binary" : "Text", !post.logger);
 
     ////////////////////////////////
     /// Application Layer
@@ -118,12 +124,34 @@ void hAIR_System::setup()
     post.webserver = components.webserver.init();
     printAndDisplayPOSTline("Webserver", post.webserver ? "Running" : "Failed", !post.webserver);
 
-    components.websocketSensorData.begin();
-    components.websocketLogMessages.begin();
+    components.websocket.onEvent([this](AsyncWebSocket* /*server*/, AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t length)
+                                 {
+                                     components.websocketTopics.onEvent(client, type, arg, data, length);
+                                 });
+    components.asyncWebserver.addHandler(&components.websocket);
+
+    // Shared by all sensors
+    Wire.begin();
+
+    initSensors();
+    for (size_t i = 0; i < components.sensors.getCount(); ++i)
+    {
+        const auto& plugin{components.sensors.getPlugin(i)};
+        const auto  present{components.sensors.isPresent(i)};
+        printAndDisplayPOSTline(plugin.getName(), present ? plugin.getInfo() : String{"Absent"}, !present);
+    }
+
+    initHistory();
+    printAndDisplayPOSTline("History", post.history ? String(sensorHistory.getMemoryUsage() / 1024) + " KiB" : "Failed", !post.history);
+
+    initArchive();
+    printAndDisplayPOSTline("Archive", post.archive ? String(sensorArchive.getSegmentCount()) + " Seg " + String(sensorArchive.getSizeOnFlash() / 1024) + " KiB" : "Failed", !post.archive);
 
-    initSGP();
-    printAndDisplayPOSTline("SGP30", post.sgp30 ? "OK" : "Failed", !post.sgp30);
-    printAndDisplayPOSTline("SGP30_BL", post.sgp30_baseline ? "Set from Prefs" : "Failed", !post.sgp30_baseline);
+    initMqtt();
+    printAndDisplayPOSTline("MQTT", !post.mqtt ? String{"Failed"} : components.mqtt.isEnabled() ? config.mqtt_host : String{"Disabled"}, !post.mqtt);
+
+    initInflux();
+    printAndDisplayPOSTline("InfluxDB", !post.influx ? "Failed" : components.influx.isEnabled() ? "Enabled" : "Disabled", !post.influx);
 
     // Initialization done, show the POST for a little while
     //delay(10000);
@@ -136,7 +164,10 @@ void hAIR_System::setup()
     /// Config
     ////////////////////////////////
 
-    PLOGI << "Config: " << Config::toJSON(config).c_str();
+    // Straight to the port, the config is several times longer than a log record (LogEntry::MESSAGE_LENGTH)
+    Serial.print("Config: ");
+    Config::toJSON(config, Serial);
+    Serial.println();
 
     // Now show the config for a little while
     //delay(10000);
@@ -155,29 +186,26 @@ void hAIR_System::setup()
     constexpr auto THREAD_SDD_CORE{1};
     constexpr auto THREAD_SDA_NAME{"sda"};
     constexpr auto THREAD_SDD_NAME{"sdd"};
+    constexpr auto THREAD_LOG_NAME{"log"};
+    constexpr auto THREAD_DSP_NAME{"dsp"};
+    constexpr auto THREAD_UPL_NAME{"upl"};
+    constexpr auto THREAD_DSP_STACK_SIZE{4 * 1024};
+    constexpr auto THREAD_UPL_STACK_SIZE{8 * 1024};
 
-    auto threadSkeleton = [](void* param)
-    {
-        auto* p = static_cast<hAIR_System::TaskParams*>(param);
-
-        while (true)
-        {
-            const auto now{millis()};
-
-            p->callThreadFunction(now);
-
-            delay(THREAD_DELAYTIME);
-        }
-    };
+    // Unlike std::thread, xTaskCreatePinnedToCore won't take a capturing lambda, so the scheduler is the param and its jobs hold 'this'
 
-    runtime.task_sda_sqp_IAQ.setFrequency(config.sgp_IAQ_frequency);
-    runtime.task_sda_sqp_IAQraw.setFrequency(config.sgp_IAQraw_frequency);
-    runtime.task_sda_sqp_baseline.setFrequency(60000); // Adafruit example is 60 seconds
-    runtime.task_sda_bme_measure.setFrequency(config.bme_measure_frequency);
-    xTaskCreatePinnedToCore(threadSkeleton,
+    runtime.sda_data = sensorData.getCopy();
+    components.sensors.schedule(scheduler_sensorDataAcquisition, runtime.sda_data, runtime.sda_changed);
+    if (components.sgp30.isPresent())
+    {
+        runtime.task_sda_sqp_baseline.setDelayTime(60000); // Adafruit example is 60 seconds
+        scheduler_sensorDataAcquisition.add("sgp_baseline", runtime.task_sda_sqp_baseline, bindJob(&hAIR_System::job_sda_sgp_baseline));
+    }
+    scheduler_sensorDataAcquisition.setPassHook(bindJob(&hAIR_System::job_sda_publish));
+    xTaskCreatePinnedToCore(&Scheduler::run,
                             THREAD_SDA_NAME,
                             THREAD_STACK_SIZE,
-                            &threadParams_sensorDataAcquisition,
+                            &scheduler_sensorDataAcquisition,
                             THREAD_PRIORITY,
                             &thread_sensorDataAcquisition,
                             THREAD_SDA_CORE);
@@ -185,209 +213,274 @@ void hAIR_System::setup()
     runtime.task_sdd_serial.setFrequency(config.sdd_serial_frequency);
     runtime.task_sdd_display.setFrequency(config.sdd_display_frequency);
     runtime.task_sdd_websocket.setFrequency(config.sdd_websocket_frequency);
-    xTaskCreatePinnedToCore(threadSkeleton,
+    scheduler_sensorDataDistribution.add("serial", runtime.task_sdd_serial, bindJob(&hAIR_System::job_sdd_serial));
+    scheduler_sensorDataDistribution.add("display", runtime.task_sdd_display, bindJob(&hAIR_System::job_sdd_display));
+    scheduler_sensorDataDistribution.add("websocket", runtime.task_sdd_websocket, bindJob(&hAIR_System::job_sdd_websocket));
+    xTaskCreatePinnedToCore(&Scheduler::run,
                             THREAD_SDD_NAME,
                             THREAD_STACK_SIZE,
-                            &threadParams_sensorDataDistribution,
+                            &scheduler_sensorDataDistribution,
                             THREAD_PRIORITY,
                             &thread_sensorDataDistribution,
                             THREAD_SDD_CORE);
+
+    // Everything that was logged during setup is queued and comes out once the drain thread runs (so the POST owns the TFT until the display thread runs)
+    // The period only catches a lost wake up, the records are drained on the notification of every write.
+    runtime.task_log_drain.setFrequency(1);
+    scheduler_log.add("log_drain", runtime.task_log_drain, bindJob(&hAIR_System::job_log_drain), true);
+    components.appender.setDrainNotifier([this]()
+                                         {
+                                             scheduler_log.notify();
+                                         });
+    xTaskCreatePinnedToCore(&Scheduler::run,
+                            THREAD_LOG_NAME,
+                            THREAD_STACK_SIZE,
+                            &scheduler_log,
+                            THREAD_PRIORITY,
+                            &thread_log,
+                            THREAD_SDD_CORE);
+
+    // The only thread that draws on the TFT once the POST is done
+    runtime.task_display_render.setFrequency(DISPLAY_FRAME_RATE);
+    scheduler_display.add("render", runtime.task_display_render, bindJob(&hAIR_System::job_display_render));
+    xTaskCreatePinnedToCore(&Scheduler::run,
+                            THREAD_DSP_NAME,
+                            THREAD_DSP_STACK_SIZE,
+                            &scheduler_display,
+                            THREAD_PRIORITY,
+                            &thread_display,
+                            THREAD_SDD_CORE);
+
+    // HTTP requests block until the server answers or times out, which is why the upload has a thread of its own
+    runtime.task_influx_add.setFrequency(config.influx_frequency);
+    runtime.task_influx_upload.setFrequency(1);
+    scheduler_upload.add("influx_add", runtime.task_influx_add, bindJob(&hAIR_System::job_influx_add));
+    scheduler_upload.add("influx_upload", runtime.task_influx_upload, bindJob(&hAIR_System::job_influx_upload));
+    xTaskCreatePinnedToCore(&Scheduler::run,
+                            THREAD_UPL_NAME,
+                            THREAD_UPL_STACK_SIZE,
+                            &scheduler_upload,
+                            THREAD_PRIORITY,
+                            &thread_upload,
+                            THREAD_SDD_CORE);
+
+    // The archive runs in the loop, flash writes may block for a while and shall not delay the sensors
+    runtime.task_system_poll.setFrequency(POLL_FREQUENCY);
+    runtime.task_system_ntp.setFrequency(1);
+    runtime.task_archive_add.setFrequency(config.archive_frequency);
+    runtime.task_archive_flush.setFrequency(1);
+    runtime.task_taskStats_serial.setDelayTime(config.taskStats_serialInterval * 1000);
+    runtime.task_mqtt_add.setFrequency(config.mqtt_frequency);
+    runtime.task_mqtt_poll.setFrequency(std::max(config.mqtt_drainRate, MQTT_POLL_FREQUENCY));
+    runtime.task_mqtt_health.setDelayTime(config.mqtt_healthInterval * 1000);
+    scheduler_loop.add("poll", runtime.task_system_poll, bindJob(&hAIR_System::job_system_poll));
+    scheduler_loop.add("ntp", runtime.task_system_ntp, bindJob(&hAIR_System::job_system_ntp));
+    scheduler_loop.add("restartWiFiFailed", runtime.task_system_restartBecauseWiFiFailed, bindJob(&hAIR_System::job_system_restartBecauseWiFiFailed));
+    scheduler_loop.add("restartRequested", runtime.task_system_restartRequested, bindJob(&hAIR_System::job_system_restartRequested), true);
+    scheduler_loop.add("archive_add", runtime.task_archive_add, bindJob(&hAIR_System::job_archive_add));
+    scheduler_loop.add("archive_flush", runtime.task_archive_flush, bindJob(&hAIR_System::job_archive_flush));
+    scheduler_loop.add("mqtt_add", runtime.task_mqtt_add, bindJob(&hAIR_System::job_mqtt_add));
+    scheduler_loop.add("mqtt_poll", runtime.task_mqtt_poll, bindJob(&hAIR_System::job_mqtt_poll));
+    scheduler_loop.add("mqtt_health", runtime.task_mqtt_health, bindJob(&hAIR_System::job_mqtt_health));
+    scheduler_loop.add("taskStats_serial", runtime.task_taskStats_serial, bindJob(&hAIR_System::job_taskStats_serial));
+    components.webserver.addScheduler(scheduler_sensorDataAcquisition);
+    components.webserver.addScheduler(scheduler_sensorDataDistribution);
+    components.webserver.addScheduler(scheduler_loop);
+    components.webserver.addScheduler(scheduler_log);
+    components.webserver.addScheduler(scheduler_display);
+    components.webserver.addScheduler(scheduler_upload);
+    components.webserver.setRestartHandler([this]()
+                                           {
+                                               runtime.restartRequested = true;
+                                               scheduler_loop.notify();
+                                           });
+    scheduler_loop.start();
 }
 
 void hAIR_System::loop()
 {
-    delay(THREAD_DELAYTIME);
-
-    threadFunction_loop(millis());
+    scheduler_loop.runOnce();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// Thread Functions
+/// Jobs
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void hAIR_System::threadFunction_sensorDataAcquisition(Timestamp now)
+Scheduler::Job hAIR_System::bindJob(void (hAIR_System::*job)(Timestamp))
 {
-    // We need to preserve old variables, since the SGP methods fail kind of often :(
-    auto tmp{sensorData.getCopy()};
-
-    ////////////////////////////////
-    /// SGP30 Data Acquisition
-    ////////////////////////////////
-
-    if (runtime.task_sda_sqp_IAQ.shallRun(now))
+    return [this, job](Timestamp now)
     {
-        /// return absolute humidity [mg/m^3] with approximation formula
-        /// If you have a temperature / humidity sensor, you can set the absolute humidity to enable the humditiy compensation for the air quality signals
-        /// @param temperature [°C]
-        /// @param humidity [%RH]
-        auto getAbsoluteHumidity = [](float temperature, float humidity) -> uint32_t
-        {
-            // approximation formula from Sensirion SGP30 Driver Integration chapter 3.15
-            const float    absoluteHumidity       = 216.7f * ((humidity / 100.0f) * 6.112f * exp((17.62f * temperature) / (243.12f + temperature)) / (273.15f + temperature)); // [g/m^3]
-            const uint32_t absoluteHumidityScaled = static_cast<uint32_t>(1000.0f * absoluteHumidity);                                                                         // [mg/m^3]
-            return absoluteHumidityScaled;
-        };
-
-        // Compensate humidity prior to measuring
-        components.sgp.setHumidity(getAbsoluteHumidity(tmp.bme_data.temperature, tmp.bme_data.humidity));
-
-        if (components.sgp.IAQmeasure())
-        {
-            runtime.task_sda_sqp_IAQ.updateSuccess(now);
+        (this->*job)(now);
+    };
+}
 
-            tmp.sgp_iaq.TVOC = components.sgp.TVOC;
-            tmp.sgp_iaq.eCO2 = components.sgp.eCO2;
+void hAIR_System::restart(Timestamp now)
+{
+    PLOGN << "Restarting hAIR...";
+    sensorArchive.flush(now);
+    components.influx.persist();
+    delay(1000);
+    ESP.restart();
+}
 
-            tmp.sgp_iaq.isValid = true;
-        }
-        else
-        {
-            // only print a warning if sensor has not been read within the last minute, since it produces a lot of errors
-            if (dt_max(now, runtime.task_sda_sqp_IAQ.getLastSuccess(), 60000))
-            {
-                PLOGW << "SGP30 IAQ data acquisition failed\n";
+////////////////////////////////
+/// Sensor Data Acquisition
+////////////////////////////////
 
-                tmp.sgp_iaq.isValid = false;
-            }
-        }
+void hAIR_System::job_sda_sgp_baseline(Timestamp now)
+{
+    // https://learn.adafruit.com/adafruit-sgp30-gas-tvoc-eco2-mox-sensor/arduino-code
+    // To make that easy, SGP lets you query the 'baseline calibration readings' from the sensor.
+    // This will grab the two 16-bit sensor calibration words.
+    // You should store these in EEPROM, FLASH or hard-coded. Then, next time you start up the sensor, you can pre-fill the calibration words (see SGP30Plugin::probe).
+
+    uint16_t   TVOC_baseline{};
+    uint16_t   eCO2_baseline{};
+    auto&      sgp{components.sgp30.getDriver()};
+    const auto status{sgp.getBaseline(now, eCO2_baseline, TVOC_baseline)};
+    if (status == SGP30::Status::Pending || status == SGP30::Status::Busy)
+    {
+        runtime.task_sda_sqp_baseline.runExtraAt(sgp.readyAt(), now);
     }
-
-    if (runtime.task_sda_sqp_IAQraw.shallRun(now))
+    else if (status == SGP30::Status::Done)
     {
-        if (components.sgp.IAQmeasureRaw())
-        {
-            runtime.task_sda_sqp_IAQraw.updateSuccess(now);
+        runtime.task_sda_sqp_baseline.updateSuccess(now);
 
-            tmp.sgp_iaqRaw.rawH2      = components.sgp.rawH2;
-            tmp.sgp_iaqRaw.rawEthanol = components.sgp.rawEthanol;
-
-            tmp.sgp_iaqRaw.isValid = true;
-        }
-        else
-        {
-            // only print a warning if sensor has not been read within the last minute, since it produces a lot of errors
-            if (dt_max(now, runtime.task_sda_sqp_IAQraw.getLastSuccess(), 60000))
-            {
-                PLOGW << "SGP30 raw IAQ data acquisition failed\n";
-
-                tmp.sgp_iaqRaw.isValid = true;
-            }
-        }
+        // https://randomnerdtutorials.com/esp32-save-data-permanently-preferences/
+        Preferences preferences;
+        preferences.begin("SGP30", false);
+        preferences.putUShort("TVOC_baseline", TVOC_baseline);
+        preferences.putUShort("eCO2_baseline", eCO2_baseline);
+        preferences.end();
     }
-
-    ////////////////////////////////
-    /// SGP30 Baseline
-    ////////////////////////////////
-
-    if (runtime.task_sda_sqp_baseline.shallRun(now))
+    else
     {
-        // https://learn.adafruit.com/adafruit-sgp30-gas-tvoc-eco2-mox-sensor/arduino-code
-        // To make that easy, SGP lets you query the 'baseline calibration readings' from the sensor with code like this:
-        // uint16_t TVOC_base, eCO2_base;
-        // sgp.getIAQBaseline(&eCO2_base, &TVOC_base);
-        // This will grab the two 16-bit sensor calibration words and place them in the variables so-named.
-        // You should store these in EEPROM, FLASH or hard-coded. Then, next time you start up the sensor, you can pre-fill the calibration words with sgp.setIAQBaseline(eCO2_baseline, TVOC_baseline);
-
-        uint16_t TVOC_baseline{};
-        uint16_t eCO2_baseline{};
-        if (components.sgp.getIAQBaseline(&eCO2_baseline, &TVOC_baseline))
-        {
-            // https://randomnerdtutorials.com/esp32-save-data-permanently-preferences/
-            Preferences preferences;
-            preferences.begin("SGP30", false);
-            preferences.putUShort("TVOC_baseline", TVOC_baseline);
-            preferences.putUShort("eCO2_baseline", eCO2_baseline);
-            preferences.end();
-        }
+        runtime.task_sda_sqp_baseline.updateFailure();
     }
+}
 
-    ////////////////////////////////
-    /// BMExxx
-    ////////////////////////////////
-
-    if (runtime.task_sda_bme_measure.shallRun(now))
+void hAIR_System::job_sda_publish(Timestamp now)
+{
+    // Only publish a new generation if something actually changed, so the sinks can skip unchanged data
+    if (runtime.sda_changed)
     {
-        runtime.task_sda_bme_measure.updateSuccess(now);
+        sensorData.update(runtime.sda_data);
+        sensorHistory.add(now, runtime.sda_data);
 
-        // let every value wander by 0.05 per measurement
-        tmp.bme_data.temperature += ((rand() % 1000) - 500) / 10000.0f;
-        tmp.bme_data.humidity += ((rand() % 1000) - 500) / 10000.0f;
-        tmp.bme_data.pressure += ((rand() % 1000) - 500) / 10000.0f;
-
-        tmp.bme_data.isValid = true;
+        runtime.sda_changed = false;
     }
+}
 
-    ////////////////////////////////
-    /// Data Storage
-    ////////////////////////////////
+////////////////////////////////
+/// Sensor Data Distribution
+////////////////////////////////
+
+// The JSON is only serialized if a sink actually needs it, and only once per generation (shared with the webserver)
 
-    sensorData.update(tmp);
+void hAIR_System::job_sdd_serial(Timestamp /*now*/)
+{
+    const auto serialized = sensorData.getSerialized();
+    Serial.write(serialized->json.data(), serialized->length);
+    Serial.println();
 }
 
-void hAIR_System::threadFunction_sensorDataDistribution(Timestamp now)
+void hAIR_System::job_sdd_display(Timestamp /*now*/)
 {
-    ////////////////////////////////
-    /// Sensor Data
-    ////////////////////////////////
+    components.display.printSensorData(sensorData.getCopy());
+}
+void hAIR_System::job_sdd_websocket(Timestamp now)
+{
+    components.websocketTopics.publish(now, sensorData);
+}
 
-    const auto data    = sensorData.getCopy();
-    auto       jsonStr = data.toJSONtxt(); // broadcastTXT does not accecpt const
+////////////////////////////////
+/// Loop
+////////////////////////////////
 
-    ////////////////////////////////
-    /// Serial
-    ////////////////////////////////
+void hAIR_System::job_system_poll(Timestamp /*now*/)
+{
+    AsyncElegantOTA.loop();
+    ArduinoOTA.handle();
+}
 
-    if (runtime.task_sdd_serial.shallRun(now))
-    {
-        Serial.println(jsonStr);
-    }
+void hAIR_System::job_system_ntp(Timestamp /*now*/)
+{
+    // Only asks the server once its update interval is over
+    components.ntpclient.update();
+}
 
-    ////////////////////////////////
-    /// Display
-    ////////////////////////////////
+void hAIR_System::job_system_restartBecauseWiFiFailed(Timestamp now)
+{
+    // Only scheduled if WiFi connection has not been established, see initWiFi()
+    restart(now);
+}
 
-    if (runtime.task_sdd_display.shallRun(now))
+void hAIR_System::job_system_restartRequested(Timestamp now)
+{
+    if (runtime.restartRequested)
     {
-        components.display.printSensorData(data);
+        restart(now);
     }
+}
 
-    ////////////////////////////////
-    /// WebSocket
-    ////////////////////////////////
+void hAIR_System::job_archive_add(Timestamp now)
+{
+    sensorArchive.add(now, getUnixTime(components.ntpclient), sensorData.getCopy());
+}
 
-    if (runtime.task_sdd_websocket.shallRun(now))
-    {
-        if (data.isValid())
-        {
-            components.websocketSensorData.broadcastTXT(jsonStr);
-        }
-    }
+void hAIR_System::job_archive_flush(Timestamp now)
+{
+    sensorArchive.flushIfDue(now);
 }
 
-void hAIR_System::threadFunction_loop(Timestamp now)
+void hAIR_System::job_mqtt_add(Timestamp /*now*/)
 {
-    ////////////////////////////////
-    /// Base Layer
-    ////////////////////////////////
+    components.mqtt.add(getUnixTime(components.ntpclient), sensorData.getCopy());
+}
 
-    AsyncElegantOTA.loop();
-    ArduinoOTA.handle();
-    components.ntpclient.update();
+void hAIR_System::job_mqtt_poll(Timestamp now)
+{
+    components.mqtt.poll(now, getUnixTime(components.ntpclient));
+}
 
-    if (runtime.task_system_restartBecauseWiFiFailed.shallRun())
-    {
-        // Restart hAIR if WiFi connection has not been established
-        PLOGN << "Restarting hAIR...";
-        delay(1000);
-        ESP.restart();
-    }
+void hAIR_System::job_mqtt_health(Timestamp /*now*/)
+{
+    components.mqtt.publishHealth();
+}
 
-    ////////////////////////////////
-    /// Application Layer
-    ////////////////////////////////
+void hAIR_System::job_taskStats_serial(Timestamp /*now*/)
+{
+    // The same data is served as JSON on /taskstats
+    scheduler_sensorDataAcquisition.printStats(Serial);
+    scheduler_sensorDataDistribution.printStats(Serial);
+    scheduler_loop.printStats(Serial);
+    scheduler_log.printStats(Serial);
+    scheduler_display.printStats(Serial);
+    scheduler_upload.printStats(Serial);
+}
 
-    components.websocketSensorData.loop();
-    components.websocketLogMessages.loop();
+void hAIR_System::job_log_drain(Timestamp /*now*/)
+{
+    components.appender.drain();
+}
+
+void hAIR_System::job_display_render(Timestamp /*now*/)
+{
+    components.display.render();
+}
+
+////////////////////////////////
+/// Upload
+////////////////////////////////
+
+void hAIR_System::job_influx_add(Timestamp /*now*/)
+{
+    components.influx.add(getUnixTime(components.ntpclient), sensorData.getCopy());
+}
+
+void hAIR_System::job_influx_upload(Timestamp now)
+{
+    components.influx.upload(now, getUnixTime(components.ntpclient));
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -407,6 +500,7 @@ void hAIR_System::initDisplay()
     components.tft.setCursor(0, 0);
 
     components.tft.setTextColor(TFT_WHITE, TFT_BLACK);
+    components.display.init();
 
     post.display = true; // Is there a way to detect whether the display was initialized correctly?
 }
@@ -438,12 +532,8 @@ void hAIR_System::loadConfigFromFileOrDefault(bool saveIfLoadFailed)
 
     if (saveIfLoadFailed)
     {
-        std::array<char, 512> jsonStr{};
-
-        const auto size = Config::toJSON<jsonStr.size()>(config, jsonStr.data());
-
         auto fileWrite = LITTLEFS.open(HAIR_CONFIG_FILE_NAME, "w");
-        fileWrite.write(reinterpret_cast<uint8_t*>(jsonStr.data()), size);
+        Config::toJSON(config, fileWrite);
         fileWrite.close();
     }
 
@@ -511,7 +601,7 @@ void hAIR_System::initOTA()
 void hAIR_System::initNTP()
 {
     components.ntpclient.begin();
-    components.ntpclient.setTimeOffset(7200); // UTC + 2
+    components.ntpclient.setTimeOffset(NTP_TIME_OFFSET);
 
     int32_t cnt{};
     while (!components.ntpclient.update())
@@ -541,32 +631,76 @@ void hAIR_System::initAsyncWebserver()
 
 void hAIR_System::initLogger()
 {
+    components.appender.setPolicy(config.logger_dropOldest ? LogQueue::Policy::DropOldest : LogQueue::Policy::DropNewest);
+    components.appender.setBinary(config.logger_binary);
     plog::init(plog::Severity(config.logger_severity), &components.appender);
+    LogCapture::setSink(&components.appender);
 
     post.logger = true;
 }
 
-void hAIR_System::initSGP()
+void hAIR_System::initSensors()
 {
-    post.sgp30 = components.sgp.begin();
+    BMExxx::Settings settings{};
+    settings.temperatureOversampling = static_cast<uint8_t>(config.bme_oversamplingT);
+    settings.pressureOversampling    = static_cast<uint8_t>(config.bme_oversamplingP);
+    settings.humidityOversampling    = static_cast<uint8_t>(config.bme_oversamplingH);
+    settings.filter                  = static_cast<uint8_t>(config.bme_filter);
+    components.bme.setSettings(settings);
+
+    // BMExxx first, the SGP30 compensation uses its data; SGP30 before SGP30 raw, which shares its driver
+    components.sensors.add("bme_measure", components.bme, config.bme_measure_frequency);
+    components.sensors.add("sgp_IAQ", components.sgp30, config.sgp_IAQ_frequency);
+    components.sensors.add("sgp_IAQraw", components.sgp30raw, config.sgp_IAQraw_frequency);
+
+    // Blocking during the setup is fine, the measurements later on are split-phase
+    components.sensors.probe(components.i2c, delay);
+}
 
-    if (post.sgp30)
-    {
-        // See Baseline acquisition in SDA
-        Preferences preferences;
-        preferences.begin("SGP30", true);
-        uint16_t TVOC_baseline = preferences.getUShort("TVOC_baseline", 0U);
-        uint16_t eCO2_baseline = preferences.getUShort("eCO2_baseline", 0U);
-        preferences.end();
+void hAIR_System::initHistory()
+{
+    post.history = sensorHistory.init(config.history_memoryBudget);
+}
 
-        PLOGN << "TV " << TVOC_baseline << " CO " << eCO2_baseline;
+void hAIR_System::initArchive()
+{
+    post.archive = sensorArchive.init(config.archive_segmentSize, config.archive_segmentCount, config.archive_flushInterval * 1000);
+}
 
-        // https://learn.adafruit.com/adafruit-sgp30-gas-tvoc-eco2-mox-sensor/arduino-code, should be around 400 if it was ever initialized
-        if (eCO2_baseline != 0)
-        {
-            post.sgp30_baseline = components.sgp.setIAQBaseline(eCO2_baseline, TVOC_baseline);
-        }
-    }
+void hAIR_System::initMqtt()
+{
+    MqttPublisher::Settings settings{};
+    settings.host      = config.mqtt_host;
+    settings.port      = static_cast<uint16_t>(config.mqtt_port);
+    settings.user      = config.mqtt_user;
+    settings.password  = config.mqtt_password;
+    settings.topic     = config.mqtt_topic;
+    settings.qos       = static_cast<uint8_t>(config.mqtt_qos);
+    settings.batchSize = config.mqtt_batchSize;
+    settings.queueSize = config.mqtt_queueSize;
+    settings.spillSize = config.mqtt_spillSize;
+    settings.drainRate = config.mqtt_drainRate;
+    settings.discovery = config.mqtt_discovery;
+
+    // A partial batch goes out once it has waited as long as a full one takes to collect
+    settings.batchDelay = config.mqtt_frequency > 0.0F ? static_cast<uint32_t>(ceilf(config.mqtt_batchSize / config.mqtt_frequency)) : 0;
+
+    post.mqtt = components.mqtt.init(settings);
+}
+
+void hAIR_System::initInflux()
+{
+    InfluxUploader::Settings settings{};
+    settings.url         = config.influx_url;
+    settings.token       = config.influx_token;
+    settings.measurement = config.influx_measurement;
+    settings.batchSize   = config.influx_batchSize;
+    settings.outboxSize  = config.influx_outboxSize;
+
+    // Same as for MQTT, a partial batch waits as long as a full one takes to collect
+    settings.batchDelay = config.influx_frequency > 0.0F ? static_cast<uint32_t>(ceilf(config.influx_batchSize / config.influx_frequency)) : 0;
+
+    post.influx = components.influx.init(settings);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,238 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// Just enough of the Arduino core for the host tests (pio test -e native), none of this is built for the target
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+inline unsigned long millis()
+{
+    using namespace std::chrono;
+    static const auto start{steady_clock::now()};
+    return static_cast<unsigned long>(duration_cast<milliseconds>(steady_clock::now() - start).count());
+}
+
+inline unsigned long micros()
+{
+    using namespace std::chrono;
+    static const auto start{steady_clock::now()};
+    return static_cast<unsigned long>(duration_cast<microseconds>(steady_clock::now() - start).count());
+}
+
+inline void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline void yield()
+{
+    std::this_thread::yield();
+}
+
+// FreeRTOS, which the Arduino core pulls in. Tasks don't exist on the host, the schedulers under test use a virtual clock.
+using TickType_t   = uint32_t;
+using TaskHandle_t = void*;
+
+constexpr TickType_t portTICK_PERIOD_MS{1};
+constexpr int        pdTRUE{1};
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return nullptr;
+}
+
+inline uint32_t ulTaskNotifyTake(int /*clearOnExit*/, TickType_t ticks)
+{
+    delay(ticks * portTICK_PERIOD_MS);
+    return 0;
+}
+
+inline void xTaskNotifyGive(TaskHandle_t /*task*/)
+{
+}
+
+inline uint32_t uxTaskGetStackHighWaterMark(TaskHandle_t /*task*/)
+{
+    return 0;
+}
+
+class String
+{
+public:
+    String() = default;
+    String(const char* str)
+        : m_str(str != nullptr ? str : "")
+    {
+    }
+
+    explicit String(unsigned long val)
+        : m_str(std::to_string(val))
+    {
+    }
+
+    explicit String(unsigned int val)
+        : m_str(std::to_string(val))
+    {
+    }
+
+    explicit String(unsigned char val)
+        : m_str(std::to_string(val))
+    {
+    }
+
+    const char* c_str() const
+    {
+        return m_str.c_str();
+    }
+
+    unsigned int length() const
+    {
+        return static_cast<unsigned int>(m_str.size());
+    }
+
+    bool operator==(const char* str) const
+    {
+        return m_str == str;
+    }
+
+    String& operator+=(const char* str)
+    {
+        m_str += str;
+        return *this;
+    }
+
+    String& operator+=(const String& str)
+    {
+        m_str += str.m_str;
+        return *this;
+    }
+
+    String substring(unsigned int from) const
+    {
+        return String{m_str.substr(std::min<size_t>(from, m_str.size())).c_str()};
+    }
+
+    int lastIndexOf(char c) const
+    {
+        const auto pos{m_str.rfind(c)};
+        return pos != std::string::npos ? static_cast<int>(pos) : -1;
+    }
+
+    bool endsWith(const char* suffix) const
+    {
+        const auto length{strlen(suffix)};
+        return m_str.size() >= length && m_str.compare(m_str.size() - length, length, suffix) == 0;
+    }
+
+private:
+    std::string m_str{};
+};
+
+inline String operator+(String lhs, const String& rhs)
+{
+    return lhs += rhs;
+}
+
+inline String operator+(String lhs, const char* rhs)
+{
+    return lhs += rhs;
+}
+
+inline String operator+(const char* lhs, const String& rhs)
+{
+    return String{lhs} += rhs;
+}
+
+class Print
+{
+public:
+    virtual ~Print() = default;
+
+    virtual size_t write(uint8_t c) = 0;
+
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            write(buffer[i]);
+        }
+        return size;
+    }
+
+    size_t write(const char* str)
+    {
+        return write(reinterpret_cast<const uint8_t*>(str), strlen(str));
+    }
+
+    size_t printf(const char* format, ...)
+    {
+        char    buffer[256];
+        va_list args;
+        va_start(args, format);
+        const auto length{vsnprintf(buffer, sizeof(buffer), format, args)};
+        va_end(args);
+        return length > 0 ? write(reinterpret_cast<const uint8_t*>(buffer), std::min<size_t>(length, sizeof(buffer) - 1)) : 0;
+    }
+
+    size_t print(const char* str)
+    {
+        return write(str);
+    }
+
+    size_t print(unsigned long val)
+    {
+        return printf("%lu", val);
+    }
+
+    size_t println(const char* str = "")
+    {
+        return write(str) + write("\r\n");
+    }
+};
+
+/// Output is discarded, the tests report through Unity
+class HardwareSerial : public Print
+{
+public:
+    size_t write(uint8_t /*c*/) override
+    {
+        return 1;
+    }
+
+    using Print::write;
+};
+
+inline HardwareSerial Serial{};
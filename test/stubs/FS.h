@@ -0,0 +1,248 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// Host tests only: a RAM file system with the part of the LittleFS API the sources use, see Arduino.h next to this file.
+// Tests can cut the power after a number of written bytes and edit the file contents directly.
+#include <Arduino.h>
+#include <climits>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs
+{
+/// The "flash", shared by the file system and all open files
+struct RamStorage
+{
+    std::map<std::string, std::vector<uint8_t>> files{};
+    std::vector<std::string>                    directories{};
+    size_t                                      capacity{1024 * 1024};
+
+    /// Bytes that still reach the flash, writes beyond are lost as if the power went away mid write
+    size_t writeBudget{SIZE_MAX};
+};
+
+class File
+{
+public:
+    File() = default;
+
+    /// A file, for writing the contents are appended to
+    File(std::shared_ptr<RamStorage> storage, std::string path, bool append)
+        : m_storage(std::move(storage)), m_path(std::move(path)), m_append(append)
+    {
+    }
+
+    /// A directory listing
+    File(std::string path, std::vector<std::string> entries, std::shared_ptr<RamStorage> storage)
+        : m_storage(std::move(storage)), m_path(std::move(path)), m_entries(std::move(entries))
+    {
+    }
+
+    explicit operator bool() const
+    {
+        return m_storage != nullptr;
+    }
+
+    const char* name() const
+    {
+        return m_path.c_str();
+    }
+
+    bool isDirectory() const
+    {
+        return !m_entries.empty();
+    }
+
+    time_t getLastWrite() const
+    {
+        return 0;
+    }
+
+    size_t size() const
+    {
+        return m_storage && isFile() ? contents().size() : 0;
+    }
+
+    bool seek(size_t pos)
+    {
+        if (!m_storage || pos > size())
+        {
+            return false;
+        }
+        m_pos = pos;
+        return true;
+    }
+
+    size_t read(uint8_t* buffer, size_t size)
+    {
+        if (!m_storage || !isFile())
+        {
+            return 0;
+        }
+        const auto& data{contents()};
+        const auto  length{std::min(size, data.size() - std::min(m_pos, data.size()))};
+        std::copy_n(data.begin() + static_cast<std::ptrdiff_t>(m_pos), length, buffer);
+        m_pos += length;
+        return length;
+    }
+
+    size_t write(const uint8_t* buffer, size_t size)
+    {
+        if (!m_storage || !m_append)
+        {
+            return 0;
+        }
+        const auto length{std::min(size, m_storage->writeBudget)};
+        auto&      data{m_storage->files[m_path]};
+        data.insert(data.end(), buffer, buffer + length);
+        if (m_storage->writeBudget != SIZE_MAX)
+        {
+            m_storage->writeBudget -= length;
+        }
+        return length;
+    }
+
+    File openNextFile()
+    {
+        if (!m_storage || m_nextEntry >= m_entries.size())
+        {
+            return {};
+        }
+        return File{m_storage, m_entries[m_nextEntry++], false};
+    }
+
+    void close()
+    {
+        m_storage.reset();
+    }
+
+private:
+    bool isFile() const
+    {
+        return m_storage->files.count(m_path) > 0;
+    }
+
+    const std::vector<uint8_t>& contents() const
+    {
+        return m_storage->files.at(m_path);
+    }
+
+    std::shared_ptr<RamStorage> m_storage{};
+    std::string                 m_path{};
+    bool                        m_append{};
+    size_t                      m_pos{};
+    std::vector<std::string>    m_entries{};
+    size_t                      m_nextEntry{};
+};
+
+class FS
+{
+public:
+    File open(const char* path, const char* mode = "r")
+    {
+        const std::string name{path};
+        if (isDirectory(name))
+        {
+            std::vector<std::string> entries{};
+            for (const auto& file : m_storage->files)
+            {
+                if (file.first.compare(0, name.size() + 1, name + "/") == 0)
+                {
+                    entries.push_back(file.first);
+                }
+            }
+            return File{name, entries, m_storage};
+        }
+
+        const bool append{mode[0] == 'a'};
+        if (append)
+        {
+            m_storage->files[name];
+        }
+        else if (m_storage->files.count(name) == 0)
+        {
+            return {};
+        }
+        return File{m_storage, name, append};
+    }
+
+    File open(const String& path, const char* mode = "r")
+    {
+        return open(path.c_str(), mode);
+    }
+
+    bool exists(const char* path) const
+    {
+        return isDirectory(path) || m_storage->files.count(path) > 0;
+    }
+
+    bool mkdir(const char* path)
+    {
+        m_storage->directories.emplace_back(path);
+        return true;
+    }
+
+    bool remove(const String& path)
+    {
+        return m_storage->files.erase(path.c_str()) > 0;
+    }
+
+    size_t totalBytes() const
+    {
+        return m_storage->capacity;
+    }
+
+    size_t usedBytes() const
+    {
+        size_t used{};
+        for (const auto& file : m_storage->files)
+        {
+            used += file.second.size();
+        }
+        return used;
+    }
+
+    /// Test access to the flash contents
+    RamStorage& storage()
+    {
+        return *m_storage;
+    }
+
+private:
+    bool isDirectory(const std::string& path) const
+    {
+        return std::find(m_storage->directories.begin(), m_storage->directories.end(), path) != m_storage->directories.end();
+    }
+
+    std::shared_ptr<RamStorage> m_storage{std::make_shared<RamStorage>()};
+};
+} // namespace fs
+
+using fs::File;
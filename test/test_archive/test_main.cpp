@@ -0,0 +1,257 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// SensorArchive on the RAM file system from test/stubs: round trip, rotation and the recovery after a power cut
+// or a truncated segment. Whatever survives, the reader has to return a clean prefix and the records added after the reboot.
+
+#include "SensorArchive.h"
+#include <LITTLEFS.h>
+#include <unity.h>
+#include <vector>
+
+namespace
+{
+constexpr uint32_t  EPOCH{1700000000};
+constexpr Timestamp FLUSH_INTERVAL{300000};
+constexpr size_t    TVOC{0}; // channel index, see ArchiveFormat::CHANNELS
+
+/// Every record is told apart by its timestamp and TVOC
+SensorData makeData(uint16_t TVOC)
+{
+    SensorData data{};
+    data.sgp_iaq              = {true, TVOC, 400};
+    data.sgp_iaqRaw           = {true, 13000, 18000};
+    data.bme_data.isValid     = true;
+    data.bme_data.temperature = 21.5F;
+    data.bme_data.humidity    = 45.0F;
+    data.bme_data.pressure    = 1013.2F;
+    return data;
+}
+
+/// Adds records [first, last), one per minute
+void addRecords(SensorArchive& archive, uint32_t first, uint32_t last)
+{
+    for (auto i = first; i < last; ++i)
+    {
+        archive.add(static_cast<Timestamp>(i * 60000), EPOCH + i * 60, makeData(static_cast<uint16_t>(i % 1000)));
+    }
+}
+
+/// Record numbers as added by addRecords()
+std::vector<uint32_t> readAll(const SensorArchive& archive, uint32_t from = 0, uint32_t to = UINT32_MAX)
+{
+    std::vector<uint32_t>  records{};
+    SensorArchive::Reader  reader{archive, from, to};
+    ArchiveFormat::Record record{};
+    while (reader.next(record))
+    {
+        const auto i{(record.timestamp - EPOCH) / 60};
+        TEST_ASSERT_EQUAL_INT32(static_cast<int32_t>(i % 1000), record.values[TVOC]);
+        records.push_back(i);
+    }
+    return records;
+}
+
+std::vector<uint32_t> range(uint32_t first, uint32_t last)
+{
+    std::vector<uint32_t> records{};
+    for (auto i = first; i < last; ++i)
+    {
+        records.push_back(i);
+    }
+    return records;
+}
+
+/// A clean prefix of [first, last) followed by after
+bool isPrefixThen(const std::vector<uint32_t>& records, uint32_t first, uint32_t last, const std::vector<uint32_t>& after, size_t& prefix)
+{
+    if (records.size() < after.size() || !std::equal(after.begin(), after.end(), records.end() - static_cast<std::ptrdiff_t>(after.size())))
+    {
+        return false;
+    }
+    prefix = records.size() - after.size();
+    return prefix <= last - first && std::equal(records.begin(), records.begin() + static_cast<std::ptrdiff_t>(prefix), range(first, last).begin());
+}
+
+fs::RamStorage& flash()
+{
+    return LITTLEFS.storage();
+}
+} // namespace
+
+void setUp()
+{
+    flash() = fs::RamStorage{};
+}
+
+void tearDown()
+{
+}
+
+void test_archive_round_trip()
+{
+    SensorArchive archive{};
+    TEST_ASSERT_TRUE(archive.init(64 * 1024, 4, FLUSH_INTERVAL));
+
+    addRecords(archive, 0, 1000);
+    archive.flush(1000 * 60000);
+
+    TEST_ASSERT_EQUAL_size_t(1, archive.getSegmentCount());
+    TEST_ASSERT_TRUE(readAll(archive) == range(0, 1000));
+    TEST_ASSERT_TRUE(readAll(archive, EPOCH + 250 * 60, EPOCH + 749 * 60) == range(250, 750));
+}
+
+void test_archive_rotation()
+{
+    SensorArchive archive{};
+    TEST_ASSERT_TRUE(archive.init(8 * 1024, 3, FLUSH_INTERVAL));
+
+    addRecords(archive, 0, 5000);
+    archive.flush(5000 * 60000);
+
+    TEST_ASSERT_EQUAL_size_t(3, archive.getSegmentCount());
+    TEST_ASSERT_EQUAL_size_t(3, flash().files.size());
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(3 * 8 * 1024, archive.getSizeOnFlash());
+
+    // the oldest segments are gone, the rest is complete up to the newest record
+    const auto records{readAll(archive)};
+    TEST_ASSERT_TRUE(records.size() > 1000);
+    TEST_ASSERT_TRUE(records == range(records.front(), 5000));
+}
+
+void test_archive_power_cut()
+{
+    // Size of the flush that gets cut, from a run without a power cut
+    size_t flushLength{};
+    {
+        SensorArchive archive{};
+        archive.init(64 * 1024, 4, FLUSH_INTERVAL);
+        addRecords(archive, 0, 100);
+        archive.flush(100 * 60000);
+        const auto before{archive.getSizeOnFlash()};
+        addRecords(archive, 100, 130);
+        archive.flush(130 * 60000);
+        flushLength = archive.getSizeOnFlash() - before;
+    }
+    TEST_ASSERT_TRUE(flushLength > 30);
+
+    size_t lastPrefix{};
+    for (size_t cut = 0; cut <= flushLength; ++cut)
+    {
+        setUp();
+        {
+            SensorArchive archive{};
+            archive.init(64 * 1024, 4, FLUSH_INTERVAL);
+            addRecords(archive, 0, 100);
+            archive.flush(100 * 60000);
+            addRecords(archive, 100, 130);
+
+            // the power goes away after 'cut' bytes of this flush
+            flash().writeBudget = cut;
+            archive.flush(130 * 60000);
+        }
+        flash().writeBudget = SIZE_MAX;
+
+        // Reboot
+        SensorArchive archive{};
+        TEST_ASSERT_TRUE(archive.init(64 * 1024, 4, FLUSH_INTERVAL));
+        addRecords(archive, 200, 250);
+        archive.flush(250 * 60000);
+
+        size_t prefix{};
+        TEST_ASSERT_TRUE(isPrefixThen(readAll(archive), 0, 130, range(200, 250), prefix));
+        TEST_ASSERT_GREATER_OR_EQUAL_UINT32(100, prefix);
+
+        // more bytes on flash never lose a record
+        TEST_ASSERT_GREATER_OR_EQUAL_UINT32(lastPrefix, prefix);
+        lastPrefix = prefix;
+    }
+    TEST_ASSERT_EQUAL_size_t(130, lastPrefix);
+}
+
+void test_archive_truncated()
+{
+    // A few blocks worth of records in one segment
+    std::vector<uint8_t> segment{};
+    std::string          path{};
+    {
+        SensorArchive archive{};
+        archive.init(64 * 1024, 4, FLUSH_INTERVAL);
+        addRecords(archive, 0, 3000);
+        archive.flush(3000 * 60000);
+        TEST_ASSERT_EQUAL_size_t(1, flash().files.size());
+        path    = flash().files.begin()->first;
+        segment = flash().files.begin()->second;
+    }
+    TEST_ASSERT_TRUE(segment.size() > 2 * ArchiveFormat::BLOCK_SIZE);
+
+    size_t lastPrefix{};
+    for (size_t length = 0; length <= segment.size(); ++length)
+    {
+        setUp();
+        flash().directories.emplace_back(SensorArchive::DIRECTORY);
+        flash().files[path].assign(segment.begin(), segment.begin() + static_cast<std::ptrdiff_t>(length));
+
+        SensorArchive archive{};
+        TEST_ASSERT_TRUE(archive.init(64 * 1024, 4, FLUSH_INTERVAL));
+        addRecords(archive, 5000, 5010);
+        archive.flush(5010 * 60000);
+
+        size_t prefix{};
+        TEST_ASSERT_TRUE(isPrefixThen(readAll(archive), 0, 3000, range(5000, 5010), prefix));
+        TEST_ASSERT_GREATER_OR_EQUAL_UINT32(lastPrefix, prefix);
+        lastPrefix = prefix;
+    }
+    TEST_ASSERT_EQUAL_size_t(3000, lastPrefix);
+}
+
+void test_archive_clock_step()
+{
+    SensorArchive archive{};
+    archive.init(64 * 1024, 4, FLUSH_INTERVAL);
+
+    // NTP hands out a wrong time for one record, the next update corrects it backwards
+    addRecords(archive, 100, 200);
+    addRecords(archive, 300, 301);
+    addRecords(archive, 210, 220);
+    archive.flush(220 * 60000);
+
+    auto expected{range(150, 200)};
+    const auto tail{range(210, 220)};
+    expected.insert(expected.end(), tail.begin(), tail.end());
+    TEST_ASSERT_TRUE(readAll(archive, EPOCH + 150 * 60, EPOCH + 250 * 60) == expected);
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_archive_round_trip);
+    RUN_TEST(test_archive_rotation);
+    RUN_TEST(test_archive_power_cut);
+    RUN_TEST(test_archive_truncated);
+    RUN_TEST(test_archive_clock_step);
+    return UNITY_END();
+}
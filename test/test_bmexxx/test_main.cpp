@@ -0,0 +1,296 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Integer compensation of the BME280 / BME680 against the reference values of the datasheets:
+// the worked example of the BMP280 datasheet (same temperature and pressure formulas as the BME280, 8.2) and the
+// floating point formulas of the BME280 datasheet (8.1) and the BME68x API over random ADC values.
+// The benchmark prints the cost of one compensated sample.
+
+#include "BMExxx.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <unity.h>
+
+namespace
+{
+constexpr uint32_t SAMPLES{200000};
+
+// BMP280 datasheet 3.12, the humidity words are the ones of a BME280 on the bench
+constexpr BMExxx::Calibration280 CAL280{27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000, 75, 362, 0, 313, 50, 30};
+
+// BME680 on the bench
+constexpr BMExxx::Calibration680 CAL680{26095, 26399, 3, 36443, -10318, 88, 6604, -142, 30, 31, -3378, -2384, 30, 749, 1005, 0, 45, 20, 120, -100};
+
+struct Reference
+{
+    double temperature; // [°C]
+    double pressure;    // [Pa]
+    double humidity;    // [%RH]
+};
+
+/// BME280 datasheet 8.1
+Reference reference280(const BMExxx::Calibration280& cal, int32_t adcT, int32_t adcP, int32_t adcH)
+{
+    Reference ref{};
+
+    double       var1{(adcT / 16384.0 - cal.T1 / 1024.0) * cal.T2};
+    double       var2{(adcT / 131072.0 - cal.T1 / 8192.0) * (adcT / 131072.0 - cal.T1 / 8192.0) * cal.T3};
+    const double tFine{var1 + var2};
+    ref.temperature = tFine / 5120.0;
+
+    var1 = tFine / 2.0 - 64000.0;
+    var2 = var1 * var1 * cal.P6 / 32768.0;
+    var2 = var2 + var1 * cal.P5 * 2.0;
+    var2 = var2 / 4.0 + cal.P4 * 65536.0;
+    var1 = (cal.P3 * var1 * var1 / 524288.0 + cal.P2 * var1) / 524288.0;
+    var1 = (1.0 + var1 / 32768.0) * cal.P1;
+    double p{1048576.0 - adcP};
+    p    = (p - var2 / 4096.0) * 6250.0 / var1;
+    var1 = cal.P9 * p * p / 2147483648.0;
+    var2 = p * cal.P8 / 32768.0;
+    ref.pressure = p + (var1 + var2 + cal.P7) / 16.0;
+
+    double h{tFine - 76800.0};
+    h = (adcH - (cal.H4 * 64.0 + cal.H5 / 16384.0 * h)) *
+        (cal.H2 / 65536.0 * (1.0 + cal.H6 / 67108864.0 * h * (1.0 + cal.H3 / 67108864.0 * h)));
+    h            = h * (1.0 - cal.H1 * h / 524288.0);
+    ref.humidity = std::min(100.0, std::max(0.0, h));
+    return ref;
+}
+
+/// BME68x API, calc_temperature() / calc_pressure() / calc_humidity() with BME68X_USE_FPU
+Reference reference680(const BMExxx::Calibration680& cal, int32_t adcT, int32_t adcP, int32_t adcH)
+{
+    Reference ref{};
+
+    double       var1{(adcT / 16384.0 - cal.T1 / 1024.0) * cal.T2};
+    double       var2{(adcT / 131072.0 - cal.T1 / 8192.0) * (adcT / 131072.0 - cal.T1 / 8192.0) * (cal.T3 * 16.0)};
+    const double tFine{var1 + var2};
+    ref.temperature = tFine / 5120.0;
+
+    var1 = tFine / 2.0 - 64000.0;
+    var2 = var1 * var1 * (cal.P6 / 131072.0);
+    var2 = var2 + var1 * cal.P5 * 2.0;
+    var2 = var2 / 4.0 + cal.P4 * 65536.0;
+    var1 = (cal.P3 * var1 * var1 / 16384.0 + cal.P2 * var1) / 524288.0;
+    var1 = (1.0 + var1 / 32768.0) * cal.P1;
+    double p{1048576.0 - adcP};
+    p                 = (p - var2 / 4096.0) * 6250.0 / var1;
+    var1              = cal.P9 * p * p / 2147483648.0;
+    var2              = p * (cal.P8 / 32768.0);
+    const double var3{(p / 256.0) * (p / 256.0) * (p / 256.0) * (cal.P10 / 131072.0)};
+    ref.pressure = p + (var1 + var2 + var3 + cal.P7 * 128.0) / 16.0;
+
+    const double temperature{ref.temperature};
+    const double h1{adcH - (cal.H1 * 16.0 + cal.H3 / 2.0 * temperature)};
+    const double h2{h1 * (cal.H2 / 262144.0 * (1.0 + cal.H4 / 16384.0 * temperature + cal.H5 / 1048576.0 * temperature * temperature))};
+    const double h{h2 + (cal.H6 / 16384.0 + cal.H7 / 2097152.0 * temperature) * h2 * h2};
+    ref.humidity = std::min(100.0, std::max(0.0, h));
+    return ref;
+}
+
+struct Deviation
+{
+    double   temperature{}; // [°C]
+    double   pressure{};    // [Pa]
+    double   humidity{};    // [%RH]
+    uint32_t samples{};
+};
+
+/// Random ADC values, only those that end up in the operating range of the sensors count
+template<typename Calibration, typename Compensate, typename Refer>
+Deviation compare(const Calibration& cal, Compensate compensate, Refer refer)
+{
+    std::mt19937                           random{42};
+    std::uniform_int_distribution<int32_t> adc20{0, (1 << 20) - 1};
+    std::uniform_int_distribution<int32_t> adc16{0, (1 << 16) - 1};
+
+    Deviation deviation{};
+    for (uint32_t i = 0; i < SAMPLES; ++i)
+    {
+        const auto adcT{adc20(random)};
+        const auto adcP{adc20(random)};
+        const auto adcH{adc16(random)};
+
+        const Reference ref{refer(cal, adcT, adcP, adcH)};
+        if (ref.temperature < -40.0 || ref.temperature > 85.0 || ref.pressure < 30000.0 || ref.pressure > 110000.0)
+        {
+            continue;
+        }
+
+        const BMExxx::Sample sample{compensate(cal, adcT, adcP, adcH)};
+        deviation.temperature = std::max(deviation.temperature, std::fabs(sample.temperature / 100.0 - ref.temperature));
+        deviation.pressure    = std::max(deviation.pressure, std::fabs(sample.pressure - ref.pressure));
+        deviation.humidity    = std::max(deviation.humidity, std::fabs(sample.humidity / 1000.0 - ref.humidity));
+        ++deviation.samples;
+    }
+    return deviation;
+}
+
+/// Same scaling as BMExxx::measure()
+BMExxx::Sample compensate280(const BMExxx::Calibration280& cal, int32_t adcT, int32_t adcP, int32_t adcH)
+{
+    BMExxx::Sample sample{};
+    int32_t        tFine{};
+    sample.temperature = BMExxx::compensateTemperature(cal, adcT, tFine);
+    sample.pressure    = (BMExxx::compensatePressure(cal, adcP, tFine) + 128) >> 8;
+    sample.humidity    = (BMExxx::compensateHumidity(cal, adcH, tFine) * 1000 + 512) >> 10;
+    return sample;
+}
+
+BMExxx::Sample compensate680(const BMExxx::Calibration680& cal, int32_t adcT, int32_t adcP, int32_t adcH)
+{
+    BMExxx::Sample sample{};
+    int32_t        tFine{};
+    sample.temperature = BMExxx::compensateTemperature(cal, adcT, tFine);
+    sample.pressure    = BMExxx::compensatePressure(cal, adcP, tFine);
+    sample.humidity    = BMExxx::compensateHumidity(cal, adcH, tFine);
+    return sample;
+}
+
+void report(const char* name, const Deviation& deviation)
+{
+    char text[128];
+    snprintf(text, sizeof(text), "%s max. deviation %.3f °C %.2f Pa %.3f %%RH (%u samples)",
+             name,
+             deviation.temperature,
+             deviation.pressure,
+             deviation.humidity,
+             deviation.samples);
+    TEST_MESSAGE(text);
+}
+
+int64_t nanos()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/// [ns] per compensated sample, the ADC values walk so the compiler can not hoist the work out of the loop
+template<typename Calibration, typename Compensate>
+void benchmark(const char* name, const Calibration& cal, Compensate compensate)
+{
+    double     checksum{};
+    const auto begin{nanos()};
+    for (uint32_t i = 0; i < SAMPLES; ++i)
+    {
+        const auto sample{compensate(cal, 519888 + static_cast<int32_t>(i & 0xFFF), 415148 + static_cast<int32_t>(i & 0x3FFF), 30000 + static_cast<int32_t>(i & 0x3FF))};
+        checksum += sample.temperature + sample.pressure + sample.humidity;
+    }
+    const auto end{nanos()};
+
+    char text[96];
+    snprintf(text, sizeof(text), "%s %6.1f ns/sample (checksum %.0f)", name, static_cast<double>(end - begin) / SAMPLES, checksum);
+    TEST_MESSAGE(text);
+}
+} // namespace
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_bme280_datasheet_example()
+{
+    // adc_T 519888 => t_fine 128422, 25.08 °C; adc_P 415148 => 100653.27 Pa (the 64 bit integer variant is 0.02 Pa off)
+    int32_t tFine{};
+    TEST_ASSERT_EQUAL_INT32(2508, BMExxx::compensateTemperature(CAL280, 519888, tFine));
+    TEST_ASSERT_EQUAL_INT32(128422, tFine);
+
+    const auto pressure{BMExxx::compensatePressure(CAL280, 415148, tFine)};
+    TEST_ASSERT_DOUBLE_WITHIN(0.05, 100653.27, pressure / 256.0);
+    TEST_ASSERT_EQUAL_UINT32(100653, (pressure + 128) >> 8);
+
+    const auto ref{reference280(CAL280, 519888, 415148, 0)};
+    TEST_ASSERT_DOUBLE_WITHIN(0.005, 25.08, ref.temperature);
+    TEST_ASSERT_DOUBLE_WITHIN(0.005, 100653.27, ref.pressure);
+}
+
+void test_bme280_against_float()
+{
+    const auto deviation{compare(CAL280, compensate280, reference280)};
+    report("BME280", deviation);
+
+    TEST_ASSERT_GREATER_THAN_UINT32(SAMPLES / 10, deviation.samples);
+    TEST_ASSERT_TRUE(deviation.temperature <= 0.01);
+    TEST_ASSERT_TRUE(deviation.pressure <= 1.0);
+    TEST_ASSERT_TRUE(deviation.humidity <= 0.02);
+}
+
+void test_bme680_against_float()
+{
+    const auto deviation{compare(CAL680, compensate680, reference680)};
+    report("BME680", deviation);
+
+    // The 32 bit pressure of the API drops the low bits of the intermediate values
+    TEST_ASSERT_GREATER_THAN_UINT32(SAMPLES / 10, deviation.samples);
+    TEST_ASSERT_TRUE(deviation.temperature <= 0.01);
+    TEST_ASSERT_TRUE(deviation.pressure <= 8.0);
+    TEST_ASSERT_TRUE(deviation.humidity <= 0.1);
+}
+
+void test_bme680_pressure_no_overflow()
+{
+    // A large P10 at high pressure overflows the int32_t cube of the API
+    auto cal{CAL680};
+    cal.P10 = 255;
+
+    int32_t tFine{};
+    BMExxx::compensateTemperature(cal, 500000, tFine);
+    for (int32_t adcP = 200000; adcP < 600000; adcP += 997)
+    {
+        const auto ref{reference680(cal, 500000, adcP, 0)};
+        if (ref.pressure < 30000.0 || ref.pressure > 110000.0)
+        {
+            continue;
+        }
+        TEST_ASSERT_DOUBLE_WITHIN(8.0, ref.pressure, BMExxx::compensatePressure(cal, adcP, tFine));
+    }
+}
+
+void test_bmexxx_benchmark()
+{
+    benchmark("BME280 integer", CAL280, compensate280);
+    benchmark("BME280 double ", CAL280, reference280);
+    benchmark("BME680 integer", CAL680, compensate680);
+    benchmark("BME680 double ", CAL680, reference680);
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_bme280_datasheet_example);
+    RUN_TEST(test_bme280_against_float);
+    RUN_TEST(test_bme680_against_float);
+    RUN_TEST(test_bme680_pressure_no_overflow);
+    RUN_TEST(test_bmexxx_benchmark);
+    return UNITY_END();
+}
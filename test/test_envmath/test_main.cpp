@@ -0,0 +1,365 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// EnvMath against the float (double) formulas over the whole BMExxx range, with the error bounds documented in
+// EnvMath.h, and the cost of a call fixed point vs float.
+
+#include "EnvMath.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <unity.h>
+
+namespace
+{
+constexpr int32_t  TEMPERATURE_STEP{3}; // [0.01 °C]
+constexpr uint32_t HUMIDITY_STEP{500};  // [0.001 %RH]
+
+////////////////////////////////
+/// References
+////////////////////////////////
+
+/// [Pa], Magnus with the Sensirion coefficients
+double svpOf(double temperature)
+{
+    return 611.2 * std::exp(17.62 * temperature / (243.12 + temperature));
+}
+
+/// [mg/m^3]
+double absoluteHumidityOf(double temperature, double humidity)
+{
+    return 2167.0 * humidity / 100.0 * svpOf(temperature) / (temperature + 273.15);
+}
+
+/// [°C]
+double dewPointOf(double temperature, double humidity)
+{
+    const double gamma{std::log(humidity / 100.0) + 17.62 * temperature / (243.12 + temperature)};
+    return 243.12 * gamma / (17.62 - gamma);
+}
+
+/// [°C], https://www.wpc.ncep.noaa.gov/html/heatindex_equation.shtml
+double heatIndexOf(double temperature, double humidity, bool& nearStep)
+{
+    const double T{temperature * 9.0 / 5.0 + 32.0};
+    const double R{humidity};
+
+    // Fixed and float may land on different sides of the steps of the formula
+    const double simple{0.5 * (T + 61.0 + (T - 68.0) * 1.2 + R * 0.094)};
+    nearStep = std::fabs((simple + T) / 2.0 - 80.0) < 0.05 || std::fabs(R - 13.0) < 0.05 || std::fabs(R - 85.0) < 0.05 ||
+               std::fabs(T - 80.0) < 0.05 || std::fabs(T - 87.0) < 0.05 || std::fabs(T - 112.0) < 0.05;
+    if ((simple + T) / 2.0 < 80.0)
+    {
+        return (simple - 32.0) * 5.0 / 9.0;
+    }
+
+    double index{-42.379 + 2.04901523 * T + 10.14333127 * R - 0.22475541 * T * R - 0.00683783 * T * T - 0.05481717 * R * R +
+                 0.00122874 * T * T * R + 0.00085282 * T * R * R - 0.00000199 * T * T * R * R};
+    if (R < 13.0 && T >= 80.0 && T <= 112.0)
+    {
+        index -= (13.0 - R) / 4.0 * std::sqrt((17.0 - std::fabs(T - 95.0)) / 17.0);
+    }
+    else if (R > 85.0 && T >= 80.0 && T <= 87.0)
+    {
+        index += (R - 85.0) / 10.0 * (87.0 - T) / 5.0;
+    }
+    return (index - 32.0) * 5.0 / 9.0;
+}
+
+////////////////////////////////
+/// Single precision, for the timing only
+////////////////////////////////
+
+// What the firmware computed before (expf() of the old SGP30 compensation), the ESP32 FPU has no double
+
+/// [mg/m^3]
+float absoluteHumidityOfFloat(float temperature, float humidity)
+{
+    return 216.7F * (humidity / 100.0F * 6.112F * expf(17.62F * temperature / (243.12F + temperature)) / (273.15F + temperature)) * 1000.0F;
+}
+
+/// [°C]
+float dewPointOfFloat(float temperature, float humidity)
+{
+    const float gamma{logf(humidity / 100.0F) + 17.62F * temperature / (243.12F + temperature)};
+    return 243.12F * gamma / (17.62F - gamma);
+}
+
+/// [°C]
+float heatIndexOfFloat(float temperature, float humidity)
+{
+    const float T{temperature * 9.0F / 5.0F + 32.0F};
+    const float R{humidity};
+
+    const float simple{0.5F * (T + 61.0F + (T - 68.0F) * 1.2F + R * 0.094F)};
+    if ((simple + T) / 2.0F < 80.0F)
+    {
+        return (simple - 32.0F) * 5.0F / 9.0F;
+    }
+
+    float index{-42.379F + 2.04901523F * T + 10.14333127F * R - 0.22475541F * T * R - 0.00683783F * T * T - 0.05481717F * R * R +
+                0.00122874F * T * T * R + 0.00085282F * T * R * R - 0.00000199F * T * T * R * R};
+    if (R < 13.0F && T >= 80.0F && T <= 112.0F)
+    {
+        index -= (13.0F - R) / 4.0F * sqrtf((17.0F - fabsf(T - 95.0F)) / 17.0F);
+    }
+    else if (R > 85.0F && T >= 80.0F && T <= 87.0F)
+    {
+        index += (R - 85.0F) / 10.0F * (87.0F - T) / 5.0F;
+    }
+    return (index - 32.0F) * 5.0F / 9.0F;
+}
+
+void report(const char* text)
+{
+    TEST_MESSAGE(text);
+}
+
+int64_t nanos()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/// [ns] per call over a sweep of the inputs
+template<typename Function>
+double benchmark(Function function)
+{
+    double     sink{};
+    const auto begin{nanos()};
+    uint32_t   calls{};
+    for (int32_t temperature = EnvMath::TEMPERATURE_MIN; temperature <= EnvMath::TEMPERATURE_MAX; temperature += 7)
+    {
+        for (uint32_t humidity = 1000; humidity <= 100000; humidity += 9900)
+        {
+            sink += function(temperature, humidity);
+            ++calls;
+        }
+    }
+    const auto end{nanos()};
+
+    // Keeps the compiler from dropping the calls
+    TEST_ASSERT_TRUE(sink != 0.0);
+    return static_cast<double>(end - begin) / calls;
+}
+} // namespace
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_envmath_saturation_vapor_pressure()
+{
+    double maxError{};
+    double maxErrorAbove20{};
+    for (int32_t temperature = EnvMath::TEMPERATURE_MIN; temperature <= EnvMath::TEMPERATURE_MAX; temperature += TEMPERATURE_STEP)
+    {
+        const double reference{svpOf(temperature / 100.0)};
+        const double error{std::fabs(EnvMath::saturationVaporPressure(temperature) / 65536.0 - reference) / reference};
+        maxError = std::max(maxError, error);
+        if (temperature >= 2000)
+        {
+            maxErrorAbove20 = std::max(maxErrorAbove20, error);
+        }
+    }
+
+    char text[96];
+    snprintf(text, sizeof(text), "SVP max. error %.3f %%, above 20 °C %.3f %%", maxError * 100, maxErrorAbove20 * 100);
+    report(text);
+    TEST_ASSERT_TRUE(maxError < 0.0013);
+    TEST_ASSERT_TRUE(maxErrorAbove20 < 0.0005);
+
+    // Outside the range the temperature is clamped
+    TEST_ASSERT_EQUAL_UINT32(EnvMath::saturationVaporPressure(EnvMath::TEMPERATURE_MIN), EnvMath::saturationVaporPressure(-6000));
+    TEST_ASSERT_EQUAL_UINT32(EnvMath::saturationVaporPressure(EnvMath::TEMPERATURE_MAX), EnvMath::saturationVaporPressure(12000));
+}
+
+void test_envmath_absolute_humidity()
+{
+    double maxError{};
+    double maxRelativeError{};
+    for (int32_t temperature = EnvMath::TEMPERATURE_MIN; temperature <= EnvMath::TEMPERATURE_MAX; temperature += TEMPERATURE_STEP)
+    {
+        const double svpError{std::fabs(EnvMath::saturationVaporPressure(temperature) / 65536.0 / svpOf(temperature / 100.0) - 1.0)};
+        for (uint32_t humidity = 0; humidity <= 100000; humidity += HUMIDITY_STEP)
+        {
+            const double reference{absoluteHumidityOf(temperature / 100.0, humidity / 1000.0)};
+            const double error{std::fabs(EnvMath::absoluteHumidity(temperature, humidity) - reference)};
+
+            // Same relative error as the SVP, plus the rounding to mg/m^3
+            TEST_ASSERT_TRUE(error <= reference * svpError + 0.5 + 1e-6);
+            maxError         = std::max(maxError, error);
+            maxRelativeError = std::max(maxRelativeError, reference >= 1000.0 ? error / reference : 0.0);
+        }
+    }
+
+    char text[96];
+    snprintf(text, sizeof(text), "absolute humidity max. error %.2f mg/m^3, above 1 g/m^3 %.3f %%", maxError, maxRelativeError * 100);
+    report(text);
+
+    // 25 °C, 50 %RH => 11.48 g/m^3, the SGP30 word 0x0B7C
+    uint16_t word{};
+    TEST_ASSERT_TRUE(EnvMath::toSensirionHumidity(EnvMath::absoluteHumidity(2500, 50000), word));
+    TEST_ASSERT_EQUAL_HEX16(0x0B7C, word);
+    TEST_ASSERT_FALSE(EnvMath::toSensirionHumidity(256000, word));
+}
+
+void test_envmath_dew_point()
+{
+    double maxError{};
+    for (int32_t temperature = EnvMath::TEMPERATURE_MIN; temperature <= EnvMath::TEMPERATURE_MAX; temperature += TEMPERATURE_STEP)
+    {
+        for (uint32_t humidity = HUMIDITY_STEP; humidity <= 100000; humidity += HUMIDITY_STEP)
+        {
+            const double reference{dewPointOf(temperature / 100.0, humidity / 1000.0)};
+            if (reference < EnvMath::TEMPERATURE_MIN / 100.0 + 0.01)
+            {
+                // Below the table, clamped
+                TEST_ASSERT_TRUE(EnvMath::dewPoint(temperature, humidity) <= EnvMath::TEMPERATURE_MIN + 2);
+                continue;
+            }
+            maxError = std::max(maxError, std::fabs(EnvMath::dewPoint(temperature, humidity) / 100.0 - reference));
+        }
+    }
+
+    char text[96];
+    snprintf(text, sizeof(text), "dew point max. error %.3f °C", maxError);
+    report(text);
+    TEST_ASSERT_TRUE(maxError < 0.02);
+
+    TEST_ASSERT_EQUAL_INT32(EnvMath::TEMPERATURE_MIN, EnvMath::dewPoint(2000, 0));
+    TEST_ASSERT_EQUAL_INT32(2000, EnvMath::dewPoint(2000, 100000));
+}
+
+void test_envmath_heat_index()
+{
+    double   maxError{};
+    uint32_t steps{};
+    for (int32_t temperature = EnvMath::TEMPERATURE_MIN; temperature <= EnvMath::TEMPERATURE_MAX; temperature += TEMPERATURE_STEP)
+    {
+        for (uint32_t humidity = 0; humidity <= 100000; humidity += HUMIDITY_STEP)
+        {
+            bool         nearStep{};
+            const double reference{heatIndexOf(temperature / 100.0, humidity / 1000.0, nearStep)};
+            if (reference > 70.0)
+            {
+                continue;
+            }
+
+            const double error{std::fabs(EnvMath::heatIndex(temperature, humidity) / 100.0 - reference)};
+            if (nearStep && error >= 0.07)
+            {
+                ++steps;
+                continue;
+            }
+            maxError = std::max(maxError, error);
+        }
+    }
+
+    char text[96];
+    snprintf(text, sizeof(text), "heat index max. error %.3f °C up to 70 °C (%u samples across a step)", maxError, steps);
+    report(text);
+    TEST_ASSERT_TRUE(maxError < 0.07);
+
+    // NOAA table: 90 °F and 60 %RH => 100 °F
+    TEST_ASSERT_INT32_WITHIN(50, 3778, EnvMath::heatIndex(3222, 60000));
+}
+
+void test_envmath_air_quality()
+{
+    TEST_ASSERT_TRUE(EnvMath::airQuality(400, 0) == EnvMath::AirQuality::Excellent);
+    TEST_ASSERT_TRUE(EnvMath::airQuality(600, 65) == EnvMath::AirQuality::Excellent);
+    TEST_ASSERT_TRUE(EnvMath::airQuality(601, 65) == EnvMath::AirQuality::Good);
+    TEST_ASSERT_TRUE(EnvMath::airQuality(400, 661) == EnvMath::AirQuality::Poor);
+    TEST_ASSERT_TRUE(EnvMath::airQuality(1501, 0) == EnvMath::AirQuality::Unhealthy);
+    TEST_ASSERT_EQUAL_STRING("Moderate", EnvMath::toString(EnvMath::airQuality(1000, 0)));
+}
+
+void test_envmath_benchmark()
+{
+    // Only a sanity check on the host: x86 has hardware double and a fast libm, the gain is on the ESP32 where
+    // expf() / logf() run in software and the fixed point math replaces them
+    struct Case
+    {
+        const char* name;
+        double      fixed;
+        double      reference;
+    };
+
+    const Case cases[]{
+        {"absolute humidity",
+         benchmark([](int32_t t, uint32_t h)
+                   {
+                       return static_cast<double>(EnvMath::absoluteHumidity(t, h));
+                   }),
+         benchmark([](int32_t t, uint32_t h)
+                   {
+                       return absoluteHumidityOfFloat(static_cast<float>(t) / 100.0F, static_cast<float>(h) / 1000.0F);
+                   })},
+        {"dew point",
+         benchmark([](int32_t t, uint32_t h)
+                   {
+                       return static_cast<double>(EnvMath::dewPoint(t, h));
+                   }),
+         benchmark([](int32_t t, uint32_t h)
+                   {
+                       return dewPointOfFloat(static_cast<float>(t) / 100.0F, static_cast<float>(h) / 1000.0F);
+                   })},
+        {"heat index",
+         benchmark([](int32_t t, uint32_t h)
+                   {
+                       return static_cast<double>(EnvMath::heatIndex(t, h));
+                   }),
+         benchmark([](int32_t t, uint32_t h)
+                   {
+                       return heatIndexOfFloat(static_cast<float>(t) / 100.0F, static_cast<float>(h) / 1000.0F);
+                   })},
+    };
+
+    for (const auto& c : cases)
+    {
+        char text[96];
+        snprintf(text, sizeof(text), "%-18s fixed %5.1f ns/call, float %5.1f ns/call (host)", c.name, c.fixed, c.reference);
+        report(text);
+    }
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_envmath_saturation_vapor_pressure);
+    RUN_TEST(test_envmath_absolute_humidity);
+    RUN_TEST(test_envmath_dew_point);
+    RUN_TEST(test_envmath_heat_index);
+    RUN_TEST(test_envmath_air_quality);
+    RUN_TEST(test_envmath_benchmark);
+    return UNITY_END();
+}
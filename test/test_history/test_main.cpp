@@ -0,0 +1,228 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// SensorHistory rollups on the host, and the cost of the tier maintenance per added sample.
+// Run with "pio test -e native -v" to see the numbers.
+
+#include "SensorHistory.h"
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <unity.h>
+#include <vector>
+
+namespace
+{
+constexpr size_t TEMPERATURE{4}; // channel index, see SensorHistory::CHANNELS
+
+SensorData makeData(uint16_t TVOC, float temperature)
+{
+    SensorData data{};
+    data.sgp_iaq              = {true, TVOC, 400};
+    data.sgp_iaqRaw           = {true, 13000, 18000};
+    data.bme_data.isValid     = true;
+    data.bme_data.temperature = temperature;
+    data.bme_data.humidity    = 45.0F;
+    data.bme_data.pressure    = 1013.2F;
+    return data;
+}
+
+std::vector<SensorHistory::Row> readAll(const SensorHistory& history, SensorHistory::Resolution resolution, Timestamp from, Timestamp to)
+{
+    std::vector<SensorHistory::Row>     rows{};
+    std::array<SensorHistory::Row, 16> chunk{};
+    uint32_t                           cursor{};
+    while (const auto count = history.read(resolution, from, to, chunk.data(), chunk.size(), cursor))
+    {
+        rows.insert(rows.end(), chunk.begin(), chunk.begin() + count);
+    }
+    return rows;
+}
+
+int64_t nanos()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+} // namespace
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_history_raw()
+{
+    SensorHistory history{};
+    TEST_ASSERT_TRUE(history.init(16 * 1024));
+
+    for (Timestamp now = 0; now < 5000; now += 100)
+    {
+        history.add(now, makeData(static_cast<uint16_t>(now / 100), 21.5F));
+    }
+
+    const auto rows{readAll(history, SensorHistory::Resolution::Raw, 1000, 1900)};
+    TEST_ASSERT_EQUAL_size_t(10, rows.size());
+    TEST_ASSERT_EQUAL_INT32(1000, rows.front().timestamp);
+    TEST_ASSERT_EQUAL_INT32(10, rows.front().avg[0]);
+    TEST_ASSERT_EQUAL_INT32(2150, rows.front().avg[TEMPERATURE]);
+    TEST_ASSERT_EQUAL_UINT8(0x7F, rows.front().valid);
+}
+
+void test_history_rollup()
+{
+    SensorHistory history{};
+    TEST_ASSERT_TRUE(history.init(16 * 1024));
+
+    // 10 Hz for a bit more than two minutes, the temperature steps up by 0.01 °C every 10 s
+    for (Timestamp now = 0; now <= 130000; now += 100)
+    {
+        history.add(now, makeData(static_cast<uint16_t>(now % 1000), 20.0F + static_cast<float>(now / 10000) / 100.0F));
+    }
+
+    const auto buckets{readAll(history, SensorHistory::Resolution::Seconds10, 0, 200000)};
+    TEST_ASSERT_EQUAL_size_t(13, buckets.size()); // the 14th is still open
+    TEST_ASSERT_EQUAL_INT32(10000, buckets[1].timestamp);
+    TEST_ASSERT_EQUAL_INT32(0, buckets[1].min[0]);
+    TEST_ASSERT_EQUAL_INT32(450, buckets[1].avg[0]);
+    TEST_ASSERT_EQUAL_INT32(900, buckets[1].max[0]);
+    TEST_ASSERT_EQUAL_INT32(2001, buckets[1].avg[TEMPERATURE]);
+
+    // The minute rollups are made from the exact sums, not from the rounded 10 s averages
+    const auto minutes{readAll(history, SensorHistory::Resolution::Minute1, 0, 200000)};
+    TEST_ASSERT_EQUAL_size_t(2, minutes.size());
+    TEST_ASSERT_EQUAL_INT32(60000, minutes[1].timestamp);
+    TEST_ASSERT_EQUAL_INT32(2006, minutes[1].min[TEMPERATURE]);
+    TEST_ASSERT_EQUAL_INT32(2011, minutes[1].max[TEMPERATURE]);
+    TEST_ASSERT_INT32_WITHIN(1, 2009, minutes[1].avg[TEMPERATURE]);
+}
+
+void test_history_invalid()
+{
+    SensorHistory history{};
+    TEST_ASSERT_TRUE(history.init(16 * 1024));
+
+    auto data{makeData(100, 21.0F)};
+    data.bme_data.isValid = false;
+    for (Timestamp now = 0; now <= 10000; now += 1000)
+    {
+        history.add(now, data);
+    }
+
+    const auto buckets{readAll(history, SensorHistory::Resolution::Seconds10, 0, 10000)};
+    TEST_ASSERT_EQUAL_size_t(1, buckets.size());
+    TEST_ASSERT_EQUAL_UINT8(0x0F, buckets[0].valid);
+}
+
+void test_history_overtaken_cursor()
+{
+    SensorHistory history{};
+    TEST_ASSERT_TRUE(history.init(4 * 1024));
+    const auto capacity{history.getCapacity(SensorHistory::Resolution::Raw)};
+
+    Timestamp now{};
+    for (; now < 100; ++now)
+    {
+        history.add(now, makeData(1, 21.0F));
+    }
+
+    std::array<SensorHistory::Row, 4> rows{};
+    uint32_t                          cursor{};
+    TEST_ASSERT_EQUAL_size_t(rows.size(), history.read(SensorHistory::Resolution::Raw, 0, INT32_MAX, rows.data(), rows.size(), cursor));
+
+    // The ring wraps while the reader pauses, it continues at the oldest sample still there
+    for (; now < static_cast<Timestamp>(100 + 2 * capacity); ++now)
+    {
+        history.add(now, makeData(1, 21.0F));
+    }
+    TEST_ASSERT_EQUAL_size_t(1, history.read(SensorHistory::Resolution::Raw, 0, INT32_MAX, rows.data(), 1, cursor));
+    TEST_ASSERT_EQUAL_INT32(now - static_cast<Timestamp>(capacity), rows[0].timestamp);
+}
+
+void test_history_benchmark()
+{
+    SensorHistory history{};
+    TEST_ASSERT_TRUE(history.init(64 * 1024));
+
+    // One day at 10 Hz, every add timed, so the samples that close a 1 h bucket (and cascade) show in the max
+    constexpr Timestamp PERIOD{100};
+    constexpr uint32_t  SAMPLES{24 * 60 * 60 * 1000 / PERIOD};
+
+    std::vector<int32_t> durations{};
+    durations.reserve(SAMPLES);
+
+    int64_t rollups{};
+    for (uint32_t i = 0; i < SAMPLES; ++i)
+    {
+        const auto now{static_cast<Timestamp>(i * PERIOD)};
+        const auto data{makeData(static_cast<uint16_t>(i % 500), 21.0F + static_cast<float>(i % 300) / 100.0F)};
+
+        const auto begin{nanos()};
+        history.add(now, data);
+        durations.push_back(static_cast<int32_t>(nanos() - begin));
+
+        rollups += (now % 10000) == 0 ? 1 : 0;
+    }
+
+    const auto total{std::accumulate(durations.begin(), durations.end(), int64_t{})};
+    std::sort(durations.begin(), durations.end());
+
+    char text[160];
+    snprintf(text, sizeof(text), "add: %.1f ns/sample mean, p50/p99/p99.99/max %d/%d/%d/%d ns, %u samples, %lld 10 s rollups, %zu bytes",
+             static_cast<double>(total) / SAMPLES,
+             durations[SAMPLES / 2],
+             durations[SAMPLES / 100 * 99],
+             durations[SAMPLES / 10000 * 9999],
+             durations.back(),
+             SAMPLES,
+             static_cast<long long>(rollups),
+             history.getMemoryUsage());
+    TEST_MESSAGE(text);
+
+    // Reading a whole tier back, what /history does for the dashboard
+    const auto begin{nanos()};
+    const auto rows{readAll(history, SensorHistory::Resolution::Seconds10, 0, INT32_MAX)};
+    snprintf(text, sizeof(text), "read: %.1f ns/row (%zu rows of 10 s)",
+             static_cast<double>(nanos() - begin) / std::max<size_t>(rows.size(), 1),
+             rows.size());
+    TEST_MESSAGE(text);
+
+    TEST_ASSERT_EQUAL_size_t(history.getCapacity(SensorHistory::Resolution::Seconds10), rows.size());
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_history_raw);
+    RUN_TEST(test_history_rollup);
+    RUN_TEST(test_history_invalid);
+    RUN_TEST(test_history_overtaken_cursor);
+    RUN_TEST(test_history_benchmark);
+    return UNITY_END();
+}
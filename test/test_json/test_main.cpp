@@ -0,0 +1,323 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// JSONWriter output and the SensorData serialization against the stringstream one it replaced.
+// Run with "pio test -e native -v" to see the numbers.
+
+#include "JSONWriter.h"
+#include "SensorData.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unity.h>
+
+////////////////////////////////
+/// Allocation counting
+////////////////////////////////
+
+namespace
+{
+std::atomic<uint32_t> g_allocations{0};
+} // namespace
+
+void* operator new(size_t size)
+{
+    ++g_allocations;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+/// The SensorData serialization before JSONWriter, for the comparison
+void appendLegacy(std::stringstream& ss, const SensorData& data)
+{
+    ss << "\"hAIR\": {";
+    ss << "\"SGP30_IAQ\": {"
+       << " \"TVOC\": " << data.sgp_iaq.TVOC << ","
+       << " \"eCO2\": " << data.sgp_iaq.eCO2 << " "
+       << "}";
+    ss << ", ";
+    ss << "\"SGP30_IAQraw\": {"
+       << " \"rawH2\": " << data.sgp_iaqRaw.rawH2 << ","
+       << " \"rawEthanol\": " << data.sgp_iaqRaw.rawEthanol << " "
+       << "}";
+    ss << ", ";
+    ss << "\"BMExxx_Data\": {"
+       << " \"temperature\": " << data.bme_data.temperature << ","
+       << " \"humidity\": " << data.bme_data.humidity << ","
+       << " \"pressure\": " << data.bme_data.pressure << " "
+       << "}";
+    ss << "}";
+}
+
+String toJSONtxtLegacy(const SensorData& data)
+{
+    std::stringstream ss;
+    ss << '{';
+    appendLegacy(ss, data);
+    ss << '}';
+    return ss.str().c_str();
+}
+
+SensorData makeData()
+{
+    SensorData data{};
+    data.sgp_iaq              = {true, 123, 456};
+    data.sgp_iaqRaw           = {true, 13000, 18500};
+    data.bme_data.isValid     = true;
+    data.bme_data.temperature = 22.37F;
+    data.bme_data.humidity    = 45.2F;
+    data.bme_data.pressure    = 1013.25F;
+    data.updateDerived();
+    return data;
+}
+
+class StringSink : public Print
+{
+public:
+    size_t write(uint8_t c) override
+    {
+        text += static_cast<char>(c);
+        return 1;
+    }
+
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+        text.append(reinterpret_cast<const char*>(buffer), size);
+        ++writes;
+        return size;
+    }
+
+    std::string text{};
+    uint32_t    writes{};
+};
+
+int64_t nanos()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/// [ns] per call and allocations per call
+template<typename Function>
+void measure(const char* name, Function function)
+{
+    constexpr uint32_t CALLS{200000};
+
+    // warm up, so lazily initialized library state is not counted
+    function();
+
+    const auto allocations{g_allocations.load()};
+    const auto begin{nanos()};
+    for (uint32_t i = 0; i < CALLS; ++i)
+    {
+        function();
+    }
+    const auto end{nanos()};
+
+    char text[96];
+    snprintf(text, sizeof(text), "%-24s %7.1f ns/call %5.2f allocations/call",
+             name,
+             static_cast<double>(end - begin) / CALLS,
+             static_cast<double>(g_allocations.load() - allocations) / CALLS);
+    TEST_MESSAGE(text);
+}
+} // namespace
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_json_structure()
+{
+    std::array<char, 128> buffer{};
+    JSONWriter            writer{buffer};
+    writer.beginObject()
+        .member("a", 1)
+        .key("b")
+        .beginArray()
+        .value(true)
+        .null()
+        .beginObject()
+        .endObject()
+        .endArray()
+        .member("c", "x\"y\\z\n")
+        .endObject();
+
+    TEST_ASSERT_EQUAL_STRING("{\"a\":1,\"b\":[true,null,{}],\"c\":\"x\\\"y\\\\z\\n\"}", writer.c_str());
+    TEST_ASSERT_FALSE(writer.overflow());
+}
+
+void test_json_numbers()
+{
+    std::array<char, 128> buffer{};
+    JSONWriter            writer{buffer};
+    writer.beginArray()
+        .value(INT32_MIN)
+        .value(UINT64_MAX)
+        .value(static_cast<uint8_t>(0))
+        .value(1013.25F, 2)
+        .value(-0.5F, 1)
+        .value(2.999F, 2)
+        .value(NAN)
+        .fixed(-2150, 2)
+        .fixed(7, 3)
+        .endArray();
+
+    TEST_ASSERT_EQUAL_STRING("[-2147483648,18446744073709551615,0,1013.25,-0.5,3.00,null,-21.50,0.007]", writer.c_str());
+}
+
+void test_json_overflow()
+{
+    std::array<char, 8> buffer{};
+    JSONWriter          writer{buffer};
+    writer.beginObject().member("temperature", 22).endObject();
+
+    TEST_ASSERT_TRUE(writer.overflow());
+    TEST_ASSERT_LESS_THAN(buffer.size(), writer.length());
+    TEST_ASSERT_EQUAL_UINT8('\0', buffer[writer.length()]);
+}
+
+void test_json_sink()
+{
+    StringSink expected{};
+    StringSink sink{};
+    {
+        std::array<char, 16>  small{};
+        std::array<char, 512> large{};
+        JSONWriter            chunked{small, &sink};
+        JSONWriter            whole{large, &expected};
+        for (auto* writer : {&chunked, &whole})
+        {
+            writer->beginArray();
+            for (int i = 0; i < 50; ++i)
+            {
+                writer->value(i * 1000);
+            }
+            writer->endArray();
+        }
+    }
+
+    TEST_ASSERT_GREATER_THAN(1, sink.writes);
+    TEST_ASSERT_EQUAL_STRING(expected.text.c_str(), sink.text.c_str());
+}
+
+void test_json_sensordata()
+{
+    const auto data{makeData()};
+
+    std::array<char, SensorData::JSON_CAPACITY> buffer{};
+    const auto length{data.toJSONtxt(buffer.data(), buffer.size(), SensorChannel::SGP30_IAQ | SensorChannel::BMExxx_Data)};
+
+    TEST_ASSERT_EQUAL_STRING("{\"hAIR\":{\"SGP30_IAQ\":{\"TVOC\":123,\"eCO2\":456},"
+                             "\"BMExxx_Data\":{\"temperature\":22.37,\"humidity\":45.20,\"pressure\":1013.25}}}",
+                             buffer.data());
+    TEST_ASSERT_EQUAL_size_t(strlen(buffer.data()), length);
+}
+
+void test_json_sensordata_fits()
+{
+    // The largest values of every field, the capacity has to hold them all
+    SensorData data{};
+    data.sgp_iaq              = {true, 60000, 60000};
+    data.sgp_iaqRaw           = {true, 65535, 65535};
+    data.bme_data.temperature = -40.0F;
+    data.bme_data.humidity    = 100.0F;
+    data.bme_data.pressure    = 1100.0F;
+
+    data.derived.dewPoint         = -4000;
+    data.derived.heatIndex        = -4000;
+    data.derived.absoluteHumidity = 655350;
+    data.derived.airQuality       = EnvMath::AirQuality::Excellent;
+
+    std::array<char, SensorData::JSON_CAPACITY> buffer{};
+    JSONWriter                                  writer{buffer};
+    writer.beginObject();
+    data.appendJSONtxt(writer);
+    writer.endObject();
+
+    TEST_ASSERT_FALSE(writer.overflow());
+}
+
+void test_json_benchmark()
+{
+    const auto data{makeData()};
+
+    std::array<char, SensorData::JSON_CAPACITY> buffer{};
+
+    // Same channels as the stringstream version had
+    const auto channels{SensorChannel::SGP30_IAQ | SensorChannel::SGP30_IAQraw | SensorChannel::BMExxx_Data};
+
+    uint32_t allocations{};
+    measure("stringstream -> String", [&data]()
+            {
+                const auto text{toJSONtxtLegacy(data)};
+                return text.length();
+            });
+    measure("JSONWriter", [&data, &buffer, &allocations, channels]()
+            {
+                const auto before{g_allocations.load()};
+                const auto length{data.toJSONtxt(buffer.data(), buffer.size(), channels)};
+                allocations += g_allocations.load() - before;
+                return length;
+            });
+
+    TEST_ASSERT_EQUAL_UINT32(0, allocations);
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_json_structure);
+    RUN_TEST(test_json_numbers);
+    RUN_TEST(test_json_overflow);
+    RUN_TEST(test_json_sink);
+    RUN_TEST(test_json_sensordata);
+    RUN_TEST(test_json_sensordata_fits);
+    RUN_TEST(test_json_benchmark);
+    return UNITY_END();
+}
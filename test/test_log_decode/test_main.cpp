@@ -0,0 +1,377 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Binary log mode against the text log: bytes per record on Serial and the websocket, time per record, and a round trip
+// through LogDecoder (what tools/hAIR_log_decode prints) that has to give back the text of every message.
+// Run with "pio test -e native -v" to see the numbers.
+
+#include "JSONWriter.h"
+#include "LogCapture.h"
+#include "LogDecoder.h"
+#include "LogFormatter.h"
+#include <chrono>
+#include <plog/Init.h>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+namespace
+{
+/// hAIR_Appender::output() and outputBinary() minus the outputs, Serial is collected in a string
+class CaptureSink : public LogSink
+{
+public:
+    explicit CaptureSink(NTPClient& ntpclient)
+        : formatter(ntpclient)
+    {
+    }
+
+    void write(const LogEntry& captured) override
+    {
+        entry = captured;
+        binary ? outputBinary(entry) : outputText(entry);
+    }
+
+    void outputText(const LogEntry& entry)
+    {
+        const auto length{formatter.format(entry, line.data(), line.size())};
+        serial.append(line.data(), length).append("\r\n");
+
+        JSONWriter writer{json};
+        writer.beginObject().member("logMessage", static_cast<const char*>(line.data())).endObject();
+        websocketBytes += writer.length();
+    }
+
+    void outputBinary(const LogEntry& entry)
+    {
+        auto length{LogFormat::putHeader(record.data(), entry.site, entry.millis, entry.severity, entry.tid)};
+        if (entry.site != LogFormat::TEXT_SITE)
+        {
+            memcpy(record.data() + length, entry.message.data(), entry.length);
+            length += entry.length;
+        }
+        else
+        {
+            LogFormat::ArgWriter args{record.data() + length, record.size() - length};
+            args.putString(entry.func.data(), strlen(entry.func.data()));
+            args.putSigned(entry.line);
+            args.putString(entry.message.data(), strlen(entry.message.data()));
+            length += args.length();
+        }
+
+        const auto framedLength{LogFormat::cobsEncode(record.data(), length, framed.data())};
+        serial.append(reinterpret_cast<const char*>(framed.data()), framedLength).push_back('\0');
+        websocketBytes += length;
+    }
+
+    void clear()
+    {
+        serial.clear();
+        websocketBytes = 0;
+    }
+
+    bool        binary{false};
+    std::string serial{};
+    size_t      websocketBytes{};
+    LogEntry    entry{};
+
+private:
+    hAIR_Formatter                                                 formatter;
+    std::array<char, hAIR_Formatter::LINE_CAPACITY>                line{};
+    std::array<char, 2 * hAIR_Formatter::LINE_CAPACITY + 24>       json{};
+    std::array<uint8_t, LogEntry::RECORD_CAPACITY>                 record{};
+    std::array<uint8_t, LogEntry::RECORD_CAPACITY * 255 / 254 + 2> framed{};
+};
+
+NTPClient   g_ntpclient{};
+CaptureSink g_sink{g_ntpclient};
+
+/// The table entry of the PLOG statement at line, the way tools/log_table.py writes it
+std::string tableLine(uint32_t line, const char* format)
+{
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%08x\t%s:%u\t%s", LogFormat::siteId(__FILE__, line), LogFormat::fileName(__FILE__), line, format);
+    return buffer;
+}
+
+/// A mix of the log statements in src/, record i has its own arguments
+/// @param decoder gets the log table entries if set
+void logRecord(uint32_t i, LogDecoder* decoder = nullptr)
+{
+    const std::array<const char*, 3> topics{"sensorData", "taskStats", "logMessages"};
+    switch (i % 4)
+    {
+    case 0:
+        if (decoder != nullptr)
+        {
+            decoder->addTableLine(tableLine(__LINE__ + 2, "InfluxDB: {} batches ({} bytes) left in the outbox"));
+        }
+        PLOGI << "InfluxDB: " << i % 17 << " batches (" << i * 131 << " bytes) left in the outbox";
+        break;
+    case 1:
+        if (decoder != nullptr)
+        {
+            decoder->addTableLine(tableLine(__LINE__ + 2, "Websocket client [{}] subscribed to {}"));
+        }
+        PLOGI << "Websocket client [" << i % 8 << "] subscribed to " << topics[i % topics.size()];
+        break;
+    case 2:
+        if (decoder != nullptr)
+        {
+            decoder->addTableLine(tableLine(__LINE__ + 2, "SGP30: TVOC {} ppb, eCO2 {} ppm at {} C, baseline {}"));
+        }
+        PLOGD << "SGP30: TVOC " << i % 600 << " ppb, eCO2 " << 400 + i % 1000 << " ppm at " << 20.0 + (i % 1000) * 0.01 << " C, baseline " << -static_cast<int32_t>(i);
+        break;
+    default:
+        if (decoder != nullptr)
+        {
+            decoder->addTableLine(tableLine(__LINE__ + 2, "Archive: wrote {} of {} bytes to /archive/0000002a.hsa{}"));
+        }
+        PLOGW << "Archive: wrote " << i % 4096 << " of " << 4096 << " bytes to " << "/archive/0000002a.hsa" << '!';
+        break;
+    }
+}
+
+/// "[millis] [severity] [tid] [location] message" => message
+std::string messageOf(const std::string& line)
+{
+    size_t pos{};
+    for (uint8_t i = 0; i < 4 && pos != std::string::npos; ++i)
+    {
+        pos = line.find("] ", pos == 0 ? 0 : pos + 2);
+    }
+    return pos != std::string::npos ? line.substr(pos + 2) : std::string{};
+}
+
+/// Everything behind the date of a text line
+std::string withoutDate(const std::string& line)
+{
+    return line.substr(DateTimeText::LENGTH + 1);
+}
+
+std::vector<std::string> splitLines(const std::string& text)
+{
+    std::vector<std::string> lines{};
+    size_t                   begin{};
+    for (auto end = text.find("\r\n"); end != std::string::npos; end = text.find("\r\n", begin))
+    {
+        lines.push_back(text.substr(begin, end - begin));
+        begin = end + 2;
+    }
+    return lines;
+}
+
+/// A decoder with the table of logRecord()
+LogDecoder makeDecoder()
+{
+    LogDecoder decoder{};
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        logRecord(i, &decoder);
+    }
+    g_sink.clear();
+    return decoder;
+}
+
+std::vector<std::string> decodeAll(LogDecoder& decoder, const std::string& capture, uint32_t& errors)
+{
+    std::vector<std::string> lines{};
+    for (const auto c : capture)
+    {
+        decoder.put(
+            c,
+            [&lines](const std::string& line)
+            {
+                lines.push_back(line);
+            },
+            [&errors](const char* /*error*/)
+            {
+                ++errors;
+            });
+    }
+    return lines;
+}
+
+int64_t nanos()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+} // namespace
+
+void setUp()
+{
+    g_ntpclient.setEpochTime(1700000000);
+    g_sink.clear();
+    g_sink.binary = false;
+    LogCapture::setBinary(false);
+}
+
+void tearDown()
+{
+}
+
+void test_log_decode_round_trip()
+{
+    constexpr uint32_t RECORDS{1000};
+
+    auto decoder{makeDecoder()};
+
+    // The same records as text and binary
+    for (uint32_t i = 0; i < RECORDS; ++i)
+    {
+        logRecord(i);
+    }
+    const auto text{splitLines(g_sink.serial)};
+
+    g_sink.clear();
+    g_sink.binary = true;
+    LogCapture::setBinary(true);
+    for (uint32_t i = 0; i < RECORDS; ++i)
+    {
+        logRecord(i);
+    }
+
+    uint32_t   errors{};
+    const auto decoded{decodeAll(decoder, g_sink.serial, errors)};
+
+    TEST_ASSERT_EQUAL_UINT32(0, errors);
+    TEST_ASSERT_EQUAL_size_t(RECORDS, text.size());
+    TEST_ASSERT_EQUAL_size_t(RECORDS, decoded.size());
+    for (uint32_t i = 0; i < RECORDS; ++i)
+    {
+        TEST_ASSERT_EQUAL_STRING(messageOf(withoutDate(text[i])).c_str(), messageOf(decoded[i]).c_str());
+    }
+
+    // Severity and thread as in the text log, the location is the file instead of the function
+    // (the millis are those of the second run, which may have crossed a millisecond)
+    const auto& line{decoded.back()};
+    TEST_ASSERT_EQUAL_STRING(withoutDate(text.back()).substr(12, 10).c_str(), line.substr(12, 10).c_str());
+    TEST_ASSERT_UINT32_WITHIN(1000, std::stoul(withoutDate(text.back()).substr(1, 10)), std::stoul(line.substr(1, 10)));
+    TEST_ASSERT_TRUE(line.find("[test_main.cpp:") != std::string::npos);
+}
+
+void test_log_decode_text_record()
+{
+    // Records that bypassed the macros (e.g. the drain's "records dropped" warning) carry their text
+    LogEntry entry{};
+    entry.severity = static_cast<uint8_t>(plog::warning);
+    entry.millis   = 1234;
+    entry.tid      = 7;
+    entry.line     = 42;
+    snprintf(entry.func.data(), entry.func.size(), "hAIR_Appender::drain");
+    snprintf(entry.message.data(), entry.message.size(), "3 log records dropped, the log queue was full");
+    g_sink.outputBinary(entry);
+
+    LogDecoder decoder{};
+    uint32_t   errors{};
+    const auto decoded{decodeAll(decoder, std::string(1, '\0') + g_sink.serial, errors)};
+
+    TEST_ASSERT_EQUAL_UINT32(0, errors);
+    TEST_ASSERT_EQUAL_size_t(1, decoded.size());
+    TEST_ASSERT_EQUAL_STRING("[      1234] [WARN ] [7] [hAIR_Appender::drain@42] 3 log records dropped, the log queue was full", decoded[0].c_str());
+}
+
+void test_log_decode_broken_capture()
+{
+    auto decoder{makeDecoder()};
+
+    g_sink.binary = true;
+    LogCapture::setBinary(true);
+    for (uint32_t i = 0; i < 20; ++i)
+    {
+        logRecord(i);
+    }
+
+    // The capture starts in the middle of the first record and a byte of the 10th frame was lost
+    auto   capture{g_sink.serial.substr(5)};
+    size_t frame10{};
+    for (uint8_t i = 0; i < 9; ++i)
+    {
+        frame10 = capture.find('\0', frame10) + 1;
+    }
+    capture.erase(frame10 + 1, 1);
+
+    uint32_t   errors{};
+    const auto decoded{decodeAll(decoder, capture, errors)};
+
+    // The cut first record is skipped silently, the damaged one is reported, all others come through
+    TEST_ASSERT_EQUAL_UINT32(1, errors);
+    TEST_ASSERT_EQUAL_size_t(18, decoded.size());
+}
+
+void test_log_decode_size()
+{
+    constexpr uint32_t RECORDS{20000};
+
+    // Same records as text and binary, bytes and time per record
+    std::array<size_t, 2>  serialBytes{};
+    std::array<size_t, 2>  websocketBytes{};
+    std::array<int64_t, 2> durations{};
+    for (uint8_t binary = 0; binary < 2; ++binary)
+    {
+        g_sink.clear();
+        g_sink.binary = binary != 0;
+        LogCapture::setBinary(binary != 0);
+
+        const auto begin{nanos()};
+        for (uint32_t i = 0; i < RECORDS; ++i)
+        {
+            logRecord(i);
+        }
+        durations[binary]      = nanos() - begin;
+        serialBytes[binary]    = g_sink.serial.size();
+        websocketBytes[binary] = g_sink.websocketBytes;
+
+        // Keep the capture in memory short
+        g_sink.clear();
+    }
+
+    char text[200];
+    snprintf(text, sizeof(text), "text:   %5.1f bytes/record on Serial, %5.1f on the websocket, %6.1f ns/record",
+             static_cast<double>(serialBytes[0]) / RECORDS, static_cast<double>(websocketBytes[0]) / RECORDS, static_cast<double>(durations[0]) / RECORDS);
+    TEST_MESSAGE(text);
+    snprintf(text, sizeof(text), "binary: %5.1f bytes/record on Serial, %5.1f on the websocket, %6.1f ns/record",
+             static_cast<double>(serialBytes[1]) / RECORDS, static_cast<double>(websocketBytes[1]) / RECORDS, static_cast<double>(durations[1]) / RECORDS);
+    TEST_MESSAGE(text);
+
+    TEST_ASSERT_LESS_THAN_UINT32(serialBytes[0] / 3, serialBytes[1]);
+    TEST_ASSERT_LESS_THAN_UINT32(websocketBytes[0] / 3, websocketBytes[1]);
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    // No appender, plog only does the severity check, the records go to the LogSink
+    plog::init(plog::verbose);
+    LogCapture::setSink(&g_sink);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_log_decode_round_trip);
+    RUN_TEST(test_log_decode_text_record);
+    RUN_TEST(test_log_decode_broken_capture);
+    RUN_TEST(test_log_decode_size);
+    return UNITY_END();
+}
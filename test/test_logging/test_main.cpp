@@ -0,0 +1,368 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The log path from the PLOG call site to the formatted line and websocket message, against the plog::Record /
+// nostringstream path it replaced: same output, ns/record and allocations/record.
+// Run with "pio test -e native -v" to see the numbers.
+
+#include "JSONWriter.h"
+#include "LogCapture.h"
+#include "LogFormatter.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <new>
+#include <plog/Init.h>
+#include <string>
+#include <unity.h>
+
+////////////////////////////////
+/// Allocation counting
+////////////////////////////////
+
+namespace
+{
+std::atomic<uint32_t> g_allocations{0};
+} // namespace
+
+void* operator new(size_t size)
+{
+    ++g_allocations;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+
+// The PLOG macro before LogCapture, a plog::Record handed to the appenders
+#define LEGACY_PLOGI (*plog::get()) += plog::Record(plog::info, PLOG_GET_FUNC(), __LINE__, PLOG_GET_FILE(), PLOG_GET_THIS(), 0).ref()
+
+namespace
+{
+constexpr uint32_t EPOCH{1700000000}; // 2023-11-14T22:13:20Z
+
+////////////////////////////////
+/// The path before LogCapture
+////////////////////////////////
+
+constexpr bool isLeapYear(unsigned long year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+/// getFormattedDate() before DateTimeText
+String getFormattedDateLegacy(unsigned long secs)
+{
+    unsigned long        rawTime     = secs / 86400L; // in days
+    unsigned long        days        = 0;
+    unsigned long        year        = 1970;
+    uint8_t              month       = 0;
+    static const uint8_t monthDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+    while ((days += (isLeapYear(year) ? 366 : 365)) <= rawTime)
+    {
+        year++;
+    }
+    rawTime -= days - (isLeapYear(year) ? 366 : 365); // now it is days in this year, starting at 0
+    days = 0;
+    for (month = 0; month < 12; month++)
+    {
+        uint8_t monthLength;
+        if (month == 1)
+        { // february
+            monthLength = isLeapYear(year) ? 29 : 28;
+        }
+        else
+        {
+            monthLength = monthDays[month];
+        }
+        if (rawTime < monthLength)
+        {
+            break;
+        }
+        rawTime -= monthLength;
+    }
+    String monthStr = ++month < 10 ? "0" + String(month) : String(month);       // jan is month 1
+    String dayStr   = ++rawTime < 10 ? "0" + String(rawTime) : String(rawTime); // day of month
+    return String(year) + "-" + monthStr + "-" + dayStr + "T" + getFormattedTime(secs ? secs : 0) + "Z";
+}
+
+/// hAIR_Formatter::format() before LineWriter
+plog::util::nstring formatLegacy(NTPClient& ntpclient, const LogEntry& entry)
+{
+    const auto  now{millis()};
+    const auto  dateTime{getFormattedDateLegacy(ntpclient.getEpochTime() - (now - entry.millis) / 1000)};
+    const auto* severity{severityToString(plog::Severity(entry.severity))};
+
+    plog::util::nostringstream ss;
+    ss << dateTime.c_str() << PLOG_NSTR(' ')
+       << PLOG_NSTR('[') << std::setfill(PLOG_NSTR(' ')) << std::setw(10) << std::right << entry.millis << PLOG_NSTR("] ")
+       << PLOG_NSTR('[') << std::setfill(PLOG_NSTR(' ')) << std::setw(5) << std::left << severity << PLOG_NSTR("] ")
+       << PLOG_NSTR('[') << entry.tid << PLOG_NSTR("] ")
+       << PLOG_NSTR('[') << entry.func.data() << PLOG_NSTR('@') << entry.line << PLOG_NSTR("] ")
+       << entry.message.data();
+    return ss.str();
+}
+
+template<size_t N>
+void copyTruncated(std::array<char, N>& out, const char* str)
+{
+    size_t len{};
+    while (len < N - 1 && str[len] != '\0')
+    {
+        out[len] = str[len];
+        ++len;
+    }
+    out[len] = '\0';
+}
+
+/// hAIR_Appender before LogCapture: write() copied the record into a LogEntry, the drain formatted it and built the websocket message
+class LegacyAppender : public plog::IAppender
+{
+public:
+    explicit LegacyAppender(NTPClient& ntpclient)
+        : ntpclient(ntpclient)
+    {
+    }
+
+    void write(const plog::Record& record) override
+    {
+        entry.severity = static_cast<uint8_t>(record.getSeverity());
+        entry.tid      = record.getTid();
+        entry.millis   = millis();
+        entry.line     = static_cast<int32_t>(record.getLine());
+        copyTruncated(entry.func, record.getFunc());
+        copyTruncated(entry.message, record.getMessage());
+
+        line = formatLegacy(ntpclient, entry);
+
+        plog::util::nostringstream ss;
+        ss << "{\"logMessage\":\""
+           << line
+           << "\"}";
+        json = ss.str();
+    }
+
+    NTPClient&          ntpclient;
+    LogEntry            entry{};
+    plog::util::nstring line{};
+    plog::util::nstring json{};
+};
+
+////////////////////////////////
+/// The current path
+////////////////////////////////
+
+/// hAIR_Appender as it is now, minus the outputs: the entry is copied like into the LogQueue, the drain formats it
+class Sink : public LogSink
+{
+public:
+    explicit Sink(NTPClient& ntpclient)
+        : formatter(ntpclient)
+    {
+    }
+
+    void write(const LogEntry& captured) override
+    {
+        entry  = captured;
+        length = formatter.format(entry, line.data(), line.size());
+
+        JSONWriter writer{json};
+        writer.beginObject().member("logMessage", static_cast<const char*>(line.data())).endObject();
+        jsonLength = writer.length();
+    }
+
+    hAIR_Formatter                                           formatter;
+    LogEntry                                                 entry{};
+    std::array<char, hAIR_Formatter::LINE_CAPACITY>          line{};
+    std::array<char, 2 * hAIR_Formatter::LINE_CAPACITY + 24> json{};
+    size_t                                                   length{};
+    size_t                                                   jsonLength{};
+};
+
+NTPClient      g_ntpclient{};
+LegacyAppender g_legacy{g_ntpclient};
+Sink           g_sink{g_ntpclient};
+
+int64_t nanos()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/// [ns] per record and allocations per record
+template<typename Function>
+uint32_t measure(const char* name, Function function)
+{
+    constexpr uint32_t CALLS{100000};
+
+    // warm up, so lazily initialized library state is not counted
+    function();
+
+    const auto allocations{g_allocations.load()};
+    const auto begin{nanos()};
+    for (uint32_t i = 0; i < CALLS; ++i)
+    {
+        function();
+    }
+    const auto end{nanos()};
+    const auto allocated{g_allocations.load() - allocations};
+
+    char text[96];
+    snprintf(text, sizeof(text), "%-24s %7.1f ns/record %5.2f allocations/record",
+             name,
+             static_cast<double>(end - begin) / CALLS,
+             static_cast<double>(allocated) / CALLS);
+    TEST_MESSAGE(text);
+    return allocated;
+}
+} // namespace
+
+void setUp()
+{
+    g_ntpclient.setEpochTime(EPOCH);
+}
+
+void tearDown()
+{
+}
+
+void test_logging_format()
+{
+    LogEntry entry{};
+    entry.severity = static_cast<uint8_t>(plog::info);
+    entry.tid      = 7;
+    entry.millis   = static_cast<uint32_t>(millis());
+    entry.line     = 315;
+    copyTruncated(entry.func, "hAIR_System::job_sda_publish");
+    copyTruncated(entry.message, "published 3 channels");
+
+    std::array<char, hAIR_Formatter::LINE_CAPACITY> line{};
+    hAIR_Formatter                                  formatter{g_ntpclient};
+    const auto                                      length{formatter.format(entry, line.data(), line.size())};
+
+    std::array<char, 128> expected{};
+    snprintf(expected.data(), expected.size(), "2023-11-14T22:13:20Z [%10u] [INFO ] [7] [hAIR_System::job_sda_publish@315] published 3 channels", entry.millis);
+    TEST_ASSERT_EQUAL_STRING(expected.data(), line.data());
+    TEST_ASSERT_EQUAL_size_t(strlen(expected.data()), length);
+
+    // Same line as before
+    TEST_ASSERT_EQUAL_STRING(formatLegacy(g_ntpclient, entry).c_str(), line.data());
+}
+
+void test_logging_capture()
+{
+    const char*   path{"/archive/0000002a.hsa"};
+    const int32_t written{-1};
+    const size_t  pending{4096};
+
+    LEGACY_PLOGI << "Archive: wrote " << written << " of " << pending << " bytes to " << path << ' ' << true;
+    PLOGI << "Archive: wrote " << written << " of " << pending << " bytes to " << path << ' ' << true;
+
+    TEST_ASSERT_EQUAL_STRING("Archive: wrote -1 of 4096 bytes to /archive/0000002a.hsa 1", g_sink.entry.message.data());
+    TEST_ASSERT_EQUAL_STRING(g_legacy.entry.message.data(), g_sink.entry.message.data());
+    TEST_ASSERT_EQUAL_STRING("test_logging_capture", g_sink.entry.func.data());
+    TEST_ASSERT_EQUAL_STRING(g_legacy.entry.func.data(), g_sink.entry.func.data());
+
+    TEST_ASSERT_EQUAL_INT32(g_legacy.entry.line + 1, g_sink.entry.line);
+
+    const std::string json{std::string{"{\"logMessage\":\""} + g_sink.line.data() + "\"}"};
+    TEST_ASSERT_EQUAL_STRING(json.c_str(), g_sink.json.data());
+}
+
+void test_logging_date()
+{
+    // One time of day per day from 1970 to 2100, the day is computed anew for each
+    DateTimeText text{};
+    for (uint32_t day = 0; day < 47482; ++day)
+    {
+        const auto secs{day * 86400U + (day * 7919U) % 86400U};
+        const auto time{static_cast<time_t>(secs)};
+        std::tm    tm{};
+        gmtime_r(&time, &tm);
+
+        std::array<char, DateTimeText::LENGTH + 1> expected{};
+        strftime(expected.data(), expected.size(), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        TEST_ASSERT_EQUAL_STRING(expected.data(), text.format(secs));
+    }
+
+    // Second by second across a day and a year change, the cached date has to follow
+    for (uint32_t secs = 1704067200 - 100; secs < 1704067200 + 100; ++secs)
+    {
+        TEST_ASSERT_EQUAL_STRING(getFormattedDateLegacy(secs).c_str(), text.format(secs));
+    }
+}
+
+void test_logging_benchmark()
+{
+    const char*   path{"/archive/0000002a.hsa"};
+    const int32_t written{1984};
+    const size_t  pending{4096};
+
+    // The epoch moves with every record, so the date cache has to follow
+    uint32_t epoch{EPOCH};
+    measure("plog::Record + sstream",
+            [&]()
+            {
+                g_ntpclient.setEpochTime(++epoch);
+                LEGACY_PLOGI << "Archive: wrote " << written << " of " << pending << " bytes to " << path;
+            });
+    const auto allocations{measure("LogCapture + LineWriter",
+                                   [&]()
+                                   {
+                                       g_ntpclient.setEpochTime(++epoch);
+                                       PLOGI << "Archive: wrote " << written << " of " << pending << " bytes to " << path;
+                                   })};
+
+    TEST_ASSERT_EQUAL_UINT32(0, allocations);
+    TEST_ASSERT_EQUAL_STRING(g_legacy.entry.message.data(), g_sink.entry.message.data());
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    plog::init(plog::verbose, &g_legacy);
+    LogCapture::setSink(&g_sink);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_logging_format);
+    RUN_TEST(test_logging_capture);
+    RUN_TEST(test_logging_date);
+    RUN_TEST(test_logging_benchmark);
+    return UNITY_END();
+}
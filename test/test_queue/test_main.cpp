@@ -0,0 +1,360 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// MPMCQueue under a producer flood: drop accounting for both policies while producers and the consumer race,
+// per producer FIFO order, and the push latency with an empty against a full queue.
+// Run with "pio test -e native -v" to see the numbers, the max values under contention are mostly preemption
+// (a time slice on a single core host).
+
+#include "MPMCQueue.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+namespace
+{
+constexpr size_t   PRODUCERS{4};
+constexpr uint32_t PUSHES{50000}; // per producer
+
+/// About the size of a LogEntry
+struct Item
+{
+    uint32_t              producer;
+    uint32_t              sequence;
+    std::array<char, 120> text;
+};
+
+using Queue  = MPMCQueue<Item, 32>;
+using Policy = Queue::Policy;
+
+int64_t nanos()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+int32_t percentile(std::vector<int32_t>& values, uint32_t p)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    const auto index{std::min(values.size() - 1, values.size() * p / 100)};
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+struct Flood
+{
+    uint32_t pushed{};
+    uint32_t failed{};
+    uint32_t consumed{};
+    uint32_t remaining{}; // still queued after the producers were done and the consumer stopped
+    uint32_t dropped{};
+
+    std::array<std::vector<bool>, PRODUCERS>     accepted{}; // push() result per sequence
+    std::array<std::vector<uint32_t>, PRODUCERS> seen{};     // sequences in the order they were popped
+    std::vector<int32_t>                         latencies{}; // [ns] per push
+};
+
+/// PRODUCERS threads push as fast as they can, optionally against one consumer
+Flood flood(Policy policy, bool withConsumer)
+{
+    Queue queue{};
+    queue.setPolicy(policy);
+
+    Flood                                       result{};
+    std::array<std::vector<int32_t>, PRODUCERS> latencies{};
+    std::atomic<bool>                           go{false};
+    std::atomic<size_t>                         running{PRODUCERS};
+
+    auto pop = [&queue, &result]()
+    {
+        Item item{};
+        if (!queue.pop(item))
+        {
+            return false;
+        }
+        result.seen[item.producer].push_back(item.sequence);
+        return true;
+    };
+
+    std::vector<std::thread> producers{};
+    for (size_t p = 0; p < PRODUCERS; ++p)
+    {
+        result.accepted[p].resize(PUSHES);
+        latencies[p].reserve(PUSHES);
+        producers.emplace_back(
+            [&, p]()
+            {
+                while (!go.load())
+                {
+                    std::this_thread::yield();
+                }
+                for (uint32_t i = 0; i < PUSHES; ++i)
+                {
+                    const auto begin{nanos()};
+                    result.accepted[p][i] = queue.push(
+                        [p, i](Item& item)
+                        {
+                            item.producer = static_cast<uint32_t>(p);
+                            item.sequence = i;
+                            item.text[0]  = 'x';
+                        });
+                    latencies[p].push_back(static_cast<int32_t>(nanos() - begin));
+                }
+                --running;
+            });
+    }
+
+    std::thread consumer{};
+    if (withConsumer)
+    {
+        consumer = std::thread(
+            [&]()
+            {
+                while (running.load() > 0)
+                {
+                    result.consumed += pop() ? 1 : 0;
+                }
+            });
+    }
+
+    go = true;
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    if (consumer.joinable())
+    {
+        consumer.join();
+    }
+
+    while (pop())
+    {
+        ++result.remaining;
+    }
+
+    for (size_t p = 0; p < PRODUCERS; ++p)
+    {
+        const auto pushed{static_cast<uint32_t>(std::count(result.accepted[p].begin(), result.accepted[p].end(), true))};
+        result.pushed += pushed;
+        result.failed += PUSHES - pushed;
+        result.latencies.insert(result.latencies.end(), latencies[p].begin(), latencies[p].end());
+    }
+    result.dropped = queue.getDropped();
+    return result;
+}
+
+/// Every element is either consumed, still queued or counted as dropped, exactly once
+void checkAccounting(const Flood& result)
+{
+    TEST_ASSERT_EQUAL_UINT32(PRODUCERS * PUSHES, result.pushed + result.failed);
+    TEST_ASSERT_EQUAL_UINT32(PRODUCERS * PUSHES, result.consumed + result.remaining + result.dropped);
+}
+
+/// Per producer, the popped elements are accepted ones, in the order they were pushed
+void checkOrder(const Flood& result)
+{
+    for (size_t p = 0; p < PRODUCERS; ++p)
+    {
+        const auto& seen{result.seen[p]};
+        for (size_t i = 0; i < seen.size(); ++i)
+        {
+            TEST_ASSERT_TRUE(result.accepted[p][seen[i]]);
+            TEST_ASSERT_TRUE(i == 0 || seen[i - 1] < seen[i]);
+        }
+    }
+}
+
+/// Accepted sequences of a producer from first on
+std::vector<uint32_t> acceptedFrom(const Flood& result, size_t p, uint32_t first)
+{
+    std::vector<uint32_t> sequences{};
+    for (auto i = first; i < PUSHES; ++i)
+    {
+        if (result.accepted[p][i])
+        {
+            sequences.push_back(i);
+        }
+    }
+    return sequences;
+}
+
+void report(const char* name, Flood& result)
+{
+    char text[200];
+    snprintf(text, sizeof(text), "%-24s push p50/p99/max %4d/%6d/%8d ns  consumed %6u dropped %6u failed %6u",
+             name,
+             percentile(result.latencies, 50), percentile(result.latencies, 99), percentile(result.latencies, 100),
+             result.consumed, result.dropped, result.failed);
+    TEST_MESSAGE(text);
+}
+} // namespace
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_queue_drop_newest_contention()
+{
+    auto result{flood(Policy::DropNewest, true)};
+    report("DropNewest + consumer", result);
+
+    checkAccounting(result);
+    checkOrder(result);
+
+    // Only the new elements are dropped
+    TEST_ASSERT_EQUAL_UINT32(result.failed, result.dropped);
+}
+
+void test_queue_drop_oldest_contention()
+{
+    auto result{flood(Policy::DropOldest, true)};
+    report("DropOldest + consumer", result);
+
+    checkAccounting(result);
+    checkOrder(result);
+
+    // A push only fails while the oldest slot is held by a preempted producer or consumer, it gives up instead of waiting.
+    // Those failures are counted like the discarded old elements.
+    TEST_ASSERT_TRUE(result.failed <= result.dropped);
+}
+
+void test_queue_drop_newest_flood()
+{
+    auto result{flood(Policy::DropNewest, false)};
+    report("DropNewest, no consumer", result);
+
+    checkAccounting(result);
+    checkOrder(result);
+
+    // The first elements stay, which is a prefix per producer
+    TEST_ASSERT_EQUAL_UINT32(Queue::capacity(), result.remaining);
+    TEST_ASSERT_EQUAL_UINT32(Queue::capacity(), result.pushed);
+    for (size_t p = 0; p < PRODUCERS; ++p)
+    {
+        const auto& seen{result.seen[p]};
+        for (uint32_t i = 0; i < seen.size(); ++i)
+        {
+            TEST_ASSERT_EQUAL_UINT32(i, seen[i]);
+        }
+    }
+}
+
+void test_queue_drop_oldest_flood()
+{
+    auto result{flood(Policy::DropOldest, false)};
+    report("DropOldest, no consumer", result);
+
+    checkAccounting(result);
+    checkOrder(result);
+
+    // The most recent elements stay, which is the tail of the accepted ones per producer
+    TEST_ASSERT_EQUAL_UINT32(Queue::capacity(), result.remaining);
+    for (size_t p = 0; p < PRODUCERS; ++p)
+    {
+        const auto& seen{result.seen[p]};
+        if (!seen.empty())
+        {
+            TEST_ASSERT_TRUE(seen == acceptedFrom(result, p, seen.front()));
+        }
+    }
+}
+
+void test_queue_push_latency()
+{
+    // Single threaded, so the numbers are the cost of push() and not the scheduling of the host
+    constexpr uint32_t SAMPLES{200000};
+
+    auto measure = [](Policy policy, bool full)
+    {
+        Queue queue{};
+        queue.setPolicy(policy);
+
+        auto push = [&queue](uint32_t i)
+        {
+            return queue.push(
+                [i](Item& item)
+                {
+                    item.sequence = i;
+                });
+        };
+
+        Item                 item{};
+        std::vector<int32_t> latencies{};
+        latencies.reserve(SAMPLES);
+        for (uint32_t i = 0; i < Queue::capacity() && full; ++i)
+        {
+            push(i);
+        }
+        for (uint32_t i = 0; i < SAMPLES; ++i)
+        {
+            const auto begin{nanos()};
+            push(i);
+            latencies.push_back(static_cast<int32_t>(nanos() - begin));
+            if (!full)
+            {
+                queue.pop(item);
+            }
+        }
+        return latencies;
+    };
+
+    auto empty{measure(Policy::DropNewest, false)};
+    auto fullNewest{measure(Policy::DropNewest, true)};
+    auto fullOldest{measure(Policy::DropOldest, true)};
+
+    char text[160];
+    snprintf(text, sizeof(text), "push p50/p99 [ns]: empty %d/%d, full DropNewest %d/%d, full DropOldest %d/%d",
+             percentile(empty, 50), percentile(empty, 99),
+             percentile(fullNewest, 50), percentile(fullNewest, 99),
+             percentile(fullOldest, 50), percentile(fullOldest, 99));
+    TEST_MESSAGE(text);
+
+    // A full queue costs at most the discard on top, no retry loops, no waiting (the clock itself is a good part of it)
+    TEST_ASSERT_LESS_OR_EQUAL_INT32(2 * percentile(empty, 50) + 50, percentile(fullNewest, 50));
+    TEST_ASSERT_LESS_OR_EQUAL_INT32(2 * percentile(empty, 50) + 50, percentile(fullOldest, 50));
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_queue_drop_newest_contention);
+    RUN_TEST(test_queue_drop_oldest_contention);
+    RUN_TEST(test_queue_drop_newest_flood);
+    RUN_TEST(test_queue_drop_oldest_flood);
+    RUN_TEST(test_queue_push_latency);
+    return UNITY_END();
+}
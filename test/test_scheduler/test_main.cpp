@@ -0,0 +1,401 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Scheduler on a virtual clock: deadline ordering, phase locking and skipping of missed periods.
+// The clock only moves when the scheduler sleeps or a job "works", so every time below is exact.
+
+#include "Scheduler.h"
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <unity.h>
+#include <vector>
+
+namespace
+{
+constexpr int64_t MS{1000}; // [us]
+
+class VirtualClock : public SchedulerClock
+{
+public:
+    /// @param start [us]
+    explicit VirtualClock(int64_t start = 0)
+        : m_now(start)
+    {
+    }
+
+    void attach() override
+    {
+    }
+
+    int64_t now() override
+    {
+        return m_now;
+    }
+
+    void sleepUntil(int64_t deadline) override
+    {
+        if (m_event && !m_woken && m_eventTime <= deadline)
+        {
+            // The event (a notify() from "another thread") ends the sleep
+            m_now = std::max(m_now, m_eventTime);
+            auto event{std::move(m_event)};
+            m_event = {};
+            event();
+        }
+        else if (!m_woken && deadline > m_now)
+        {
+            m_now = deadline;
+        }
+        m_woken = false;
+    }
+
+    void wake() override
+    {
+        m_woken = true;
+    }
+
+    /// A job that takes time
+    void work(int64_t duration)
+    {
+        m_now += duration;
+    }
+
+    /// Calls event at time [us] while the scheduler sleeps
+    void at(int64_t time, std::function<void()> event)
+    {
+        m_eventTime = time;
+        m_event     = std::move(event);
+    }
+
+private:
+    int64_t               m_now{};
+    bool                  m_woken{};
+    int64_t               m_eventTime{};
+    std::function<void()> m_event{};
+};
+
+struct Run
+{
+    const char* name;
+    int64_t     start; // [us]
+};
+
+/// Passes up to and including the one at end [us]
+void runUntil(Scheduler& scheduler, VirtualClock& clock, int64_t end)
+{
+    while (clock.now() <= end)
+    {
+        scheduler.runOnce();
+    }
+}
+
+std::vector<int64_t> startsOf(const std::vector<Run>& runs, const char* name)
+{
+    std::vector<int64_t> starts{};
+    for (const auto& run : runs)
+    {
+        if (run.name == name)
+        {
+            starts.push_back(run.start);
+        }
+    }
+    return starts;
+}
+} // namespace
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_scheduler_deadline_order()
+{
+    VirtualClock     clock{};
+    Scheduler        scheduler{"test", clock};
+    std::vector<Run> runs{};
+
+    std::array<TaskItem, 3>    tasks{};
+    std::array<const char*, 3> names{"10ms", "25ms", "100ms"};
+    std::array<int32_t, 3>     periods{10, 25, 100};
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        tasks[i].setDelayTime(periods[i]);
+        scheduler.add(names[i],
+                      tasks[i],
+                      [&runs, &clock, name = names[i]](Timestamp /*now*/)
+                      {
+                          runs.push_back({name, clock.now()});
+                      });
+    }
+
+    // A disabled task never runs
+    TaskItem disabled{};
+    disabled.setDelayTime(0);
+    scheduler.add("disabled",
+                  disabled,
+                  [&runs, &clock](Timestamp /*now*/)
+                  {
+                      runs.push_back({"disabled", clock.now()});
+                  });
+
+    scheduler.start();
+    runUntil(scheduler, clock, 200 * MS);
+
+    // Every run in deadline order, each one on time
+    for (size_t i = 1; i < runs.size(); ++i)
+    {
+        TEST_ASSERT_TRUE(runs[i - 1].start <= runs[i].start);
+    }
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        const auto starts{startsOf(runs, names[i])};
+        TEST_ASSERT_EQUAL_size_t(200 / periods[i], starts.size());
+        for (size_t k = 0; k < starts.size(); ++k)
+        {
+            TEST_ASSERT_EQUAL_INT64(static_cast<int64_t>(k + 1) * periods[i] * MS, starts[k]);
+        }
+        TEST_ASSERT_EQUAL_UINT32(0, tasks[i].getStats().lateness.max());
+        TEST_ASSERT_EQUAL_UINT32(0, tasks[i].getStats().skipped);
+    }
+    TEST_ASSERT_EQUAL_size_t(0, startsOf(runs, "disabled").size());
+}
+
+void test_scheduler_phase_lock()
+{
+    VirtualClock     clock{};
+    Scheduler        scheduler{"test", clock};
+    std::vector<Run> runs{};
+
+    // The job takes 3 ms, every 5th run 8 ms, the 10 ms grid stays where it is
+    TaskItem task{};
+    task.setDelayTime(10);
+    scheduler.add("job",
+                  task,
+                  [&runs, &clock](Timestamp /*now*/)
+                  {
+                      runs.push_back({"job", clock.now()});
+                      clock.work(runs.size() % 5 == 0 ? 8 * MS : 3 * MS);
+                  });
+
+    // Due at the same time as the job and runs behind it, so it is late by the job duration, but without drift
+    TaskItem other{};
+    other.setDelayTime(20);
+    scheduler.add("other",
+                  other,
+                  [&runs, &clock](Timestamp /*now*/)
+                  {
+                      runs.push_back({"other", clock.now()});
+                      clock.work(1 * MS);
+                  });
+
+    scheduler.start();
+    runUntil(scheduler, clock, 1000 * MS);
+
+    const auto starts{startsOf(runs, "job")};
+    TEST_ASSERT_TRUE(starts.size() >= 99);
+    for (size_t k = 0; k < starts.size(); ++k)
+    {
+        const auto deadline{static_cast<int64_t>(k + 1) * 10 * MS};
+        TEST_ASSERT_TRUE(starts[k] >= deadline && starts[k] <= deadline + 1 * MS);
+    }
+
+    const auto otherStarts{startsOf(runs, "other")};
+    TEST_ASSERT_TRUE(otherStarts.size() >= 49);
+    for (size_t k = 0; k < otherStarts.size(); ++k)
+    {
+        const auto deadline{static_cast<int64_t>(k + 1) * 20 * MS};
+        TEST_ASSERT_TRUE(otherStarts[k] >= deadline && otherStarts[k] <= deadline + 8 * MS);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(0, task.getStats().skipped);
+    TEST_ASSERT_EQUAL_UINT32(0, other.getStats().skipped);
+}
+
+void test_scheduler_missed_periods()
+{
+    VirtualClock     clock{};
+    Scheduler        scheduler{"test", clock};
+    std::vector<Run> runs{};
+
+    // The first run hangs for 35 ms
+    TaskItem task{};
+    task.setDelayTime(10);
+    scheduler.add("job",
+                  task,
+                  [&runs, &clock](Timestamp /*now*/)
+                  {
+                      runs.push_back({"job", clock.now()});
+                      if (runs.size() == 1)
+                      {
+                          clock.work(35 * MS);
+                      }
+                  });
+
+    scheduler.start();
+    runUntil(scheduler, clock, 80 * MS);
+
+    // The run due at 20 starts late at 45, the ones at 30 and 40 are dropped instead of running back to back,
+    // then the task is back on its 10 ms grid
+    const std::vector<int64_t> expected{10 * MS, 45 * MS, 50 * MS, 60 * MS, 70 * MS, 80 * MS};
+    TEST_ASSERT_TRUE(startsOf(runs, "job") == expected);
+
+    const auto& stats{task.getStats()};
+    TEST_ASSERT_EQUAL_UINT32(2, stats.skipped);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.overruns);
+    TEST_ASSERT_EQUAL_UINT32(6, stats.runs);
+    TEST_ASSERT_UINT32_WITHIN(25 * MS / 4, 25 * MS, stats.lateness.max());
+}
+
+void test_scheduler_notify()
+{
+    VirtualClock     clock{};
+    Scheduler        scheduler{"test", clock};
+    std::vector<Run> runs{};
+
+    TaskItem task{};
+    task.setDelayTime(10);
+    scheduler.add("job",
+                  task,
+                  [&runs, &clock](Timestamp /*now*/)
+                  {
+                      runs.push_back({"job", clock.now()});
+                  },
+                  true);
+
+    // An extra run on notification, the periodic runs keep their phase
+    clock.at(23 * MS,
+             [&scheduler]()
+             {
+                 scheduler.notify();
+             });
+
+    scheduler.start();
+    runUntil(scheduler, clock, 40 * MS);
+
+    const std::vector<int64_t> expected{10 * MS, 20 * MS, 23 * MS, 30 * MS, 40 * MS};
+    TEST_ASSERT_TRUE(startsOf(runs, "job") == expected);
+    TEST_ASSERT_EQUAL_UINT32(0, task.getStats().skipped);
+}
+
+void test_scheduler_extra_run()
+{
+    VirtualClock     clock{};
+    Scheduler        scheduler{"test", clock};
+    std::vector<Run> runs{};
+
+    // Starts something on a regular run and comes back 3 ms later for the result, the request is relative to the start
+    // of the run even if the job took a while
+    TaskItem task{};
+    task.setDelayTime(10);
+    scheduler.add("job",
+                  task,
+                  [&runs, &clock, &task](Timestamp now)
+                  {
+                      runs.push_back({"job", clock.now()});
+                      if (clock.now() % (10 * MS) == 0)
+                      {
+                          task.runExtraAt(now + 3, now);
+                          clock.work(1 * MS);
+                      }
+                  });
+
+    scheduler.start();
+    runUntil(scheduler, clock, 30 * MS);
+
+    const std::vector<int64_t> expected{10 * MS, 13 * MS, 20 * MS, 23 * MS, 30 * MS};
+    TEST_ASSERT_TRUE(startsOf(runs, "job") == expected);
+    TEST_ASSERT_EQUAL_UINT32(0, task.getStats().skipped);
+}
+
+void test_scheduler_extra_run_millis_wrap()
+{
+    // The millis() timestamps of the jobs wrap to negative values 2^31 ms after boot, the scheduler clock does not
+    constexpr int64_t WRAP{int64_t{1} << 31}; // [ms]
+    VirtualClock      clock{(WRAP - 2) * MS};
+    Scheduler         scheduler{"test", clock};
+    std::vector<Run>  runs{};
+
+    TaskItem task{};
+    task.setDelayTime(10);
+    scheduler.add("job",
+                  task,
+                  [&runs, &clock, &task](Timestamp now)
+                  {
+                      runs.push_back({"job", clock.now()});
+                      if (runs.size() == 1)
+                      {
+                          task.runExtraAt(static_cast<Timestamp>(static_cast<uint32_t>(now) + 5), now);
+                      }
+                  });
+
+    scheduler.start();
+    runUntil(scheduler, clock, (WRAP + 20) * MS);
+
+    // One extra run across the wrap instead of a deadline in the past that runs the job on every pass
+    const std::vector<int64_t> expected{(WRAP - 2) * MS, (WRAP + 3) * MS, (WRAP + 8) * MS, (WRAP + 18) * MS};
+    TEST_ASSERT_TRUE(startsOf(runs, "job") == expected);
+}
+
+void test_scheduler_disabled()
+{
+    VirtualClock     clock{};
+    Scheduler        scheduler{"test", clock};
+    std::vector<Run> runs{};
+
+    // A delay of 0 (e.g. an interval the config switched off) disables the task
+    TaskItem task{};
+    task.setDelayTime(0);
+    TEST_ASSERT_TRUE(task.getPeriod() == 0);
+    TEST_ASSERT_FALSE(task.shallRun(1000));
+
+    scheduler.add("job",
+                  task,
+                  [&runs, &clock](Timestamp /*now*/)
+                  {
+                      runs.push_back({"job", clock.now()});
+                  });
+
+    scheduler.start();
+    runUntil(scheduler, clock, 3000 * MS);
+    TEST_ASSERT_TRUE(runs.empty());
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_scheduler_deadline_order);
+    RUN_TEST(test_scheduler_phase_lock);
+    RUN_TEST(test_scheduler_missed_periods);
+    RUN_TEST(test_scheduler_notify);
+    RUN_TEST(test_scheduler_extra_run);
+    RUN_TEST(test_scheduler_extra_run_millis_wrap);
+    RUN_TEST(test_scheduler_disabled);
+    return UNITY_END();
+}
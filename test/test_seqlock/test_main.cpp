@@ -0,0 +1,257 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// SeqLock / SensorDataStorage on the host: torn reads under a multi reader stress, and latency against the mutex
+// storage it replaced. Run with "pio test -e native -v" to see the numbers, the max values are mostly preemption
+// (a time slice on a single core host), p50/p99 are the cost of the operation.
+
+#include "SensorData.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+namespace
+{
+constexpr size_t READERS{3};
+
+/// The SensorDataStorage before the seqlock, for the comparison
+class MutexSensorDataStorage
+{
+public:
+    SensorData getCopy()
+    {
+        m_mtx.lock();
+        SensorData tmp{m_data};
+        m_mtx.unlock();
+        return tmp;
+    }
+
+    void update(const SensorData& data)
+    {
+        m_mtx.lock();
+        m_data = data;
+        m_mtx.unlock();
+    }
+
+private:
+    SensorData m_data{};
+    std::mutex m_mtx{};
+};
+
+/// Every field holds the same counter, a torn read mixes two of them
+SensorData makeData(uint16_t value)
+{
+    SensorData data{};
+    data.sgp_iaq              = {true, value, value};
+    data.sgp_iaqRaw           = {true, value, value};
+    data.bme_data.isValid     = true;
+    data.bme_data.temperature = value;
+    data.bme_data.humidity    = value;
+    data.bme_data.pressure    = value;
+    return data;
+}
+
+bool isConsistent(const SensorData& data)
+{
+    const auto value{data.sgp_iaq.TVOC};
+    return data.sgp_iaq.eCO2 == value && data.sgp_iaqRaw.rawH2 == value && data.sgp_iaqRaw.rawEthanol == value &&
+           data.bme_data.temperature == value && data.bme_data.humidity == value && data.bme_data.pressure == value;
+}
+
+int64_t nanos()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct Latencies
+{
+    std::vector<int32_t> write{};
+    std::vector<int32_t> read{};
+};
+
+/// One writer storing back to back, READERS readers copying back to back, every operation timed
+template<typename Storage>
+Latencies measure(size_t writes)
+{
+    Storage storage{};
+    storage.update(makeData(0));
+
+    std::atomic<bool> stop{false};
+    Latencies         latencies{};
+    latencies.write.reserve(writes);
+
+    std::vector<std::vector<int32_t>> reads(READERS);
+    std::vector<std::thread>          readers{};
+    for (auto& read : reads)
+    {
+        read.reserve(writes);
+        readers.emplace_back([&storage, &stop, &read]()
+                             {
+                                 while (!stop.load(std::memory_order_relaxed))
+                                 {
+                                     const auto begin{nanos()};
+                                     const auto data{storage.getCopy()};
+                                     const auto end{nanos()};
+                                     if (read.size() < read.capacity() && isConsistent(data))
+                                     {
+                                         read.push_back(static_cast<int32_t>(end - begin));
+                                     }
+                                 }
+                             });
+    }
+
+    for (size_t i = 0; i < writes; ++i)
+    {
+        const auto data{makeData(static_cast<uint16_t>(i))};
+        const auto begin{nanos()};
+        storage.update(data);
+        latencies.write.push_back(static_cast<int32_t>(nanos() - begin));
+    }
+    stop = true;
+
+    for (size_t i = 0; i < READERS; ++i)
+    {
+        readers[i].join();
+        latencies.read.insert(latencies.read.end(), reads[i].begin(), reads[i].end());
+    }
+    return latencies;
+}
+
+int32_t percentile(std::vector<int32_t>& values, uint32_t p)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    const auto index{std::min(values.size() - 1, values.size() * p / 100)};
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+void report(const char* name, Latencies& latencies)
+{
+    char text[160];
+    snprintf(text, sizeof(text), "%-6s write p50/p99/max %5d/%6d/%8d ns   read p50/p99/max %5d/%6d/%8d ns  (%zu reads)",
+             name,
+             percentile(latencies.write, 50), percentile(latencies.write, 99), percentile(latencies.write, 100),
+             percentile(latencies.read, 50), percentile(latencies.read, 99), percentile(latencies.read, 100),
+             latencies.read.size());
+    TEST_MESSAGE(text);
+}
+} // namespace
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_seqlock_sequence()
+{
+    SeqLock<SensorData> lock{};
+    const auto          initial{lock.sequence()};
+    TEST_ASSERT_EQUAL_UINT32(0, initial & 1U);
+
+    lock.store(makeData(7));
+    uint32_t   sequence{};
+    const auto data{lock.load(&sequence)};
+    TEST_ASSERT_EQUAL_UINT32(initial + 2, sequence);
+    TEST_ASSERT_EQUAL_UINT16(7, data.sgp_iaq.TVOC);
+    TEST_ASSERT_TRUE(isConsistent(data));
+}
+
+void test_seqlock_no_torn_reads()
+{
+    SensorDataStorage storage{};
+    storage.update(makeData(0));
+
+    const auto        initial{storage.getGeneration()};
+    std::atomic<bool> stop{false};
+    std::atomic<bool> torn{false};
+    std::atomic<bool> backwards{false};
+
+    std::vector<std::thread> readers{};
+    for (size_t i = 0; i < READERS; ++i)
+    {
+        readers.emplace_back([&storage, &stop, &torn, &backwards]()
+                             {
+                                 uint32_t last{};
+                                 while (!stop.load(std::memory_order_relaxed))
+                                 {
+                                     uint32_t   generation{};
+                                     const auto data{storage.getCopy(&generation)};
+                                     torn      = torn || !isConsistent(data);
+                                     backwards = backwards || generation < last;
+                                     last      = generation;
+                                 }
+                             });
+    }
+
+    constexpr uint32_t WRITES{500000};
+    for (uint32_t i = 1; i <= WRITES; ++i)
+    {
+        storage.update(makeData(static_cast<uint16_t>(i)));
+    }
+    stop = true;
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+
+    TEST_ASSERT_FALSE(torn);
+    TEST_ASSERT_FALSE(backwards);
+    TEST_ASSERT_EQUAL_UINT32(initial + WRITES, storage.getGeneration());
+}
+
+void test_latency_mutex_vs_seqlock()
+{
+    constexpr size_t WRITES{200000};
+
+    auto mutex{measure<MutexSensorDataStorage>(WRITES)};
+    auto seqlock{measure<SensorDataStorage>(WRITES)};
+    report("mutex", mutex);
+    report("seqlock", seqlock);
+
+    // The numbers depend on the host, only check that the readers got through at all
+    TEST_ASSERT_GREATER_THAN(0, mutex.read.size());
+    TEST_ASSERT_GREATER_THAN(0, seqlock.read.size());
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_seqlock_sequence);
+    RUN_TEST(test_seqlock_no_torn_reads);
+    RUN_TEST(test_latency_mutex_vs_seqlock);
+    return UNITY_END();
+}
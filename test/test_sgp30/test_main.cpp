@@ -0,0 +1,305 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// SGP30 driver against a mocked sensor: word order and CRC of the frames, rejection of corrupted responses and the
+// Busy/Pending interleaving of the split-phase measurements. The mock NACKs like the real sensor while it converts.
+
+#include "SGP30.h"
+#include <climits>
+#include <map>
+#include <unity.h>
+#include <vector>
+
+namespace
+{
+/// The sensor as seen on the bus, times [ms] are max. conversion times from the datasheet
+class MockSGP30 : public I2CBus
+{
+public:
+    int32_t                                   now{};
+    std::map<uint16_t, std::vector<uint16_t>> responses{}; // by command code
+    std::vector<std::vector<uint8_t>>         writes{};
+    size_t                                    reads{};
+    size_t                                    nacks{};
+    bool                                      corruptCrc{};
+
+    bool write(uint8_t address, const uint8_t* data, size_t length) override
+    {
+        if (address != SGP30::ADDRESS || length < 2 || isConverting())
+        {
+            ++nacks;
+            return false;
+        }
+        writes.emplace_back(data, data + length);
+
+        m_command = static_cast<uint16_t>((data[0] << 8) | data[1]);
+        m_readyAt = now + durationOf(m_command);
+        return true;
+    }
+
+    bool read(uint8_t address, uint8_t* data, size_t length) override
+    {
+        ++reads;
+        const auto& words{responses[m_command]};
+        if (address != SGP30::ADDRESS || isConverting() || length != 3 * words.size())
+        {
+            ++nacks;
+            return false;
+        }
+
+        for (size_t i = 0; i < words.size(); ++i)
+        {
+            data[3 * i]     = static_cast<uint8_t>(words[i] >> 8);
+            data[3 * i + 1] = static_cast<uint8_t>(words[i]);
+            data[3 * i + 2] = SGP30::crc8(data + 3 * i, 2);
+        }
+        if (corruptCrc)
+        {
+            data[length - 1] ^= 0x01;
+        }
+        return true;
+    }
+
+    uint16_t lastCommand() const
+    {
+        return m_command;
+    }
+
+private:
+    uint16_t m_command{};
+    int32_t  m_readyAt{};
+
+    bool isConverting() const
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(now) - static_cast<uint32_t>(m_readyAt)) < 0;
+    }
+
+    static int32_t durationOf(uint16_t command)
+    {
+        switch (command)
+        {
+        case 0x3682:
+            return 1; // get_serial_id, 0.5 ms
+        case 0x2008:
+            return 12; // measure_air_quality
+        case 0x2050:
+            return 25; // measure_raw_signals
+        default:
+            return 10;
+        }
+    }
+};
+
+/// The mock's time is the driver's time
+MockSGP30* s_sensor{nullptr};
+
+void advance(uint32_t ms)
+{
+    s_sensor->now += static_cast<int32_t>(ms);
+}
+
+uint8_t crcOf(uint8_t msb, uint8_t lsb)
+{
+    const uint8_t word[]{msb, lsb};
+    return SGP30::crc8(word, 2);
+}
+
+constexpr uint16_t MEASURE_AIR_QUALITY{0x2008};
+constexpr uint16_t MEASURE_RAW_SIGNALS{0x2050};
+constexpr uint16_t GET_BASELINE{0x2015};
+constexpr uint16_t SET_HUMIDITY{0x2061};
+} // namespace
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_sgp30_crc()
+{
+    // Example from the datasheet
+    const uint8_t data[]{0xBE, 0xEF};
+    TEST_ASSERT_EQUAL_HEX8(0x92, SGP30::crc8(data, 2));
+}
+
+void test_sgp30_begin()
+{
+    MockSGP30 sensor{};
+    s_sensor                 = &sensor;
+    sensor.responses[0x3682] = {0x0001, 0x0203, 0x0405};
+    sensor.responses[0x202F] = {0x0022};
+    SGP30 sgp{sensor};
+
+    TEST_ASSERT_TRUE(sgp.begin(advance));
+    TEST_ASSERT_TRUE(sgp.getSerialId() == 0x000102030405ULL);
+    TEST_ASSERT_EQUAL_HEX16(0x2003, sensor.lastCommand());
+    TEST_ASSERT_EQUAL_UINT32(0, sensor.nacks);
+
+    // Another product version
+    MockSGP30 other{};
+    s_sensor                = &other;
+    other.responses[0x3682] = {0x0001, 0x0203, 0x0405};
+    other.responses[0x202F] = {0x0010};
+    SGP30 otherSgp{other};
+    TEST_ASSERT_FALSE(otherSgp.begin(advance));
+}
+
+void test_sgp30_word_order()
+{
+    MockSGP30 sensor{};
+    s_sensor                              = &sensor;
+    sensor.responses[MEASURE_AIR_QUALITY] = {400, 12};         // eCO2, then TVOC
+    sensor.responses[GET_BASELINE]        = {0x8A2B, 0x8C3D}; // eCO2, then TVOC
+    SGP30 sgp{sensor};
+
+    uint16_t eCO2{};
+    uint16_t TVOC{};
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Pending);
+    sensor.now = sgp.readyAt();
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Done);
+    TEST_ASSERT_EQUAL_UINT16(400, eCO2);
+    TEST_ASSERT_EQUAL_UINT16(12, TVOC);
+
+    TEST_ASSERT_TRUE(sgp.getBaseline(sensor.now, eCO2, TVOC) == SGP30::Status::Pending);
+    sensor.now = sgp.readyAt();
+    TEST_ASSERT_TRUE(sgp.getBaseline(sensor.now, eCO2, TVOC) == SGP30::Status::Done);
+    TEST_ASSERT_EQUAL_HEX16(0x8A2B, eCO2);
+    TEST_ASSERT_EQUAL_HEX16(0x8C3D, TVOC);
+
+    // set_baseline takes them the other way round, every word with its CRC
+    TEST_ASSERT_TRUE(sgp.setBaseline(0x8A2B, 0x8C3D, advance));
+    const std::vector<uint8_t> frame{0x20, 0x1E, 0x8C, 0x3D, crcOf(0x8C, 0x3D), 0x8A, 0x2B, crcOf(0x8A, 0x2B)};
+    TEST_ASSERT_TRUE(sensor.writes.back() == frame);
+    TEST_ASSERT_EQUAL_UINT32(0, sensor.nacks);
+}
+
+void test_sgp30_crc_rejected()
+{
+    MockSGP30 sensor{};
+    s_sensor                              = &sensor;
+    sensor.responses[MEASURE_AIR_QUALITY] = {400, 12};
+    SGP30 sgp{sensor};
+
+    uint16_t eCO2{1};
+    uint16_t TVOC{2};
+    sensor.corruptCrc = true;
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Pending);
+    sensor.now = sgp.readyAt();
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Failed);
+    TEST_ASSERT_EQUAL_UINT16(1, eCO2);
+    TEST_ASSERT_EQUAL_UINT16(2, TVOC);
+
+    // The failure is handed out once, the next measurement starts over
+    sensor.corruptCrc = false;
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Pending);
+    sensor.now = sgp.readyAt();
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Done);
+    TEST_ASSERT_EQUAL_UINT16(400, eCO2);
+}
+
+void test_sgp30_interleaving()
+{
+    MockSGP30 sensor{};
+    s_sensor                              = &sensor;
+    sensor.responses[MEASURE_AIR_QUALITY] = {400, 12};
+    sensor.responses[MEASURE_RAW_SIGNALS] = {13000, 18000};
+    SGP30 sgp{sensor};
+
+    uint16_t eCO2{};
+    uint16_t TVOC{};
+    uint16_t rawH2{};
+    uint16_t rawEthanol{};
+
+    // The raw signals wait for the air quality measurement in flight, nobody reads before its time
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Pending);
+    const auto airQualityReady{sgp.readyAt()};
+    TEST_ASSERT_TRUE(sgp.measureRawSignals(sensor.now, rawH2, rawEthanol) == SGP30::Status::Busy);
+    TEST_ASSERT_EQUAL_INT32(airQualityReady, sgp.readyAt());
+    sensor.now = airQualityReady - 1;
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Pending);
+    TEST_ASSERT_TRUE(sgp.measureRawSignals(sensor.now, rawH2, rawEthanol) == SGP30::Status::Busy);
+    TEST_ASSERT_EQUAL_UINT32(0, sensor.reads);
+
+    // The raw signals come first, collect the air quality result for its owner and go out themselves
+    sensor.now = airQualityReady;
+    TEST_ASSERT_TRUE(sgp.measureRawSignals(sensor.now, rawH2, rawEthanol) == SGP30::Status::Pending);
+    TEST_ASSERT_EQUAL_UINT32(1, sensor.reads);
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Done);
+    TEST_ASSERT_EQUAL_UINT16(400, eCO2);
+    TEST_ASSERT_EQUAL_UINT16(12, TVOC);
+
+    sensor.now = sgp.readyAt();
+    TEST_ASSERT_TRUE(sgp.measureRawSignals(sensor.now, rawH2, rawEthanol) == SGP30::Status::Done);
+    TEST_ASSERT_EQUAL_UINT16(13000, rawH2);
+    TEST_ASSERT_EQUAL_UINT16(18000, rawEthanol);
+
+    // A changed humidity goes out first, the measurement follows once it is through
+    TEST_ASSERT_TRUE(sgp.setAbsoluteHumidity(11757));
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Busy);
+    TEST_ASSERT_EQUAL_HEX16(SET_HUMIDITY, sensor.lastCommand());
+    TEST_ASSERT_EQUAL_UINT32(5, sensor.writes.back().size());
+    sensor.now = sgp.readyAt();
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Pending);
+    TEST_ASSERT_EQUAL_HEX16(MEASURE_AIR_QUALITY, sensor.lastCommand());
+
+    TEST_ASSERT_EQUAL_UINT32(0, sensor.nacks);
+}
+
+void test_sgp30_millis_wrap()
+{
+    MockSGP30 sensor{};
+    s_sensor                              = &sensor;
+    sensor.now                            = INT32_MAX - 5;
+    sensor.responses[MEASURE_AIR_QUALITY] = {400, 12};
+    SGP30 sgp{sensor};
+
+    // readyAt() wraps to a negative timestamp, which is still ahead of now
+    uint16_t eCO2{};
+    uint16_t TVOC{};
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Pending);
+    TEST_ASSERT_TRUE(sgp.readyAt() < 0);
+    sensor.now = INT32_MAX;
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Pending);
+    TEST_ASSERT_EQUAL_UINT32(0, sensor.reads);
+    sensor.now = sgp.readyAt();
+    TEST_ASSERT_TRUE(sgp.measureAirQuality(sensor.now, eCO2, TVOC) == SGP30::Status::Done);
+    TEST_ASSERT_EQUAL_UINT16(400, eCO2);
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_sgp30_crc);
+    RUN_TEST(test_sgp30_begin);
+    RUN_TEST(test_sgp30_word_order);
+    RUN_TEST(test_sgp30_crc_rejected);
+    RUN_TEST(test_sgp30_interleaving);
+    RUN_TEST(test_sgp30_millis_wrap);
+    return UNITY_END();
+}
@@ -0,0 +1,85 @@
+# Stages data/ for the filesystem image: every web asset is gzipped and content-hashed
+#
+# Runs as PlatformIO pre script on every build, or by hand: python tools/compress_fs.py
+# It has to be a pre script, the platform defines the image target from PROJECT_DATA_DIR, which is pointed at the staging folder.
+#   data/<file>  => <staging>/<file>.gz, served with Content-Encoding: gzip (see WebServer::onAsset)
+#   assets.txt   => manifest, one line per asset: "<url>\t<hash>\t<content type>", the hash is the strong ETag
+# Files that the firmware reads itself (RAW_FILES) are staged as they are and are not served as assets.
+# References to other assets in HTML files get "?v=<hash>", those URLs can be cached forever.
+# The build fails if the assets together exceed BUDGET (gzipped), the dashboard has to load quickly on a slow WiFi.
+import gzip
+import hashlib
+import re
+import shutil
+import sys
+from pathlib import Path
+
+DATA = Path("data")
+MANIFEST = "assets.txt"
+RAW_FILES = {"hAIR_config.json"}
+BUDGET = 30 * 1024
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".txt": "text/plain",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".ico": "image/x-icon",
+}
+
+
+def add_versions(html, assets):
+    """Appends ?v=<hash> to every quoted reference of an asset"""
+    for url, (hash, _) in assets.items():
+        html = re.sub(r"""(["'])""" + re.escape(url) + r"""(?=["'])""", rf"\g<1>{url}?v={hash}", html)
+    return html
+
+
+def stage(staging):
+    if staging.exists():
+        shutil.rmtree(staging)
+    staging.mkdir(parents=True)
+
+    files = [path for path in sorted(DATA.rglob("*")) if path.is_file()]
+    assets = {}
+    raw_bytes, staged_bytes = 0, 0
+
+    # HTML goes last, it references the others and its hash has to cover the versioned references
+    for path in sorted(files, key=lambda path: path.suffix == ".html"):
+        relative = path.relative_to(DATA)
+        target = staging / relative
+        target.parent.mkdir(parents=True, exist_ok=True)
+        if relative.as_posix() in RAW_FILES:
+            shutil.copyfile(path, target)
+            continue
+
+        content = path.read_bytes()
+        if path.suffix == ".html":
+            content = add_versions(content.decode("utf-8"), assets).encode("utf-8")
+
+        # mtime=0 so the same content always results in the same bytes and hash
+        compressed = gzip.compress(content, compresslevel=9, mtime=0)
+        target.with_name(target.name + ".gz").write_bytes(compressed)
+
+        url = "/" + relative.as_posix()
+        assets[url] = (hashlib.sha256(compressed).hexdigest()[:16], CONTENT_TYPES.get(path.suffix, "application/octet-stream"))
+        raw_bytes += len(content)
+        staged_bytes += len(compressed)
+
+    lines = ["# hAIR assets, generated by tools/compress_fs.py, do not edit"]
+    lines += [f"{url}\t{hash}\t{content_type}" for url, (hash, content_type) in assets.items()]
+    (staging / MANIFEST).write_text("\n".join(lines) + "\n", encoding="utf-8")
+    print(f"compress_fs: {len(assets)} assets in {staging}, {raw_bytes} => {staged_bytes} bytes")
+    if staged_bytes > BUDGET:
+        sys.exit(f"compress_fs: the assets exceed the budget of {BUDGET} bytes by {staged_bytes - BUDGET} bytes")
+
+
+try:
+    Import("env")
+    staging = Path(env.subst("$BUILD_DIR")) / "data"
+    env.Replace(PROJECT_DATA_DIR=str(staging))
+except NameError:
+    staging = Path(".pio") / "data"  # run by hand
+stage(staging)
@@ -0,0 +1,202 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Host side reader for the segments of the sensor archive, writes CSV to stdout
+///
+/// Build: g++ -std=c++17 -O2 -I include -o hAIR_archive_export tools/hAIR_archive_export.cpp
+/// Usage: hAIR_archive_export [--from <unix seconds>] [--to <unix seconds>] <segment.hsa>...
+///
+/// The segments can be downloaded from http://hAIR.local/archive/<name>, see http://hAIR.local/archive for the list.
+/// Broken records (e.g. a torn write after a power loss) are reported on stderr and skipped up to the next block.
+
+#include "ArchiveFormat.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Segment
+{
+    std::string                  path;
+    ArchiveFormat::SegmentHeader header;
+    std::vector<uint8_t>         data;
+
+    size_t getBlockCount() const
+    {
+        return (data.size() + ArchiveFormat::BLOCK_SIZE - 1) / ArchiveFormat::BLOCK_SIZE;
+    }
+
+    /// Block 0 starts behind the header
+    size_t getBlockBegin(size_t block) const
+    {
+        return std::max(block * ArchiveFormat::BLOCK_SIZE, ArchiveFormat::SegmentHeader::SIZE);
+    }
+
+    ArchiveFormat::BlockDecoder getBlock(size_t block) const
+    {
+        const auto begin{getBlockBegin(block)};
+        const auto end{std::min((block + 1) * ArchiveFormat::BLOCK_SIZE, data.size())};
+        return ArchiveFormat::BlockDecoder{data.data() + begin, end - begin};
+    }
+};
+
+bool load(const std::string& path, Segment& segment)
+{
+    std::ifstream file{path, std::ios::binary};
+    segment.path = path;
+    segment.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    return segment.data.size() >= ArchiveFormat::SegmentHeader::SIZE && segment.header.fromBytes(segment.data.data());
+}
+
+/// Sparse index lookup, binary search for the last block that starts at or before 'from'
+/// A block whose first record is broken counts as 'after', so we rather start a block too early than too late.
+size_t findFirstBlock(const Segment& segment, uint32_t from)
+{
+    size_t lo{0};
+    size_t hi{segment.getBlockCount()};
+    while (hi - lo > 1)
+    {
+        const auto mid{lo + (hi - lo) / 2};
+
+        auto                  decoder{segment.getBlock(mid)};
+        ArchiveFormat::Record first{};
+        if (decoder.next(first) && first.timestamp <= from)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void printValue(int32_t value, uint8_t decimals)
+{
+    if (decimals == 0)
+    {
+        std::printf("%d", value);
+        return;
+    }
+
+    int32_t scale{1};
+    for (uint8_t i = 0; i < decimals; ++i)
+    {
+        scale *= 10;
+    }
+    const auto magnitude{std::abs(static_cast<int64_t>(value))};
+    std::printf("%s%lld.%0*lld", value < 0 ? "-" : "", static_cast<long long>(magnitude / scale), decimals, static_cast<long long>(magnitude % scale));
+}
+
+void printRecord(const ArchiveFormat::Record& record)
+{
+    std::printf("%u", record.timestamp);
+    for (size_t channel = 0; channel < ArchiveFormat::CHANNEL_COUNT; ++channel)
+    {
+        std::printf(",");
+        if (record.valid & (1U << channel))
+        {
+            printValue(record.values[channel], ArchiveFormat::CHANNELS[channel].decimals);
+        }
+    }
+    std::printf("\n");
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    uint32_t             from{0};
+    uint32_t             to{UINT32_MAX};
+    std::vector<Segment> segments{};
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        if ((arg == "--from" || arg == "--to") && i + 1 < argc)
+        {
+            (arg == "--from" ? from : to) = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            continue;
+        }
+
+        Segment segment{};
+        if (!load(arg, segment))
+        {
+            std::cerr << arg << ": not a hAIR archive segment (version " << int{ArchiveFormat::VERSION} << ")\n";
+            return EXIT_FAILURE;
+        }
+        segments.push_back(std::move(segment));
+    }
+
+    if (segments.empty())
+    {
+        std::cerr << "Usage: " << argv[0] << " [--from <unix seconds>] [--to <unix seconds>] <segment.hsa>...\n";
+        return EXIT_FAILURE;
+    }
+
+    // Oldest segment first, independent of the order on the command line
+    std::sort(segments.begin(), segments.end(),
+              [](const Segment& lhs, const Segment& rhs)
+              {
+                  return lhs.header.segmentId < rhs.header.segmentId;
+              });
+
+    std::printf("timestamp");
+    for (const auto& channel : ArchiveFormat::CHANNELS)
+    {
+        std::printf(",%s", channel.name);
+    }
+    std::printf("\n");
+
+    for (const auto& segment : segments)
+    {
+        for (auto block = findFirstBlock(segment, from); block < segment.getBlockCount(); ++block)
+        {
+            auto                  decoder{segment.getBlock(block)};
+            ArchiveFormat::Record record{};
+            while (decoder.next(record))
+            {
+                if (record.timestamp >= from && record.timestamp <= to)
+                {
+                    printRecord(record);
+                }
+            }
+
+            if (decoder.isCorrupt())
+            {
+                std::cerr << segment.path << ": broken record at offset " << segment.getBlockBegin(block) + decoder.position() << ", skipping to the next block\n";
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
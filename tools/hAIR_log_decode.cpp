@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// hAIR - HSB Air Station
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MIT License
+///
+/// Copyright (c) 2021 hsbsw (https://github.com/hsbsw)
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/// Host side decoder for the binary log records, writes the log as text to stdout
+///
+/// Build: g++ -std=c++17 -O2 -I include -I lib/plog/include -o hAIR_log_decode tools/hAIR_log_decode.cpp
+/// Usage: hAIR_log_decode <log_table.txt> [<capture>]
+///
+/// The capture is a dump of the Serial output or of http://hAIR.local/logs, stdin if omitted.
+/// The table is generated at build time (data/log_table.txt) and has to match the firmware that wrote the records.
+/// A capture may start in the middle of a record, the first frame is only printed if its site is known.
+
+#include "LogDecoder.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    LogDecoder decoder{};
+    if (argc < 2 || !decoder.loadTable(argv[1]))
+    {
+        std::cerr << "Usage: " << argv[0] << " <log_table.txt> [<capture>]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream file{};
+    if (argc > 2)
+    {
+        file.open(argv[2], std::ios::binary);
+        if (!file)
+        {
+            std::cerr << argv[2] << ": cannot open\n";
+            return EXIT_FAILURE;
+        }
+    }
+    std::istream& in{argc > 2 ? file : std::cin};
+
+    char c{};
+    while (in.get(c))
+    {
+        decoder.put(
+            c,
+            [](const std::string& line)
+            {
+                std::printf("%s\n", line.c_str());
+            },
+            [](const char* error)
+            {
+                std::cerr << error << '\n';
+            });
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,180 @@
+# Stand-in for the InfluxDB write endpoint, to test and benchmark the uploader (see include/InfluxUploader.h) without a server
+#
+# Standard library only:
+#   python tools/influx_standin.py --port 8086
+#   set "influx": {"url": "http://<this machine>:8086/api/v2/write?org=test&bucket=hAIR", ...} in hAIR_config.json
+#   and upload it on the dashboard
+#
+# Answers every valid write with 204 like InfluxDB, broken line protocol with 400, a wrong token (with --token) with 401.
+# Prints per interval and in total:
+#   requests/s and samples/s
+#   bytes per sample: gzipped as sent and as line protocol, and what zlib -6 makes of the same lines for comparison
+#   latency: arrival - timestamp of the newest sample of a request, includes the batching delay by design (1 s resolution)
+#   duplicates and gaps in the timestamps per series: a batch whose answer got lost is sent again, so duplicates
+#   are fine (InfluxDB overwrites them), gaps are not
+# For the outbox, simulate an outage with --outage 60:300 (503 from 60 s to 360 s after the start) or switch off the WiFi:
+# afterwards the outbox drains at one batch per second, with latencies up to the length of the outage.
+import argparse
+import gzip
+import random
+import re
+import statistics
+import threading
+import time
+import zlib
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+# measurement[,tag=value..] field=value[,field=value..] timestamp, with backslash escapes in the first two parts
+LINE = re.compile(r"^((?:[^ \\]|\\.)+) ((?:[^ \\]|\\.)+) (-?\d+)$")
+FIELD = re.compile(r"^[^=]+=(-?\d+i|-?\d+(\.\d+)?([eE][-+]?\d+)?|t|f|true|false|\"[^\"]*\")$")
+
+
+class Stats:
+    def __init__(self):
+        self.requests = 0
+        self.samples = 0
+        self.body_bytes = 0
+        self.line_bytes = 0
+        self.zlib_bytes = 0
+        self.latencies = []
+
+    def add(self, body_bytes, lines, samples, latency):
+        self.requests += 1
+        self.samples += samples
+        self.body_bytes += body_bytes
+        self.line_bytes += len(lines)
+        self.zlib_bytes += len(zlib.compress(lines, 6))
+        self.latencies.append(latency)
+
+    def report(self, label, seconds):
+        line = f"{label}: {self.requests / seconds:6.2f} req/s {self.samples / seconds:7.2f} samples/s"
+        if self.samples:
+            line += f"  B/sample gzip {self.body_bytes / self.samples:.1f} lines {self.line_bytes / self.samples:.1f} zlib -6 {self.zlib_bytes / self.samples:.1f}"
+        if self.latencies:
+            ordered = sorted(self.latencies)
+            p95 = ordered[min(len(ordered) - 1, int(len(ordered) * 0.95))]
+            line += f"  latency [s] median {statistics.median(ordered):.1f} p95 {p95:.1f} max {ordered[-1]:.1f}"
+        print(line, flush=True)
+
+
+class Server(ThreadingHTTPServer):
+    def __init__(self, args):
+        super().__init__(("", args.port), Handler)
+        self.args = args
+        self.start = time.time()
+        self.lock = threading.Lock()
+        self.interval = Stats()
+        self.total = Stats()
+        self.seen = {}  # series => set of timestamps
+        self.duplicates = 0
+        self.failed = 0
+
+    def unavailable(self):
+        if self.args.outage:
+            begin, length = (float(part) for part in self.args.outage.split(":"))
+            if begin <= time.time() - self.start < begin + length:
+                return True
+        return random.random() < self.args.fail_rate
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive, like InfluxDB
+
+    def log_message(self, format, *args):
+        if self.server.args.verbose:
+            super().log_message(format, *args)
+
+    def answer(self, code, message=""):
+        body = message.encode()
+        self.send_response(code)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_POST(self):
+        arrival = time.time()
+        server = self.server
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+
+        if self.path.split("?")[0] not in ("/api/v2/write", "/write"):
+            return self.answer(404, "unknown endpoint")
+        if server.args.token and self.headers.get("Authorization") != "Token " + server.args.token:
+            return self.answer(401, "unauthorized")
+        if server.unavailable():
+            with server.lock:
+                server.failed += 1
+            return self.answer(503, "simulated outage")
+
+        try:
+            lines = gzip.decompress(body) if self.headers.get("Content-Encoding") == "gzip" else body
+            text = lines.decode()
+        except (OSError, UnicodeDecodeError) as error:
+            return self.answer(400, f"cannot decode body: {error}")
+
+        samples = []
+        for number, line in enumerate(text.splitlines(), 1):
+            match = LINE.match(line)
+            if not match or not all(FIELD.match(field) for field in re.split(r"(?<!\\),", match.group(2))):
+                return self.answer(400, f"line {number}: invalid line protocol: {line!r}")
+            samples.append((match.group(1), int(match.group(3))))
+
+        if server.args.dump:
+            with server.lock, open(server.args.dump, "a") as dump:
+                dump.write(text)
+
+        with server.lock:
+            for series, timestamp in samples:
+                timestamps = server.seen.setdefault(series, set())
+                server.duplicates += timestamp in timestamps
+                timestamps.add(timestamp)
+            latency = arrival - max(timestamp for _, timestamp in samples) if samples else 0
+            server.interval.add(len(body), lines, len(samples), latency)
+            server.total.add(len(body), lines, len(samples), latency)
+        self.answer(204)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Stand-in for the InfluxDB write endpoint, reports what the hAIR uploads")
+    parser.add_argument("--port", type=int, default=8086)
+    parser.add_argument("--token", help="expected token, anything else gets 401")
+    parser.add_argument("--fail-rate", type=float, default=0, help="fraction of the writes answered with 503")
+    parser.add_argument("--outage", help="START:LENGTH [s] after the start during which every write gets 503")
+    parser.add_argument("--dump", help="appends the received lines to this file")
+    parser.add_argument("--interval", type=float, default=60, help="[s] between two reports")
+    parser.add_argument("--duration", type=float, default=0, help="[s] 0 runs until Ctrl+C")
+    parser.add_argument("--verbose", action="store_true", help="log every request")
+    args = parser.parse_args()
+
+    server = Server(args)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    print(f"influx_standin: listening on port {args.port}", flush=True)
+
+    last = time.time()
+    try:
+        while not args.duration or time.time() - server.start < args.duration:
+            time.sleep(0.2)
+            if time.time() - last >= args.interval:
+                with server.lock:
+                    server.interval.report("interval", time.time() - last)
+                    server.interval = Stats()
+                last = time.time()
+    except KeyboardInterrupt:
+        pass
+    server.shutdown()
+
+    server.total.report("total", time.time() - server.start)
+
+    # Gaps: a step between two consecutive samples of a series of more than twice the usual one
+    gaps = 0
+    for timestamps in server.seen.values():
+        ordered = sorted(timestamps)
+        steps = [b - a for a, b in zip(ordered, ordered[1:])]
+        if steps:
+            usual = statistics.median(steps)
+            gaps += sum(1 for step in steps if step > 2 * usual)
+    distinct = sum(len(timestamps) for timestamps in server.seen.values())
+    print(f"total: {distinct} distinct samples in {len(server.seen)} series, {server.duplicates} duplicates, {gaps} gaps, {server.failed} simulated failures", flush=True)
+
+
+if __name__ == "__main__":
+    main()
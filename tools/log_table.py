@@ -0,0 +1,142 @@
+# Generates data/log_table.txt, the format strings of the binary log records (see include/LogFormat.h)
+#
+# Runs as PlatformIO pre script on every build, or by hand: python tools/log_table.py
+# Every PLOG statement in src/ and include/ becomes one line: "<site id hex>\t<file>:<line>\t<format>"
+# String literals are copied into the format, every other streamed expression becomes "{}".
+# The table goes to the filesystem image, upload it (pio run -t uploadfs) whenever log statements changed.
+import re
+import sys
+from pathlib import Path
+
+SOURCE_FOLDERS = [Path("src"), Path("include")]
+TABLE = Path("data") / "log_table.txt"
+
+PLOG_MACRO = re.compile(r"PLOG(?:[VDIWEFN]|_VERBOSE|_DEBUG|_INFO|_WARNING|_ERROR|_FATAL|_NONE)")
+IDENTIFIER = re.compile(r"[A-Za-z_][A-Za-z0-9_]*")
+STRING_LITERALS = re.compile(r'^\s*(?:"(?:[^"\\]|\\.)*"\s*)+$', re.S)
+ESCAPES = {"n": "\n", "t": "\t", "r": "\r", "0": "\0", "\\": "\\", '"': '"', "'": "'"}
+
+
+def site_id(path, line):
+    """Same as LogFormat::siteId()"""
+    hash = 2166136261
+    for c in f"{path.name}:{line}".encode():
+        hash = ((hash ^ c) * 16777619) & 0xFFFFFFFF
+    return hash if hash != 0 else 1
+
+
+def skip_literal(text, pos):
+    """pos is at the opening quote, returns the position behind the closing one"""
+    quote = text[pos]
+    pos += 1
+    while text[pos] != quote:
+        pos += 2 if text[pos] == "\\" else 1
+    return pos + 1
+
+
+def split_statement(text, pos):
+    """Splits the statement starting at pos at every top level '<<', up to the ';'"""
+    pieces, begin, depth = [], pos, 0
+    while True:
+        c = text[pos]
+        if c in "\"'":
+            pos = skip_literal(text, pos)
+            continue
+        if c in "([{":
+            depth += 1
+        elif c in ")]}":
+            depth -= 1
+        elif depth == 0 and text.startswith("<<", pos):
+            pieces.append(text[begin:pos])
+            pos += 2
+            begin = pos
+            continue
+        elif depth == 0 and c == ";":
+            pieces.append(text[begin:pos])
+            return pieces
+        pos += 1
+
+
+def unescape(literal):
+    out, pos = [], 1
+    while pos < len(literal) - 1:
+        if literal[pos] == "\\":
+            out.append(ESCAPES.get(literal[pos + 1], literal[pos + 1]))
+            pos += 2
+        else:
+            out.append(literal[pos])
+            pos += 1
+    return "".join(out)
+
+
+def to_format(pieces):
+    # pieces[0] is whatever stands between the macro and the first '<<', i.e. nothing
+    out = []
+    for piece in pieces[1:]:
+        if STRING_LITERALS.match(piece):
+            text = "".join(unescape(m.group(0)) for m in re.finditer(r'"(?:[^"\\]|\\.)*"', piece))
+            out.append(text.replace("\\", "\\\\").replace("{", "{{").replace("}", "}}").replace("\n", "\\n").replace("\t", "\\t"))
+        else:
+            out.append("{}")
+    return "".join(out)
+
+
+def scan(path):
+    """Yields (line, format) of every PLOG statement, comments and literals are skipped"""
+    text = path.read_text(encoding="utf-8", errors="replace").replace("\r\n", "\n")
+    pos, line = 0, 1
+    while pos < len(text):
+        c = text[pos]
+        if text.startswith("//", pos):
+            pos = text.find("\n", pos)
+            pos = len(text) if pos < 0 else pos
+        elif text.startswith("/*", pos):
+            end = text.find("*/", pos) + 2
+            line += text.count("\n", pos, end)
+            pos = end
+        elif c in "\"'":
+            pos = skip_literal(text, pos)
+        elif c == "#":
+            # preprocessor line (e.g. the PLOG_ override itself), including continuations
+            while pos < len(text) and not (text[pos] == "\n" and text[pos - 1] != "\\"):
+                line += text[pos] == "\n"
+                pos += 1
+        elif c == "\n":
+            line += 1
+            pos += 1
+        elif c.isalpha() or c == "_":
+            match = IDENTIFIER.match(text, pos)
+            if PLOG_MACRO.fullmatch(match.group(0)):
+                yield line, to_format(split_statement(text, match.end()))
+            pos = match.end()
+        else:
+            pos += 1
+
+
+def generate():
+    sites = {}
+    for folder in SOURCE_FOLDERS:
+        for path in sorted(folder.glob("*.[ch]*")):
+            for line, fmt in scan(path):
+                site = site_id(path, line)
+                location = f"{path.name}:{line}"
+                if site in sites and sites[site][0] != location:
+                    sys.exit(f"log_table: {location} and {sites[site][0]} have the same site id {site:08x}")
+                sites[site] = (location, fmt)
+
+    lines = ["# hAIR log table, generated by tools/log_table.py, do not edit"]
+    by_location = sorted(sites.items(), key=lambda item: (item[1][0].split(":")[0], int(item[1][0].split(":")[1])))
+    lines += [f"{site:08x}\t{location}\t{fmt}" for site, (location, fmt) in by_location]
+    content = "\n".join(lines) + "\n"
+
+    # keep the timestamp if nothing changed, so the filesystem image is not rebuilt for nothing
+    if not TABLE.exists() or TABLE.read_text(encoding="utf-8") != content:
+        TABLE.write_text(content, encoding="utf-8")
+    print(f"log_table: {len(sites)} log statements in {TABLE}")
+
+
+try:
+    Import("env")
+except NameError:
+    pass  # run by hand
+generate()
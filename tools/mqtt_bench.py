@@ -0,0 +1,120 @@
+# Throughput and latency of the MQTT publisher (see include/MqttPublisher.h), measured on the receiving side
+#
+# Needs paho-mqtt (pip install paho-mqtt) and a broker, e.g. a local Mosquitto:
+#   mosquitto -v
+#   set "mqtt": {"host": "<this machine>", ...} in hAIR_config.json and upload it on the dashboard
+#   python tools/mqtt_bench.py --host localhost --topic hAIR --duration 600
+#
+# Subscribes to <topic>/# and prints per interval and in total:
+#   messages/s, samples/s and payload bytes/s of <topic>/samples
+#   latency: arrival - timestamp of the newest sample of a message, so it includes the batching delay by design
+#            (1 s resolution, the device only has NTP seconds; keep the clocks of both machines synced)
+#   duplicates and gaps in the sample timestamps: QoS 1 delivers at least once, so duplicates after a reconnect are fine, gaps are not
+# For the store-and-forward queue, stop the broker (or the WiFi) for a while and start it again:
+# the backlog arrives as a burst at the drain rate, with latencies up to the length of the outage.
+import argparse
+import json
+import statistics
+import sys
+import time
+
+try:
+    import paho.mqtt.client as mqtt
+except ImportError:
+    sys.exit("mqtt_bench: needs paho-mqtt (pip install paho-mqtt)")
+
+
+class Stats:
+    def __init__(self):
+        self.messages = 0
+        self.samples = 0
+        self.bytes = 0
+        self.latencies = []
+
+    def add(self, payload_bytes, samples, latency):
+        self.messages += 1
+        self.samples += samples
+        self.bytes += payload_bytes
+        self.latencies.append(latency)
+
+    def report(self, label, seconds):
+        line = f"{label}: {self.messages / seconds:6.2f} msg/s {self.samples / seconds:7.2f} samples/s {self.bytes / seconds:9.1f} B/s"
+        if self.latencies:
+            ordered = sorted(self.latencies)
+            p95 = ordered[min(len(ordered) - 1, int(len(ordered) * 0.95))]
+            line += f"  latency [s] median {statistics.median(ordered):.1f} p95 {p95:.1f} max {ordered[-1]:.1f}"
+        print(line, flush=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Throughput and latency of the MQTT publisher of the hAIR")
+    parser.add_argument("--host", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--user")
+    parser.add_argument("--password")
+    parser.add_argument("--topic", default="hAIR", help="prefix as in the mqtt section of hAIR_config.json")
+    parser.add_argument("--qos", type=int, default=1, choices=[0, 1])
+    parser.add_argument("--interval", type=float, default=10, help="[s] between two reports")
+    parser.add_argument("--duration", type=float, default=0, help="[s] 0 runs until Ctrl+C")
+    args = parser.parse_args()
+
+    interval, total = Stats(), Stats()
+    seen = set()
+    duplicates = 0
+
+    def on_connect(client, userdata, flags, rc):
+        client.subscribe(args.topic + "/#", qos=args.qos)
+        print(f"mqtt_bench: subscribed to {args.topic}/# on {args.host}:{args.port}", flush=True)
+
+    def on_message(client, userdata, msg):
+        nonlocal duplicates
+        arrival = time.time()
+        if msg.topic == args.topic + "/samples":
+            samples = json.loads(msg.payload)["samples"]
+            for sample in samples:
+                if sample["timestamp"] in seen:
+                    duplicates += 1
+                seen.add(sample["timestamp"])
+            latency = arrival - max(sample["timestamp"] for sample in samples) if samples else 0
+            interval.add(len(msg.payload), len(samples), latency)
+            total.add(len(msg.payload), len(samples), latency)
+        elif msg.topic == args.topic + "/health":
+            print(f"health: {msg.payload.decode()}", flush=True)
+        elif msg.topic == args.topic + "/status":
+            print(f"status: {msg.payload.decode()}", flush=True)
+
+    # paho-mqtt 2 wants the callback version, 1.x does not know it
+    client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION1) if hasattr(mqtt, "CallbackAPIVersion") else mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.loop_start()
+
+    start = last = time.time()
+    try:
+        while not args.duration or time.time() - start < args.duration:
+            time.sleep(0.2)
+            if time.time() - last >= args.interval:
+                interval.report("interval", time.time() - last)
+                interval = Stats()
+                last = time.time()
+    except KeyboardInterrupt:
+        pass
+    client.loop_stop()
+
+    total.report("total", time.time() - start)
+
+    # Gaps: a step between two consecutive samples of more than twice the usual one
+    timestamps = sorted(seen)
+    steps = [b - a for a, b in zip(timestamps, timestamps[1:])]
+    gaps = 0
+    if steps:
+        usual = statistics.median(steps)
+        gaps = sum(1 for step in steps if step > 2 * usual)
+    print(f"total: {len(timestamps)} distinct samples, {duplicates} duplicates, {gaps} gaps", flush=True)
+
+
+if __name__ == "__main__":
+    main()